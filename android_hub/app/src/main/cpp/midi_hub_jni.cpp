@@ -13,8 +13,16 @@ extern "C" {
                                   const char* daw_ip, uint16_t daw_port);
     void stop_service(void* handle);
     void destroy_service(void* handle);
+    void report_discovered_service(void* handle, const char* name, const char* service_type,
+                                   const char* ip, uint16_t port, uint32_t ttl_secs);
+    uint64_t av_sync_audio_delay_us();
+    uint64_t av_sync_midi_delay_us();
+    int64_t av_sync_offset_us();
 }
 
+// TTL for services resolved by NsdManager (RFC 6762 PTR/SRV record TTL)
+static const uint32_t NSD_SERVICE_TTL_SECS = 4500;
+
 // Global service handle
 static void* g_service_handle = nullptr;
 
@@ -58,11 +66,9 @@ Java_com_example_rtpmidi_MidiHubViewModel_startNativeService(JNIEnv* env, jobjec
         return;
     }
     
-    // Start service with discovered device addresses
-    // For now, use default addresses - these would be passed from the ViewModel
-    start_android_hub_service(g_service_handle, 
-                             "192.168.1.100", 8000,  // ESP32 default
-                             "192.168.1.50", 5004);  // DAW default
+    // Null addresses are resolved by Rust from the discovery cache
+    // (last-known-good services restored from disk, refreshed via mDNS/NSD)
+    start_android_hub_service(g_service_handle, nullptr, 0, nullptr, 0);
     
     LOGI("Native service started");
 }
@@ -100,4 +106,41 @@ Java_com_example_rtpmidi_MidiHubViewModel_startServiceWithDevices(
     env->ReleaseStringUTFChars(daw_ip, daw_ip_str);
     
     LOGI("Native service started with specific devices");
-} 
\ No newline at end of file
+} 
+
+// Feeds a service resolved by NsdManager into the Rust discovery cache
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_rtpmidi_MidiHubViewModel_reportDiscoveredDevice(
+    JNIEnv* env, jobject thiz,
+    jstring name, jstring service_type, jstring ip, jint port) {
+    
+    if (g_service_handle == nullptr) {
+        return;
+    }
+    
+    const char* name_str = env->GetStringUTFChars(name, nullptr);
+    const char* type_str = env->GetStringUTFChars(service_type, nullptr);
+    const char* ip_str = env->GetStringUTFChars(ip, nullptr);
+    
+    report_discovered_service(g_service_handle, name_str, type_str, ip_str,
+                              (uint16_t)port, NSD_SERVICE_TTL_SECS);
+    
+    env->ReleaseStringUTFChars(name, name_str);
+    env->ReleaseStringUTFChars(service_type, type_str);
+    env->ReleaseStringUTFChars(ip, ip_str);
+}
+
+// Audio path delay, applied MIDI delay and remaining offset (µs)
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_example_rtpmidi_MidiHubViewModel_getAvLatency(JNIEnv* env, jobject thiz) {
+    jlong values[3] = {
+        (jlong)av_sync_audio_delay_us(),
+        (jlong)av_sync_midi_delay_us(),
+        (jlong)av_sync_offset_us(),
+    };
+    jlongArray result = env->NewLongArray(3);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, 3, values);
+    }
+    return result;
+}
@@ -101,6 +101,14 @@ fun MidiHubScreen(viewModel: MidiHubViewModel = viewModel()) {
                     color = if (uiState.isServiceRunning) MaterialTheme.colorScheme.primary 
                            else MaterialTheme.colorScheme.error
                 )
+                if (uiState.isServiceRunning) {
+                    Text(
+                        text = "Audio delay %.1f ms, A/V offset %.1f ms".format(
+                            uiState.audioDelayMs, uiState.avOffsetMs
+                        ),
+                        color = MaterialTheme.colorScheme.onSurfaceVariant
+                    )
+                }
             }
         }
         
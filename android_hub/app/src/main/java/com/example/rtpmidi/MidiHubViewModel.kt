@@ -9,9 +9,12 @@ import android.net.nsd.NsdManager
 import android.net.nsd.NsdServiceInfo
 import androidx.lifecycle.AndroidViewModel
 import androidx.lifecycle.viewModelScope
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
 
 data class DiscoveredDevice(
@@ -25,7 +28,10 @@ data class MidiHubUiState(
     val isServiceRunning: Boolean = false,
     val discoveredDevices: List<DiscoveredDevice> = emptyList(),
     val midiDeviceName: String? = null,
-    val errorMessage: String? = null
+    val errorMessage: String? = null,
+    // Audio path delay and its remaining offset against MIDI-driven light (ms)
+    val audioDelayMs: Double = 0.0,
+    val avOffsetMs: Double = 0.0
 )
 
 class MidiHubViewModel(application: Application) : AndroidViewModel(application) {
@@ -35,6 +41,8 @@ class MidiHubViewModel(application: Application) : AndroidViewModel(application)
     private lateinit var midiManager: MidiManager
     private lateinit var nsdManager: NsdManager
     private var currentMidiDevice: MidiDevice? = null
+    // Polls the native stats while the service runs
+    private var statsPoll: Job? = null
     
     init {
         initializeManagers()
@@ -53,6 +61,7 @@ class MidiHubViewModel(application: Application) : AndroidViewModel(application)
                 // Start the native service
                 startNativeService()
                 _uiState.value = _uiState.value.copy(isServiceRunning = true)
+                startStatsPoll()
             } catch (e: Exception) {
                 _uiState.value = _uiState.value.copy(
                     errorMessage = "Failed to start service: ${e.message}"
@@ -64,6 +73,8 @@ class MidiHubViewModel(application: Application) : AndroidViewModel(application)
     fun stopService() {
         viewModelScope.launch {
             try {
+                statsPoll?.cancel()
+                statsPoll = null
                 // Stop the native service
                 stopNativeService()
                 _uiState.value = _uiState.value.copy(isServiceRunning = false)
@@ -75,6 +86,24 @@ class MidiHubViewModel(application: Application) : AndroidViewModel(application)
         }
     }
     
+    private fun startStatsPoll() {
+        statsPoll?.cancel()
+        statsPoll = viewModelScope.launch {
+            while (isActive) {
+                refreshAvLatency()
+                delay(STATS_POLL_MS)
+            }
+        }
+    }
+    
+    fun refreshAvLatency() {
+        val (audioUs, _, offsetUs) = getAvLatency()
+        _uiState.value = _uiState.value.copy(
+            audioDelayMs = audioUs / 1000.0,
+            avOffsetMs = offsetUs / 1000.0
+        )
+    }
+    
     private fun startDeviceDiscovery() {
         // Discover OSC services (ESP32)
         discoverOscServices()
@@ -224,12 +253,22 @@ class MidiHubViewModel(application: Application) : AndroidViewModel(application)
         }
         
         _uiState.value = _uiState.value.copy(discoveredDevices = currentDevices)
+        
+        // Share with the native discovery cache so the hub can connect without hard-coded IPs
+        val serviceType = if (device.type == "OSC") "_osc._udp.local." else "_apple-midi._udp.local."
+        if (device.address.isNotEmpty()) {
+            reportDiscoveredDevice(device.name, serviceType, device.address, device.port)
+        }
     }
     
     private external fun startNativeService()
     private external fun stopNativeService()
+    private external fun reportDiscoveredDevice(name: String, serviceType: String, ip: String, port: Int)
+    private external fun getAvLatency(): LongArray
     
     companion object {
+        private const val STATS_POLL_MS = 1000L
+        
         init {
             System.loadLibrary("rtp_midi_lib")
         }
@@ -0,0 +1,49 @@
+//! Benchmark analýzy audio bufferu: blokové FFT (`compute_fft_magnitudes`)
+//! proti IIR bance filtrů (`FilterBank`) na stejných bufferech.
+
+use audio::audio_analysis::compute_fft_magnitudes;
+use audio::filterbank::{FilterBank, FilterBankConfig};
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use std::hint::black_box;
+
+fn sine(len: usize) -> Vec<f32> {
+    (0..len)
+        .map(|i| (2.0 * std::f32::consts::PI * 440.0 * i as f32 / 48_000.0).sin())
+        .collect()
+}
+
+fn bench_compute_fft_magnitudes(c: &mut Criterion) {
+    let mut group = c.benchmark_group("compute_fft_magnitudes");
+    // 1024 odpovídá výchozímu audio_buffer_size v config.toml.
+    for len in [256usize, 1024, 4096] {
+        let input = sine(len);
+        let mut prev = Vec::new();
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &input, |b, input| {
+            b.iter(|| compute_fft_magnitudes(black_box(input), &mut prev, 0.5))
+        });
+    }
+    group.finish();
+}
+
+/// Stejné buffery přes banku filtrů: 16 pásem, úrovně po každých 64 vzorcích.
+/// Latence FFT je celý buffer (1024 @ 48 kHz = 21 ms), banky jeden hop (1,3 ms).
+fn bench_filterbank(c: &mut Criterion) {
+    let mut group = c.benchmark_group("filterbank");
+    for len in [64usize, 256, 1024, 4096] {
+        let input = sine(len);
+        let mut bank = FilterBank::new(FilterBankConfig::default(), 48_000);
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &input, |b, input| {
+            b.iter(|| {
+                bank.process(black_box(input), 1, |levels| {
+                    black_box(levels);
+                })
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_compute_fft_magnitudes, bench_filterbank);
+criterion_main!(benches);
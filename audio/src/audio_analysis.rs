@@ -1,3 +1,4 @@
+use crate::filterbank::{FilterBank, FilterBankConfig};
 use rustfft::{num_complex::Complex, FftPlanner};
 
 /// Performs FFT on the input buffer and returns normalized magnitudes.
@@ -24,6 +25,76 @@ pub fn compute_fft_magnitudes(input: &[f32], prev: &mut Vec<f32>, smoothing: f32
     mags
 }
 
+/// Audio analysis engine selected by `audio_analysis` in the config.
+pub enum Analyzer {
+    /// Block FFT over each whole buffer (`compute_fft_magnitudes`).
+    Fft { prev: Vec<f32>, smoothing: f32 },
+    /// IIR filter bank updated every hop; built on the first buffer, when
+    /// the sample rate is known.
+    FilterBank {
+        config: FilterBankConfig,
+        bank: Option<FilterBank>,
+    },
+}
+
+impl Analyzer {
+    /// `"filterbank"` selects the filter bank, anything else the FFT.
+    pub fn from_name(name: Option<&str>) -> Self {
+        match name {
+            Some("filterbank") => Analyzer::FilterBank {
+                config: FilterBankConfig::default(),
+                bank: None,
+            },
+            _ => Analyzer::Fft {
+                prev: Vec::new(),
+                smoothing: 0.5,
+            },
+        }
+    }
+
+    /// Analyses one interleaved buffer into `magnitudes`. Returns how far
+    /// (µs) after the buffer's first sample the analysed audio starts: 0 for
+    /// the FFT, the start of the last complete hop for the filter bank.
+    ///
+    /// `on_hop` gets every intermediate result with its own start offset:
+    /// once per buffer for the FFT, once per hop for the filter bank, so
+    /// transients shorter than a buffer still reach the consumer.
+    pub fn analyze(
+        &mut self,
+        samples: &[f32],
+        sample_rate: u32,
+        channels: u16,
+        magnitudes: &mut Vec<f32>,
+        mut on_hop: impl FnMut(u64, &[f32]),
+    ) -> u64 {
+        let to_us = |frames: usize| frames as u64 * 1_000_000 / sample_rate.max(1) as u64;
+        match self {
+            Analyzer::Fft { prev, smoothing } => {
+                *magnitudes = compute_fft_magnitudes(samples, prev, *smoothing);
+                on_hop(0, magnitudes);
+                0
+            }
+            Analyzer::FilterBank { config, bank } => {
+                let bank = match bank {
+                    Some(bank) if bank.sample_rate() == sample_rate => bank,
+                    _ => bank.insert(FilterBank::new(*config, sample_rate)),
+                };
+                let frames = samples.len() / channels.max(1) as usize;
+                let hop = bank.config().hop.max(1);
+                // The first hop may have started in the previous buffer.
+                let mut hop_end = hop.saturating_sub(bank.pending());
+                let left_over = bank.process(samples, channels as usize, |levels| {
+                    on_hop(to_us(hop_end.saturating_sub(hop)), levels);
+                    hop_end += hop;
+                });
+                magnitudes.clear();
+                magnitudes.extend_from_slice(bank.levels());
+                to_us(frames.saturating_sub(left_over + hop))
+            }
+        }
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -58,6 +129,48 @@ mod tests {
         assert!(peak > 3.0 * avg, "Peak not prominent enough");
     }
 
+    #[test]
+    fn filter_bank_reports_every_hop() {
+        let mut analyzer = Analyzer::from_name(Some("filterbank"));
+        let hop = match &analyzer {
+            Analyzer::FilterBank { config, .. } => config.hop,
+            _ => unreachable!(),
+        };
+        let rate = 48_000;
+        // 2.5 hops of silence, then a burst filling the third hop only
+        let mut samples = vec![0.0f32; hop * 5 / 2];
+        samples.extend((0..hop / 2).map(|i| (2.0 * PI * 1_000.0 * i as f32 / rate as f32).sin()));
+        samples.extend(vec![0.0f32; hop * 3 / 2]);
+
+        let mut hops = Vec::new();
+        let mut magnitudes = Vec::new();
+        let offset = analyzer.analyze(
+            &samples[..hop * 5 / 2],
+            rate,
+            1,
+            &mut magnitudes,
+            |at, l| hops.push((at, l.iter().cloned().fold(0.0, f32::max))),
+        );
+        analyzer.analyze(
+            &samples[hop * 5 / 2..],
+            rate,
+            1,
+            &mut magnitudes,
+            |at, l| hops.push((at, l.iter().cloned().fold(0.0, f32::max))),
+        );
+
+        let hop_us = hop as u64 * 1_000_000 / rate as u64;
+        assert_eq!(offset, hop_us);
+        // Offsets are relative to each buffer; the hop straddling the
+        // buffers starts before the second one and is clamped to 0.
+        let offsets: Vec<u64> = hops.iter().map(|h| h.0).collect();
+        assert_eq!(offsets, vec![0, hop_us, 0, hop_us / 2]);
+        assert_eq!(hops[1].1, 0.0);
+        assert!(hops[2].1 > 0.1, "burst hop level {}", hops[2].1);
+        // The last hop is what the buffer as a whole reports.
+        assert_eq!(hops[3].1, magnitudes.iter().cloned().fold(0.0, f32::max));
+    }
+
     #[test]
     fn test_fft_smoothing() {
         let n = 8;
@@ -1,15 +1,18 @@
 use anyhow::Result;
 use cpal::traits::{DeviceTrait, HostTrait};
 use cpal::{Sample, SampleFormat};
+use rtp_midi_core::clock::SharedClock;
 use rtp_midi_core::event_bus::Event;
 use rustfft::num_traits;
 use tokio::sync::broadcast;
 
 /// Starts audio capture from the specified device (or default if None).
-/// Sends audio buffers (Vec<f32>) to the provided channel sender.
+/// Sends audio buffers (Vec<f32>) to the provided channel sender, stamped
+/// with the capture time of their first sample on `clock`.
 pub fn start_audio_input(
     device_name: Option<&str>,
     tx: broadcast::Sender<Event>,
+    clock: SharedClock,
 ) -> Result<cpal::Stream> {
     let host = cpal::default_host();
     let device = if let Some(name) = device_name {
@@ -25,9 +28,15 @@ pub fn start_audio_input(
     let config = config.into();
     let err_fn = |err| eprintln!("Audio input error: {err}");
     let stream = match sample_format {
-        SampleFormat::F32 => build_input_stream::<f32>(&device, &config, tx.clone(), err_fn)?,
-        SampleFormat::I16 => build_input_stream::<i16>(&device, &config, tx.clone(), err_fn)?,
-        SampleFormat::U16 => build_input_stream::<u16>(&device, &config, tx.clone(), err_fn)?,
+        SampleFormat::F32 => {
+            build_input_stream::<f32>(&device, &config, tx.clone(), clock, err_fn)?
+        }
+        SampleFormat::I16 => {
+            build_input_stream::<i16>(&device, &config, tx.clone(), clock, err_fn)?
+        }
+        SampleFormat::U16 => {
+            build_input_stream::<u16>(&device, &config, tx.clone(), clock, err_fn)?
+        }
         _ => {
             log::error!("Unsupported sample format: {sample_format:?}");
             return Err(anyhow::anyhow!(
@@ -43,21 +52,36 @@ fn build_input_stream<T>(
     device: &cpal::Device,
     config: &cpal::StreamConfig,
     tx: broadcast::Sender<Event>,
+    clock: SharedClock,
     err_fn: fn(cpal::StreamError),
 ) -> Result<cpal::Stream>
 where
     T: Sample + cpal::SizedSample + num_traits::ToPrimitive + Send + 'static,
 {
-    let _channels = config.channels as usize;
+    let channels = config.channels.max(1);
+    let sample_rate = config.sample_rate.0.max(1);
     let stream = device.build_input_stream(
         config,
-        move |data: &[T], _| {
+        move |data: &[T], info: &cpal::InputCallbackInfo| {
+            let now_us = clock.now_us();
+            // How long ago the buffer was captured, on the stream's clock;
+            // hosts without capture timestamps get the buffer duration.
+            let timestamp = info.timestamp();
+            let age_us = match timestamp.callback.duration_since(&timestamp.capture) {
+                Some(age) if !age.is_zero() => age.as_micros() as u64,
+                _ => data.len() as u64 / channels as u64 * 1_000_000 / sample_rate as u64,
+            };
             let mut buffer = Vec::with_capacity(data.len());
             for &sample in data {
                 buffer.push(num_traits::ToPrimitive::to_f32(&sample).unwrap_or(0.0));
             }
             // Optionally: downmix to mono or keep as is
-            let _ = tx.send(Event::AudioDataReady(buffer));
+            let _ = tx.send(Event::AudioDataReady {
+                samples: buffer,
+                sample_rate,
+                channels,
+                captured_us: now_us.saturating_sub(age_us),
+            });
         },
         err_fn,
         None,
@@ -17,3 +17,5 @@ mod tests {
 
 pub mod audio_analysis;
 pub mod audio_input;
+pub mod filterbank;
+pub mod wav;
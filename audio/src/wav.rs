@@ -0,0 +1,209 @@
+//! WAV file reader for offline analysis.
+//!
+//! The file is read once; samples are decoded on demand per frame range, so
+//! parallel workers each convert only their own part of the song and the
+//! decoded audio never exists as a whole in memory. Supports PCM with 8, 16,
+//! 24 and 32 bits and 32-bit IEEE float, also inside `WAVE_FORMAT_EXTENSIBLE`.
+
+use std::io;
+use std::ops::Range;
+use std::path::Path;
+
+const FORMAT_PCM: u16 = 1;
+const FORMAT_FLOAT: u16 = 3;
+const FORMAT_EXTENSIBLE: u16 = 0xFFFE;
+
+fn invalid(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, format!("WAV: {message}"))
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Encoding {
+    Pcm(u16),
+    Float,
+}
+
+/// Audio of a WAV file.
+pub struct WavFile {
+    sample_rate: u32,
+    channels: u16,
+    encoding: Encoding,
+    bytes: Vec<u8>,
+    // Sample data inside `bytes`.
+    data: Range<usize>,
+}
+
+impl WavFile {
+    pub fn open(path: impl AsRef<Path>) -> io::Result<Self> {
+        Self::from_bytes(std::fs::read(path)?)
+    }
+
+    pub fn from_bytes(bytes: Vec<u8>) -> io::Result<Self> {
+        if bytes.len() < 12 || &bytes[0..4] != b"RIFF" || &bytes[8..12] != b"WAVE" {
+            return Err(invalid("not a RIFF/WAVE file"));
+        }
+        let u16_at = |at: usize| u16::from_le_bytes([bytes[at], bytes[at + 1]]);
+        let mut format = None;
+        let mut data = None;
+        let mut pos = 12;
+        while pos + 8 <= bytes.len() {
+            let id = &bytes[pos..pos + 4];
+            let len = u32::from_le_bytes(bytes[pos + 4..pos + 8].try_into().unwrap()) as usize;
+            let body = pos + 8;
+            // Streamed files may leave the data length open (0 or too long).
+            let end = body.saturating_add(len).min(bytes.len());
+            match id {
+                b"fmt " if end - body >= 16 => {
+                    let mut tag = u16_at(body);
+                    if tag == FORMAT_EXTENSIBLE && end - body >= 26 {
+                        tag = u16_at(body + 24);
+                    }
+                    let bits = u16_at(body + 14);
+                    let encoding = match (tag, bits) {
+                        (FORMAT_PCM, 8 | 16 | 24 | 32) => Encoding::Pcm(bits),
+                        (FORMAT_FLOAT, 32) => Encoding::Float,
+                        _ => return Err(invalid("unsupported sample format")),
+                    };
+                    let rate = u32::from_le_bytes(bytes[body + 4..body + 8].try_into().unwrap());
+                    format = Some((u16_at(body + 2), rate, encoding));
+                }
+                b"data" => {
+                    data = Some(body..if len == 0 { bytes.len() } else { end });
+                }
+                _ => {}
+            }
+            // Chunks are padded to an even length.
+            pos = body.saturating_add(len + (len & 1));
+        }
+        let (channels, sample_rate, encoding) = format.ok_or_else(|| invalid("missing fmt"))?;
+        let data = data.ok_or_else(|| invalid("missing data"))?;
+        if channels == 0 || sample_rate == 0 {
+            return Err(invalid("no channels or zero sample rate"));
+        }
+        Ok(Self {
+            sample_rate,
+            channels,
+            encoding,
+            bytes,
+            data,
+        })
+    }
+
+    pub fn sample_rate(&self) -> u32 {
+        self.sample_rate
+    }
+
+    pub fn channels(&self) -> u16 {
+        self.channels
+    }
+
+    fn bytes_per_sample(&self) -> usize {
+        match self.encoding {
+            Encoding::Pcm(bits) => bits as usize / 8,
+            Encoding::Float => 4,
+        }
+    }
+
+    /// Number of complete frames (one sample per channel).
+    pub fn frames(&self) -> usize {
+        self.data.len() / (self.bytes_per_sample() * self.channels as usize)
+    }
+
+    /// Song length (µs).
+    pub fn duration_us(&self) -> u64 {
+        self.frames() as u64 * 1_000_000 / self.sample_rate as u64
+    }
+
+    /// Decodes `frames` (clamped to the file) into interleaved samples in
+    /// -1.0..1.0; `out` is cleared first.
+    pub fn read_frames(&self, frames: Range<usize>, out: &mut Vec<f32>) {
+        let width = self.bytes_per_sample();
+        let frame_len = width * self.channels as usize;
+        let end = frames.end.min(self.frames());
+        let start = frames.start.min(end);
+        let bytes =
+            &self.bytes[self.data.start + start * frame_len..self.data.start + end * frame_len];
+        out.clear();
+        out.reserve(bytes.len() / width);
+        let samples = bytes.chunks_exact(width);
+        match self.encoding {
+            Encoding::Pcm(8) => out.extend(samples.map(|s| (s[0] as f32 - 128.0) / 128.0)),
+            Encoding::Pcm(16) => {
+                out.extend(samples.map(|s| i16::from_le_bytes([s[0], s[1]]) as f32 / 32_768.0))
+            }
+            Encoding::Pcm(24) => out
+                .extend(samples.map(|s| {
+                    (i32::from_le_bytes([0, s[0], s[1], s[2]]) >> 8) as f32 / 8_388_608.0
+                })),
+            Encoding::Pcm(_) => out
+                .extend(samples.map(|s| {
+                    i32::from_le_bytes([s[0], s[1], s[2], s[3]]) as f32 / 2_147_483_648.0
+                })),
+            Encoding::Float => {
+                out.extend(samples.map(|s| f32::from_le_bytes([s[0], s[1], s[2], s[3]])))
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn wav(tag: u16, channels: u16, bits: u16, data: &[u8]) -> Vec<u8> {
+        let mut bytes = b"RIFF\0\0\0\0WAVE".to_vec();
+        bytes.extend_from_slice(b"fmt ");
+        bytes.extend_from_slice(&16u32.to_le_bytes());
+        bytes.extend_from_slice(&tag.to_le_bytes());
+        bytes.extend_from_slice(&channels.to_le_bytes());
+        bytes.extend_from_slice(&48_000u32.to_le_bytes());
+        let block = channels * bits / 8;
+        bytes.extend_from_slice(&(48_000 * block as u32).to_le_bytes());
+        bytes.extend_from_slice(&block.to_le_bytes());
+        bytes.extend_from_slice(&bits.to_le_bytes());
+        // An unknown chunk with odd length (padded) before the data.
+        bytes.extend_from_slice(b"LIST\x03\0\0\0abc\0");
+        bytes.extend_from_slice(b"data");
+        bytes.extend_from_slice(&(data.len() as u32).to_le_bytes());
+        bytes.extend_from_slice(data);
+        bytes
+    }
+
+    #[test]
+    fn pcm16_stereo_frames() {
+        let data: Vec<u8> = [0i16, 16_384, -32_768, 32_767]
+            .iter()
+            .flat_map(|s| s.to_le_bytes())
+            .collect();
+        let file = WavFile::from_bytes(wav(FORMAT_PCM, 2, 16, &data)).unwrap();
+        assert_eq!(
+            (file.channels(), file.sample_rate(), file.frames()),
+            (2, 48_000, 2)
+        );
+        let mut out = Vec::new();
+        file.read_frames(1..5, &mut out);
+        assert_eq!(out.len(), 2);
+        assert_eq!(out[0], -1.0);
+        assert!((out[1] - 1.0).abs() < 1e-4);
+        file.read_frames(0..1, &mut out);
+        assert_eq!(out, vec![0.0, 0.5]);
+    }
+
+    #[test]
+    fn pcm24_and_float() {
+        let pcm24 = WavFile::from_bytes(wav(FORMAT_PCM, 1, 24, &[0x00, 0x00, 0xC0])).unwrap();
+        let mut out = Vec::new();
+        pcm24.read_frames(0..1, &mut out);
+        assert_eq!(out, vec![-0.5]);
+
+        let float = WavFile::from_bytes(wav(FORMAT_FLOAT, 1, 32, &0.25f32.to_le_bytes())).unwrap();
+        float.read_frames(0..10, &mut out);
+        assert_eq!(out, vec![0.25]);
+    }
+
+    #[test]
+    fn rejects_unsupported() {
+        assert!(WavFile::from_bytes(b"RIFF\0\0\0\0AVI ".to_vec()).is_err());
+        assert!(WavFile::from_bytes(wav(2, 1, 4, &[0; 4])).is_err());
+    }
+}
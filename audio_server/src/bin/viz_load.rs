@@ -0,0 +1,301 @@
+//! Per-client CPU cost of the `viz` data channels.
+//!
+//! Runs the streaming side on its own runtime (threads `viz-server`) fed by
+//! a real `FrameScheduler` publishing into the tap like the hub does, and N
+//! headless WebRTC clients on a second runtime, connected in-process over
+//! loopback without a signaling server. The CPU time of the `viz-server`
+//! threads (Linux `/proc`) is measured first without clients, then with all
+//! clients streaming; the difference divided by N is the per-client cost.
+//!
+//! ```sh
+//! cargo run --release -p audio_server --bin viz_load -- --clients 20 --seconds 10
+//! ```
+
+use anyhow::{anyhow, Context, Result};
+use audio_server::viz;
+use output::frame_scheduler::{FrameScheduler, FrameSchedulerConfig};
+use output::viz_stream::{self, decode_packet, RateConfig, VizKind};
+use rtp_midi_core::{DataStreamNetSender, StreamError};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+use tokio::runtime::{Builder, Runtime};
+use webrtc::api::media_engine::MediaEngine;
+use webrtc::api::{APIBuilder, API};
+use webrtc::data_channel::data_channel_message::DataChannelMessage;
+use webrtc::data_channel::RTCDataChannel;
+use webrtc::peer_connection::configuration::RTCConfiguration;
+use webrtc::peer_connection::sdp::session_description::RTCSessionDescription;
+use webrtc::peer_connection::RTCPeerConnection;
+
+const SERVER_THREADS: &str = "viz-server";
+// USER_HZ of /proc/<pid>/task/<tid>/stat.
+const CLOCK_TICKS_PER_S: f64 = 100.0;
+
+struct Args {
+    clients: usize,
+    seconds: f64,
+    leds: usize,
+    fps: u32,
+}
+
+fn parse_args() -> Result<Args> {
+    let mut args = Args {
+        clients: 20,
+        seconds: 10.0,
+        leds: 300,
+        fps: 60,
+    };
+    let mut it = std::env::args().skip(1);
+    while let Some(flag) = it.next() {
+        let mut value = || it.next().ok_or_else(|| anyhow!("{flag} needs a value"));
+        match flag.as_str() {
+            "--clients" => args.clients = value()?.parse()?,
+            "--seconds" => args.seconds = value()?.parse()?,
+            "--leds" => args.leds = value()?.parse()?,
+            "--fps" => args.fps = value()?.parse()?,
+            _ => return Err(anyhow!("unknown flag {flag}")),
+        }
+    }
+    Ok(args)
+}
+
+// Frames only go to the tap; no LED hardware.
+struct NullSender;
+
+impl DataStreamNetSender for NullSender {
+    fn init(&mut self) -> Result<(), StreamError> {
+        Ok(())
+    }
+
+    fn send(&mut self, _ts: u64, _payload: &[u8]) -> Result<(), StreamError> {
+        Ok(())
+    }
+}
+
+/// CPU seconds used so far by the threads named `SERVER_THREADS`.
+fn server_cpu_s() -> Result<f64> {
+    let mut ticks = 0u64;
+    for task in std::fs::read_dir("/proc/self/task").context("/proc/self/task")? {
+        let path = task?.path();
+        let comm = std::fs::read_to_string(path.join("comm")).unwrap_or_default();
+        if !comm.starts_with(SERVER_THREADS) {
+            continue;
+        }
+        let stat = std::fs::read_to_string(path.join("stat")).unwrap_or_default();
+        // Fields after the parenthesised name; utime and stime are 14 and 15.
+        let fields: Vec<&str> = stat
+            .rsplit_once(')')
+            .map_or("", |(_, rest)| rest)
+            .split_whitespace()
+            .collect();
+        if let (Some(utime), Some(stime)) = (fields.get(11), fields.get(12)) {
+            ticks += utime.parse::<u64>()? + stime.parse::<u64>()?;
+        }
+    }
+    Ok(ticks as f64 / CLOCK_TICKS_PER_S)
+}
+
+fn api() -> Result<API> {
+    let mut media_engine = MediaEngine::default();
+    media_engine.register_default_codecs()?;
+    Ok(APIBuilder::new().with_media_engine(media_engine).build())
+}
+
+/// Packets one client received.
+#[derive(Default)]
+struct Received {
+    leds: AtomicU64,
+    bands: AtomicU64,
+    bytes: AtomicU64,
+    // Sequence gaps: packets the unreliable channel lost.
+    lost: AtomicU64,
+    last_sequence: AtomicU64,
+}
+
+impl Received {
+    fn record(&self, data: &[u8]) {
+        let Some(packet) = decode_packet(data) else {
+            return;
+        };
+        match packet.kind {
+            VizKind::Leds => self.leds.fetch_add(1, Ordering::Relaxed),
+            VizKind::Bands => self.bands.fetch_add(1, Ordering::Relaxed),
+        };
+        self.bytes.fetch_add(data.len() as u64, Ordering::Relaxed);
+        let sequence = packet.sequence as u64 + 1;
+        let last = self.last_sequence.swap(sequence, Ordering::Relaxed);
+        if last != 0 && sequence > last + 1 {
+            self.lost.fetch_add(sequence - last - 1, Ordering::Relaxed);
+        }
+    }
+}
+
+struct Client {
+    _peer_connection: Arc<RTCPeerConnection>,
+    _server: Arc<RTCPeerConnection>,
+    received: Arc<Received>,
+}
+
+// Server side of one client, on the server runtime: answers `offer`.
+async fn serve(offer: String) -> Result<(Arc<RTCPeerConnection>, String)> {
+    let peer_connection = Arc::new(
+        api()?
+            .new_peer_connection(RTCConfiguration::default())
+            .await?,
+    );
+    peer_connection
+        .set_remote_description(RTCSessionDescription::offer(offer)?)
+        .await?;
+    viz::attach(&peer_connection, "load", RateConfig::default()).await?;
+    let answer = peer_connection.create_answer(None).await?;
+    let mut gathered = peer_connection.gathering_complete_promise().await;
+    peer_connection.set_local_description(answer).await?;
+    let _ = gathered.recv().await;
+    let sdp = peer_connection
+        .local_description()
+        .await
+        .ok_or_else(|| anyhow!("no answer"))?
+        .sdp;
+    Ok((peer_connection, sdp))
+}
+
+async fn connect(server: &Runtime) -> Result<Client> {
+    let peer_connection = Arc::new(
+        api()?
+            .new_peer_connection(RTCConfiguration::default())
+            .await?,
+    );
+    let received = Arc::new(Received::default());
+    let on_viz = Arc::clone(&received);
+    peer_connection.on_data_channel(Box::new(move |channel: Arc<RTCDataChannel>| {
+        let received = Arc::clone(&on_viz);
+        Box::pin(async move {
+            if channel.label() == viz::LABEL {
+                channel.on_message(Box::new(move |msg: DataChannelMessage| {
+                    received.record(&msg.data);
+                    Box::pin(async {})
+                }));
+            }
+        })
+    }));
+    // Like the browser client: the `midi` channel puts SCTP into the offer.
+    peer_connection.create_data_channel("midi", None).await?;
+    let offer = peer_connection.create_offer(None).await?;
+    let mut gathered = peer_connection.gathering_complete_promise().await;
+    peer_connection.set_local_description(offer).await?;
+    let _ = gathered.recv().await;
+    let offer = peer_connection
+        .local_description()
+        .await
+        .ok_or_else(|| anyhow!("no offer"))?
+        .sdp;
+    let (server_connection, answer) = server.spawn(serve(offer)).await??;
+    peer_connection
+        .set_remote_description(RTCSessionDescription::answer(answer)?)
+        .await?;
+    Ok(Client {
+        _peer_connection: peer_connection,
+        _server: server_connection,
+        received,
+    })
+}
+
+fn measure(seconds: f64) -> Result<f64> {
+    let cpu_before = server_cpu_s()?;
+    let started = Instant::now();
+    std::thread::sleep(Duration::from_secs_f64(seconds));
+    Ok((server_cpu_s()? - cpu_before) / started.elapsed().as_secs_f64())
+}
+
+fn main() -> Result<()> {
+    let args = parse_args()?;
+    let server = Builder::new_multi_thread()
+        .worker_threads(2)
+        .thread_name(SERVER_THREADS)
+        .enable_all()
+        .build()?;
+    let clients_rt = Builder::new_multi_thread()
+        .worker_threads(2)
+        .thread_name("viz-client")
+        .enable_all()
+        .build()?;
+
+    // The hub's frame clock: a moving dot and a band sweep every tick.
+    let leds = args.leds;
+    let mut scheduler = FrameScheduler::spawn(
+        FrameSchedulerConfig {
+            fps: args.fps,
+            ..Default::default()
+        },
+        move |now_us, frame| {
+            frame.clear();
+            frame.resize(leds * 3, 0);
+            let lit = (now_us / 10_000) as usize % leds;
+            frame[lit * 3..lit * 3 + 3].copy_from_slice(&[255, 128, 0]);
+            viz_stream::tap().publish_leds(now_us, frame);
+            let bands: Vec<f32> = (0..viz_stream::MAX_BANDS)
+                .map(|band| ((now_us / 1_000 + band as u64 * 50) % 1_000) as f32 / 1_000.0)
+                .collect();
+            viz_stream::tap().publish_bands(now_us, &bands);
+        },
+        NullSender,
+    );
+
+    let idle = measure(args.seconds)?;
+    let clients = clients_rt.block_on(async {
+        let mut clients = Vec::with_capacity(args.clients);
+        for _ in 0..args.clients {
+            clients.push(connect(&server).await?);
+        }
+        Ok::<_, anyhow::Error>(clients)
+    })?;
+    // Wait until every channel delivers before measuring.
+    let deadline = Instant::now() + Duration::from_secs(10);
+    while clients
+        .iter()
+        .any(|client| client.received.leds.load(Ordering::Relaxed) == 0)
+    {
+        if Instant::now() > deadline {
+            return Err(anyhow!("not all viz channels opened"));
+        }
+        std::thread::sleep(Duration::from_millis(50));
+    }
+    let counts_before: Vec<u64> = clients
+        .iter()
+        .map(|client| client.received.bytes.load(Ordering::Relaxed))
+        .collect();
+    let loaded = measure(args.seconds)?;
+    scheduler.stop();
+
+    let n = args.clients as f64;
+    let bytes: u64 = clients
+        .iter()
+        .zip(&counts_before)
+        .map(|(client, before)| client.received.bytes.load(Ordering::Relaxed) - before)
+        .sum();
+    let (leds_rx, bands_rx, lost) = clients.iter().fold((0, 0, 0), |acc, client| {
+        let r = &client.received;
+        (
+            acc.0 + r.leds.load(Ordering::Relaxed),
+            acc.1 + r.bands.load(Ordering::Relaxed),
+            acc.2 + r.lost.load(Ordering::Relaxed),
+        )
+    });
+    println!(
+        "{} clients, {} LEDs at {} fps, {:.0} s per phase",
+        args.clients, args.leds, args.fps, args.seconds
+    );
+    println!("server CPU without clients: {:.2} %", idle * 100.0);
+    println!("server CPU with clients:    {:.2} %", loaded * 100.0);
+    println!(
+        "per client: {:.3} % CPU, {:.1} kbit/s",
+        (loaded - idle) * 100.0 / n,
+        bytes as f64 * 8.0 / 1_000.0 / args.seconds / n
+    );
+    println!("received: {leds_rx} LED frames, {bands_rx} band vectors, {lost} lost");
+    drop(clients);
+    clients_rt.shutdown_timeout(Duration::from_secs(1));
+    server.shutdown_timeout(Duration::from_secs(1));
+    Ok(())
+}
@@ -1,12 +1,14 @@
 use anyhow::Result;
+use audio_server::viz;
 use futures_util::{stream::SplitSink, SinkExt, StreamExt};
 use log::{error, info, warn};
+use output::viz_stream::RateConfig;
 use serde::{Deserialize, Serialize};
 use serde_json::json;
 use std::collections::HashMap;
 use std::sync::Arc;
 use tokio::net::TcpStream;
-use tokio::sync::Mutex;
+use tokio::sync::{watch, Mutex};
 use tokio_tungstenite::{connect_async, tungstenite::Message, MaybeTlsStream, WebSocketStream};
 use url::Url;
 use webrtc::api::media_engine::MediaEngine;
@@ -51,6 +53,19 @@ async fn main() -> Result<()> {
     let server_id = "audio_server_main".to_string();
     let signaling_url = "ws://localhost:8080/signaling";
 
+    // Viz kanály posílají jen to, co publikuje hub ve stejném procesu.
+    // Vestavěný hub je volitelný (`--hub config.toml`): vedle běžícího
+    // hubu by si znovu otevřel MIDI port i audio zařízení.
+    let (_shutdown_tx, shutdown_rx) = watch::channel(false);
+    match hub_config_path()? {
+        Some(config_path) => {
+            let config = rtp_midi_lib::Config::load_from_file(&config_path)?;
+            info!("[AudioServer] Vestavěný hub s konfigurací {}", config_path);
+            tokio::spawn(rtp_midi_lib::run_service_loop(config, shutdown_rx));
+        }
+        None => info!("[AudioServer] Bez vestavěného hubu (--hub): viz kanály zůstanou prázdné"),
+    }
+
     let url = Url::parse(signaling_url)?;
     let (ws_stream, _) = connect_async(url.as_str()).await?;
     println!("[AudioServer] Připojeno k signalizačnímu serveru.");
@@ -130,6 +145,24 @@ async fn main() -> Result<()> {
     Ok(())
 }
 
+/// Cesta z `--hub <config.toml>`, pokud je zadána.
+fn hub_config_path() -> Result<Option<String>> {
+    let mut args = std::env::args().skip(1);
+    let mut path = None;
+    while let Some(arg) = args.next() {
+        match arg.as_str() {
+            "--hub" => {
+                path = Some(
+                    args.next()
+                        .ok_or_else(|| anyhow::anyhow!("--hub vyžaduje cestu ke konfiguraci"))?,
+                )
+            }
+            _ => return Err(anyhow::anyhow!("neznámý argument {}", arg)),
+        }
+    }
+    Ok(path)
+}
+
 async fn handle_offer(
     msg: &SignalingMessage,
     client_id: &str,
@@ -235,6 +268,7 @@ async fn handle_offer(
     if let Some(sdp) = msg.payload.get("sdp").and_then(|v| v.as_str()) {
         let offer = RTCSessionDescription::offer(sdp.to_string())?;
         peer_connection.set_remote_description(offer).await?;
+        viz::attach(&peer_connection, client_id, RateConfig::default()).await?;
         let answer = peer_connection.create_answer(None).await?;
         peer_connection
             .set_local_description(answer.clone())
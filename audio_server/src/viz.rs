@@ -0,0 +1,76 @@
+//! Data channel `viz`: live LED frames and band levels for one WebRTC client.
+//!
+//! The server opens the channel itself, unordered and without
+//! retransmissions, on the SCTP association the client's offer set up (its
+//! `midi` channel), so no renegotiation is needed. The packets and the rate
+//! adaptation are `output::viz_stream`; this module only drives them from a
+//! task per client.
+
+use anyhow::Result;
+use bytes::Bytes;
+use log::{info, warn};
+use output::viz_stream::{self, RateConfig, VizClient, VizClientStats};
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::time::Instant;
+use webrtc::data_channel::data_channel_init::RTCDataChannelInit;
+use webrtc::data_channel::data_channel_state::RTCDataChannelState;
+use webrtc::data_channel::RTCDataChannel;
+use webrtc::peer_connection::RTCPeerConnection;
+
+pub const LABEL: &str = "viz";
+
+/// Creates the `viz` channel on `peer_connection` (call after the remote
+/// offer is set) and starts streaming to it once it opens.
+pub async fn attach(
+    peer_connection: &Arc<RTCPeerConnection>,
+    client_id: &str,
+    config: RateConfig,
+) -> Result<Arc<RTCDataChannel>> {
+    let init = RTCDataChannelInit {
+        ordered: Some(false),
+        max_retransmits: Some(0),
+        ..Default::default()
+    };
+    let channel = peer_connection
+        .create_data_channel(LABEL, Some(init))
+        .await?;
+    let stream_channel = Arc::clone(&channel);
+    let client_id = client_id.to_string();
+    channel.on_open(Box::new(move || {
+        Box::pin(async move {
+            info!("[AudioServer] Viz kanál otevřen pro klienta {}", client_id);
+            tokio::spawn(async move {
+                let stats = stream(stream_channel, config).await;
+                info!(
+                    "[AudioServer] Viz klient {}: {} paketů, {} B, {} přeskočeno",
+                    client_id, stats.packets, stats.bytes, stats.congested
+                );
+            });
+        })
+    }));
+    Ok(channel)
+}
+
+/// Sends the newest tap data to `channel` at the client's adapted rate
+/// until the channel closes.
+pub async fn stream(channel: Arc<RTCDataChannel>, config: RateConfig) -> VizClientStats {
+    let mut client = VizClient::new(viz_stream::tap(), config);
+    let started = Instant::now();
+    let mut packets: Vec<Bytes> = Vec::with_capacity(2);
+    while channel.ready_state() == RTCDataChannelState::Open {
+        let buffered = channel.buffered_amount().await;
+        let now_us = started.elapsed().as_micros() as u64;
+        let _ = client.poll(now_us, buffered, |data| {
+            packets.push(Bytes::copy_from_slice(data));
+            Ok::<_, ()>(())
+        });
+        for packet in packets.drain(..) {
+            if let Err(e) = channel.send(&packet).await {
+                warn!("[AudioServer] Viz paket neodeslán: {}", e);
+            }
+        }
+        tokio::time::sleep_until(started + Duration::from_micros(client.next_due_us())).await;
+    }
+    client.stats()
+}
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Compare benchmark results against the baselines stored in benches/baselines.
+
+Reads criterion results (target/criterion/**/new/estimates.json) and Google
+Benchmark JSON reports, prints a table of baseline vs. current mean time and
+exits with status 1 if any benchmark regressed by more than the threshold.
+
+Usage:
+    cargo bench
+    ./build/firmware-host/bench_render_core --benchmark_out=firmware.json --benchmark_out_format=json
+    benches/compare.py --gbench firmware=firmware.json
+    benches/compare.py --gbench firmware=firmware.json --update   # accept new numbers
+"""
+
+import argparse
+import json
+import sys
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parent.parent
+BASELINES = REPO / "benches" / "baselines"
+
+TIME_UNITS_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load_criterion(criterion_dir):
+    """Suite "rust": {group/bench/param: mean ns}."""
+    results = {}
+    for estimates in sorted(criterion_dir.glob("**/new/estimates.json")):
+        name = estimates.parent.parent.relative_to(criterion_dir).as_posix()
+        if name.startswith("report") or "/report/" in name:
+            continue
+        with open(estimates) as f:
+            results[name] = json.load(f)["mean"]["point_estimate"]
+    return results
+
+
+def load_gbench(path):
+    """Google Benchmark JSON report: {name: real time ns} (aggregates skipped)."""
+    with open(path) as f:
+        report = json.load(f)
+    results = {}
+    for bench in report.get("benchmarks", []):
+        if bench.get("run_type") == "aggregate":
+            continue
+        scale = TIME_UNITS_NS[bench.get("time_unit", "ns")]
+        results[bench["name"]] = bench["real_time"] * scale
+    return results
+
+
+def load_baseline(suite):
+    path = BASELINES / f"{suite}.json"
+    if not path.exists():
+        return {}
+    with open(path) as f:
+        return json.load(f)["benchmarks"]
+
+
+def save_baseline(suite, results):
+    path = BASELINES / f"{suite}.json"
+    merged = load_baseline(suite)
+    merged.update({name: round(ns, 1) for name, ns in results.items()})
+    with open(path, "w") as f:
+        json.dump({"unit": "ns", "benchmarks": dict(sorted(merged.items()))}, f, indent=2)
+        f.write("\n")
+    print(f"updated {path.relative_to(REPO)} ({len(results)} entries)")
+
+
+def compare(suite, results, threshold):
+    baseline = load_baseline(suite)
+    regressions = 0
+    print(f"\n== {suite} ==")
+    print(f"{'benchmark':<48} {'baseline':>12} {'current':>12} {'delta':>8}")
+    for name in sorted(results):
+        current = results[name]
+        base = baseline.get(name)
+        if base is None:
+            print(f"{name:<48} {'-':>12} {current:>10.1f}ns {'new':>8}")
+            continue
+        delta = (current - base) / base
+        flag = ""
+        if delta > threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif delta < -threshold:
+            flag = "  faster"
+        print(f"{name:<48} {base:>10.1f}ns {current:>10.1f}ns {delta:>+7.1%}{flag}")
+    for name in sorted(set(baseline) - set(results)):
+        print(f"{name:<48} {baseline[name]:>10.1f}ns {'-':>12} {'missing':>8}")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--criterion-dir", type=Path, default=REPO / "target" / "criterion",
+                        help="criterion output directory (default: target/criterion)")
+    parser.add_argument("--gbench", action="append", default=[], metavar="SUITE=FILE",
+                        help="Google Benchmark JSON report for a suite, e.g. firmware=out.json")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown counted as regression (default: 0.10)")
+    parser.add_argument("--update", action="store_true", help="write current results as new baselines")
+    args = parser.parse_args()
+
+    suites = {}
+    if args.criterion_dir.exists():
+        suites["rust"] = load_criterion(args.criterion_dir)
+    for spec in args.gbench:
+        suite, _, path = spec.partition("=")
+        if not path:
+            parser.error(f"--gbench expects SUITE=FILE, got {spec!r}")
+        suites[suite] = load_gbench(path)
+    suites = {suite: results for suite, results in suites.items() if results}
+    if not suites:
+        print("no benchmark results found (run `cargo bench` or pass --gbench)", file=sys.stderr)
+        return 2
+
+    if args.update:
+        for suite, results in suites.items():
+            save_baseline(suite, results)
+        return 0
+
+    regressions = sum(compare(suite, results, args.threshold) for suite, results in suites.items())
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower than baseline by more than {args.threshold:.0%}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
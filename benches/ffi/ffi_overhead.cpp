@@ -0,0 +1,81 @@
+// FFI call overhead of the calls the Qt and JNI bridges make per UI update
+// or per discovered device. BM_EmptyCall is the floor: a plain
+// non-inlined C++ call with the same signature shape.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdio>
+
+// Same declarations as qt_ui/rust_service_bridge.cpp and android_hub midi_hub_jni.cpp
+extern "C" {
+    struct ServiceHandle;
+    ServiceHandle* create_service(const char* config_path);
+    void destroy_service(ServiceHandle* handle);
+    char* get_wled_ip(ServiceHandle* handle);
+    char* get_discovery_snapshot(ServiceHandle* handle);
+    void report_discovered_service(ServiceHandle* handle, const char* name, const char* service_type,
+                                   const char* ip, uint16_t port, uint32_t ttl_secs);
+    void free_string(char* s);
+}
+
+namespace {
+
+struct ServiceFixture {
+    ServiceHandle* handle = create_service(RTP_MIDI_CONFIG);
+    ~ServiceFixture() { destroy_service(handle); }
+};
+
+ServiceFixture& fixture() {
+    static ServiceFixture f;
+    return f;
+}
+
+__attribute__((noinline)) char* emptyCall(ServiceHandle* handle) {
+    benchmark::DoNotOptimize(handle);
+    return nullptr;
+}
+
+void BM_EmptyCall(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(emptyCall(fixture().handle));
+    }
+}
+BENCHMARK(BM_EmptyCall);
+
+// RustServiceBridge::updateStatus(): string out + free_string
+void BM_GetWledIp(benchmark::State& state) {
+    for (auto _ : state) {
+        char* ip = get_wled_ip(fixture().handle);
+        benchmark::DoNotOptimize(ip);
+        free_string(ip);
+    }
+}
+BENCHMARK(BM_GetWledIp);
+
+// Discovery snapshot as JSON, scaling with the number of cached services
+void BM_GetDiscoverySnapshot(benchmark::State& state) {
+    ServiceHandle* handle = fixture().handle;
+    for (int i = 0; i < state.range(0); i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "bench-%d._osc._udp.local.", i);
+        report_discovered_service(handle, name, "_osc._udp.local.", "10.0.0.1", 8000, 60);
+    }
+    for (auto _ : state) {
+        char* json = get_discovery_snapshot(handle);
+        benchmark::DoNotOptimize(json);
+        free_string(json);
+    }
+}
+BENCHMARK(BM_GetDiscoverySnapshot)->Arg(1)->Arg(16);
+
+// JNI reportDiscoveredDevice(): three C strings in, cache upsert
+void BM_ReportDiscoveredService(benchmark::State& state) {
+    for (auto _ : state) {
+        report_discovered_service(fixture().handle, "esp32._osc._udp.local.", "_osc._udp.local.",
+                                  "10.0.0.2", 8000, 60);
+    }
+}
+BENCHMARK(BM_ReportDiscoveredService);
+
+} // namespace
@@ -0,0 +1,255 @@
+//! Benchmarky parsování RTP paketů, MIDI zpráv a recovery journalu.
+//!
+//! Spuštění: `cargo bench -p rtp_midi_core`; porovnání s baseline viz
+//! `benches/compare.py`.
+
+use bytes::Bytes;
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use rtp_midi_core::journal_engine::TimedMidiCommand;
+use rtp_midi_core::trace::{self, Stage};
+use rtp_midi_core::{
+    midi_command_length, parse_command_section, parse_midi_message, parse_rtp_packet, InputEvent,
+    JournalData, JournalEntry, Mapping, MidiBatch, MidiCommand, MidiEvent, SysexArena,
+};
+use std::hint::black_box;
+
+/// RTP header (V=2, PT=97) followed by `commands` three-byte Note On messages.
+fn rtp_packet(commands: usize) -> Vec<u8> {
+    let mut packet = vec![
+        0x80, 0x61, 0x12, 0x34, 0, 0, 0x10, 0, 0xAA, 0xBB, 0xCC, 0xDD,
+    ];
+    packet.push((commands * 3).min(0x0F) as u8);
+    for i in 0..commands {
+        packet.extend_from_slice(&[0x90, 60 + i as u8, 100]);
+    }
+    packet
+}
+
+fn journal_entry(sequence_nr: u16, commands: usize) -> JournalEntry {
+    JournalEntry {
+        sequence_nr,
+        commands: (0..commands)
+            .map(|i| TimedMidiCommand {
+                delta_time: i as u32 * 10,
+                command: MidiCommand::NoteOn {
+                    channel: 0,
+                    key: 60 + i as u8,
+                    velocity: 100,
+                },
+            })
+            .collect(),
+    }
+}
+
+fn journal(entries: usize) -> JournalData {
+    JournalData::Enhanced {
+        a_bit: false,
+        ch_bits: 0,
+        checkpoint_sequence_number: 0,
+        entries: (0..entries).map(|i| journal_entry(i as u16, 4)).collect(),
+    }
+}
+
+fn bench_parse_rtp_packet(c: &mut Criterion) {
+    let mut group = c.benchmark_group("parse_rtp_packet");
+    for commands in [1usize, 5] {
+        let packet = rtp_packet(commands);
+        group.throughput(Throughput::Bytes(packet.len() as u64));
+        group.bench_with_input(
+            BenchmarkId::from_parameter(commands),
+            &packet,
+            |b, packet| b.iter(|| parse_rtp_packet(black_box(packet)).unwrap()),
+        );
+    }
+    group.finish();
+}
+
+fn bench_parse_midi_message(c: &mut Criterion) {
+    let mut group = c.benchmark_group("parse_midi_message");
+    let messages: [(&str, &[u8]); 3] = [
+        ("note_on", &[0x90, 60, 100]),
+        ("program_change", &[0xC0, 5]),
+        ("sysex", &[0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7]),
+    ];
+    for (name, data) in messages {
+        group.bench_with_input(BenchmarkId::from_parameter(name), data, |b, data| {
+            b.iter(|| parse_midi_message(black_box(data)).unwrap())
+        });
+    }
+    group.finish();
+}
+
+fn bench_journal(c: &mut Criterion) {
+    let mut group = c.benchmark_group("journal");
+    let entry = journal_entry(1, 8);
+    let entry_bytes = entry.serialize().unwrap();
+    group.bench_function("entry_serialize", |b| {
+        b.iter(|| black_box(&entry).serialize().unwrap())
+    });
+    group.bench_function("entry_parse", |b| {
+        b.iter(|| JournalEntry::parse(&mut black_box(entry_bytes.clone())).unwrap())
+    });
+
+    for entries in [1usize, 16] {
+        let data = journal(entries);
+        group.bench_with_input(
+            BenchmarkId::new("data_serialize", entries),
+            &data,
+            |b, data| b.iter(|| black_box(data).serialize_enhanced().unwrap()),
+        );
+    }
+    for entries in [1usize, 16] {
+        let bytes: Bytes = journal(entries).serialize_enhanced().unwrap();
+        group.bench_with_input(
+            BenchmarkId::new("data_parse", entries),
+            &bytes,
+            |b, bytes| {
+                b.iter(|| JournalData::parse_enhanced(&mut black_box(bytes.clone())).unwrap())
+            },
+        );
+    }
+    group.finish();
+}
+
+/// Proud `count` Note On / CC zpráv, jak přichází v MIDI sekci paketu.
+fn midi_stream(count: usize) -> Vec<u8> {
+    (0..count)
+        .flat_map(|i| {
+            if i % 4 == 3 {
+                [0xB0, 64, 127]
+            } else {
+                [0x90, 60 + (i % 12) as u8, 100]
+            }
+        })
+        .collect()
+}
+
+/// Cesta od MIDI bajtů k vyhodnocení mappingu: původní `Vec<u8>` na zprávu +
+/// `parse_midi_message` proti zabalenému `MidiEvent` bez alokací.
+fn bench_event_path(c: &mut Criterion) {
+    let mut group = c.benchmark_group("event_path");
+    let mapping = Mapping {
+        input: InputEvent::MidiNoteOn {
+            note: Some(60),
+            velocity: None,
+        },
+        output: Vec::new(),
+    };
+    for count in [16usize] {
+        let stream = midi_stream(count);
+        group.throughput(Throughput::Elements(count as u64));
+        group.bench_with_input(
+            BenchmarkId::new("legacy_vec", count),
+            &stream,
+            |b, stream| {
+                b.iter(|| {
+                    // Session -> bus -> mapping: one owned buffer per message.
+                    let mut received: Vec<(u64, Vec<u8>)> = Vec::new();
+                    let mut rest = &black_box(stream)[..];
+                    while !rest.is_empty() {
+                        let (_, len) = parse_midi_message(rest).unwrap();
+                        received.push((0, rest[..len].to_vec()));
+                        rest = &rest[len..];
+                    }
+                    received
+                        .iter()
+                        .filter(|(_, bytes)| {
+                            let (command, _) = parse_midi_message(bytes).unwrap();
+                            mapping.matches_midi_command(&command)
+                        })
+                        .count()
+                })
+            },
+        );
+        let mut events = Vec::with_capacity(count);
+        let mut sysex = SysexArena::new();
+        group.bench_with_input(BenchmarkId::new("packed", count), &stream, |b, stream| {
+            b.iter(|| {
+                events.clear();
+                sysex.clear();
+                let mut rest = &black_box(stream)[..];
+                while let Some((event, len)) = MidiEvent::decode(rest, 0, &mut sysex) {
+                    events.push(event);
+                    rest = &rest[len..];
+                }
+                events.iter().filter(|e| mapping.matches_event(e)).count()
+            })
+        });
+    }
+    group.finish();
+}
+
+/// Command section s `count` příkazy, každý s jednobajtovým delta časem.
+fn command_section(count: usize) -> Vec<u8> {
+    let mut section = Vec::new();
+    for (i, bytes) in midi_stream(count).chunks(3).enumerate() {
+        section.push((i % 3) as u8);
+        section.extend_from_slice(bytes);
+    }
+    section
+}
+
+/// Celá command section: zpráva po zprávě přes `parse_midi_message` proti
+/// jednoprůchodovému `parse_command_section` do SoA sloupců.
+fn bench_command_section(c: &mut Criterion) {
+    let mut group = c.benchmark_group("command_section");
+    for count in [16usize, 128] {
+        let section = command_section(count);
+        group.throughput(Throughput::Elements(count as u64));
+        group.bench_with_input(
+            BenchmarkId::new("per_message", count),
+            &section,
+            |b, section| {
+                b.iter(|| {
+                    let section = black_box(&section[..]);
+                    let mut commands = Vec::new();
+                    let mut pos = 0;
+                    while pos < section.len() {
+                        let delta = section[pos] as u32;
+                        pos += 1;
+                        let len = midi_command_length(section[pos]).unwrap();
+                        let (command, _) = parse_midi_message(&section[pos..pos + len]).unwrap();
+                        commands.push((delta, command));
+                        pos += len;
+                    }
+                    commands
+                })
+            },
+        );
+        let mut batch = MidiBatch::with_capacity(count);
+        group.bench_with_input(BenchmarkId::new("batch", count), &section, |b, section| {
+            b.iter(|| {
+                batch.clear();
+                parse_command_section(black_box(section), &mut batch).unwrap()
+            })
+        });
+    }
+    group.finish();
+}
+
+/// Cena jednoho spanu s vypnutým a zapnutým tracingem.
+fn bench_trace_span(c: &mut Criterion) {
+    let mut group = c.benchmark_group("trace_span");
+    trace::set_enabled(false);
+    group.bench_function("disabled", |b| {
+        b.iter(|| drop(trace::span(Stage::Mapping, black_box(1))))
+    });
+    trace::set_enabled(true);
+    group.bench_function("enabled", |b| {
+        b.iter(|| drop(trace::span(Stage::Mapping, black_box(1))))
+    });
+    trace::set_enabled(false);
+    trace::clear();
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_parse_rtp_packet,
+    bench_parse_midi_message,
+    bench_journal,
+    bench_event_path,
+    bench_command_section,
+    bench_trace_span
+);
+criterion_main!(benches);
@@ -0,0 +1,200 @@
+//! Audio/visual latency alignment.
+//!
+//! Audio-reactive light lags the sound by the capture buffer plus the
+//! analysis window, and the lag changes with `audio_buffer_size`; MIDI-driven
+//! light follows its events almost immediately. `AvSync` measures the audio
+//! path (capture of a buffer's first sample until its analysis is done) as a
+//! running average and, in `DelayMidi` mode, holds MIDI-driven output back by
+//! the same amount so combined scenes line up.
+//!
+//! The MIDI delay only moves when the measured delay drifts more than
+//! `tolerance_ms` away from it, so jitter of single buffers does not make
+//! note envelopes wobble. All state is atomic: the audio path writes, the
+//! frame clock and the FFI (Qt/Android UIs) read from any thread.
+
+use serde::Deserialize;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+
+/// How `AvSync` aligns the two paths.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Deserialize)]
+#[serde(rename_all = "snake_case")]
+pub enum AvSyncMode {
+    /// Only measure; MIDI output is not delayed.
+    #[default]
+    Off,
+    /// Delay MIDI-driven output by the measured audio delay.
+    DelayMidi,
+}
+
+/// `[av_sync]` section of the config.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Deserialize)]
+#[serde(default)]
+pub struct AvSyncConfig {
+    pub mode: AvSyncMode,
+    /// Allowed misalignment before the MIDI delay is adjusted.
+    pub tolerance_ms: u64,
+    /// Upper bound of the MIDI delay.
+    pub max_delay_ms: u64,
+}
+
+impl Default for AvSyncConfig {
+    fn default() -> Self {
+        Self {
+            mode: AvSyncMode::Off,
+            tolerance_ms: 5,
+            max_delay_ms: 200,
+        }
+    }
+}
+
+// Weight of a new measurement in the running average (1/8).
+const AVERAGE_SHIFT: u32 = 3;
+
+/// Measured audio delay and the MIDI delay applied against it.
+pub struct AvSync {
+    delay_midi: AtomicBool,
+    tolerance_us: AtomicU64,
+    max_delay_us: AtomicU64,
+    audio_delay_us: AtomicU64,
+    midi_delay_us: AtomicU64,
+    measurements: AtomicU64,
+}
+
+static GLOBAL: AvSync = AvSync::new();
+
+/// Process-wide instance fed by the service loop and read by the FFI.
+pub fn global() -> &'static AvSync {
+    &GLOBAL
+}
+
+impl AvSync {
+    pub const fn new() -> Self {
+        Self {
+            delay_midi: AtomicBool::new(false),
+            tolerance_us: AtomicU64::new(5_000),
+            max_delay_us: AtomicU64::new(200_000),
+            audio_delay_us: AtomicU64::new(0),
+            midi_delay_us: AtomicU64::new(0),
+            measurements: AtomicU64::new(0),
+        }
+    }
+
+    /// Applies a configuration and restarts the measurement.
+    pub fn configure(&self, config: &AvSyncConfig) {
+        self.delay_midi
+            .store(config.mode == AvSyncMode::DelayMidi, Ordering::Relaxed);
+        self.tolerance_us
+            .store(config.tolerance_ms * 1_000, Ordering::Relaxed);
+        self.max_delay_us
+            .store(config.max_delay_ms * 1_000, Ordering::Relaxed);
+        self.audio_delay_us.store(0, Ordering::Relaxed);
+        self.midi_delay_us.store(0, Ordering::Relaxed);
+        self.measurements.store(0, Ordering::Relaxed);
+    }
+
+    /// Records one analysed audio buffer: its first sample was captured at
+    /// `captured_us`, the analysis finished at `analysed_us` (both on the
+    /// same `Clock`). Called from a single thread.
+    pub fn record_audio(&self, captured_us: u64, analysed_us: u64) {
+        let sample = analysed_us.saturating_sub(captured_us);
+        let average = if self.measurements.fetch_add(1, Ordering::Relaxed) == 0 {
+            sample
+        } else {
+            let old = self.audio_delay_us.load(Ordering::Relaxed);
+            old - (old >> AVERAGE_SHIFT) + (sample >> AVERAGE_SHIFT)
+        };
+        self.audio_delay_us.store(average, Ordering::Relaxed);
+
+        let target = if self.delay_midi.load(Ordering::Relaxed) {
+            average.min(self.max_delay_us.load(Ordering::Relaxed))
+        } else {
+            0
+        };
+        let current = self.midi_delay_us.load(Ordering::Relaxed);
+        if target.abs_diff(current) > self.tolerance_us.load(Ordering::Relaxed) || target == 0 {
+            self.midi_delay_us.store(target, Ordering::Relaxed);
+        }
+    }
+
+    /// Average capture-to-analysis delay of the audio path (µs).
+    pub fn audio_delay_us(&self) -> u64 {
+        self.audio_delay_us.load(Ordering::Relaxed)
+    }
+
+    /// Delay currently applied to MIDI-driven output (µs).
+    pub fn midi_delay_us(&self) -> u64 {
+        self.midi_delay_us.load(Ordering::Relaxed)
+    }
+
+    /// Remaining lag of audio-driven behind MIDI-driven light (µs);
+    /// within ±tolerance once aligned, the full audio delay when off.
+    pub fn offset_us(&self) -> i64 {
+        self.audio_delay_us() as i64 - self.midi_delay_us() as i64
+    }
+}
+
+impl Default for AvSync {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn delay_midi(tolerance_ms: u64, max_delay_ms: u64) -> AvSync {
+        let sync = AvSync::new();
+        sync.configure(&AvSyncConfig {
+            mode: AvSyncMode::DelayMidi,
+            tolerance_ms,
+            max_delay_ms,
+        });
+        sync
+    }
+
+    #[test]
+    fn midi_delay_follows_audio_within_tolerance() {
+        let sync = delay_midi(5, 200);
+        sync.record_audio(0, 30_000);
+        assert_eq!(
+            (sync.audio_delay_us(), sync.midi_delay_us()),
+            (30_000, 30_000)
+        );
+
+        // Jitter inside the tolerance leaves the MIDI delay alone.
+        for i in 0..20u64 {
+            sync.record_audio(i * 1_000, i * 1_000 + 30_000 + (i % 3) * 1_000);
+        }
+        assert_eq!(sync.midi_delay_us(), 30_000);
+        assert!(sync.offset_us().abs() <= 5_000);
+
+        // A bigger audio buffer moves it once the average drifts away.
+        for i in 0..40u64 {
+            sync.record_audio(i, i + 60_000);
+        }
+        assert!(sync.midi_delay_us() > 50_000, "{}", sync.midi_delay_us());
+        assert!(sync.offset_us().abs() <= 5_000);
+    }
+
+    #[test]
+    fn delay_is_capped_and_off_mode_only_measures() {
+        let sync = delay_midi(5, 50);
+        sync.record_audio(0, 120_000);
+        assert_eq!(sync.midi_delay_us(), 50_000);
+        assert_eq!(sync.offset_us(), 70_000);
+
+        sync.configure(&AvSyncConfig::default());
+        sync.record_audio(0, 40_000);
+        assert_eq!((sync.audio_delay_us(), sync.midi_delay_us()), (40_000, 0));
+        assert_eq!(sync.offset_us(), 40_000);
+    }
+
+    #[test]
+    fn config_section_parses() {
+        let config: AvSyncConfig =
+            toml::from_str("mode = \"delay_midi\"\ntolerance_ms = 8").unwrap();
+        assert_eq!(config.mode, AvSyncMode::DelayMidi);
+        assert_eq!((config.tolerance_ms, config.max_delay_ms), (8, 200));
+    }
+}
@@ -0,0 +1,377 @@
+//! Process-wide monotonic time base and the injectable `Clock`.
+//!
+//! All timestamps exchanged inside the hub (packet arrival, MIDI event times,
+//! clock-sync results) are microseconds on this single monotonic clock, so
+//! they can be compared across tasks without touching wall-clock time.
+//!
+//! Components that pace themselves (the service loop, the LED frame clock,
+//! the session host) take a `SharedClock` instead of reading the time and
+//! sleeping directly. Live runs use `SystemClock`; tests and benchmarks use
+//! `VirtualClock`, which only moves when told to and then jumps straight
+//! from one sleeper's deadline to the next, so a minute of service time
+//! runs as fast as the CPU allows and in the same order every time.
+
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::{Arc, Condvar, Mutex, OnceLock};
+use std::thread;
+use std::time::{Duration, Instant};
+use tokio::sync::watch;
+
+static ANCHOR: OnceLock<Instant> = OnceLock::new();
+
+fn anchor() -> Instant {
+    *ANCHOR.get_or_init(Instant::now)
+}
+
+/// Microseconds elapsed on the process monotonic clock.
+pub fn monotonic_us() -> u64 {
+    anchor().elapsed().as_micros() as u64
+}
+
+/// Future returned by `Clock::sleep_until_async`.
+pub type ClockSleep = Pin<Box<dyn Future<Output = ()> + Send>>;
+
+/// Clock shared by the components of one service instance.
+pub type SharedClock = Arc<dyn Clock>;
+
+/// Source of time and sleeps, all in µs on one monotonic time base.
+///
+/// Sleeps may return early after `wake` (used on shutdown), so callers
+/// re-check the time or their stop flag.
+pub trait Clock: Send + Sync + std::fmt::Debug {
+    fn now_us(&self) -> u64;
+
+    /// Blocks the calling thread until `deadline_us`.
+    fn sleep_until_us(&self, deadline_us: u64);
+
+    /// Waits until `deadline_us` without blocking the runtime.
+    fn sleep_until_async(&self, deadline_us: u64) -> ClockSleep;
+
+    /// Registers a thread or task that blocks only by sleeping on this clock
+    /// (see `ClockAttachment`).
+    fn attach(&self) {}
+
+    fn detach(&self) {}
+
+    /// Wakes every sleeper right away.
+    fn wake(&self) {}
+}
+
+/// The real monotonic clock (`monotonic_us`).
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SystemClock;
+
+// The last stretch before a deadline is spent yielding instead of sleeping;
+// OS sleeps overshoot by up to a scheduler tick.
+const SPIN_MARGIN_US: u64 = 500;
+
+impl Clock for SystemClock {
+    fn now_us(&self) -> u64 {
+        monotonic_us()
+    }
+
+    fn sleep_until_us(&self, deadline_us: u64) {
+        loop {
+            let left = deadline_us.saturating_sub(monotonic_us());
+            if left == 0 {
+                return;
+            }
+            if left > SPIN_MARGIN_US {
+                thread::sleep(Duration::from_micros(left - SPIN_MARGIN_US));
+            } else {
+                thread::yield_now();
+            }
+        }
+    }
+
+    fn sleep_until_async(&self, deadline_us: u64) -> ClockSleep {
+        let left = Duration::from_micros(deadline_us.saturating_sub(monotonic_us()));
+        Box::pin(tokio::time::sleep(left))
+    }
+}
+
+/// The real clock as a `SharedClock`.
+pub fn system_clock() -> SharedClock {
+    Arc::new(SystemClock)
+}
+
+/// Keeps a thread or task attached to a clock until dropped.
+///
+/// A `VirtualClock` only moves on while every attached thread and task is
+/// asleep on it, so each of them finishes its work for one instant before
+/// the next. Attach before spawning (the guard moves into the thread), or
+/// the clock may run ahead before the thread first sleeps.
+pub struct ClockAttachment(SharedClock);
+
+impl ClockAttachment {
+    pub fn new(clock: &SharedClock) -> Self {
+        clock.attach();
+        Self(clock.clone())
+    }
+}
+
+impl Drop for ClockAttachment {
+    fn drop(&mut self) {
+        self.0.detach();
+    }
+}
+
+#[derive(Debug, Default)]
+struct VirtualState {
+    now_us: u64,
+    attached: usize,
+    // Deadlines of current sleepers.
+    sleeping: Vec<u64>,
+    // Bumped by `wake`; sleepers of an older generation return.
+    generation: u64,
+}
+
+impl VirtualState {
+    // Sleepers still waiting; the ones whose deadline has come are awake
+    // even before they take themselves off the list.
+    fn asleep(&self) -> usize {
+        self.sleeping.iter().filter(|&&d| d > self.now_us).count()
+    }
+
+    fn leave(&mut self, deadline_us: u64) {
+        if let Some(at) = self.sleeping.iter().position(|&d| d == deadline_us) {
+            self.sleeping.swap_remove(at);
+        }
+    }
+}
+
+#[derive(Debug)]
+struct VirtualInner {
+    state: Mutex<VirtualState>,
+    changed: Condvar,
+    // (now, generation) for async sleepers.
+    time: watch::Sender<(u64, u64)>,
+}
+
+impl VirtualInner {
+    fn publish(&self, state: &VirtualState) {
+        self.time.send_replace((state.now_us, state.generation));
+        self.changed.notify_all();
+    }
+}
+
+// Takes an async sleeper off the list when it finishes or is cancelled.
+struct AsyncSleeper {
+    inner: Arc<VirtualInner>,
+    deadline_us: u64,
+}
+
+impl Drop for AsyncSleeper {
+    fn drop(&mut self) {
+        let mut state = self.inner.state.lock().unwrap();
+        state.leave(self.deadline_us);
+        self.inner.changed.notify_all();
+    }
+}
+
+/// Manually driven clock for deterministic, faster-than-real-time runs.
+///
+/// Time stands still until `advance`/`advance_to`, which step from one
+/// sleeper deadline to the next and at each step wait until all attached
+/// threads and tasks sleep again. Call them from a thread that is not a
+/// runtime worker the attached tasks need (e.g. `spawn_blocking`).
+#[derive(Debug, Clone)]
+pub struct VirtualClock {
+    inner: Arc<VirtualInner>,
+}
+
+impl VirtualClock {
+    pub fn new(start_us: u64) -> Self {
+        Self {
+            inner: Arc::new(VirtualInner {
+                state: Mutex::new(VirtualState {
+                    now_us: start_us,
+                    ..Default::default()
+                }),
+                changed: Condvar::new(),
+                time: watch::channel((start_us, 0)).0,
+            }),
+        }
+    }
+
+    /// This clock as a `SharedClock`.
+    pub fn shared(&self) -> SharedClock {
+        Arc::new(self.clone())
+    }
+
+    /// Moves time forward by `us`; see `advance_to`.
+    pub fn advance(&self, us: u64) {
+        let target_us = self.now_us() + us;
+        self.advance_to(target_us);
+    }
+
+    /// Moves time to `target_us` through every sleeper deadline on the way
+    /// and returns once all attached sleepers wait beyond it.
+    pub fn advance_to(&self, target_us: u64) {
+        let inner = &self.inner;
+        let mut state = inner.state.lock().unwrap();
+        loop {
+            while state.asleep() < state.attached {
+                state = inner.changed.wait(state).unwrap();
+            }
+            if state.now_us >= target_us {
+                return;
+            }
+            let now_us = state.now_us;
+            let next_us = state.sleeping.iter().copied().filter(|&d| d > now_us).min();
+            state.now_us = next_us.map_or(target_us, |d| d.min(target_us));
+            inner.publish(&state);
+        }
+    }
+
+    /// Blocks until at least `count` threads and tasks are attached and all
+    /// of them sleep, e.g. until a service under test has started.
+    pub fn wait_for_sleepers(&self, count: usize) {
+        let inner = &self.inner;
+        let mut state = inner.state.lock().unwrap();
+        while state.attached < count || state.asleep() < state.attached {
+            state = inner.changed.wait(state).unwrap();
+        }
+    }
+}
+
+impl Clock for VirtualClock {
+    fn now_us(&self) -> u64 {
+        self.inner.state.lock().unwrap().now_us
+    }
+
+    fn sleep_until_us(&self, deadline_us: u64) {
+        let inner = &self.inner;
+        let mut state = inner.state.lock().unwrap();
+        let generation = state.generation;
+        if state.now_us >= deadline_us {
+            return;
+        }
+        state.sleeping.push(deadline_us);
+        inner.changed.notify_all();
+        while state.now_us < deadline_us && state.generation == generation {
+            state = inner.changed.wait(state).unwrap();
+        }
+        state.leave(deadline_us);
+        inner.changed.notify_all();
+    }
+
+    fn sleep_until_async(&self, deadline_us: u64) -> ClockSleep {
+        let inner = self.inner.clone();
+        Box::pin(async move {
+            let (mut time, generation) = {
+                let mut state = inner.state.lock().unwrap();
+                if state.now_us >= deadline_us {
+                    return;
+                }
+                state.sleeping.push(deadline_us);
+                inner.changed.notify_all();
+                (inner.time.subscribe(), state.generation)
+            };
+            let _sleeper = AsyncSleeper {
+                inner: inner.clone(),
+                deadline_us,
+            };
+            let _ = time
+                .wait_for(|&(now_us, g)| now_us >= deadline_us || g != generation)
+                .await;
+        })
+    }
+
+    fn attach(&self) {
+        self.inner.state.lock().unwrap().attached += 1;
+    }
+
+    fn detach(&self) {
+        let mut state = self.inner.state.lock().unwrap();
+        state.attached = state.attached.saturating_sub(1);
+        self.inner.changed.notify_all();
+    }
+
+    fn wake(&self) {
+        let mut state = self.inner.state.lock().unwrap();
+        state.generation += 1;
+        self.inner.publish(&state);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn monotonic_clock_never_goes_back() {
+        let a = monotonic_us();
+        let b = monotonic_us();
+        assert!(b >= a);
+    }
+
+    #[test]
+    fn virtual_clock_steps_through_sleeper_deadlines() {
+        let clock = VirtualClock::new(1_000);
+        let shared = clock.shared();
+        let attachment = ClockAttachment::new(&shared);
+        let ticks = Arc::new(Mutex::new(Vec::new()));
+        let worker = {
+            let (shared, ticks) = (shared.clone(), ticks.clone());
+            thread::spawn(move || {
+                let _attachment = attachment;
+                for tick in 1..=5 {
+                    shared.sleep_until_us(1_000 + tick * 10_000);
+                    ticks.lock().unwrap().push(shared.now_us());
+                }
+            })
+        };
+        // Ten virtual seconds take no real time and stop at every deadline.
+        let started = Instant::now();
+        clock.advance(10_000_000);
+        worker.join().unwrap();
+        assert!(started.elapsed() < Duration::from_secs(1));
+        assert_eq!(
+            *ticks.lock().unwrap(),
+            vec![11_000, 21_000, 31_000, 41_000, 51_000]
+        );
+        assert_eq!(clock.now_us(), 10_001_000);
+    }
+
+    #[test]
+    fn wake_interrupts_sleepers() {
+        let clock = VirtualClock::new(0);
+        let shared = clock.shared();
+        let sleeper = {
+            let shared = shared.clone();
+            thread::spawn(move || shared.sleep_until_us(u64::MAX))
+        };
+        while clock.inner.state.lock().unwrap().sleeping.is_empty() {
+            thread::yield_now();
+        }
+        shared.wake();
+        sleeper.join().unwrap();
+        assert_eq!(clock.now_us(), 0);
+    }
+
+    #[tokio::test(flavor = "multi_thread", worker_threads = 2)]
+    async fn async_sleepers_follow_virtual_time() {
+        let clock = VirtualClock::new(0);
+        let shared = clock.shared();
+        let attachment = ClockAttachment::new(&shared);
+        let task = tokio::spawn({
+            let shared = shared.clone();
+            async move {
+                let _attachment = attachment;
+                let mut woke = Vec::new();
+                for deadline in [10_000, 20_000, 30_000] {
+                    shared.sleep_until_async(deadline).await;
+                    woke.push(shared.now_us());
+                }
+                woke
+            }
+        });
+        tokio::task::spawn_blocking(move || clock.advance(25_000))
+            .await
+            .unwrap();
+        shared.wake();
+        assert_eq!(task.await.unwrap(), vec![10_000, 20_000, 25_000]);
+    }
+}
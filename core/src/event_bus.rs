@@ -7,6 +7,8 @@ pub enum Event {
     RawPacketReceived {
         payload: Vec<u8>,
         source_addr: std::net::SocketAddr,
+        /// Arrival time on the monotonic clock (µs), kernel-stamped where available.
+        received_at_us: u64,
     },
     SendPacket {
         payload: Vec<u8>,
@@ -18,11 +20,6 @@ pub enum Event {
     SessionTerminated {
         peer: std::net::SocketAddr,
     },
-    MidiCommandsReceived {
-        commands: Vec<u8>,
-        timestamp: u64,
-        peer: std::net::SocketAddr,
-    },
     JournalReceived {
         journal_data: Vec<u8>,
         peer: std::net::SocketAddr,
@@ -47,7 +44,14 @@ pub enum Event {
         message: Vec<u8>,
         peer: std::net::SocketAddr,
     },
-    AudioDataReady(Vec<f32>),
+    AudioDataReady {
+        /// Interleaved samples, `channels` per frame.
+        samples: Vec<f32>,
+        sample_rate: u32,
+        channels: u16,
+        /// Capture time of the first sample on the service's clock (µs).
+        captured_us: u64,
+    },
     SyncStatusChanged {
         peer: std::net::SocketAddr,
     },
@@ -63,14 +63,13 @@ impl JournalEntry {
 
         let mut commands = Vec::new();
         while data.has_remaining() {
-            let (delta_time, delta_len) = parse_variable_length_quantity(data)?;
-            data.advance(delta_len); // Consume VLQ bytes
+            // parse_variable_length_quantity already consumes the VLQ bytes
+            let (delta_time, _) = parse_variable_length_quantity(data)?;
 
             if !data.has_remaining() {
                 break;
             }
-            let status_byte = data[0];
-            let command_len = midi_command_length(status_byte)?;
+            let command_len = command_length(data)?;
             if data.remaining() < command_len {
                 return Err(anyhow!("Not enough data for MIDI command in journal entry"));
             }
@@ -105,8 +104,15 @@ impl JournalData {
         buf.put_u8(*checkpoint_sequence_number);
         buf.put_u16(entries.len() as u16); // Count of packets in journal
 
+        // Entries are prefixed with their length: commands carry no
+        // terminator, so without it only the last entry could be delimited.
         for entry in entries {
-            buf.put_slice(&entry.serialize()?);
+            let bytes = entry.serialize()?;
+            if bytes.len() > u16::MAX as usize {
+                return Err(anyhow!("Journal entry too long"));
+            }
+            buf.put_u16(bytes.len() as u16);
+            buf.put_slice(&bytes);
         }
         Ok(buf.freeze())
     }
@@ -127,9 +133,16 @@ impl JournalData {
         let checkpoint_sequence_number = data.get_u8();
         let entry_count = data.get_u16() as usize;
 
-        let mut entries = Vec::with_capacity(entry_count);
+        let mut entries = Vec::with_capacity(entry_count.min(data.len() / 4));
         for _ in 0..entry_count {
-            entries.push(JournalEntry::parse(data)?);
+            if data.remaining() < 2 {
+                return Err(anyhow!("Journal entry length missing"));
+            }
+            let len = data.get_u16() as usize;
+            if data.remaining() < len {
+                return Err(anyhow!("Journal entry truncated"));
+            }
+            entries.push(JournalEntry::parse(&mut data.split_to(len))?);
         }
 
         Ok(JournalData::Enhanced {
@@ -156,6 +169,20 @@ pub fn process_journal(journal_data: &JournalData, history: &mut BTreeSet<u16>)
     }
 }
 
+/// Length of the MIDI command at the start of `data`; SysEx runs up to and
+/// including its F7.
+pub fn command_length(data: &[u8]) -> Result<usize> {
+    match data.first() {
+        None => Err(anyhow!("Empty MIDI command")),
+        Some(0xF0) => data
+            .iter()
+            .position(|&b| b == 0xF7)
+            .map(|end| end + 1)
+            .ok_or_else(|| anyhow!("Unterminated SysEx")),
+        Some(&status) => midi_command_length(status),
+    }
+}
+
 // Helper functions (could be moved to rtp_midi_utils if truly generic)
 
 fn parse_variable_length_quantity(data: &mut Bytes) -> Result<(u32, usize)> {
@@ -276,3 +303,83 @@ pub fn serialize_midi_command(cmd: &MidiCommand, out: &mut Vec<u8>) -> Result<()
     }
     Ok(())
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entry(sequence_nr: u16, keys: &[u8]) -> JournalEntry {
+        JournalEntry {
+            sequence_nr,
+            commands: keys
+                .iter()
+                .map(|&key| TimedMidiCommand {
+                    delta_time: key as u32,
+                    command: MidiCommand::NoteOn {
+                        channel: 1,
+                        key,
+                        velocity: 90,
+                    },
+                })
+                .collect(),
+        }
+    }
+
+    #[test]
+    fn multi_entry_journal_roundtrip() {
+        let journal = JournalData::Enhanced {
+            a_bit: false,
+            ch_bits: 0,
+            checkpoint_sequence_number: 7,
+            entries: vec![entry(7, &[60, 64]), entry(8, &[]), entry(9, &[67])],
+        };
+        let mut bytes = journal.serialize_enhanced().unwrap();
+        let JournalData::Enhanced { entries, .. } =
+            JournalData::parse_enhanced(&mut bytes).unwrap();
+        assert_eq!(
+            entries,
+            vec![entry(7, &[60, 64]), entry(8, &[]), entry(9, &[67])]
+        );
+        assert!(bytes.is_empty());
+    }
+
+    #[test]
+    fn sysex_in_entry_is_delimited_by_f7() {
+        // seq 3, SysEx, then a note
+        let mut bytes = Bytes::from_static(&[
+            0x00, 0x03, 0x00, 0xF0, 0x7E, 0x01, 0x02, 0xF7, 0x05, 0x90, 60, 100,
+        ]);
+        let entry = JournalEntry::parse(&mut bytes).unwrap();
+        assert_eq!(entry.commands.len(), 2);
+        assert!(matches!(
+            entry.commands[0].command,
+            MidiCommand::SystemExclusive(_)
+        ));
+        assert_eq!(
+            entry.commands[1],
+            TimedMidiCommand {
+                delta_time: 5,
+                command: MidiCommand::NoteOn {
+                    channel: 0,
+                    key: 60,
+                    velocity: 100
+                }
+            }
+        );
+        let mut open = Bytes::from_static(&[0x00, 0x03, 0x00, 0xF0, 0x7E]);
+        assert!(JournalEntry::parse(&mut open).is_err());
+    }
+
+    #[test]
+    fn truncated_journal_is_rejected() {
+        let journal = JournalData::Enhanced {
+            a_bit: false,
+            ch_bits: 0,
+            checkpoint_sequence_number: 0,
+            entries: vec![entry(1, &[60]), entry(2, &[62])],
+        };
+        let bytes = journal.serialize_enhanced().unwrap();
+        let mut truncated = bytes.slice(..bytes.len() - 2);
+        assert!(JournalData::parse_enhanced(&mut truncated).is_err());
+    }
+}
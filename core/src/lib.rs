@@ -15,12 +15,18 @@ mod tests {
     }
 }
 
+pub mod av_sync;
+pub mod clock;
 pub mod event_bus;
 pub mod journal_engine;
 pub mod mapping;
+pub mod midi_batch;
+pub mod midi_event;
 pub mod network_interface;
 pub mod packet_processor;
 pub mod session_manager;
+pub mod smf;
+pub mod trace;
 
 use std::fmt;
 
@@ -123,6 +129,8 @@ fn test_sender_injection() {
 */
 
 pub use crate::journal_engine::{JournalData, JournalEntry};
+pub use crate::midi_batch::{parse_command_section, MidiBatch};
+pub use crate::midi_event::{MidiEvent, SharedSysexArena, SysexArena};
 
 // === Shared Data Models and MIDI Parsing Logic (moved from utils) ===
 
@@ -185,6 +193,85 @@ pub enum WledOutputAction {
     },
 }
 
+/// Pořadí barevných kanálů na cílovém pásku.
+#[derive(Debug, Clone, Copy, Default, Serialize, Deserialize, PartialEq, Eq)]
+#[serde(rename_all = "UPPERCASE")]
+pub enum ColorOrder {
+    #[default]
+    Rgb,
+    Rbg,
+    Grb,
+    Gbr,
+    Brg,
+    Bgr,
+}
+
+impl ColorOrder {
+    /// Reorders an RGB pixel into the strip's wire order.
+    #[inline]
+    pub fn apply(self, [r, g, b]: [u8; 3]) -> [u8; 3] {
+        match self {
+            ColorOrder::Rgb => [r, g, b],
+            ColorOrder::Rbg => [r, b, g],
+            ColorOrder::Grb => [g, r, b],
+            ColorOrder::Gbr => [g, b, r],
+            ColorOrder::Brg => [b, r, g],
+            ColorOrder::Bgr => [b, g, r],
+        }
+    }
+}
+
+/// Korekce barev jednoho výstupu (gamma, vyvážení bílé, RGBW).
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq)]
+#[serde(default)]
+pub struct ColorCorrection {
+    /// Output = input^gamma; WLED and most strips look right around 2.2.
+    pub gamma: f32,
+    /// Per-channel scale (0.0..=1.0) applied after gamma.
+    pub white_balance: [f32; 3],
+    /// Extract the common part of R, G and B into a fourth (white) channel.
+    pub rgbw: bool,
+}
+
+impl Default for ColorCorrection {
+    fn default() -> Self {
+        Self {
+            gamma: 1.0,
+            white_balance: [1.0; 3],
+            rgbw: false,
+        }
+    }
+}
+
+/// Cílové zařízení jednoho segmentu LED plátna.
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
+#[serde(tag = "protocol", rename_all = "lowercase")]
+pub enum OutputTarget {
+    /// WLED (or any DDP receiver); port defaults to 4048.
+    Ddp { ip: String, port: Option<u16> },
+    /// OSC receiver getting the pixels as a `/leds` blob.
+    Osc { address: String },
+    /// ESP32 visualizer over the binary visualizer link (hal-esp32): frames
+    /// plus the live MIDI events; `kbps` caps the board's traffic.
+    Esp32 { address: String, kbps: Option<u32> },
+}
+
+/// Úsek logického LED plátna poslaný na jeden cíl.
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
+pub struct OutputSegment {
+    pub target: OutputTarget,
+    /// First canvas pixel of the segment.
+    pub offset: usize,
+    /// Number of pixels.
+    pub length: usize,
+    #[serde(default)]
+    pub color_order: ColorOrder,
+    #[serde(default)]
+    pub color: ColorCorrection,
+    /// Frame rate cap of this target (default: every canvas frame).
+    pub fps: Option<u32>,
+}
+
 #[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
 pub enum MappingOutput {
     Wled(WledOutputAction),
@@ -229,6 +316,25 @@ impl Mapping {
             _ => false,
         }
     }
+
+    /// Returns true if this mapping matches the given packed event.
+    pub fn matches_event(&self, event: &MidiEvent) -> bool {
+        match &self.input {
+            InputEvent::MidiNoteOn { note, velocity } => {
+                event.kind() == 0x90
+                    && event.message_type() == midi_event::MT_CHANNEL_VOICE
+                    && note.is_none_or(|n| n == event.data1())
+                    && velocity.is_none_or(|v| v == event.data2())
+            }
+            InputEvent::MidiControlChange { controller, value } => {
+                event.kind() == 0xB0
+                    && event.message_type() == midi_event::MT_CHANNEL_VOICE
+                    && controller.is_none_or(|c| c == event.data1())
+                    && value.is_none_or(|v| v == event.data2())
+            }
+            _ => false,
+        }
+    }
 }
 
 #[derive(Debug, Clone)]
@@ -489,6 +595,26 @@ pub struct Config {
     pub audio_smoothing_factor: f32,
     pub webrtc_ice_servers: Option<Vec<String>>,
     pub mapping_preset: Option<String>,
+    /// Analýza audia: "fft" (výchozí, celý buffer) nebo "filterbank"
+    /// (IIR pásma, aktualizace po 64 vzorcích).
+    pub audio_analysis: Option<String>,
+    /// Snímková frekvence LED výstupu (výchozí 60 fps).
+    pub led_fps: Option<u32>,
+    /// Rozdělení plátna (`led_count` pixelů) na více výstupů; bez nich jde
+    /// celé plátno přes DDP na `wled_ip`.
+    pub outputs: Option<Vec<OutputSegment>>,
+    /// Po kolika ms se znovu pošle nezměněný snímek (výchozí 1000).
+    pub led_keepalive_ms: Option<u64>,
+    /// Sladění audio a MIDI řízeného světla (`[av_sync]`, výchozí jen měření).
+    pub av_sync: Option<av_sync::AvSyncConfig>,
+    /// Nahrávání show (MIDI, analýza, LED snímky) do souboru.
+    pub show_record: Option<String>,
+    /// Přehrávání nahrané show místo živého renderu (ve smyčce).
+    pub show_play: Option<String>,
+    /// Počet worker tasků RTP-MIDI session hostu (výchozí: počet jader, max 8).
+    pub midi_workers: Option<usize>,
+    /// Soubor s posledními známými mDNS službami (výchozí: vedle konfigurace).
+    pub discovery_cache_path: Option<String>,
     // Android Hub specific fields
     pub esp32_ip: Option<String>,
     pub esp32_port: Option<u16>,
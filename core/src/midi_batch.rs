@@ -0,0 +1,358 @@
+//! Batch parser for RTP-MIDI command sections.
+//!
+//! `parse_command_section` decodes a whole section (RFC 6295 §3: VLQ delta
+//! time + MIDI command, repeated) in one pass into the columns of a
+//! `MidiBatch`. Unlike `parse_midi_message` it handles running status and
+//! system real-time bytes interleaved inside other commands, and reports a
+//! single error per section instead of one `Result` per message.
+//!
+//! Status bytes are classified by a 256-entry table; the common case (one
+//! byte delta, channel message with all data bytes present) takes a straight
+//! path without per-status matching. Cleared batches keep their capacity, so
+//! a reused batch stops allocating after the first packets.
+
+use crate::midi_event::{midi1_length, MidiEvent, SysexArena};
+use anyhow::{anyhow, Result};
+
+// Class bits of `STATUS_CLASS`; the low two bits hold the data byte count.
+const DATA_BYTES: u8 = 0b0000_0011;
+const CHANNEL: u8 = 0b0000_0100;
+const REALTIME: u8 = 0b0000_1000;
+const SYSEX: u8 = 0b0001_0000;
+const INVALID: u8 = 0b0010_0000;
+
+const fn classify(byte: u8) -> u8 {
+    if byte < 0x80 {
+        return INVALID;
+    }
+    if byte == 0xF0 {
+        return SYSEX;
+    }
+    match midi1_length(byte) {
+        Some(len) => {
+            let data = (len - 1) as u8;
+            if byte < 0xF0 {
+                CHANNEL | data
+            } else if byte >= 0xF8 {
+                REALTIME
+            } else {
+                data
+            }
+        }
+        None => INVALID,
+    }
+}
+
+const fn build_status_class() -> [u8; 256] {
+    let mut table = [0u8; 256];
+    let mut i = 0;
+    while i < 256 {
+        table[i] = classify(i as u8);
+        i += 1;
+    }
+    table
+}
+
+/// Class of every byte in status position (see the bit constants above).
+static STATUS_CLASS: [u8; 256] = build_status_class();
+
+/// Commands of one or more command sections, stored column-wise.
+///
+/// Row `i` is `status[i]`, `data1[i]`, `data2[i]` at `ticks[i]` RTP ticks
+/// after the packet timestamp. SysEx rows have status `0xF0` and carry the
+/// `sysex` arena index in `data1` (high byte) and `data2` (low byte).
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct MidiBatch {
+    pub ticks: Vec<u32>,
+    pub status: Vec<u8>,
+    pub data1: Vec<u8>,
+    pub data2: Vec<u8>,
+    pub sysex: SysexArena,
+}
+
+impl MidiBatch {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn with_capacity(commands: usize) -> Self {
+        Self {
+            ticks: Vec::with_capacity(commands),
+            status: Vec::with_capacity(commands),
+            data1: Vec::with_capacity(commands),
+            data2: Vec::with_capacity(commands),
+            sysex: SysexArena::new(),
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.status.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.status.is_empty()
+    }
+
+    /// Empties all columns, keeping their capacity.
+    pub fn clear(&mut self) {
+        self.ticks.clear();
+        self.status.clear();
+        self.data1.clear();
+        self.data2.clear();
+        self.sysex.clear();
+    }
+
+    /// Row `i` as a packed event stamped with `base_rtp + ticks[i]` (RTP
+    /// timestamp, left for the caller to map onto the local clock).
+    pub fn event(&self, i: usize, base_rtp: u32) -> MidiEvent {
+        let time = base_rtp.wrapping_add(self.ticks[i]) as u64;
+        let (status, data1, data2) = (self.status[i], self.data1[i], self.data2[i]);
+        if status == 0xF0 {
+            MidiEvent::sysex(u16::from_be_bytes([data1, data2]), time)
+        } else {
+            MidiEvent::midi1(status, data1, data2, time)
+        }
+    }
+
+    /// All rows as packed events, see `event`.
+    pub fn events(&self, base_rtp: u32) -> impl Iterator<Item = MidiEvent> + '_ {
+        (0..self.len()).map(move |i| self.event(i, base_rtp))
+    }
+
+    #[inline(always)]
+    fn push(&mut self, ticks: u32, status: u8, data1: u8, data2: u8) {
+        self.ticks.push(ticks);
+        self.status.push(status);
+        self.data1.push(data1);
+        self.data2.push(data2);
+    }
+}
+
+/// Reads a delta time (max. four bytes); returns it with its length.
+#[inline]
+fn read_delta(section: &[u8], pos: usize) -> Result<(u32, usize)> {
+    let mut value = 0u32;
+    for (i, &byte) in section[pos..].iter().take(4).enumerate() {
+        value = (value << 7) | (byte & 0x7F) as u32;
+        if byte & 0x80 == 0 {
+            return Ok((value, i + 1));
+        }
+    }
+    Err(anyhow!(
+        "Incomplete Variable Length Quantity at offset {}",
+        pos
+    ))
+}
+
+/// Decodes a complete command section into `batch` (appending); returns the
+/// number of rows added.
+///
+/// Every command is preceded by its delta time, as written by
+/// `PacketBuilder`. A data byte in status position continues the last
+/// channel status (running status, cancelled by system common messages).
+/// Real-time bytes (`0xF8..=0xFF`) may appear between the bytes of another
+/// command, SysEx included; they become rows of their own at the same time.
+pub fn parse_command_section(section: &[u8], batch: &mut MidiBatch) -> Result<usize> {
+    let start_len = batch.len();
+    let len = section.len();
+    let mut pos = 0;
+    let mut ticks = 0u32;
+    let mut running = 0u8;
+
+    while pos < len {
+        // Delta time: almost always a single byte.
+        let delta = section[pos];
+        if delta < 0x80 {
+            ticks = ticks.wrapping_add(delta as u32);
+            pos += 1;
+        } else {
+            let (delta, delta_len) = read_delta(section, pos)?;
+            ticks = ticks.wrapping_add(delta);
+            pos += delta_len;
+        }
+
+        let Some(&byte) = section.get(pos) else {
+            return Err(anyhow!("Missing MIDI command after delta time"));
+        };
+        let status = if byte < 0x80 {
+            if running == 0 {
+                return Err(anyhow!("Data byte 0x{:02X} without running status", byte));
+            }
+            running
+        } else {
+            pos += 1;
+            byte
+        };
+        let class = STATUS_CLASS[status as usize];
+
+        // Fast path: channel message with its data bytes in place.
+        if class & CHANNEL != 0 {
+            let count = (class & DATA_BYTES) as usize;
+            let data1 = section.get(pos).copied().unwrap_or(0x80);
+            let data2 = if count == 2 {
+                section.get(pos + 1).copied().unwrap_or(0x80)
+            } else {
+                0
+            };
+            if (data1 | data2) & 0x80 == 0 {
+                batch.push(ticks, status, data1, data2);
+                running = status;
+                pos += count;
+                continue;
+            }
+            running = status;
+        } else if class & REALTIME != 0 {
+            batch.push(ticks, status, 0, 0);
+            continue;
+        } else if class & INVALID != 0 {
+            return Err(anyhow!("Unknown MIDI status byte: 0x{:02X}", status));
+        } else {
+            // System common and SysEx cancel running status.
+            running = 0;
+        }
+
+        if class & SYSEX != 0 {
+            pos = parse_sysex(section, pos, ticks, batch)?;
+            continue;
+        }
+
+        // Slow path: data bytes interleaved with real-time bytes.
+        let mut data = [0u8; 2];
+        for slot in data.iter_mut().take((class & DATA_BYTES) as usize) {
+            loop {
+                let Some(&byte) = section.get(pos) else {
+                    return Err(anyhow!("Incomplete MIDI command 0x{:02X}", status));
+                };
+                pos += 1;
+                if byte < 0x80 {
+                    *slot = byte;
+                    break;
+                }
+                if STATUS_CLASS[byte as usize] & REALTIME == 0 {
+                    return Err(anyhow!(
+                        "Status 0x{:02X} inside MIDI command 0x{:02X}",
+                        byte,
+                        status
+                    ));
+                }
+                batch.push(ticks, byte, 0, 0);
+            }
+        }
+        batch.push(ticks, status, data[0], data[1]);
+    }
+
+    Ok(batch.len() - start_len)
+}
+
+// Stores the SysEx starting after the F0 at `pos - 1`; returns the offset
+// after its F7.
+fn parse_sysex(section: &[u8], pos: usize, ticks: u32, batch: &mut MidiBatch) -> Result<usize> {
+    let body = &section[pos..];
+    let Some(end) = body.iter().position(|&b| (0x80..0xF8).contains(&b)) else {
+        return Err(anyhow!("Unterminated SysEx"));
+    };
+    if body[end] != 0xF7 {
+        return Err(anyhow!("SysEx terminated by status 0x{:02X}", body[end]));
+    }
+    let payload = &body[..end];
+    let index = if payload.iter().all(|&b| b < 0x80) {
+        batch.sysex.push_payload(payload)
+    } else {
+        // Real-time bytes inside the SysEx: emit them, keep them out of the payload.
+        for &byte in payload.iter().filter(|&&b| b >= 0x80) {
+            batch.push(ticks, byte, 0, 0);
+        }
+        batch
+            .sysex
+            .push_payload_iter(payload.iter().copied().filter(|&b| b < 0x80))
+    }
+    .ok_or_else(|| anyhow!("SysEx arena full"))?;
+    let [hi, lo] = index.to_be_bytes();
+    batch.push(ticks, 0xF0, hi, lo);
+    Ok(pos + end + 1)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn rows(batch: &MidiBatch) -> Vec<(u32, u8, u8, u8)> {
+        (0..batch.len())
+            .map(|i| {
+                (
+                    batch.ticks[i],
+                    batch.status[i],
+                    batch.data1[i],
+                    batch.data2[i],
+                )
+            })
+            .collect()
+    }
+
+    #[test]
+    fn running_status_and_deltas() {
+        // Note On, running-status Note On after 10 ticks, long delta, Program Change.
+        let section = [
+            0x00, 0x90, 60, 100, 0x0A, 62, 90, 0x81, 0x00, 0xC1, 5, 0x00, 7,
+        ];
+        let mut batch = MidiBatch::new();
+        assert_eq!(parse_command_section(&section, &mut batch).unwrap(), 4);
+        assert_eq!(
+            rows(&batch),
+            vec![
+                (0, 0x90, 60, 100),
+                (10, 0x90, 62, 90),
+                (138, 0xC1, 5, 0),
+                (138, 0xC1, 7, 0),
+            ]
+        );
+        let event = batch.event(1, 1000);
+        assert!(event.is_note_on());
+        assert_eq!((event.data1(), event.time_us), (62, 1010));
+    }
+
+    #[test]
+    fn interleaved_realtime_and_sysex() {
+        let section = [
+            0x00, 0xB0, 0xF8, 64, 127, // clock between status and data
+            0x00, 0xFA, // Start keeps running status
+            0x05, 7, 0, // running-status CC
+            0x00, 0xF0, 0x7E, 0xFE, 0x01, 0xF7, // active sensing inside SysEx
+        ];
+        let mut batch = MidiBatch::with_capacity(8);
+        parse_command_section(&section, &mut batch).unwrap();
+        assert_eq!(
+            rows(&batch),
+            vec![
+                (0, 0xF8, 0, 0),
+                (0, 0xB0, 64, 127),
+                (0, 0xFA, 0, 0),
+                (5, 0xB0, 7, 0),
+                (5, 0xFE, 0, 0),
+                (5, 0xF0, 0, 0),
+            ]
+        );
+        let sysex = batch.event(5, 0);
+        assert_eq!(sysex.sysex_index(), Some(0));
+        assert_eq!(batch.sysex.get(0), Some(&[0xF0, 0x7E, 0x01, 0xF7][..]));
+    }
+
+    #[test]
+    fn malformed_sections_fail() {
+        let mut batch = MidiBatch::new();
+        for section in [
+            &[0x00, 60, 100][..],            // data without running status
+            &[0x00, 0x90, 60],               // truncated
+            &[0x00, 0xF0, 0x01],             // unterminated SysEx
+            &[0x00, 0xF2, 0, 0, 0x00, 1, 2], // system common cancels running status
+            &[0x80, 0x80, 0x80, 0x80, 0x90], // delta longer than four bytes
+            &[0x00, 0xF4],                   // undefined status
+        ] {
+            batch.clear();
+            assert!(
+                parse_command_section(section, &mut batch).is_err(),
+                "{section:02X?}"
+            );
+        }
+    }
+}
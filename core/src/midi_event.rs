@@ -0,0 +1,455 @@
+//! Packed MIDI event modelled on the MIDI 2.0 Universal MIDI Packet (UMP).
+//!
+//! One MIDI 1.0 message fits a single 32-bit UMP word:
+//!
+//! ```text
+//! | type (4) | group (4) | status (8) | data1 (8) | data2 (8) |
+//! ```
+//!
+//! `MidiEvent` pairs that word with a monotonic timestamp, is `Copy` and
+//! 16 bytes large, so events move through the pipeline without a heap
+//! allocation per message. SysEx does not fit a word: its bytes go into a
+//! `SysexArena` and the event carries the arena index in its data bytes.
+
+use crate::MidiCommand;
+use bytes::Bytes;
+
+/// UMP message type of system common / real-time messages.
+pub const MT_SYSTEM: u8 = 0x1;
+/// UMP message type of MIDI 1.0 channel voice messages.
+pub const MT_CHANNEL_VOICE: u8 = 0x2;
+/// UMP message type of 7-bit SysEx (payload in a `SysexArena`).
+pub const MT_SYSEX: u8 = 0x3;
+
+/// A MIDI message packed into one UMP word plus its time.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Default)]
+pub struct MidiEvent {
+    /// Universal MIDI Packet word.
+    pub word: u32,
+    /// Event time on the monotonic clock (µs).
+    pub time_us: u64,
+}
+
+impl MidiEvent {
+    /// Packs the fields of a 32-bit UMP word.
+    pub const fn pack_word(message_type: u8, group: u8, status: u8, data1: u8, data2: u8) -> u32 {
+        ((message_type as u32 & 0x0F) << 28)
+            | ((group as u32 & 0x0F) << 24)
+            | ((status as u32) << 16)
+            | ((data1 as u32) << 8)
+            | data2 as u32
+    }
+
+    /// Wraps a MIDI 1.0 message with the given status byte (group 0).
+    pub const fn midi1(status: u8, data1: u8, data2: u8, time_us: u64) -> Self {
+        let message_type = if status >= 0xF0 {
+            MT_SYSTEM
+        } else {
+            MT_CHANNEL_VOICE
+        };
+        Self {
+            word: Self::pack_word(message_type, 0, status, data1 & 0x7F, data2 & 0x7F),
+            time_us,
+        }
+    }
+
+    pub const fn note_on(channel: u8, key: u8, velocity: u8, time_us: u64) -> Self {
+        Self::midi1(0x90 | (channel & 0x0F), key, velocity, time_us)
+    }
+
+    pub const fn note_off(channel: u8, key: u8, velocity: u8, time_us: u64) -> Self {
+        Self::midi1(0x80 | (channel & 0x0F), key, velocity, time_us)
+    }
+
+    pub const fn control_change(channel: u8, control: u8, value: u8, time_us: u64) -> Self {
+        Self::midi1(0xB0 | (channel & 0x0F), control, value, time_us)
+    }
+
+    /// SysEx event referring to entry `index` of a `SysexArena`.
+    pub const fn sysex(index: u16, time_us: u64) -> Self {
+        Self {
+            word: Self::pack_word(MT_SYSEX, 0, 0xF0, (index >> 8) as u8, index as u8),
+            time_us,
+        }
+    }
+
+    pub const fn message_type(&self) -> u8 {
+        (self.word >> 28) as u8
+    }
+
+    pub const fn group(&self) -> u8 {
+        ((self.word >> 24) & 0x0F) as u8
+    }
+
+    /// Full MIDI 1.0 status byte (including the channel).
+    pub const fn status(&self) -> u8 {
+        (self.word >> 16) as u8
+    }
+
+    /// Status without the channel nibble for channel messages (0x80..=0xE0),
+    /// the full status byte for system messages.
+    pub const fn kind(&self) -> u8 {
+        let status = self.status();
+        if status >= 0xF0 {
+            status
+        } else {
+            status & 0xF0
+        }
+    }
+
+    pub const fn channel(&self) -> u8 {
+        self.status() & 0x0F
+    }
+
+    pub const fn data1(&self) -> u8 {
+        (self.word >> 8) as u8
+    }
+
+    pub const fn data2(&self) -> u8 {
+        self.word as u8
+    }
+
+    /// A Note On with velocity 0 is a Note Off.
+    pub const fn is_note_on(&self) -> bool {
+        self.message_type() == MT_CHANNEL_VOICE && self.kind() == 0x90 && self.data2() > 0
+    }
+
+    pub const fn is_note_off(&self) -> bool {
+        self.message_type() == MT_CHANNEL_VOICE
+            && (self.kind() == 0x80 || (self.kind() == 0x90 && self.data2() == 0))
+    }
+
+    pub const fn is_sysex(&self) -> bool {
+        self.message_type() == MT_SYSEX
+    }
+
+    /// Arena index of a SysEx event.
+    pub const fn sysex_index(&self) -> Option<u16> {
+        if self.is_sysex() {
+            Some(((self.data1() as u16) << 8) | self.data2() as u16)
+        } else {
+            None
+        }
+    }
+
+    /// 14-bit pitch bend value (0..=16383, centre 8192).
+    pub const fn pitch_bend(&self) -> u16 {
+        ((self.data2() as u16) << 7) | self.data1() as u16
+    }
+
+    /// Decodes one MIDI 1.0 message from the start of `bytes`; returns the
+    /// event and the number of bytes consumed. SysEx (F0 … F7) is copied
+    /// into `arena`. Returns `None` for incomplete or unknown messages.
+    pub fn decode(bytes: &[u8], time_us: u64, arena: &mut SysexArena) -> Option<(Self, usize)> {
+        let &status = bytes.first()?;
+        if status == 0xF0 {
+            let end = bytes.iter().position(|&b| b == 0xF7)?;
+            let index = arena.push(&bytes[..=end])?;
+            return Some((Self::sysex(index, time_us), end + 1));
+        }
+        let len = midi1_length(status)?;
+        if bytes.len() < len {
+            return None;
+        }
+        let data1 = if len > 1 { bytes[1] } else { 0 };
+        let data2 = if len > 2 { bytes[2] } else { 0 };
+        Some((Self::midi1(status, data1, data2, time_us), len))
+    }
+
+    /// Writes the MIDI 1.0 bytes of a non-SysEx event; returns their count
+    /// (0 for SysEx, whose bytes live in the arena).
+    pub fn write_midi1(&self, out: &mut [u8; 3]) -> usize {
+        if self.is_sysex() {
+            return 0;
+        }
+        let status = self.status();
+        out[0] = status;
+        out[1] = self.data1();
+        out[2] = self.data2();
+        midi1_length(status).unwrap_or(1)
+    }
+
+    /// Packs a `MidiCommand`; a SysEx payload is stored in `arena`.
+    pub fn from_command(
+        command: &MidiCommand,
+        time_us: u64,
+        arena: &mut SysexArena,
+    ) -> Option<Self> {
+        let t = time_us;
+        Some(match *command {
+            MidiCommand::NoteOff {
+                channel,
+                key,
+                velocity,
+            } => Self::note_off(channel, key, velocity, t),
+            MidiCommand::NoteOn {
+                channel,
+                key,
+                velocity,
+            } => Self::note_on(channel, key, velocity, t),
+            MidiCommand::PolyphonicKeyPressure {
+                channel,
+                key,
+                value,
+            } => Self::midi1(0xA0 | (channel & 0x0F), key, value, t),
+            MidiCommand::ControlChange {
+                channel,
+                control,
+                value,
+            } => Self::control_change(channel, control, value, t),
+            MidiCommand::ProgramChange { channel, program } => {
+                Self::midi1(0xC0 | (channel & 0x0F), program, 0, t)
+            }
+            MidiCommand::ChannelPressure { channel, value } => {
+                Self::midi1(0xD0 | (channel & 0x0F), value, 0, t)
+            }
+            MidiCommand::PitchBendChange { channel, value } => {
+                Self::midi1(0xE0 | (channel & 0x0F), value as u8, (value >> 7) as u8, t)
+            }
+            MidiCommand::TimingClock => Self::midi1(0xF8, 0, 0, t),
+            MidiCommand::Start => Self::midi1(0xFA, 0, 0, t),
+            MidiCommand::Continue => Self::midi1(0xFB, 0, 0, t),
+            MidiCommand::Stop => Self::midi1(0xFC, 0, 0, t),
+            MidiCommand::ActiveSensing => Self::midi1(0xFE, 0, 0, t),
+            MidiCommand::TuneRequest => Self::midi1(0xF6, 0, 0, t),
+            MidiCommand::SystemExclusive(ref payload) => {
+                Self::sysex(arena.push_payload(payload)?, t)
+            }
+            MidiCommand::Unknown { .. } => return None,
+        })
+    }
+
+    /// Converts to the `MidiCommand` enum (allocates only for SysEx).
+    pub fn to_command(&self, arena: &SysexArena) -> Option<MidiCommand> {
+        if let Some(index) = self.sysex_index() {
+            let bytes = arena.get(index)?;
+            let payload = bytes
+                .get(1..bytes.len().saturating_sub(1))
+                .unwrap_or_default();
+            return Some(MidiCommand::SystemExclusive(payload.to_vec()));
+        }
+        let (channel, data1, data2) = (self.channel(), self.data1(), self.data2());
+        Some(match self.kind() {
+            0x80 => MidiCommand::NoteOff {
+                channel,
+                key: data1,
+                velocity: data2,
+            },
+            0x90 => MidiCommand::NoteOn {
+                channel,
+                key: data1,
+                velocity: data2,
+            },
+            0xA0 => MidiCommand::PolyphonicKeyPressure {
+                channel,
+                key: data1,
+                value: data2,
+            },
+            0xB0 => MidiCommand::ControlChange {
+                channel,
+                control: data1,
+                value: data2,
+            },
+            0xC0 => MidiCommand::ProgramChange {
+                channel,
+                program: data1,
+            },
+            0xD0 => MidiCommand::ChannelPressure {
+                channel,
+                value: data1,
+            },
+            0xE0 => MidiCommand::PitchBendChange {
+                channel,
+                value: self.pitch_bend(),
+            },
+            0xF6 => MidiCommand::TuneRequest,
+            0xF8 => MidiCommand::TimingClock,
+            0xFA => MidiCommand::Start,
+            0xFB => MidiCommand::Continue,
+            0xFC => MidiCommand::Stop,
+            0xFE => MidiCommand::ActiveSensing,
+            status => MidiCommand::Unknown {
+                status,
+                data: Vec::new(),
+            },
+        })
+    }
+}
+
+/// Length of a MIDI 1.0 message by status byte (SysEx excluded).
+pub const fn midi1_length(status: u8) -> Option<usize> {
+    match status {
+        0x80..=0xBF | 0xE0..=0xEF | 0xF2 => Some(3),
+        0xC0..=0xDF | 0xF1 | 0xF3 => Some(2),
+        0xF6 | 0xF8 | 0xFA..=0xFC | 0xFE | 0xFF => Some(1),
+        _ => None,
+    }
+}
+
+/// Side storage for SysEx payloads referenced by `MidiEvent`s.
+///
+/// Entries are appended into one buffer and addressed by a 16-bit index;
+/// `clear` keeps the capacity, so a reused arena stops allocating once it
+/// has seen its largest batch.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct SysexArena {
+    bytes: Vec<u8>,
+    spans: Vec<(u32, u32)>,
+}
+
+impl SysexArena {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Stores a complete SysEx message (F0 … F7); `None` when full.
+    pub fn push(&mut self, sysex: &[u8]) -> Option<u16> {
+        let index = u16::try_from(self.spans.len()).ok()?;
+        let start = u32::try_from(self.bytes.len()).ok()?;
+        self.bytes.extend_from_slice(sysex);
+        self.spans.push((start, sysex.len() as u32));
+        Some(index)
+    }
+
+    /// Stores a SysEx payload without its F0/F7 framing.
+    pub fn push_payload(&mut self, payload: &[u8]) -> Option<u16> {
+        let index = u16::try_from(self.spans.len()).ok()?;
+        let start = u32::try_from(self.bytes.len()).ok()?;
+        self.bytes.push(0xF0);
+        self.bytes.extend_from_slice(payload);
+        self.bytes.push(0xF7);
+        self.spans.push((start, payload.len() as u32 + 2));
+        Some(index)
+    }
+
+    /// Like `push_payload`, for payloads that are not contiguous in memory.
+    pub fn push_payload_iter<I: IntoIterator<Item = u8>>(&mut self, payload: I) -> Option<u16> {
+        let index = u16::try_from(self.spans.len()).ok()?;
+        let start = u32::try_from(self.bytes.len()).ok()?;
+        self.bytes.push(0xF0);
+        self.bytes.extend(payload);
+        self.bytes.push(0xF7);
+        self.spans
+            .push((start, (self.bytes.len() - start as usize) as u32));
+        Some(index)
+    }
+
+    pub fn get(&self, index: u16) -> Option<&[u8]> {
+        let &(start, len) = self.spans.get(index as usize)?;
+        self.bytes
+            .get(start as usize..start as usize + len as usize)
+    }
+
+    pub fn len(&self) -> usize {
+        self.spans.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.spans.is_empty()
+    }
+
+    pub fn clear(&mut self) {
+        self.bytes.clear();
+        self.spans.clear();
+    }
+
+    /// Freezes the arena; its entries are then handed out without copying.
+    pub fn into_shared(self) -> SharedSysexArena {
+        SharedSysexArena {
+            bytes: Bytes::from(self.bytes),
+            spans: self.spans,
+        }
+    }
+}
+
+/// Frozen `SysexArena` whose entries are `Bytes` slices of one buffer.
+#[derive(Debug, Clone, Default)]
+pub struct SharedSysexArena {
+    bytes: Bytes,
+    spans: Vec<(u32, u32)>,
+}
+
+impl SharedSysexArena {
+    pub fn get(&self, index: u16) -> Option<Bytes> {
+        let &(start, len) = self.spans.get(index as usize)?;
+        let range = start as usize..start as usize + len as usize;
+        (range.end <= self.bytes.len()).then(|| self.bytes.slice(range))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn event_is_packed() {
+        assert_eq!(std::mem::size_of::<MidiEvent>(), 16);
+        let event = MidiEvent::note_on(3, 60, 100, 42);
+        assert_eq!(event.word, 0x2093_3C64);
+        assert_eq!(
+            (event.message_type(), event.kind(), event.channel()),
+            (MT_CHANNEL_VOICE, 0x90, 3)
+        );
+        assert_eq!((event.data1(), event.data2()), (60, 100));
+        assert!(event.is_note_on());
+        assert!(MidiEvent::note_on(0, 60, 0, 0).is_note_off());
+    }
+
+    #[test]
+    fn decode_stream_and_roundtrip() {
+        let stream = [0x90, 60, 100, 0xF8, 0xC2, 5, 0xE0, 0x00, 0x40];
+        let mut arena = SysexArena::new();
+        let mut pos = 0;
+        let mut events = Vec::new();
+        while pos < stream.len() {
+            let (event, len) = MidiEvent::decode(&stream[pos..], 7, &mut arena).unwrap();
+            let mut out = [0u8; 3];
+            assert_eq!(event.write_midi1(&mut out), len);
+            assert_eq!(&out[..len], &stream[pos..pos + len]);
+            events.push(event);
+            pos += len;
+        }
+        assert_eq!(events.len(), 4);
+        assert_eq!(events[1].message_type(), MT_SYSTEM);
+        assert_eq!(
+            events[3].to_command(&arena),
+            Some(MidiCommand::PitchBendChange {
+                channel: 0,
+                value: 8192
+            })
+        );
+        assert!(MidiEvent::decode(&[0x90, 60], 0, &mut arena).is_none());
+    }
+
+    #[test]
+    fn sysex_goes_to_arena() {
+        let mut arena = SysexArena::new();
+        let (event, len) =
+            MidiEvent::decode(&[0xF0, 0x7E, 0x01, 0xF7, 0x90], 0, &mut arena).unwrap();
+        assert_eq!(len, 4);
+        assert_eq!(event.sysex_index(), Some(0));
+        assert_eq!(arena.get(0), Some(&[0xF0, 0x7E, 0x01, 0xF7][..]));
+        assert_eq!(
+            event.to_command(&arena),
+            Some(MidiCommand::SystemExclusive(vec![0x7E, 0x01]))
+        );
+        // Unterminated SysEx is incomplete.
+        assert!(MidiEvent::decode(&[0xF0, 0x01], 0, &mut arena).is_none());
+
+        let command = MidiCommand::SystemExclusive(vec![0x43, 0x10]);
+        let packed = MidiEvent::from_command(&command, 0, &mut arena).unwrap();
+        assert_eq!(packed.sysex_index(), Some(1));
+        assert_eq!(packed.to_command(&arena), Some(command));
+
+        let shared = arena.into_shared();
+        assert_eq!(
+            shared.get(0).as_deref(),
+            Some(&[0xF0, 0x7E, 0x01, 0xF7][..])
+        );
+        assert_eq!(
+            shared.get(1).as_deref(),
+            Some(&[0xF0, 0x43, 0x10, 0xF7][..])
+        );
+        assert_eq!(shared.get(2), None);
+    }
+}
@@ -1,3 +1,4 @@
+use crate::clock::monotonic_us;
 use crate::event_bus::Event;
 use std::net::SocketAddr;
 use tokio::net::UdpSocket;
@@ -20,10 +21,12 @@ impl NetworkInterface {
     pub async fn start_listening(&self) {
         let mut buf = [0u8; 2048];
         while let Ok((len, src)) = self.socket.recv_from(&mut buf).await {
+            let received_at_us = monotonic_us();
             let payload = buf[..len].to_vec();
             let event = Event::RawPacketReceived {
                 payload,
                 source_addr: src,
+                received_at_us,
             };
             let _ = self.event_sender.send(event).await;
         }
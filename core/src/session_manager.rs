@@ -1,3 +1,4 @@
+use crate::clock::monotonic_us;
 use crate::event_bus::Event;
 use std::net::SocketAddr;
 use tokio::sync::mpsc::{Receiver, Sender};
@@ -17,6 +18,8 @@ pub struct SessionManager {
     peer_addr: Option<SocketAddr>,
     initiator_token: Option<u32>,
     ssrc: Option<u32>,
+    // Session start on the monotonic clock; CK timestamps count from here.
+    clock_anchor_us: u64,
     // Add more fields as needed for clock sync, etc.
 }
 
@@ -29,6 +32,7 @@ impl SessionManager {
             peer_addr: None,
             initiator_token: None,
             ssrc: None,
+            clock_anchor_us: monotonic_us(),
         }
     }
 
@@ -42,6 +46,7 @@ impl SessionManager {
         if let Event::RawPacketReceived {
             payload,
             source_addr,
+            ..
         } = event
         {
             // Parse AppleMIDI control packet (IN, OK, NO, BY, CK)
@@ -246,7 +251,7 @@ impl SessionManager {
                 self.initiator_token = Some(initiator_token);
                 self.ssrc = Some(ssrc);
                 // Begin clock sync as initiator: send CK0
-                let now = Self::current_timestamp();
+                let now = self.ck_timestamp();
                 let mut payload = Vec::new();
                 payload.extend_from_slice(b"CK");
                 payload.push(0); // count = 0 (CK0)
@@ -307,7 +312,7 @@ impl SessionManager {
             match count {
                 0 => {
                     // Received CK0, respond with CK1
-                    let now = Self::current_timestamp();
+                    let now = self.ck_timestamp();
                     let mut payload = Vec::new();
                     payload.extend_from_slice(b"CK");
                     payload.push(1); // count = 1 (CK1)
@@ -326,7 +331,7 @@ impl SessionManager {
                 }
                 1 => {
                     // Received CK1, respond with CK2
-                    let now = Self::current_timestamp();
+                    let now = self.ck_timestamp();
                     let mut payload = Vec::new();
                     payload.extend_from_slice(b"CK");
                     payload.push(2); // count = 2 (CK2)
@@ -364,13 +369,9 @@ impl SessionManager {
         }
     }
 
-    fn current_timestamp() -> u64 {
-        // Return current time in microseconds since epoch (placeholder)
-        use std::time::{SystemTime, UNIX_EPOCH};
-        SystemTime::now()
-            .duration_since(UNIX_EPOCH)
-            .unwrap()
-            .as_micros() as u64
+    /// CK timestamp (100 µs units) on the session clock.
+    fn ck_timestamp(&self) -> u64 {
+        monotonic_us().saturating_sub(self.clock_anchor_us) / 100
     }
 }
 
@@ -0,0 +1,276 @@
+//! Standard MIDI File reader.
+//!
+//! Reads format 0 and 1 files into `MidiEvent`s with `time_us` measured from
+//! the start of the song. Ticks are converted with the tempo map collected
+//! from all tracks (or the SMPTE division). Channel messages are kept;
+//! SysEx and meta events other than tempo are skipped, since nothing
+//! downstream of an offline render consumes them.
+
+use crate::MidiEvent;
+use std::io;
+use std::path::Path;
+
+const DEFAULT_TEMPO_US: u64 = 500_000;
+
+fn invalid(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, format!("SMF: {message}"))
+}
+
+// Event of one track before the tempo map is applied.
+enum TrackEvent {
+    Midi(u8, u8, u8),
+    Tempo(u64),
+}
+
+struct Reader<'a> {
+    bytes: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, len: usize) -> io::Result<&'a [u8]> {
+        let end = self
+            .pos
+            .checked_add(len)
+            .filter(|&end| end <= self.bytes.len())
+            .ok_or_else(|| invalid("truncated"))?;
+        let slice = &self.bytes[self.pos..end];
+        self.pos = end;
+        Ok(slice)
+    }
+
+    fn u8(&mut self) -> io::Result<u8> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn u16(&mut self) -> io::Result<u16> {
+        let b = self.take(2)?;
+        Ok(u16::from_be_bytes([b[0], b[1]]))
+    }
+
+    fn u32(&mut self) -> io::Result<u32> {
+        let b = self.take(4)?;
+        Ok(u32::from_be_bytes([b[0], b[1], b[2], b[3]]))
+    }
+
+    // Variable-length quantity, at most four bytes.
+    fn vlq(&mut self) -> io::Result<u32> {
+        let mut value = 0u32;
+        for _ in 0..4 {
+            let byte = self.u8()?;
+            value = (value << 7) | (byte & 0x7F) as u32;
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+        }
+        Err(invalid("variable-length quantity too long"))
+    }
+
+    fn at_end(&self) -> bool {
+        self.pos >= self.bytes.len()
+    }
+}
+
+/// Reads a Standard MIDI File from `path`.
+pub fn read_smf(path: impl AsRef<Path>) -> io::Result<Vec<MidiEvent>> {
+    parse_smf(&std::fs::read(path)?)
+}
+
+/// Parses a Standard MIDI File; returns its channel events in time order.
+pub fn parse_smf(bytes: &[u8]) -> io::Result<Vec<MidiEvent>> {
+    let mut reader = Reader { bytes, pos: 0 };
+    if reader.take(4)? != b"MThd" {
+        return Err(invalid("missing MThd header"));
+    }
+    let header_len = reader.u32()? as usize;
+    if header_len < 6 {
+        return Err(invalid("short header"));
+    }
+    let format = reader.u16()?;
+    let tracks = reader.u16()?;
+    let division = reader.u16()?;
+    reader.take(header_len - 6)?;
+    if format > 1 {
+        return Err(invalid("only formats 0 and 1 are supported"));
+    }
+
+    // (tick, track, event) of all tracks; sorted stably so events at the
+    // same tick keep their file order.
+    let mut events = Vec::new();
+    for track in 0..tracks {
+        loop {
+            let id = reader.take(4)?;
+            let len = reader.u32()? as usize;
+            if id == b"MTrk" {
+                let data = reader.take(len)?;
+                read_track(data, track, &mut events)?;
+                break;
+            }
+            // Unknown chunks are skipped, as the specification asks.
+            reader.take(len)?;
+        }
+    }
+    events.sort_by_key(|&(tick, track, _)| (tick, track));
+
+    // SMPTE division: frames per second × ticks per frame, tempo-independent.
+    let smpte = division & 0x8000 != 0;
+    let ticks_per_second = if smpte {
+        let fps = match (division >> 8) as u8 as i8 {
+            -29 => 29.97,
+            fps => -(fps as f64),
+        };
+        fps * (division & 0xFF) as f64
+    } else {
+        0.0
+    };
+    let ticks_per_quarter = (division & 0x7FFF).max(1) as u64;
+
+    let mut midi = Vec::with_capacity(events.len());
+    let (mut last_tick, mut time_us, mut tempo_us) = (0u64, 0f64, DEFAULT_TEMPO_US);
+    for (tick, _, event) in events {
+        let delta = (tick - last_tick) as f64;
+        time_us += if smpte {
+            delta * 1e6 / ticks_per_second.max(1.0)
+        } else {
+            delta * tempo_us as f64 / ticks_per_quarter as f64
+        };
+        last_tick = tick;
+        match event {
+            TrackEvent::Tempo(tempo) => tempo_us = tempo,
+            TrackEvent::Midi(status, data1, data2) => {
+                midi.push(MidiEvent::midi1(
+                    status,
+                    data1,
+                    data2,
+                    time_us.round() as u64,
+                ));
+            }
+        }
+    }
+    Ok(midi)
+}
+
+fn read_track(data: &[u8], track: u16, events: &mut Vec<(u64, u16, TrackEvent)>) -> io::Result<()> {
+    let mut reader = Reader {
+        bytes: data,
+        pos: 0,
+    };
+    let mut tick = 0u64;
+    let mut running = 0u8;
+    while !reader.at_end() {
+        tick += reader.vlq()? as u64;
+        let mut status = reader.u8()?;
+        match status {
+            0xFF => {
+                let kind = reader.u8()?;
+                let len = reader.vlq()? as usize;
+                let payload = reader.take(len)?;
+                match kind {
+                    0x2F => break,
+                    0x51 if len == 3 => {
+                        let tempo = u32::from_be_bytes([0, payload[0], payload[1], payload[2]]);
+                        events.push((tick, track, TrackEvent::Tempo(tempo.max(1) as u64)));
+                    }
+                    _ => {}
+                }
+            }
+            0xF0 | 0xF7 => {
+                let len = reader.vlq()? as usize;
+                reader.take(len)?;
+                running = 0;
+            }
+            _ => {
+                // Running status: the byte read is already the first data byte.
+                let first = if status & 0x80 == 0 {
+                    if running == 0 {
+                        return Err(invalid("data byte without status"));
+                    }
+                    let data1 = status;
+                    status = running;
+                    data1
+                } else {
+                    running = status;
+                    reader.u8()?
+                };
+                let second = match status & 0xF0 {
+                    0xC0 | 0xD0 => 0,
+                    _ => reader.u8()?,
+                };
+                events.push((tick, track, TrackEvent::Midi(status, first, second)));
+            }
+        }
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn file(division: u16, tracks: &[&[u8]]) -> Vec<u8> {
+        let mut bytes = b"MThd".to_vec();
+        bytes.extend_from_slice(&6u32.to_be_bytes());
+        bytes.extend_from_slice(&1u16.to_be_bytes());
+        bytes.extend_from_slice(&(tracks.len() as u16).to_be_bytes());
+        bytes.extend_from_slice(&division.to_be_bytes());
+        for track in tracks {
+            bytes.extend_from_slice(b"MTrk");
+            bytes.extend_from_slice(&(track.len() as u32).to_be_bytes());
+            bytes.extend_from_slice(track);
+        }
+        bytes
+    }
+
+    #[test]
+    fn tempo_map_from_conductor_track() {
+        // 480 ticks per quarter; 120 BPM, then 60 BPM from tick 960.
+        let conductor: &[u8] = &[
+            0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20, // 500 000 µs
+            0x87, 0x40, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, // +960: 1 000 000 µs
+            0x00, 0xFF, 0x2F, 0x00,
+        ];
+        let notes: &[u8] = &[
+            0x00, 0x90, 60, 100, // tick 0
+            0x87, 0x40, 64, 90, // +960, running status
+            0x83, 0x60, 0x80, 60, 0, // +480
+            0x00, 0xFF, 0x2F, 0x00,
+        ];
+        let events = parse_smf(&file(480, &[conductor, notes])).unwrap();
+        let summary: Vec<_> = events
+            .iter()
+            .map(|e| (e.status(), e.data1(), e.data2(), e.time_us))
+            .collect();
+        assert_eq!(
+            summary,
+            vec![
+                (0x90, 60, 100, 0),
+                (0x90, 64, 90, 1_000_000),
+                (0x80, 60, 0, 2_000_000)
+            ]
+        );
+    }
+
+    #[test]
+    fn sysex_and_program_change_and_smpte() {
+        // 25 fps × 40 ticks per frame = 1000 ticks per second.
+        let track: &[u8] = &[
+            0x00, 0xF0, 0x03, 0x7E, 0x01, 0xF7, // SysEx, skipped
+            0x00, 0xC2, 5, // program change, one data byte
+            0x87, 0x68, 0x92, 36, 127, // +1000 ticks
+            0x00, 0xFF, 0x2F, 0x00,
+        ];
+        let division = (((-25i8) as u8 as u16) << 8) | 40;
+        let events = parse_smf(&file(division, &[track])).unwrap();
+        assert_eq!(events.len(), 2);
+        assert_eq!((events[0].status(), events[0].data1()), (0xC2, 5));
+        assert!(events[1].is_note_on());
+        assert_eq!(events[1].time_us, 1_000_000);
+    }
+
+    #[test]
+    fn rejects_garbage() {
+        assert!(parse_smf(b"RIFF....").is_err());
+        let truncated = file(96, &[&[0x00, 0x90, 60]]);
+        assert!(parse_smf(&truncated).is_err());
+    }
+}
@@ -0,0 +1,250 @@
+//! Lightweight span tracing of the MIDI-to-light pipeline.
+//!
+//! Spans carry monotonic timestamps (`crate::clock`) and the id of the event
+//! they belong to (the packet arrival time in µs), so one MIDI event can be
+//! followed from UDP receive to socket send. Spans land in a fixed-size,
+//! lock-free in-memory ring and can be exported as Chrome trace JSON
+//! (chrome://tracing, Perfetto).
+//!
+//! Tracing is off by default. A disabled span costs a single relaxed atomic
+//! load; the ring is only allocated when tracing is first enabled.
+
+use crate::clock::monotonic_us;
+use std::cell::Cell;
+use std::sync::atomic::{fence, AtomicBool, AtomicU32, AtomicU64, Ordering};
+use std::sync::OnceLock;
+
+/// Number of spans kept; older spans are overwritten.
+pub const RING_CAPACITY: usize = 16 * 1024;
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static HEAD: AtomicU64 = AtomicU64::new(0);
+static RING: OnceLock<Box<[Slot]>> = OnceLock::new();
+static NEXT_TID: AtomicU32 = AtomicU32::new(1);
+
+thread_local! {
+    static TID: Cell<u32> = const { Cell::new(0) };
+}
+
+/// Pipeline stage a span measures.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+pub enum Stage {
+    /// Kernel receive timestamp until the packet is on the event bus.
+    UdpReceive = 0,
+    /// RTP/AppleMIDI parsing and session bookkeeping.
+    SessionParse = 1,
+    /// Matching commands and audio against mappings.
+    Mapping = 2,
+    /// Building output payloads (LED frames, WLED JSON, OSC).
+    OutputEncode = 3,
+    /// Handing the payload to the socket.
+    SocketSend = 4,
+}
+
+impl Stage {
+    const ALL: [Stage; 5] = [
+        Stage::UdpReceive,
+        Stage::SessionParse,
+        Stage::Mapping,
+        Stage::OutputEncode,
+        Stage::SocketSend,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Stage::UdpReceive => "udp_receive",
+            Stage::SessionParse => "session_parse",
+            Stage::Mapping => "mapping",
+            Stage::OutputEncode => "output_encode",
+            Stage::SocketSend => "socket_send",
+        }
+    }
+}
+
+/// One recorded span.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SpanRecord {
+    pub stage: Stage,
+    pub id: u64,
+    pub tid: u32,
+    pub start_us: u64,
+    pub dur_us: u64,
+}
+
+#[derive(Default)]
+struct Slot {
+    // 0 = empty, otherwise write index + 1; changes while a writer is active.
+    seq: AtomicU64,
+    stage_tid: AtomicU64,
+    id: AtomicU64,
+    start_us: AtomicU64,
+    dur_us: AtomicU64,
+}
+
+/// Whether spans are currently recorded.
+#[inline]
+pub fn enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// Turns tracing on or off; enabling allocates the ring on first use.
+pub fn set_enabled(on: bool) {
+    if on {
+        ring();
+    }
+    ENABLED.store(on, Ordering::Relaxed);
+}
+
+/// Starts a span that is recorded when the guard drops.
+#[inline]
+pub fn span(stage: Stage, id: u64) -> SpanGuard {
+    SpanGuard {
+        active: enabled().then(|| (stage, id, monotonic_us())),
+    }
+}
+
+/// Records a span measured elsewhere (e.g. starting at a kernel timestamp).
+#[inline]
+pub fn record(stage: Stage, id: u64, start_us: u64, end_us: u64) {
+    if enabled() {
+        write(stage, id, start_us, end_us.saturating_sub(start_us));
+    }
+}
+
+/// Records its span on drop; does nothing when tracing was disabled at creation.
+#[must_use = "the span ends when the guard is dropped"]
+pub struct SpanGuard {
+    active: Option<(Stage, u64, u64)>,
+}
+
+impl Drop for SpanGuard {
+    fn drop(&mut self) {
+        if let Some((stage, id, start_us)) = self.active {
+            write(stage, id, start_us, monotonic_us().saturating_sub(start_us));
+        }
+    }
+}
+
+fn ring() -> &'static [Slot] {
+    RING.get_or_init(|| (0..RING_CAPACITY).map(|_| Slot::default()).collect())
+}
+
+fn thread_id() -> u32 {
+    TID.with(|tid| {
+        if tid.get() == 0 {
+            tid.set(NEXT_TID.fetch_add(1, Ordering::Relaxed));
+        }
+        tid.get()
+    })
+}
+
+fn write(stage: Stage, id: u64, start_us: u64, dur_us: u64) {
+    let n = HEAD.fetch_add(1, Ordering::Relaxed);
+    let slot = &ring()[n as usize % RING_CAPACITY];
+    // Seqlock: the zero must be visible before any of the data stores.
+    slot.seq.store(0, Ordering::Relaxed);
+    fence(Ordering::Release);
+    slot.stage_tid.store(
+        ((thread_id() as u64) << 8) | stage as u64,
+        Ordering::Relaxed,
+    );
+    slot.id.store(id, Ordering::Relaxed);
+    slot.start_us.store(start_us, Ordering::Relaxed);
+    slot.dur_us.store(dur_us, Ordering::Relaxed);
+    slot.seq.store(n + 1, Ordering::Release);
+}
+
+/// Copies all complete spans out of the ring, oldest first.
+pub fn snapshot() -> Vec<SpanRecord> {
+    let Some(ring) = RING.get() else {
+        return Vec::new();
+    };
+    let mut spans: Vec<(u64, SpanRecord)> = ring
+        .iter()
+        .filter_map(|slot| {
+            let seq = slot.seq.load(Ordering::Acquire);
+            if seq == 0 {
+                return None;
+            }
+            let stage_tid = slot.stage_tid.load(Ordering::Relaxed);
+            let record = SpanRecord {
+                stage: Stage::ALL[(stage_tid & 0xFF) as usize % Stage::ALL.len()],
+                tid: (stage_tid >> 8) as u32,
+                id: slot.id.load(Ordering::Relaxed),
+                start_us: slot.start_us.load(Ordering::Relaxed),
+                dur_us: slot.dur_us.load(Ordering::Relaxed),
+            };
+            // Skip slots that were rewritten while being read. The fence
+            // keeps the data loads above ahead of the re-check.
+            fence(Ordering::Acquire);
+            (slot.seq.load(Ordering::Relaxed) == seq).then_some((seq, record))
+        })
+        .collect();
+    spans.sort_by_key(|(seq, _)| *seq);
+    spans.into_iter().map(|(_, record)| record).collect()
+}
+
+/// Drops all recorded spans.
+pub fn clear() {
+    if let Some(ring) = RING.get() {
+        for slot in ring.iter() {
+            slot.seq.store(0, Ordering::Release);
+        }
+    }
+}
+
+/// Exports the ring in Chrome trace event format (complete "X" events).
+pub fn export_chrome_json() -> String {
+    let events: Vec<serde_json::Value> = snapshot()
+        .into_iter()
+        .map(|span| {
+            serde_json::json!({
+                "name": span.stage.name(),
+                "cat": "pipeline",
+                "ph": "X",
+                "ts": span.start_us,
+                "dur": span.dur_us,
+                "pid": 1,
+                "tid": span.tid,
+                "args": { "event": span.id },
+            })
+        })
+        .collect();
+    serde_json::json!({ "traceEvents": events, "displayTimeUnit": "ms" }).to_string()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // The ring is process-global; keep all assertions in one test.
+    #[test]
+    fn spans_are_recorded_only_when_enabled_and_export() {
+        set_enabled(false);
+        drop(span(Stage::Mapping, 1));
+        record(Stage::UdpReceive, 1, 10, 20);
+        assert!(snapshot().iter().all(|s| s.id != 1));
+
+        set_enabled(true);
+        {
+            let _span = span(Stage::SessionParse, 42);
+        }
+        record(Stage::UdpReceive, 42, 100, 150);
+        set_enabled(false);
+
+        let spans: Vec<_> = snapshot().into_iter().filter(|s| s.id == 42).collect();
+        assert_eq!(spans.len(), 2);
+        assert_eq!(spans[0].stage, Stage::SessionParse);
+        assert_eq!((spans[1].start_us, spans[1].dur_us), (100, 50));
+
+        let json: serde_json::Value = serde_json::from_str(&export_chrome_json()).unwrap();
+        let events = json["traceEvents"].as_array().unwrap();
+        assert!(events
+            .iter()
+            .any(|e| e["name"] == "udp_receive" && e["ph"] == "X" && e["args"]["event"] == 42));
+
+        clear();
+        assert!(snapshot().is_empty());
+    }
+}
@@ -1,29 +1,428 @@
 //! ESP32 HAL adapter for DataStreamNetSender
+//!
+//! `Esp32Sender` drives one visualizer board over the visualizer link (see
+//! `link` for the wire format): batched MIDI events for the board's own
+//! renderer and LED frames rendered on the hub, both numbered and
+//! timestamped. Frames go out in MTU-sized slices and only the slices that
+//! changed since the last frame are sent; an unchanged frame (the frame
+//! scheduler's keepalive) and every `REFRESH_FRAMES`-th frame resend all of
+//! them, so a lost slice does not stay stale on the board. A board's byte budget is
+//! shared by its frame and event senders (`event_link`): events always go,
+//! frames are left out while the budget is in debt. One datagram buffer per
+//! board is reused for every send.
 
-use rtp_midi_core::{DataStreamNetSender, StreamError};
+pub mod link;
 
-pub struct Esp32Sender;
+use link::{Pacer, MAX_SLICE_PIXELS};
+use log::info;
+use rtp_midi_core::{DataStreamNetSender, MidiEvent, StreamError};
+use std::net::UdpSocket;
+use std::sync::{Arc, Mutex};
+use std::time::Instant;
 
-impl DataStreamNetSender for Esp32Sender {
-    fn init(&mut self) -> Result<(), StreamError> {
+/// Every this many sent frames all slices go out, changed or not (half a
+/// second at 60 fps). The link has no acknowledgements.
+pub const REFRESH_FRAMES: u32 = 30;
+
+/// Counters of one board.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LinkStats {
+    pub datagrams: u64,
+    /// UDP payload bytes.
+    pub bytes: u64,
+    pub events: u64,
+    pub frames: u64,
+    /// Frames left out while the byte budget was in debt.
+    pub paced: u64,
+    /// Frame slices not sent because they did not change.
+    pub unchanged_slices: u64,
+}
+
+struct Link {
+    socket: UdpSocket,
+    seq: u16,
+    pacer: Pacer,
+    started: Instant,
+    buf: Vec<u8>,
+    stats: LinkStats,
+}
+
+impl Link {
+    fn now_us(&self) -> u64 {
+        self.started.elapsed().as_micros() as u64
+    }
+
+    fn begin(&mut self, timestamp_us: u64) {
+        link::begin(&mut self.buf, self.seq, timestamp_us);
+    }
+
+    // The sequence number only advances for datagrams that left, so the
+    // board never counts one that was not sent as lost.
+    fn flush(&mut self) -> Result<(), StreamError> {
+        self.socket
+            .send(&self.buf)
+            .map_err(|e| StreamError::Network(e.to_string()))?;
+        self.seq = self.seq.wrapping_add(1);
+        self.stats.datagrams += 1;
+        self.stats.bytes += self.buf.len() as u64;
         Ok(())
     }
-    fn send(&mut self, _ts: u64, _payload: &[u8]) -> Result<(), StreamError> {
+}
+
+/// Sender of one visualizer board; `send` takes RGB frames.
+pub struct Esp32Sender {
+    address: String,
+    link: Arc<Mutex<Link>>,
+    // Last frame sent, to skip unchanged slices.
+    previous: Vec<u8>,
+    // Frames sent since all slices last went out.
+    since_refresh: u32,
+}
+
+impl Esp32Sender {
+    /// Opens the link to `address` (`ip:port`). `bytes_per_sec` caps the
+    /// board's traffic including UDP/IP headers, 0 = unpaced.
+    pub fn open(address: &str, bytes_per_sec: u64) -> std::io::Result<Self> {
+        let socket = UdpSocket::bind("0.0.0.0:0")?;
+        socket.connect(address)?;
+        socket.set_nonblocking(true)?;
+        let link = Link {
+            socket,
+            seq: 0,
+            pacer: Pacer::new(bytes_per_sec),
+            started: Instant::now(),
+            buf: Vec::with_capacity(link::MAX_DATAGRAM),
+            stats: LinkStats::default(),
+        };
+        Ok(Self {
+            address: address.to_string(),
+            link: Arc::new(Mutex::new(link)),
+            previous: Vec::new(),
+            since_refresh: 0,
+        })
+    }
+
+    /// Second sender on the same board (socket, sequence and budget), for
+    /// events from another thread than the frames.
+    pub fn event_link(&self) -> Self {
+        Self {
+            address: self.address.clone(),
+            link: self.link.clone(),
+            previous: Vec::new(),
+            since_refresh: 0,
+        }
+    }
+
+    pub fn address(&self) -> &str {
+        &self.address
+    }
+
+    pub fn stats(&self) -> LinkStats {
+        self.link.lock().unwrap().stats
+    }
+
+    /// Sends `events` in as few datagrams as possible, each stamped with
+    /// the time of its first event. SysEx is not sent (the board gets no
+    /// payloads), so a batch of only SysEx sends nothing. Never held back
+    /// by pacing.
+    pub fn send_events(&mut self, events: &[MidiEvent]) -> Result<(), StreamError> {
+        let mut guard = self.link.lock().unwrap();
+        let link = &mut *guard;
+        let now_us = link.now_us();
+        let mut rest = events;
+        while let Some(skip) = rest.iter().position(|e| !e.is_sysex()) {
+            rest = &rest[skip..];
+            link.begin(rest[0].time_us);
+            let mut taken = 0;
+            while taken < rest.len() {
+                match link::push_events(&mut link.buf, &rest[taken..]) {
+                    0 => break,
+                    n => taken += n,
+                }
+            }
+            link.stats.events += rest[..taken].iter().filter(|e| !e.is_sysex()).count() as u64;
+            rest = &rest[taken..];
+            if link.buf.len() > link::HEADER_LEN {
+                link.pacer
+                    .charge(now_us, link.buf.len() + link::WIRE_OVERHEAD);
+                link.flush()?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Sends the changed slices of an RGB frame, the last one with
+    /// `FRAME_PUSH`, unless the board's budget is in debt.
+    pub fn send_frame(&mut self, ts: u64, pixels: &[u8]) -> Result<(), StreamError> {
+        let pixels = &pixels[..pixels.len() / 3 * 3];
+        if pixels.is_empty() {
+            return Ok(());
+        }
+        const SLICE: usize = MAX_SLICE_PIXELS * 3;
+        let resend_all = self.previous.len() != pixels.len()
+            || self.previous == pixels
+            || self.since_refresh + 1 >= REFRESH_FRAMES;
+        let previous = &self.previous;
+        let changed = |i: usize, slice: &[u8]| {
+            resend_all || previous[i * SLICE..i * SLICE + slice.len()] != *slice
+        };
+        let mut bytes = 0;
+        let mut last = 0;
+        for (i, slice) in pixels.chunks(SLICE).enumerate() {
+            if changed(i, slice) {
+                bytes += link::HEADER_LEN + link::FRAME_HEADER + slice.len() + link::WIRE_OVERHEAD;
+                last = i;
+            }
+        }
+
+        let mut guard = self.link.lock().unwrap();
+        let link = &mut *guard;
+        let now_us = link.now_us();
+        if !link.pacer.admit(now_us, bytes) {
+            link.stats.paced += 1;
+            return Ok(());
+        }
+        for (i, slice) in pixels.chunks(SLICE).enumerate() {
+            if !changed(i, slice) {
+                link.stats.unchanged_slices += 1;
+                continue;
+            }
+            link.begin(ts);
+            link::push_frame(&mut link.buf, i * MAX_SLICE_PIXELS, slice, i == last);
+            link.flush()?;
+        }
+        link.stats.frames += 1;
+        drop(guard);
+        self.since_refresh = if resend_all {
+            0
+        } else {
+            self.since_refresh + 1
+        };
+        self.previous.clear();
+        self.previous.extend_from_slice(pixels);
         Ok(())
     }
 }
 
-pub fn add(left: u64, right: u64) -> u64 {
-    left + right
+impl DataStreamNetSender for Esp32Sender {
+    fn init(&mut self) -> Result<(), StreamError> {
+        info!("ESP32 visualizer link to {}", self.address);
+        Ok(())
+    }
+
+    fn send(&mut self, ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+        self.send_frame(ts, payload)
+    }
 }
 
 #[cfg(test)]
 mod tests {
     use super::*;
+    use link::{Header, Record};
+    use std::time::Duration;
+
+    fn board() -> (UdpSocket, Esp32Sender) {
+        let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        socket
+            .set_read_timeout(Some(Duration::from_millis(200)))
+            .unwrap();
+        let sender = Esp32Sender::open(&socket.local_addr().unwrap().to_string(), 0).unwrap();
+        (socket, sender)
+    }
+
+    // Datagrams until the socket is quiet: (header, frame slices as
+    // (offset, push, pixels), event words)
+    fn receive(socket: &UdpSocket) -> Vec<(Header, Vec<(u16, bool, Vec<u8>)>, Vec<u32>)> {
+        let mut out = Vec::new();
+        let mut buf = [0u8; 2048];
+        while let Ok(len) = socket.recv(&mut buf) {
+            let (mut slices, mut words) = (Vec::new(), Vec::new());
+            let header = link::decode(&buf[..len], |record| match record {
+                Record::Event(event) => words.push(event.word),
+                Record::Frame {
+                    push,
+                    offset,
+                    pixels,
+                } => slices.push((offset, push, pixels.to_vec())),
+            })
+            .unwrap();
+            assert!(len <= link::MAX_DATAGRAM);
+            out.push((header, slices, words));
+        }
+        out
+    }
+
+    fn frame(pixels: usize, value: u8) -> Vec<u8> {
+        vec![value; pixels * 3]
+    }
+
+    #[test]
+    fn large_frames_go_out_in_numbered_slices() {
+        let (socket, mut sender) = board();
+        let pixels: Vec<u8> = (0..1000 * 3).map(|i| i as u8).collect();
+        sender.send(0x1234, &pixels).unwrap();
+
+        let datagrams = receive(&socket);
+        assert_eq!(datagrams.len(), 3);
+        let mut reassembled = Vec::new();
+        for (i, (header, slices, _)) in datagrams.iter().enumerate() {
+            assert_eq!(header.seq, i as u16);
+            assert_eq!(header.timestamp_us, 0x1234);
+            let (offset, push, data) = &slices[0];
+            assert_eq!(*offset as usize, i * MAX_SLICE_PIXELS);
+            assert_eq!(*push, i == 2);
+            reassembled.extend_from_slice(data);
+        }
+        assert_eq!(reassembled, pixels);
+    }
+
+    #[test]
+    fn only_changed_slices_are_resent() {
+        let (socket, mut sender) = board();
+        let mut pixels = frame(1000, 1);
+        sender.send(0, &pixels).unwrap();
+        assert_eq!(receive(&socket).len(), 3);
+
+        // One pixel in the middle slice
+        pixels[(MAX_SLICE_PIXELS + 5) * 3] = 9;
+        sender.send(1, &pixels).unwrap();
+        let datagrams = receive(&socket);
+        assert_eq!(datagrams.len(), 1);
+        let (offset, push, _) = &datagrams[0].1[0];
+        assert_eq!((*offset as usize, *push), (MAX_SLICE_PIXELS, true));
+
+        // The same frame again is a keepalive: everything
+        sender.send(2, &pixels).unwrap();
+        assert_eq!(receive(&socket).len(), 3);
+        let stats = sender.stats();
+        assert_eq!((stats.frames, stats.unchanged_slices), (3, 2));
+    }
+
+    #[test]
+    fn a_lost_slice_is_repaired_by_the_refresh() {
+        let (socket, mut sender) = board();
+        let mut pixels = frame(1000, 1);
+        sender.send(0, &pixels).unwrap();
+        // The middle slice changes once; its datagram (seq 3) is lost.
+        pixels[(MAX_SLICE_PIXELS + 5) * 3] = 9;
+        sender.send(1, &pixels).unwrap();
+        // Afterwards only the first slice keeps changing.
+        let mut frames = vec![pixels.clone()];
+        for i in 2..REFRESH_FRAMES as u64 + 2 {
+            pixels[0] = i as u8;
+            sender.send(i, &pixels).unwrap();
+            frames.push(pixels.clone());
+        }
+
+        // The board's staging buffer, as after each pushed frame
+        let mut staging = frame(1000, 0);
+        let mut stale_frames = 0;
+        for (header, slices, _) in receive(&socket) {
+            if header.seq == 3 {
+                continue;
+            }
+            for (offset, push, data) in slices {
+                let start = offset as usize * 3;
+                staging[start..start + data.len()].copy_from_slice(&data);
+                if push && header.timestamp_us >= 1 {
+                    stale_frames += (staging != frames[header.timestamp_us as usize - 1]) as u32;
+                }
+            }
+        }
+        // Frames 2 to 29 show the old middle slice, frame 30 resends it.
+        assert_eq!(stale_frames, REFRESH_FRAMES - 2);
+        assert_eq!(staging, pixels);
+    }
 
     #[test]
-    fn it_works() {
-        let result = add(2, 2);
-        assert_eq!(result, 4);
+    fn events_are_batched_on_the_board_sequence() {
+        let (socket, mut frames) = board();
+        let mut events = frames.event_link();
+        frames.send(0, &frame(10, 1)).unwrap();
+        let notes: Vec<MidiEvent> = (0..300u32)
+            .map(|i| MidiEvent::note_on(0, (i % 128) as u8, 100, 5_000 + i as u64))
+            .collect();
+        events.send_events(&notes).unwrap();
+
+        let datagrams = receive(&socket);
+        // One frame, then 300 events in one datagram (two records)
+        assert_eq!(datagrams.len(), 2);
+        let (header, slices, words) = &datagrams[1];
+        assert_eq!(
+            *header,
+            Header {
+                seq: 1,
+                timestamp_us: 5_000
+            }
+        );
+        assert!(slices.is_empty());
+        assert_eq!(words.len(), 300);
+        assert!(words.iter().zip(&notes).all(|(w, e)| *w == e.word));
+        assert_eq!(frames.stats().events, 300);
+    }
+
+    #[test]
+    fn sysex_only_batches_use_no_sequence_number() {
+        let (socket, mut sender) = board();
+        sender.send(0, &frame(10, 1)).unwrap();
+        sender
+            .send_events(&[MidiEvent::sysex(0, 100), MidiEvent::sysex(1, 200)])
+            .unwrap();
+        // Leading SysEx neither opens a datagram nor sets its timestamp
+        sender
+            .send_events(&[
+                MidiEvent::sysex(2, 300),
+                MidiEvent::note_on(0, 60, 100, 400),
+            ])
+            .unwrap();
+        sender.send(500, &frame(10, 2)).unwrap();
+
+        let datagrams = receive(&socket);
+        let headers: Vec<Header> = datagrams.iter().map(|d| d.0).collect();
+        assert_eq!(
+            headers,
+            vec![
+                Header {
+                    seq: 0,
+                    timestamp_us: 0
+                },
+                Header {
+                    seq: 1,
+                    timestamp_us: 400
+                },
+                Header {
+                    seq: 2,
+                    timestamp_us: 500
+                },
+            ]
+        );
+        assert_eq!(datagrams[1].2.len(), 1);
+        assert_eq!(sender.stats().datagrams, 3);
+    }
+
+    #[test]
+    fn pacing_drops_frames_but_not_events() {
+        let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        socket
+            .set_read_timeout(Some(Duration::from_millis(200)))
+            .unwrap();
+        // 1 kB/s: the 100 B burst takes one 60-pixel frame, then debt
+        let mut frames =
+            Esp32Sender::open(&socket.local_addr().unwrap().to_string(), 1_000).unwrap();
+        let mut events = frames.event_link();
+        for i in 0..5u8 {
+            frames.send(i as u64, &frame(60, i)).unwrap();
+            events
+                .send_events(&[MidiEvent::note_on(0, 60 + i, 100, 0)])
+                .unwrap();
+        }
+
+        let datagrams = receive(&socket);
+        let frame_count = datagrams.iter().filter(|d| !d.1.is_empty()).count();
+        let event_count: usize = datagrams.iter().map(|d| d.2.len()).sum();
+        assert_eq!(frame_count, 1);
+        assert_eq!(event_count, 5);
+        let stats = frames.stats();
+        assert_eq!((stats.frames, stats.paced, stats.events), (1, 4, 5));
     }
 }
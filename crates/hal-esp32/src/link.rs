@@ -0,0 +1,313 @@
+//! Visualizer link: wire format of the hub -> ESP32 stream.
+//!
+//! One UDP datagram of at most `MAX_DATAGRAM` bytes (below the WiFi MTU, so
+//! the board never has to reassemble IP fragments; lwIP on the ESP32 drops
+//! them by default) is an 8-byte header followed by records, big-endian like
+//! DDP and OSC:
+//!
+//! ```text
+//! header  'E' version seq:u16 timestamp_us:u32
+//! events  0x01 count:u8, count x packed UMP word:u32
+//! frame   0x02 flags:u8 offset:u16 count:u16, count x RGB
+//! ```
+//!
+//! `seq` counts datagrams (the board counts gaps), `timestamp_us` is the low
+//! half of the hub clock at the first event or at the frame. A frame larger
+//! than one datagram goes out in slices; `FRAME_PUSH` on the last one tells
+//! the board to show it. The firmware side is `viz_link.h`.
+
+use rtp_midi_core::MidiEvent;
+
+pub const MAGIC: u8 = b'E';
+pub const VERSION: u8 = 1;
+pub const HEADER_LEN: usize = 8;
+/// Largest datagram, UDP payload.
+pub const MAX_DATAGRAM: usize = 1400;
+/// IPv4 + UDP headers added to every datagram on the air.
+pub const WIRE_OVERHEAD: usize = 28;
+
+pub const RECORD_EVENTS: u8 = 0x01;
+pub const RECORD_FRAME: u8 = 0x02;
+pub const EVENTS_HEADER: usize = 2;
+pub const FRAME_HEADER: usize = 6;
+/// Last slice of a frame: show it.
+pub const FRAME_PUSH: u8 = 0x01;
+
+/// Events one record holds.
+pub const MAX_RECORD_EVENTS: usize = u8::MAX as usize;
+/// Pixels of one frame slice filling a datagram.
+pub const MAX_SLICE_PIXELS: usize = (MAX_DATAGRAM - HEADER_LEN - FRAME_HEADER) / 3;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Header {
+    pub seq: u16,
+    pub timestamp_us: u32,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Record<'a> {
+    Event(MidiEvent),
+    Frame {
+        push: bool,
+        offset: u16,
+        pixels: &'a [u8],
+    },
+}
+
+/// Starts a datagram in `buf` (cleared first).
+pub fn begin(buf: &mut Vec<u8>, seq: u16, timestamp_us: u64) {
+    buf.clear();
+    buf.extend_from_slice(&[MAGIC, VERSION]);
+    buf.extend_from_slice(&seq.to_be_bytes());
+    buf.extend_from_slice(&(timestamp_us as u32).to_be_bytes());
+}
+
+/// Appends as many of `events` as fit in the datagram as one record and
+/// returns how many. SysEx events are skipped (counted as packed): their word
+/// only points into the hub's arena.
+pub fn push_events(buf: &mut Vec<u8>, events: &[MidiEvent]) -> usize {
+    let room = MAX_DATAGRAM.saturating_sub(buf.len() + EVENTS_HEADER) / 4;
+    let start = buf.len();
+    buf.extend_from_slice(&[RECORD_EVENTS, 0]);
+    let mut count = 0;
+    let mut taken = 0;
+    for event in events {
+        if count == room.min(MAX_RECORD_EVENTS) {
+            break;
+        }
+        taken += 1;
+        if event.is_sysex() {
+            continue;
+        }
+        buf.extend_from_slice(&event.word.to_be_bytes());
+        count += 1;
+    }
+    if count == 0 {
+        buf.truncate(start);
+    } else {
+        buf[start + 1] = count as u8;
+    }
+    taken
+}
+
+/// Appends a slice of a frame starting at pixel `offset`: as many pixels of
+/// the RGB `pixels` as fit. Returns how many pixels went in.
+pub fn push_frame(buf: &mut Vec<u8>, offset: usize, pixels: &[u8], push: bool) -> usize {
+    let room = MAX_DATAGRAM.saturating_sub(buf.len() + FRAME_HEADER) / 3;
+    let count = (pixels.len() / 3).min(room).min(u16::MAX as usize);
+    buf.extend_from_slice(&[RECORD_FRAME, if push { FRAME_PUSH } else { 0 }]);
+    buf.extend_from_slice(&(offset as u16).to_be_bytes());
+    buf.extend_from_slice(&(count as u16).to_be_bytes());
+    buf.extend_from_slice(&pixels[..count * 3]);
+    count
+}
+
+/// Parses a datagram, handing every record to `f`. `None` for a foreign or
+/// truncated datagram; records before the damage are still delivered.
+pub fn decode<'a>(datagram: &'a [u8], mut f: impl FnMut(Record<'a>)) -> Option<Header> {
+    if datagram.len() < HEADER_LEN || datagram[0] != MAGIC || datagram[1] != VERSION {
+        return None;
+    }
+    let header = Header {
+        seq: u16::from_be_bytes([datagram[2], datagram[3]]),
+        timestamp_us: u32::from_be_bytes(datagram[4..8].try_into().unwrap()),
+    };
+    let mut rest = &datagram[HEADER_LEN..];
+    while let Some(&tag) = rest.first() {
+        match tag {
+            RECORD_EVENTS if rest.len() >= EVENTS_HEADER => {
+                let end = EVENTS_HEADER + rest[1] as usize * 4;
+                let words = rest.get(EVENTS_HEADER..end)?;
+                for word in words.chunks_exact(4) {
+                    f(Record::Event(MidiEvent {
+                        word: u32::from_be_bytes(word.try_into().unwrap()),
+                        time_us: header.timestamp_us as u64,
+                    }));
+                }
+                rest = &rest[end..];
+            }
+            RECORD_FRAME if rest.len() >= FRAME_HEADER => {
+                let count = u16::from_be_bytes([rest[4], rest[5]]) as usize;
+                let end = FRAME_HEADER + count * 3;
+                f(Record::Frame {
+                    push: rest[1] & FRAME_PUSH != 0,
+                    offset: u16::from_be_bytes([rest[2], rest[3]]),
+                    pixels: rest.get(FRAME_HEADER..end)?,
+                });
+                rest = &rest[end..];
+            }
+            _ => return None,
+        }
+    }
+    Some(header)
+}
+
+/// Byte budget of one board (token bucket in bytes on the air).
+///
+/// Events always go out and may run the budget into debt; frames wait until
+/// it is paid off, so a board on a weak link loses frames, never notes.
+#[derive(Debug, Clone)]
+pub struct Pacer {
+    bytes_per_sec: u64,
+    // Budget in byte-microseconds, so slow rates do not round away.
+    tokens: i64,
+    last_us: u64,
+}
+
+impl Pacer {
+    /// `bytes_per_sec` 0 = unlimited.
+    pub fn new(bytes_per_sec: u64) -> Self {
+        Self {
+            bytes_per_sec,
+            tokens: Self::burst(bytes_per_sec),
+            last_us: 0,
+        }
+    }
+
+    // 100 ms worth of budget can be saved up.
+    fn burst(bytes_per_sec: u64) -> i64 {
+        (bytes_per_sec as i64).saturating_mul(100_000)
+    }
+
+    fn refill(&mut self, now_us: u64) {
+        let elapsed = now_us.saturating_sub(self.last_us);
+        self.last_us = self.last_us.max(now_us);
+        let earned = (elapsed as i64).saturating_mul(self.bytes_per_sec as i64);
+        self.tokens = self
+            .tokens
+            .saturating_add(earned)
+            .min(Self::burst(self.bytes_per_sec));
+    }
+
+    /// Charges `bytes` that go out regardless (events).
+    pub fn charge(&mut self, now_us: u64, bytes: usize) {
+        if self.bytes_per_sec == 0 {
+            return;
+        }
+        self.refill(now_us);
+        self.tokens -= bytes as i64 * 1_000_000;
+    }
+
+    /// Charges `bytes` if the budget is not in debt (frames).
+    pub fn admit(&mut self, now_us: u64, bytes: usize) -> bool {
+        if self.bytes_per_sec == 0 {
+            return true;
+        }
+        self.refill(now_us);
+        if self.tokens < 0 {
+            return false;
+        }
+        self.tokens -= bytes as i64 * 1_000_000;
+        true
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn records(datagram: &[u8]) -> (Option<Header>, Vec<Record<'_>>) {
+        let mut out = Vec::new();
+        let header = decode(datagram, |r| out.push(r));
+        (header, out)
+    }
+
+    // Same bytes as testDecodeGolden in firmware/esp32_visualizer/host/viz_link_test.cpp
+    #[test]
+    fn golden_datagram() {
+        let mut buf = Vec::new();
+        begin(&mut buf, 0x0102, 0x1_0304_0506);
+        let events = [
+            MidiEvent::note_on(0, 60, 100, 0),
+            MidiEvent::note_off(1, 62, 0, 0),
+        ];
+        assert_eq!(push_events(&mut buf, &events), 2);
+        assert_eq!(push_frame(&mut buf, 3, &[1, 2, 3, 4, 5, 6], true), 2);
+        assert_eq!(
+            buf,
+            [
+                b'E', 1, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, // header
+                0x01, 2, 0x20, 0x90, 60, 100, 0x20, 0x81, 62, 0, // events
+                0x02, 0x01, 0, 3, 0, 2, 1, 2, 3, 4, 5, 6, // frame
+            ]
+        );
+
+        let (header, decoded) = records(&buf);
+        assert_eq!(
+            header,
+            Some(Header {
+                seq: 0x0102,
+                timestamp_us: 0x0304_0506
+            })
+        );
+        assert_eq!(decoded.len(), 3);
+        assert!(matches!(decoded[0], Record::Event(e) if e.word == events[0].word));
+        assert!(matches!(decoded[1], Record::Event(e) if e.word == events[1].word));
+        assert_eq!(
+            decoded[2],
+            Record::Frame {
+                push: true,
+                offset: 3,
+                pixels: &[1, 2, 3, 4, 5, 6]
+            }
+        );
+    }
+
+    #[test]
+    fn records_never_exceed_a_datagram() {
+        let mut buf = Vec::new();
+        begin(&mut buf, 0, 0);
+        let events = vec![MidiEvent::note_on(0, 60, 100, 0); 1000];
+        assert_eq!(push_events(&mut buf, &events), MAX_RECORD_EVENTS);
+        assert_eq!(push_events(&mut buf, &events), 92);
+        assert!(buf.len() <= MAX_DATAGRAM);
+
+        begin(&mut buf, 0, 0);
+        let pixels = vec![7u8; 1000 * 3];
+        assert_eq!(push_frame(&mut buf, 0, &pixels, false), MAX_SLICE_PIXELS);
+        assert!(buf.len() <= MAX_DATAGRAM);
+    }
+
+    #[test]
+    fn sysex_is_skipped() {
+        let mut buf = Vec::new();
+        begin(&mut buf, 0, 0);
+        assert_eq!(push_events(&mut buf, &[MidiEvent::sysex(0, 0)]), 1);
+        assert_eq!(buf.len(), HEADER_LEN);
+    }
+
+    #[test]
+    fn rejects_foreign_and_truncated_datagrams() {
+        assert_eq!(records(b"/midi\0\0\0,i\0\0\0\0\0\0").0, None);
+        let mut buf = Vec::new();
+        begin(&mut buf, 0, 0);
+        push_frame(&mut buf, 0, &[1, 2, 3, 4, 5, 6], true);
+        buf.truncate(buf.len() - 1);
+        assert_eq!(records(&buf).0, None);
+    }
+
+    #[test]
+    fn pacer_keeps_the_rate_and_lets_events_through() {
+        // 100 kB/s, 10 kB burst
+        let mut pacer = Pacer::new(100_000);
+        assert!(pacer.admit(0, 10_000));
+        // Budget spent but not in debt: one more frame
+        assert!(pacer.admit(0, 1_000));
+        // In debt: events still go, frames wait
+        pacer.charge(0, 500);
+        assert!(!pacer.admit(1_000, 1_000));
+        // 1500 bytes of debt are paid after 15 ms
+        assert!(!pacer.admit(14_000, 1_000));
+        assert!(pacer.admit(15_000, 1_000));
+
+        // One second of 1 kB frames every ms: about 100 go out
+        let mut pacer = Pacer::new(100_000);
+        let sent = (0..1_000u64)
+            .filter(|ms| pacer.admit(ms * 1_000, 1_000))
+            .count();
+        assert!((100..=112).contains(&sent), "{sent}");
+
+        let mut unlimited = Pacer::new(0);
+        assert!((0..1_000).all(|i| unlimited.admit(i, 1_000_000)));
+    }
+}
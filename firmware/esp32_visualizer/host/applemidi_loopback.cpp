@@ -0,0 +1,212 @@
+// Loopback test of the firmware AppleMIDI endpoint (applemidi.cpp) against
+// the project's Rust session (integration_tests/src/bin/applemidi_peer.rs).
+//
+// Binds the control and data port on 127.0.0.1, starts the peer command
+// given after `--` with `--target 127.0.0.1:<control port>` appended, and
+// serves it until it says BY. The peer invites, runs a CK exchange, sends
+// `--notes` Note On/Off pairs dropping every `--drop-every`-th RTP packet
+// and ends with a CC 120 sentinel. Passes when every command arrived in
+// order (dropped ones recovered from the journal) and the CK exchange
+// completed.
+//
+//   applemidi_loopback --notes 200 --drop-every 7 -- cargo run -p integration_tests --bin applemidi_peer --
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "applemidi.h"
+
+extern char** environ;
+
+namespace {
+
+uint64_t nowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+// Binds a UDP socket on 127.0.0.1:`port` (0 = any); -1 on failure.
+int bindUdp(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+uint16_t localPort(int fd) {
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+struct Received {
+    std::vector<midi::Event> events;
+    unsigned recovered = 0;
+};
+
+void onMidi(void* context, midi::Event event, bool recovered) {
+    Received* received = static_cast<Received*>(context);
+    received->events.push_back(event);
+    if (recovered) received->recovered++;
+}
+
+// The sequence the peer sends: key 21 + i % 88 on, then off, then the sentinel.
+std::vector<uint32_t> expectedWords(int notes) {
+    std::vector<uint32_t> words;
+    for (int i = 0; i < notes; i++) {
+        const uint32_t key = 21 + i % 88;
+        const uint32_t velocity = 1 + i % 127;
+        words.push_back(0x20900000u | key << 8 | velocity);
+        words.push_back(0x20800000u | key << 8);
+    }
+    words.push_back(0x20B07800u);
+    return words;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int notes = 200;
+    int dropEvery = 7;
+    int arg = 1;
+    for (; arg < argc && strcmp(argv[arg], "--") != 0; arg++) {
+        if (strcmp(argv[arg], "--notes") == 0 && arg + 1 < argc) {
+            notes = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--drop-every") == 0 && arg + 1 < argc) {
+            dropEvery = atoi(argv[++arg]);
+        }
+    }
+    if (arg + 1 >= argc) {
+        fprintf(stderr, "usage: %s [--notes N] [--drop-every N] -- <peer command>\n", argv[0]);
+        return 2;
+    }
+
+    // AppleMIDI needs the data port right above the control port.
+    int controlFd = -1;
+    int dataFd = -1;
+    for (int attempt = 0; attempt < 20 && dataFd < 0; attempt++) {
+        if (controlFd >= 0) close(controlFd);
+        controlFd = bindUdp(0);
+        if (controlFd >= 0) dataFd = bindUdp(localPort(controlFd) + 1);
+    }
+    if (dataFd < 0) {
+        perror("bind");
+        return 1;
+    }
+    const uint16_t controlPort = localPort(controlFd);
+
+    std::vector<std::string> command(argv + arg + 1, argv + argc);
+    command.push_back("--target");
+    command.push_back("127.0.0.1:" + std::to_string(controlPort));
+    command.push_back("--notes");
+    command.push_back(std::to_string(notes));
+    command.push_back("--drop-every");
+    command.push_back(std::to_string(dropEvery));
+    std::vector<char*> childArgv;
+    for (std::string& part : command) childArgv.push_back(&part[0]);
+    childArgv.push_back(nullptr);
+    pid_t child;
+    if (posix_spawnp(&child, childArgv[0], nullptr, nullptr, childArgv.data(), environ) != 0) {
+        perror("posix_spawnp");
+        return 1;
+    }
+
+    Received received;
+    applemidi::Endpoint endpoint("esp32-visualizer", 0x45535032, onMidi, &received);
+    bool peerDone = false;
+    bool sawSession = false;
+    std::string peerName;
+    int childStatus = 0;
+    uint64_t doneAt = 0;
+    // Serve until the peer has exited and the socket stayed quiet briefly.
+    while (!peerDone || nowUs() - doneAt < 200000) {
+        pollfd fds[2] = {{controlFd, POLLIN, 0}, {dataFd, POLLIN, 0}};
+        if (poll(fds, 2, 50) > 0) {
+            for (int i = 0; i < 2; i++) {
+                if (!(fds[i].revents & POLLIN)) continue;
+                uint8_t buf[1500];
+                sockaddr_in from = {};
+                socklen_t fromLen = sizeof(from);
+                ssize_t len = recvfrom(fds[i].fd, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+                if (len <= 0) continue;
+                uint8_t reply[applemidi::MAX_REPLY];
+                const applemidi::Port port = i == 0 ? applemidi::Port::Control : applemidi::Port::Data;
+                size_t replyLen = endpoint.handlePacket(port, buf, (size_t)len, nowUs(), reply);
+                if (replyLen > 0) sendto(fds[i].fd, reply, replyLen, 0, (sockaddr*)&from, fromLen);
+                if (endpoint.state() == applemidi::State::Connected && !sawSession) {
+                    sawSession = true;
+                    peerName = endpoint.peerName();
+                }
+            }
+        }
+        if (!peerDone && waitpid(child, &childStatus, WNOHANG) == child) {
+            peerDone = true;
+            doneAt = nowUs();
+        }
+    }
+
+    const applemidi::Stats& stats = endpoint.stats();
+    printf("peer '%s': %u packets, %u commands, %u recovered (%u commands), %u lost, %u duplicates, "
+           "%u malformed\n",
+           peerName.c_str(), stats.packets, stats.commands, stats.recovered, received.recovered, stats.lost,
+           stats.duplicates, stats.malformed);
+    printf("clock sync: %u exchanges, offset %lld us, rtt %u us\n", stats.syncs, (long long)stats.clockOffsetUs,
+           stats.rttUs);
+
+    int failures = 0;
+    if (!WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+        fprintf(stderr, "FAIL: peer exited with status %d\n", childStatus);
+        failures++;
+    }
+    if (!sawSession || endpoint.state() != applemidi::State::Idle) {
+        fprintf(stderr, "FAIL: session was not set up and closed with BY\n");
+        failures++;
+    }
+    if (stats.syncs == 0) {
+        fprintf(stderr, "FAIL: no CK exchange completed\n");
+        failures++;
+    }
+    const std::vector<uint32_t> expected = expectedWords(notes);
+    size_t mismatch = 0;
+    while (mismatch < expected.size() && mismatch < received.events.size() &&
+           received.events[mismatch].word == expected[mismatch]) {
+        mismatch++;
+    }
+    if (received.events.size() != expected.size() || mismatch != expected.size()) {
+        fprintf(stderr, "FAIL: %zu of %zu commands, first difference at %zu\n", received.events.size(),
+                expected.size(), mismatch);
+        failures++;
+    }
+    if (dropEvery > 0 && stats.recovered == 0) {
+        fprintf(stderr, "FAIL: no packet was recovered from a journal\n");
+        failures++;
+    }
+    if (stats.lost != 0 || stats.malformed != 0) {
+        fprintf(stderr, "FAIL: lost or malformed packets\n");
+        failures++;
+    }
+    close(controlFd);
+    close(dataFd);
+    return failures == 0 ? 0 : 1;
+}
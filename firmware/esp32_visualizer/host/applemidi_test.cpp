@@ -0,0 +1,175 @@
+// Host test of the AppleMIDI endpoint (applemidi.cpp) with RFC 6295
+// payloads as DAWs send them: command sections without a leading delta,
+// long headers, running status, SysEx segments, the recovery journal and
+// the session timeout. The loopback against the Rust peer
+// (applemidi_loopback.cpp) needs cargo; this one does not.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "applemidi.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+const uint32_t PEER_SSRC = 0x11223344;
+
+struct Board {
+    std::vector<uint32_t> events;
+    unsigned recovered = 0;
+    applemidi::Endpoint endpoint;
+
+    Board() : endpoint("esp32-visualizer", 0x45535032, onMidi, this) {}
+
+    static void onMidi(void* context, midi::Event event, bool recovered) {
+        Board* board = static_cast<Board*>(context);
+        board->events.push_back(event.word);
+        if (recovered) board->recovered++;
+    }
+
+    size_t handle(applemidi::Port port, const std::vector<uint8_t>& packet, uint64_t nowUs) {
+        uint8_t reply[applemidi::MAX_REPLY];
+        return endpoint.handlePacket(port, packet.data(), packet.size(), nowUs, reply);
+    }
+};
+
+void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    const uint8_t bytes[] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+std::vector<uint8_t> invitation(uint32_t token, uint32_t ssrc) {
+    std::vector<uint8_t> packet = {0xFF, 0xFF, 'I', 'N'};
+    putU32(packet, 2);
+    putU32(packet, token);
+    putU32(packet, ssrc);
+    const char name[] = "DAW";
+    packet.insert(packet.end(), name, name + sizeof(name));
+    return packet;
+}
+
+// RTP packet of `ssrc` with an RFC 6295 payload (flags byte(s) included)
+std::vector<uint8_t> rtp(uint16_t sequence, const std::vector<uint8_t>& payload, uint32_t ssrc = PEER_SSRC) {
+    std::vector<uint8_t> packet = {0x80, 0x61, (uint8_t)(sequence >> 8), (uint8_t)sequence};
+    putU32(packet, 0);
+    putU32(packet, ssrc);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    return packet;
+}
+
+void connect(Board& board, uint64_t nowUs) {
+    CHECK(board.handle(applemidi::Port::Control, invitation(7, PEER_SSRC), nowUs) > 0);
+    CHECK(board.handle(applemidi::Port::Data, invitation(7, PEER_SSRC), nowUs) > 0);
+    CHECK(board.endpoint.state() == applemidi::State::Connected);
+}
+
+void testCommandSection() {
+    Board board;
+    connect(board, 0);
+    // Z=0: Note On without a delta, then delta 0 + running status
+    board.handle(applemidi::Port::Data, rtp(1, {0x06, 0x90, 60, 100, 0x00, 62, 90}), 1000);
+    // Z=1 and a two-byte delta before the first command
+    board.handle(applemidi::Port::Data, rtp(2, {0x25, 0x81, 0x00, 0xB0, 7, 64}), 2000);
+    // Long header (B): 12-bit length
+    board.handle(applemidi::Port::Data, rtp(3, {0x80, 0x03, 0x80, 60, 0}), 3000);
+    const std::vector<uint32_t> expected = {0x20903C64, 0x20903E5A, 0x20B00740, 0x20803C00};
+    CHECK(board.events == expected);
+    CHECK(board.endpoint.stats().packets == 3);
+    CHECK(board.endpoint.stats().malformed == 0);
+
+    // A packet of another stream is ignored, a truncated one counted
+    board.handle(applemidi::Port::Data, rtp(4, {0x03, 0x90, 1, 1}, 0x99), 4000);
+    board.handle(applemidi::Port::Data, rtp(4, {0x05, 0x90, 1}), 4000);
+    CHECK(board.events.size() == expected.size());
+    CHECK(board.endpoint.stats().malformed == 1);
+}
+
+void testSysexSegments() {
+    Board board;
+    connect(board, 0);
+    // First segment (ends F0), real-time byte inside the last one (F7..F7),
+    // then a cancelled one (F4) and a Note On after it
+    board.handle(applemidi::Port::Data,
+                 rtp(1, {0x80, 0x10, 0xF0, 0x7D, 0x01, 0xF0, 0x00, 0xF7, 0x02, 0xF8, 0xF7, 0x00, 0xF0, 0xF4, 0x00, 0x90,
+                         64, 1}),
+                 1000);
+    CHECK(board.events.size() == 1 && board.events[0] == 0x20904001);
+    CHECK(board.endpoint.stats().malformed == 0);
+}
+
+void testJournalRecovery() {
+    Board board;
+    connect(board, 0);
+    board.handle(applemidi::Port::Data, rtp(10, {0x03, 0x90, 60, 100}), 1000);
+    board.handle(applemidi::Port::Data, rtp(11, {0x03, 0x90, 61, 80}), 2000);
+    // 12 (Note Off 60, CC 7 = 90, Note On 62) is lost. The journal of 13
+    // covers 11..12: CC 7, note 61 and 62 held, note 60 released. Only
+    // what differs from the board's state is replayed.
+    const std::vector<uint8_t> payload = {
+        0x43, 0x80, 63, 0,                    // J, Note Off 63
+        0x20, 0x00, 11,                       // A, TOTCHAN 0, checkpoint 11
+        0x00, 0x0D, 0x48,                     // channel 1, length 13, chapters C and N
+        0x00, 7, 90,                          // C: one log, controller 7 = 90
+        0x02, 0x77,                           // N: two logs, offbits for octet 7
+        61, 0x80 | 80, 62, 0x80 | 100,        // logs, Y=1
+        0x08,                                 // offbit: note 60
+    };
+    board.handle(applemidi::Port::Data, rtp(13, payload), 3000);
+    const std::vector<uint32_t> expected = {0x20903C64, 0x20903D50, 0x20B0075A, 0x20803C00, 0x20903E64, 0x20803F00};
+    CHECK(board.events == expected);
+    CHECK(board.recovered == 3);
+    CHECK(board.endpoint.stats().recovered == 1);
+    CHECK(board.endpoint.stats().lost == 0);
+
+    // A gap older than the journal's checkpoint is not covered
+    board.handle(applemidi::Port::Data, rtp(20, {0x43, 0x80, 61, 0, 0x00, 0x00, 19}), 4000);
+    CHECK(board.endpoint.stats().recovered == 1);
+    CHECK(board.endpoint.stats().lost == 6);
+    CHECK(board.endpoint.stats().malformed == 0);
+}
+
+void testSessionTimeout() {
+    const uint64_t second = 1000000;
+    Board board;
+    connect(board, 0);
+    board.endpoint.poll(59 * second);
+    CHECK(board.endpoint.state() == applemidi::State::Connected);
+    // RTP keeps the session alive
+    board.handle(applemidi::Port::Data, rtp(1, {0x03, 0x90, 60, 100}), 50 * second);
+    board.endpoint.poll(100 * second);
+    CHECK(board.endpoint.state() == applemidi::State::Connected);
+    board.endpoint.poll(111 * second);
+    CHECK(board.endpoint.state() == applemidi::State::Idle);
+    CHECK(board.endpoint.stats().timeouts == 1);
+
+    // Another DAW can invite now; a stale session refuses it until it
+    // times out, which the next packet checks as well
+    connect(board, 112 * second);
+    CHECK(board.handle(applemidi::Port::Control, invitation(8, 0x55), 113 * second) > 0);
+    CHECK(board.endpoint.peerSsrc() == PEER_SSRC);
+    board.handle(applemidi::Port::Control, invitation(8, 0x55), 200 * second);
+    CHECK(board.endpoint.peerSsrc() == 0x55);
+    CHECK(board.endpoint.stats().timeouts == 2);
+}
+
+} // namespace
+
+int main() {
+    testCommandSection();
+    testSysexSegments();
+    testJournalRecovery();
+    testSessionTimeout();
+    if (failures == 0) printf("applemidi: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Google Benchmark for the firmware render core (render_core.cpp), the 2D
+// canvas (canvas.cpp) and the clocked LED encoder (led_wire.cpp).
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "canvas.h"
+#include "led_wire.h"
+#include "render_core.h"
+
+namespace {
+
+// `active` notes spread over the keyboard, every other one fading out.
+std::vector<render::NoteState> makeNotes(int active) {
+    std::vector<render::NoteState> notes(render::NOTE_COUNT);
+    for (int i = 0; i < active; i++) {
+        render::NoteState& n = notes[(i * 37) % render::NOTE_COUNT];
+        n.active = true;
+        n.velocity = 64 + (i % 64);
+        n.startTime = 0;
+        n.fading = (i % 2) == 1;
+        n.fadeStartTime = 500;
+    }
+    return notes;
+}
+
+void BM_RenderNotes(benchmark::State& state) {
+    const int active = static_cast<int>(state.range(0));
+    const render::RenderConfig cfg = {static_cast<uint16_t>(state.range(1)), 127, 2000};
+    std::vector<render::NoteState> notes = makeNotes(active);
+    std::vector<render::Rgb> leds(cfg.numLeds);
+    for (auto _ : state) {
+        render::renderNotes(notes.data(), 1000, cfg, leds.data());
+        benchmark::DoNotOptimize(leds.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * cfg.numLeds);
+}
+// {active notes, LEDs}: idle strip, a chord, full keyboard; 23 LEDs = board_config.h
+BENCHMARK(BM_RenderNotes)->Args({0, 23})->Args({10, 23})->Args({128, 23})->Args({10, 300});
+
+void BM_HsvToRgb(benchmark::State& state) {
+    uint8_t hue = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(render::hsvToRgb(hue++, 255, 200));
+    }
+}
+BENCHMARK(BM_HsvToRgb);
+
+// {width, height}: one 32 x 32 serpentine matrix, a 64 x 16 wall of four
+// 16 x 16 serpentine panels
+canvas::Layout matrixLayout(const benchmark::State& state) {
+    const uint16_t width = static_cast<uint16_t>(state.range(0));
+    const uint16_t height = static_cast<uint16_t>(state.range(1));
+    const uint16_t panel = width == height ? width : height;
+    return {width, height, panel, panel, canvas::SERPENTINE, canvas::ROW_MAJOR};
+}
+
+void BM_CanvasPresent(benchmark::State& state) {
+    const canvas::Layout layout = matrixLayout(state);
+    std::vector<uint16_t> xy(canvas::pixelCount(layout));
+    canvas::buildXyTable(layout, xy.data());
+    std::vector<render::Rgb> frame(xy.size(), render::Rgb{1, 2, 3});
+    std::vector<render::Rgb> strip(xy.size());
+    const canvas::Canvas matrix(layout, xy.data(), frame.data());
+    for (auto _ : state) {
+        matrix.present(strip.data());
+        benchmark::DoNotOptimize(strip.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * xy.size());
+}
+BENCHMARK(BM_CanvasPresent)->Args({32, 32})->Args({64, 16});
+
+// The same mapping computed per pixel, what the table saves
+void BM_SerpentineMath(benchmark::State& state) {
+    const canvas::Layout layout = matrixLayout(state);
+    std::vector<render::Rgb> frame(canvas::pixelCount(layout), render::Rgb{1, 2, 3});
+    std::vector<render::Rgb> strip(frame.size());
+    const uint16_t panel = layout.panelWidth;
+    for (auto _ : state) {
+        for (uint16_t y = 0; y < layout.height; y++) {
+            for (uint16_t x = 0; x < layout.width; x++) {
+                const uint16_t px = x % panel;
+                const uint16_t py = y % panel;
+                const size_t base = (size_t)(y / panel * (layout.width / panel) + x / panel) * panel * panel;
+                const size_t index = base + py * panel + ((py & 1) ? panel - 1 - px : px);
+                strip[index] = frame[(size_t)y * layout.width + x];
+            }
+        }
+        benchmark::DoNotOptimize(strip.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_SerpentineMath)->Args({32, 32})->Args({64, 16});
+
+void BM_BuildXyTable(benchmark::State& state) {
+    const canvas::Layout layout = matrixLayout(state);
+    std::vector<uint16_t> xy(canvas::pixelCount(layout));
+    for (auto _ : state) {
+        canvas::buildXyTable(layout, xy.data());
+        benchmark::DoNotOptimize(xy.data());
+    }
+}
+BENCHMARK(BM_BuildXyTable)->Args({32, 32})->Args({64, 16});
+
+void BM_NoteColumns(benchmark::State& state) {
+    const canvas::Layout layout = matrixLayout(state);
+    std::vector<uint16_t> xy(canvas::pixelCount(layout));
+    canvas::buildXyTable(layout, xy.data());
+    std::vector<render::Rgb> frame(xy.size());
+    std::vector<render::Rgb> strip(xy.size());
+    canvas::Canvas matrix(layout, xy.data(), frame.data());
+    std::vector<render::NoteState> notes = makeNotes(10);
+    const render::RenderConfig cfg = {static_cast<uint16_t>(xy.size()), 127, 2000};
+    for (auto _ : state) {
+        canvas::renderNoteColumns(notes.data(), 1000, cfg, matrix);
+        matrix.present(strip.data());
+        benchmark::DoNotOptimize(strip.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * xy.size());
+}
+BENCHMARK(BM_NoteColumns)->Args({32, 32})->Args({64, 16});
+
+void BM_EncodeApa102(benchmark::State& state) {
+    const uint16_t numLeds = static_cast<uint16_t>(state.range(0));
+    std::vector<render::Rgb> pixels(numLeds, render::Rgb{200, 100, 50});
+    std::vector<uint8_t> frame(ledwire::frameBytes(ledwire::Chipset::Apa102, numLeds));
+    for (auto _ : state) {
+        ledwire::encode(ledwire::Chipset::Apa102, pixels.data(), numLeds, 150, ledwire::Order::BGR, frame.data());
+        benchmark::DoNotOptimize(frame.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * numLeds);
+    state.counters["wire_us"] = ledwire::wireTimeUs(ledwire::Chipset::Apa102, numLeds, 12000000);
+}
+// The board strip and a 1000-LED strip (LED_SPI_HZ = 12 MHz in board_config.h)
+BENCHMARK(BM_EncodeApa102)->Arg(23)->Arg(1000);
+
+} // namespace
@@ -0,0 +1,100 @@
+// Host test of the 2D canvas (canvas.cpp): XY tables for serpentine,
+// column-major, flipped and tiled wirings, present, and the note columns.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "canvas.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+std::vector<uint16_t> table(const canvas::Layout& layout) {
+    std::vector<uint16_t> xy(canvas::pixelCount(layout));
+    CHECK(canvas::buildXyTable(layout, xy.data()));
+    return xy;
+}
+
+// Every strip index exactly once
+bool isPermutation(const std::vector<uint16_t>& xy) {
+    std::vector<bool> seen(xy.size(), false);
+    for (uint16_t index : xy) {
+        if (index >= xy.size() || seen[index]) return false;
+        seen[index] = true;
+    }
+    return true;
+}
+
+void testSinglePanelWirings() {
+    // 4 x 3, strip index of (x, y) at [y * 4 + x]
+    const std::vector<uint16_t> rows = table({4, 3, 4, 3, canvas::ROW_MAJOR, 0});
+    CHECK((rows == std::vector<uint16_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}));
+    const std::vector<uint16_t> serpentine = table({4, 3, 4, 3, canvas::SERPENTINE, 0});
+    CHECK((serpentine == std::vector<uint16_t>{0, 1, 2, 3, 7, 6, 5, 4, 8, 9, 10, 11}));
+    const std::vector<uint16_t> columns = table({4, 3, 4, 3, canvas::COLUMN_MAJOR | canvas::SERPENTINE, 0});
+    CHECK((columns == std::vector<uint16_t>{0, 5, 6, 11, 1, 4, 7, 10, 2, 3, 8, 9}));
+    // Wired from the bottom right corner
+    const std::vector<uint16_t> flipped = table({4, 3, 4, 3, canvas::FLIP_X | canvas::FLIP_Y, 0});
+    CHECK(flipped[0] == 11 && flipped[11] == 0);
+    CHECK(isPermutation(serpentine) && isPermutation(columns) && isPermutation(flipped));
+}
+
+void testTiledPanels() {
+    // Two 2 x 2 serpentine panels side by side: left panel first
+    const std::vector<uint16_t> tiled = table({4, 2, 2, 2, canvas::SERPENTINE, canvas::ROW_MAJOR});
+    CHECK((tiled == std::vector<uint16_t>{0, 1, 4, 5, 3, 2, 7, 6}));
+    // 64 x 16 of four 16 x 16 panels, chained right to left
+    const std::vector<uint16_t> wall = table({64, 16, 16, 16, canvas::SERPENTINE, canvas::FLIP_X});
+    CHECK(isPermutation(wall));
+    CHECK(wall[48] == 0);
+    CHECK(wall[0] == 3 * 256);
+
+    uint16_t unused[12];
+    CHECK(!canvas::buildXyTable({4, 3, 3, 3, 0, 0}, unused));
+    CHECK(!canvas::buildXyTable({4, 3, 0, 3, 0, 0}, unused));
+    CHECK(!canvas::buildXyTable({256, 256, 256, 256, 0, 0}, unused));
+}
+
+void testPresentAndNoteColumns() {
+    const canvas::Layout layout = {4, 3, 4, 3, canvas::SERPENTINE, 0};
+    const std::vector<uint16_t> xy = table(layout);
+    std::vector<render::Rgb> frame(12);
+    std::vector<render::Rgb> strip(12);
+    canvas::Canvas matrix(layout, xy.data(), frame.data());
+    matrix.at(3, 1) = render::Rgb{9, 8, 7};
+    matrix.present(strip.data());
+    CHECK(strip[4].r == 9 && strip[4].b == 7);
+
+    // Note 5 -> column 1, full velocity -> full height; note 2 at a third
+    std::vector<render::NoteState> notes(render::NOTE_COUNT);
+    notes[5] = {true, 127, 0, 0, false};
+    notes[2] = {true, 1, 0, 0, false};
+    const render::RenderConfig cfg = {12, 127, 2000};
+    canvas::renderNoteColumns(notes.data(), 0, cfg, matrix);
+    const render::Rgb color = render::noteColor(5, notes[5], 0, cfg);
+    for (uint16_t y = 0; y < 3; y++) CHECK(memcmp(&matrix.at(1, y), &color, sizeof(color)) == 0);
+    CHECK(matrix.at(2, 2).r + matrix.at(2, 2).g + matrix.at(2, 2).b > 0);
+    CHECK(matrix.at(2, 1).r + matrix.at(2, 1).g + matrix.at(2, 1).b == 0);
+    CHECK(matrix.at(0, 2).r + matrix.at(0, 2).g + matrix.at(0, 2).b == 0);
+}
+
+} // namespace
+
+int main() {
+    testSinglePanelWirings();
+    testTiledPanels();
+    testPresentAndNoteColumns();
+    if (failures == 0) printf("canvas: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
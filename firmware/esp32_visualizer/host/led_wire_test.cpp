@@ -0,0 +1,90 @@
+// Host test of the LED wire formats (led_wire.cpp): clocked frame layout,
+// hardware brightness split, colour order, end frames and wire times.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "led_wire.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+using ledwire::Chipset;
+using ledwire::Order;
+
+void testFrameLayout() {
+    const render::Rgb pixels[2] = {{10, 20, 30}, {255, 0, 128}};
+    std::vector<uint8_t> frame(ledwire::frameBytes(Chipset::Apa102, 2), 0xAA);
+    // Start, 2 LEDs, one end byte (2 / 2 clock edges)
+    CHECK(frame.size() == 4 + 8 + 1);
+    CHECK(ledwire::encode(Chipset::Apa102, pixels, 2, 255, Order::BGR, frame.data()) == frame.size());
+    const uint8_t expected[] = {0, 0, 0, 0, 0xFF, 30, 20, 10, 0xFF, 128, 0, 255, 0};
+    CHECK(memcmp(frame.data(), expected, sizeof(expected)) == 0);
+
+    ledwire::encode(Chipset::Apa102, pixels, 2, 255, Order::GRB, frame.data());
+    CHECK(frame[5] == 20 && frame[6] == 10 && frame[7] == 30);
+    ledwire::encode(Chipset::Apa102, pixels, 2, 255, Order::RGB, frame.data());
+    CHECK(frame[5] == 10 && frame[6] == 20 && frame[7] == 30);
+}
+
+void testEndFrames() {
+    // numLeds / 2 extra clock edges, SK9822 also a 32-bit latch
+    CHECK(ledwire::frameBytes(Chipset::Apa102, 16) == 4 + 64 + 1);
+    CHECK(ledwire::frameBytes(Chipset::Apa102, 17) == 4 + 68 + 2);
+    CHECK(ledwire::frameBytes(Chipset::Sk9822, 16) == 4 + 64 + 4 + 1);
+    CHECK(ledwire::frameBytes(Chipset::Ws2812, 16) == 0);
+
+    std::vector<render::Rgb> pixels(17, render::Rgb{1, 2, 3});
+    std::vector<uint8_t> frame(ledwire::frameBytes(Chipset::Sk9822, 17), 0xAA);
+    ledwire::encode(Chipset::Sk9822, pixels.data(), 17, 255, Order::RGB, frame.data());
+    for (size_t i = 4 + 68; i < frame.size(); i++) CHECK(frame[i] == 0);
+}
+
+void testBrightnessSplit() {
+    const render::Rgb white = {255, 255, 255};
+    uint8_t frame[4 + 4 + 1];
+    // Off: global 0, colours 0
+    ledwire::encode(Chipset::Apa102, &white, 1, 0, Order::RGB, frame);
+    CHECK(frame[4] == 0xE0 && frame[5] == 0);
+    // 150 -> hardware 19/31, colours scaled by the remainder
+    ledwire::encode(Chipset::Apa102, &white, 1, 150, Order::RGB, frame);
+    CHECK(frame[4] == (0xE0 | 19));
+    const double effective = 19.0 / 31.0 * frame[5] / 255.0;
+    CHECK(effective > 149.0 / 255.0 && effective <= 150.0 / 255.0);
+    // Very dim: hardware does the dimming, the colour keeps its resolution
+    ledwire::encode(Chipset::Apa102, &white, 1, 8, Order::RGB, frame);
+    CHECK(frame[4] == (0xE0 | 1));
+    CHECK(frame[5] >= 240);
+}
+
+void testWireTime() {
+    // WS2812: 30 us per LED plus the latch
+    CHECK(ledwire::wireTimeUs(Chipset::Ws2812, 23, 0) == 23 * 30 + 280);
+    CHECK(ledwire::maxFps(Chipset::Ws2812, 1000, 0) == 33);
+    // APA102, 1000 LEDs at 12 MHz: (4 + 4000 + 63) bytes
+    CHECK(ledwire::wireTimeUs(Chipset::Apa102, 1000, 12000000) == 2712);
+    CHECK(ledwire::maxFps(Chipset::Apa102, 1000, 12000000) >= 200);
+    CHECK(ledwire::wireTimeUs(Chipset::Apa102, 1000, 0) == 0);
+}
+
+} // namespace
+
+int main() {
+    testFrameLayout();
+    testEndFrames();
+    testBrightnessSplit();
+    testWireTime();
+    if (failures == 0) printf("led_wire: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF FreeRTOS headers: just the types and
+// configuration task_stats.cpp reads. Task tables come from
+// freertos_shim::setTasks (see task.h), not from a scheduler.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+// Bytes, as on the ESP32
+typedef uint8_t StackType_t;
+typedef void* TaskHandle_t;
+
+#define configGENERATE_RUN_TIME_STATS 1
+#define configTASKLIST_INCLUDE_COREID 1
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define tskNO_AFFINITY 0x7FFFFFFF
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid,
+} eTaskState;
+
+// Field subset and order of the ESP-IDF TaskStatus_t
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t* pxStackBase;
+    uint16_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+UBaseType_t uxTaskGetNumberOfTasks(void);
+// Copies the task table set with freertos_shim::setTasks; 0 when it does
+// not fit into `arraySize`, like FreeRTOS.
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* tasks, UBaseType_t arraySize,
+                                 configRUN_TIME_COUNTER_TYPE* totalRunTime);
+
+namespace freertos_shim {
+
+// Task table and run-time counter the next uxTaskGetSystemState reports
+void setTasks(const TaskStatus_t* tasks, size_t count, uint32_t totalRunTime);
+
+} // namespace freertos_shim
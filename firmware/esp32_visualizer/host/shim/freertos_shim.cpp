@@ -0,0 +1,31 @@
+#include "freertos/task.h"
+
+#include <vector>
+
+namespace {
+
+std::vector<TaskStatus_t> tasks;
+uint32_t totalRunTime = 0;
+
+} // namespace
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    return (UBaseType_t)tasks.size();
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* out, UBaseType_t arraySize,
+                                 configRUN_TIME_COUNTER_TYPE* total) {
+    if (tasks.size() > arraySize) return 0;
+    for (size_t i = 0; i < tasks.size(); i++) out[i] = tasks[i];
+    if (total) *total = totalRunTime;
+    return (UBaseType_t)tasks.size();
+}
+
+namespace freertos_shim {
+
+void setTasks(const TaskStatus_t* table, size_t count, uint32_t total) {
+    tasks.assign(table, table + count);
+    totalRunTime = total;
+}
+
+} // namespace freertos_shim
@@ -0,0 +1,165 @@
+// Host test of the task telemetry (task_stats.cpp) on the FreeRTOS shim
+// (shim/freertos): loads over the interval, idle share per core, stack
+// watermarks, tasks appearing between samples, reordered task lists,
+// counter wrap and the log line.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "freertos/task.h"
+#include "task_stats.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+TaskStatus_t task(const char* name, UBaseType_t number, BaseType_t core, uint32_t runTime, uint16_t stackFree) {
+    TaskStatus_t status = {};
+    status.pcTaskName = name;
+    status.xTaskNumber = number;
+    status.xCoreID = core;
+    status.ulRunTimeCounter = runTime;
+    status.usStackHighWaterMark = stackFree;
+    return status;
+}
+
+// The firmware's own tasks and the idle tasks, counters at `base` + the load
+// per core given in permille over `interval`.
+std::vector<TaskStatus_t> board(uint32_t base, uint32_t interval, uint32_t idle0, uint32_t idle1,
+                                uint32_t network, uint32_t animation) {
+    return {
+        task("IDLE", 1, 0, base + interval / 1000 * idle0, 900),
+        task("IDLE", 2, 1, base + interval / 1000 * idle1, 900),
+        task("NetworkTask", 3, 0, base + interval / 1000 * network, 5120),
+        task("AnimationTask", 4, 1, base + interval / 1000 * animation, 1480),
+        task("Tmr Svc", 5, tskNO_AFFINITY, base, 1700),
+    };
+}
+
+void set(const std::vector<TaskStatus_t>& tasks, uint32_t total) {
+    freertos_shim::setTasks(tasks.data(), tasks.size(), total);
+}
+
+void testLoadsOverInterval() {
+    taskstats::Sampler sampler;
+    taskstats::Snapshot snapshot;
+    set(board(0, 0, 0, 0, 0, 0), 0);
+    CHECK(!sampler.sample(snapshot));
+    CHECK(!snapshot.hasLoad);
+    CHECK(snapshot.count == 5);
+    CHECK(snapshot.tasks[2].stackFreeBytes == 5120);
+
+    set(board(0, 1000000, 970, 800, 23, 195), 1000000);
+    CHECK(sampler.sample(snapshot));
+    CHECK(snapshot.hasLoad);
+    CHECK(snapshot.interval == 1000000);
+    CHECK(snapshot.idlePermille[0] == 970);
+    CHECK(snapshot.idlePermille[1] == 800);
+    CHECK(snapshot.tasks[2].loadPermille == 23);
+    CHECK(snapshot.tasks[2].core == 0);
+    CHECK(snapshot.tasks[3].loadPermille == 195);
+    CHECK(snapshot.tasks[4].core == taskstats::ANY_CORE);
+    CHECK(strcmp(snapshot.tasks[snapshot.minStackIndex].name, "IDLE") == 0);
+
+    char line[256];
+    taskstats::formatLine(snapshot, line, sizeof(line));
+    CHECK(strcmp(line, "idle 97.0% 80.0% | NetworkTask c0 2.3% 5120B | AnimationTask c1 19.5% 1480B"
+                       " | Tmr Svc c- 0.0% 1700B") == 0);
+    // Truncated, still terminated
+    CHECK(taskstats::formatLine(snapshot, line, 12) == 11);
+    CHECK(strlen(line) == 11);
+}
+
+void testNewTaskAndWrap() {
+    taskstats::Sampler sampler;
+    taskstats::Snapshot snapshot;
+    // Counters about to wrap (uint32_t us wraps after ~71 minutes)
+    const uint32_t base = 0xFFFFFFFFu - 200000;
+    set(board(base, 0, 0, 0, 0, 0), base);
+    sampler.sample(snapshot);
+
+    std::vector<TaskStatus_t> tasks = board(base, 1000000, 500, 500, 500, 500);
+    // Started since the last sample: its whole counter is this interval
+    tasks.push_back(task("ota", 6, 0, 400000, 64));
+    set(tasks, base + 1000000);
+    CHECK(sampler.sample(snapshot));
+    CHECK(snapshot.idlePermille[0] == 500);
+    CHECK(snapshot.tasks[5].loadPermille == 400);
+    CHECK(snapshot.minStackIndex == 5);
+}
+
+void testReorderedTasks() {
+    taskstats::Sampler sampler;
+    taskstats::Snapshot snapshot;
+    set(board(0, 0, 0, 0, 0, 0), 0);
+    sampler.sample(snapshot);
+
+    // uxTaskGetSystemState lists tasks by state, so the order changes
+    // between samples; every load must still use the task's own counter
+    std::vector<TaskStatus_t> tasks = board(0, 1000000, 970, 800, 23, 195);
+    std::vector<TaskStatus_t> reversed(tasks.rbegin(), tasks.rend());
+    set(reversed, 1000000);
+    CHECK(sampler.sample(snapshot));
+    CHECK(strcmp(snapshot.tasks[1].name, "AnimationTask") == 0);
+    CHECK(snapshot.tasks[1].loadPermille == 195);
+    CHECK(snapshot.tasks[2].loadPermille == 23);
+    CHECK(snapshot.idlePermille[0] == 970);
+    CHECK(snapshot.idlePermille[1] == 800);
+
+    // And back, one interval later
+    tasks = board(1000000, 1000000, 500, 600, 100, 300);
+    for (TaskStatus_t& status : tasks) {
+        // Counters continue from the reversed sample's values
+        for (const TaskStatus_t& before : reversed) {
+            if (before.xTaskNumber == status.xTaskNumber) {
+                status.ulRunTimeCounter = before.ulRunTimeCounter + (status.ulRunTimeCounter - 1000000);
+            }
+        }
+    }
+    set(tasks, 2000000);
+    CHECK(sampler.sample(snapshot));
+    CHECK(snapshot.idlePermille[0] == 500);
+    CHECK(snapshot.idlePermille[1] == 600);
+    CHECK(snapshot.tasks[2].loadPermille == 100);
+    CHECK(snapshot.tasks[3].loadPermille == 300);
+}
+
+void testTooManyTasks() {
+    taskstats::Sampler sampler;
+    taskstats::Snapshot snapshot;
+    std::vector<TaskStatus_t> tasks(taskstats::MAX_TASKS + 1, task("worker", 7, 0, 0, 100));
+    set(tasks, 0);
+    CHECK(!sampler.sample(snapshot));
+    CHECK(snapshot.count == 0);
+    CHECK(snapshot.overflow == taskstats::MAX_TASKS + 1);
+    char line[64];
+    taskstats::formatLine(snapshot, line, sizeof(line));
+    CHECK(strcmp(line, "25 tasks, more than 24") == 0);
+
+    // Back under the limit: a fresh baseline first
+    set(board(0, 0, 0, 0, 0, 0), 1000);
+    CHECK(!sampler.sample(snapshot));
+    set(board(0, 1000000, 1000, 1000, 0, 0), 1001000);
+    CHECK(sampler.sample(snapshot));
+}
+
+} // namespace
+
+int main() {
+    testLoadsOverInterval();
+    testNewTaskAndWrap();
+    testReorderedTasks();
+    testTooManyTasks();
+    if (failures == 0) printf("task_stats: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
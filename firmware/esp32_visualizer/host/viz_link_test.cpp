@@ -0,0 +1,152 @@
+// Host test of the visualizer link receiver (viz_link.cpp): the datagram
+// of the Rust encoder, sliced frames, sequence gaps, late datagrams, hub
+// restarts and malformed input.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "viz_link.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+struct Board {
+    std::vector<render::Rgb> frame;
+    std::vector<uint32_t> events;
+    vizlink::Receiver receiver;
+
+    explicit Board(uint16_t numLeds)
+        : frame(numLeds, render::Rgb{0, 0, 0}), receiver(frame.data(), numLeds, onEvent, this) {}
+
+    static void onEvent(void* context, midi::Event event) {
+        static_cast<Board*>(context)->events.push_back(event.word);
+    }
+
+    bool handle(const std::vector<uint8_t>& datagram) {
+        return receiver.handlePacket(datagram.data(), datagram.size());
+    }
+};
+
+std::vector<uint8_t> header(uint16_t seq, uint32_t timestampUs) {
+    return {'E', 1, (uint8_t)(seq >> 8), (uint8_t)seq, (uint8_t)(timestampUs >> 24), (uint8_t)(timestampUs >> 16),
+            (uint8_t)(timestampUs >> 8), (uint8_t)timestampUs};
+}
+
+// Datagram with one frame slice of `count` pixels of `value`
+std::vector<uint8_t> slice(uint16_t seq, uint16_t offset, uint16_t count, uint8_t value, bool push) {
+    std::vector<uint8_t> datagram = header(seq, 0);
+    datagram.reserve(vizlink::HEADER_LEN + 6 + (size_t)count * 3);
+    const uint8_t record[] = {vizlink::RECORD_FRAME, push ? vizlink::FRAME_PUSH : (uint8_t)0,
+                              (uint8_t)(offset >> 8), (uint8_t)offset, (uint8_t)(count >> 8), (uint8_t)count};
+    datagram.insert(datagram.end(), record, record + sizeof(record));
+    datagram.insert(datagram.end(), (size_t)count * 3, value);
+    return datagram;
+}
+
+void testDecodeGolden() {
+    // link::tests::golden_datagram in crates/hal-esp32/src/link.rs
+    const std::vector<uint8_t> datagram = {
+        'E', 1, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,          // header
+        0x01, 2, 0x20, 0x90, 60, 100, 0x20, 0x81, 62, 0,     // events
+        0x02, 0x01, 0, 3, 0, 2, 1, 2, 3, 4, 5, 6,           // frame
+    };
+    Board board(4);
+    CHECK(board.handle(datagram));
+    CHECK(board.events.size() == 2);
+    CHECK(board.events[0] == 0x20903C64u && board.events[1] == 0x20813E00u);
+    CHECK(midi::Event{board.events[0]}.isNoteOn() && midi::Event{board.events[1]}.isNoteOff());
+    // Pixel 3 only, 4 and up are cut off
+    CHECK(board.frame[3].r == 1 && board.frame[3].g == 2 && board.frame[3].b == 3);
+    CHECK(board.frame[2].r == 0);
+    const vizlink::Stats& stats = board.receiver.stats();
+    CHECK(stats.packets == 1 && stats.events == 2 && stats.frames == 1);
+    CHECK(stats.lastTimestampUs == 0x03040506u);
+}
+
+void testSlicedFrame() {
+    Board board(1000);
+    CHECK(!board.handle(slice(0, 0, 462, 1, false)));
+    CHECK(!board.handle(slice(1, 462, 462, 2, false)));
+    CHECK(board.handle(slice(2, 924, 76, 3, true)));
+    CHECK(board.frame[0].r == 1 && board.frame[461].b == 1);
+    CHECK(board.frame[462].r == 2 && board.frame[923].b == 2);
+    CHECK(board.frame[924].r == 3 && board.frame[999].b == 3);
+    CHECK(board.receiver.stats().frames == 1 && board.receiver.stats().lost == 0);
+}
+
+void testSequence() {
+    Board board(10);
+    board.handle(slice(100, 0, 10, 1, true));
+    // 101 and 102 lost
+    board.handle(slice(103, 0, 10, 2, true));
+    CHECK(board.receiver.stats().lost == 2);
+    // 102 arrives late: its events count, its pixels do not
+    std::vector<uint8_t> late = slice(102, 0, 10, 9, true);
+    const uint8_t events[] = {vizlink::RECORD_EVENTS, 1, 0x20, 0x90, 64, 90};
+    late.insert(late.end(), events, events + sizeof(events));
+    CHECK(!board.handle(late));
+    CHECK(board.receiver.stats().late == 1);
+    CHECK(board.events.size() == 1);
+    CHECK(board.frame[0].r == 2);
+    // Wrap-around is not a gap
+    Board wrap(10);
+    wrap.handle(slice(0xFFFF, 0, 10, 1, true));
+    wrap.handle(slice(0, 0, 10, 2, true));
+    CHECK(wrap.receiver.stats().lost == 0 && wrap.frame[0].r == 2);
+    board.handle(slice(104, 0, 10, 3, true));
+    // The hub restarted at 0: the last of a run of late datagrams resyncs
+    for (uint16_t seq = 0; seq < vizlink::RESYNC_LATE_RUN; seq++) board.handle(slice(seq, 0, 10, 5 + seq, true));
+    CHECK(board.receiver.stats().late == 1 + vizlink::RESYNC_LATE_RUN - 1);
+    CHECK(board.frame[0].r == 5 + vizlink::RESYNC_LATE_RUN - 1);
+    board.handle(slice(vizlink::RESYNC_LATE_RUN, 0, 10, 42, true));
+    CHECK(board.frame[0].r == 42 && board.receiver.stats().lost == 2);
+    // ... or at once when it is far behind
+    Board restart(10);
+    restart.handle(slice(5000, 0, 10, 1, true));
+    restart.handle(slice(0, 0, 10, 2, true));
+    CHECK(restart.frame[0].r == 2 && restart.receiver.stats().late == 0);
+}
+
+void testMalformed() {
+    Board board(10);
+    std::vector<uint8_t> cut = slice(0, 0, 10, 7, true);
+    cut.pop_back();
+    CHECK(!board.handle(cut));
+    std::vector<uint8_t> foreign = {'/', 'm', 'i', 'd', 'i', 0, 0, 0, ',', 'i', 0, 0, 0, 0, 0, 1};
+    CHECK(!board.handle(foreign));
+    std::vector<uint8_t> unknown = slice(0, 0, 1, 7, true);
+    unknown.push_back(0x7F);
+    CHECK(!board.handle(unknown));
+    // Nothing of the damaged datagrams was applied
+    CHECK(board.frame[0].r == 0);
+    CHECK(board.receiver.stats().malformed == 3 && board.receiver.stats().packets == 0);
+    // Events past the end of the datagram
+    std::vector<uint8_t> events = header(0, 0);
+    events.push_back(vizlink::RECORD_EVENTS);
+    events.push_back(2);
+    events.insert(events.end(), {0x20, 0x90, 60, 100});
+    CHECK(!board.handle(events));
+    CHECK(board.events.empty());
+}
+
+} // namespace
+
+int main() {
+    testDecodeGolden();
+    testSlicedFrame();
+    testSequence();
+    testMalformed();
+    if (failures == 0) printf("viz_link: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include "apa102_spi.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+Apa102Spi::Apa102Spi()
+    : chipset_(ledwire::Chipset::Apa102), numLeds_(0), frameBytes_(0), device_(NULL), next_(0), pending_(false) {
+    buffers_[0] = NULL;
+    buffers_[1] = NULL;
+    memset(&transaction_, 0, sizeof(transaction_));
+}
+
+Apa102Spi::~Apa102Spi() {
+    flush();
+    if (device_) {
+        spi_bus_remove_device(device_);
+        spi_bus_free(SPI2_HOST);
+    }
+    heap_caps_free(buffers_[0]);
+    heap_caps_free(buffers_[1]);
+}
+
+bool Apa102Spi::begin(ledwire::Chipset chipset, int dataPin, int clockPin, uint32_t clockHz, uint16_t numLeds) {
+    chipset_ = chipset;
+    numLeds_ = numLeds;
+    frameBytes_ = ledwire::frameBytes(chipset, numLeds);
+    if (frameBytes_ == 0) return false;
+
+    for (int i = 0; i < 2; i++) {
+        buffers_[i] = static_cast<uint8_t*>(heap_caps_malloc(frameBytes_, MALLOC_CAP_DMA));
+        if (!buffers_[i]) return false;
+    }
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = dataPin;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = clockPin;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = (int)frameBytes_;
+    if (spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) return false;
+
+    // No chip select; one frame in flight
+    spi_device_interface_config_t device = {};
+    device.clock_speed_hz = (int)clockHz;
+    device.mode = 0;
+    device.spics_io_num = -1;
+    device.queue_size = 1;
+    return spi_bus_add_device(SPI2_HOST, &device, &device_) == ESP_OK;
+}
+
+void Apa102Spi::show(const render::Rgb* pixels, uint8_t brightness, ledwire::Order order) {
+    if (!device_) return;
+    // Encode while the previous frame is still on the wire
+    uint8_t* buffer = buffers_[next_];
+    ledwire::encode(chipset_, pixels, numLeds_, brightness, order, buffer);
+    flush();
+
+    memset(&transaction_, 0, sizeof(transaction_));
+    transaction_.length = frameBytes_ * 8;
+    transaction_.tx_buffer = buffer;
+    if (spi_device_queue_trans(device_, &transaction_, portMAX_DELAY) == ESP_OK) {
+        pending_ = true;
+        next_ ^= 1;
+    }
+}
+
+void Apa102Spi::flush() {
+    if (!pending_) return;
+    spi_transaction_t* done = NULL;
+    spi_device_get_trans_result(device_, &done, portMAX_DELAY);
+    pending_ = false;
+}
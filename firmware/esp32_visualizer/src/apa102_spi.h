@@ -0,0 +1,39 @@
+#pragma once
+
+// Clocked LED strip (APA102/SK9822) on an ESP32 SPI bus with DMA.
+// Two DMA-capable frame buffers: `show` encodes into the idle one while the
+// previous frame is still clocked out, then queues it, so the render task
+// only blocks when frames come faster than the wire (see led_wire.h for the
+// format and wire time).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/spi_master.h"
+#include "led_wire.h"
+#include "render_core.h"
+
+class Apa102Spi {
+public:
+    Apa102Spi();
+    ~Apa102Spi();
+
+    // Sets up the bus (SPI2) and buffers; false when the IDF refused.
+    bool begin(ledwire::Chipset chipset, int dataPin, int clockPin, uint32_t clockHz, uint16_t numLeds);
+
+    // Encodes and queues one frame.
+    void show(const render::Rgb* pixels, uint8_t brightness, ledwire::Order order);
+
+    // Waits until the last queued frame left the wire.
+    void flush();
+
+private:
+    ledwire::Chipset chipset_;
+    uint16_t numLeds_;
+    size_t frameBytes_;
+    spi_device_handle_t device_;
+    uint8_t* buffers_[2];
+    uint8_t next_;
+    bool pending_;
+    spi_transaction_t transaction_;
+};
@@ -0,0 +1,463 @@
+#include "applemidi.h"
+
+#include <string.h>
+
+namespace applemidi {
+
+namespace {
+
+static const uint32_t PROTOCOL_VERSION = 2;
+static const size_t CONTROL_HEADER_LEN = 16; // FF FF, command, version, token, ssrc
+static const size_t CK_LEN = 36;             // FF FF CK, ssrc, count, pad, 3x u64
+static const size_t RTP_HEADER_LEN = 12;
+static const uint64_t CK_TICK_US = 100;
+
+// Command section header (RFC 6295 3.2)
+static const uint8_t FLAG_LONG_HEADER = 0x80;
+static const uint8_t FLAG_JOURNAL = 0x40;
+static const uint8_t FLAG_FIRST_DELTA = 0x20;
+
+// Recovery journal (RFC 6295 5, 6.1, appendix A)
+static const size_t JOURNAL_HEADER_LEN = 3;  // S|Y|A|H|TOTCHAN, checkpoint
+static const uint8_t JOURNAL_SYSTEM = 0x40;
+static const uint8_t JOURNAL_CHANNELS = 0x20;
+static const size_t CHANNEL_HEADER_LEN = 3;  // S|CHAN|H|LENGTH, TOC
+static const uint8_t CHAPTER_P = 0x80;
+static const uint8_t CHAPTER_C = 0x40;
+static const uint8_t CHAPTER_M = 0x20;
+static const uint8_t CHAPTER_W = 0x10;
+static const uint8_t CHAPTER_N = 0x08;
+
+// Channel state not described by any journal yet
+static const uint8_t UNKNOWN_VALUE = 0x80;
+static const uint16_t UNKNOWN_BEND = 0xFFFF;
+
+uint16_t readU16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+uint32_t readU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+uint64_t readU64(const uint8_t* p) {
+    return ((uint64_t)readU32(p) << 32) | readU32(p + 4);
+}
+
+void writeU32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+void writeU64(uint8_t* p, uint64_t v) {
+    writeU32(p, (uint32_t)(v >> 32));
+    writeU32(p + 4, (uint32_t)v);
+}
+
+// Data bytes following a status byte other than SysEx; -1 when invalid
+int dataBytes(uint8_t status) {
+    if (status < 0x80) return -1;
+    switch (status & 0xF0) {
+        case 0xC0:
+        case 0xD0:
+            return 1;
+        case 0xF0:
+            break;
+        default:
+            return 2;
+    }
+    switch (status) {
+        case 0xF1:
+        case 0xF3: return 1;
+        case 0xF2: return 2;
+        case 0xF0:
+        case 0xF4:
+        case 0xF5:
+        case 0xF7:
+        case 0xFD: return -1;
+        default: return 0; // F6 and real-time
+    }
+}
+
+// Variable-length delta time; returns its length, 0 when truncated.
+size_t skipDelta(const uint8_t* p, size_t len) {
+    for (size_t i = 0; i < len && i < 4; i++) {
+        if ((p[i] & 0x80) == 0) return i + 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+Endpoint::Endpoint(const char* name, uint32_t ssrc, MidiHandler handler, void* context)
+    : ssrc_(ssrc), handler_(handler), context_(context), clockStarted_(false), clockStartUs_(0) {
+    strncpy(name_, name, MAX_NAME);
+    name_[MAX_NAME] = '\0';
+    memset(&stats_, 0, sizeof(stats_));
+    reset();
+}
+
+void Endpoint::reset() {
+    state_ = State::Idle;
+    token_ = 0;
+    peerSsrc_ = 0;
+    peerName_[0] = '\0';
+    haveSequence_ = false;
+    nextSequence_ = 0;
+    lastHeardUs_ = 0;
+    memset(notesOn_, 0, sizeof(notesOn_));
+    memset(controllers_, UNKNOWN_VALUE, sizeof(controllers_));
+    memset(programs_, UNKNOWN_VALUE, sizeof(programs_));
+    for (int channel = 0; channel < 16; channel++) pitchBends_[channel] = UNKNOWN_BEND;
+}
+
+void Endpoint::poll(uint64_t nowUs) {
+    if (state_ != State::Idle && nowUs - lastHeardUs_ > SESSION_TIMEOUT_US) {
+        stats_.timeouts++;
+        reset();
+    }
+}
+
+uint64_t Endpoint::ckNow(uint64_t nowUs) const {
+    return (nowUs - clockStartUs_) / CK_TICK_US;
+}
+
+size_t Endpoint::writeHeader(const char command[2], uint32_t token, uint8_t* out) const {
+    out[0] = 0xFF;
+    out[1] = 0xFF;
+    out[2] = (uint8_t)command[0];
+    out[3] = (uint8_t)command[1];
+    writeU32(out + 4, PROTOCOL_VERSION);
+    writeU32(out + 8, token);
+    writeU32(out + 12, ssrc_);
+    return CONTROL_HEADER_LEN;
+}
+
+size_t Endpoint::handlePacket(Port port, const uint8_t* data, size_t len, uint64_t nowUs, uint8_t* reply) {
+    if (!clockStarted_) {
+        clockStarted_ = true;
+        clockStartUs_ = nowUs;
+    }
+    poll(nowUs);
+    if (len >= 4 && data[0] == 0xFF && data[1] == 0xFF) {
+        return handleControl(port, data, len, nowUs, reply);
+    }
+    if (port == Port::Data && state_ == State::Connected) {
+        handleRtp(data, len, nowUs);
+    }
+    return 0;
+}
+
+size_t Endpoint::handleControl(Port port, const uint8_t* data, size_t len, uint64_t nowUs, uint8_t* reply) {
+    const uint8_t* command = data + 2;
+
+    if (memcmp(command, "IN", 2) == 0) {
+        if (len < CONTROL_HEADER_LEN || readU32(data + 4) != PROTOCOL_VERSION) {
+            stats_.malformed++;
+            return 0;
+        }
+        const uint32_t token = readU32(data + 8);
+        if (state_ != State::Idle && token != token_) {
+            return writeHeader("NO", token, reply);
+        }
+        token_ = token;
+        peerSsrc_ = readU32(data + 12);
+        size_t nameLen = strnlen((const char*)data + CONTROL_HEADER_LEN, len - CONTROL_HEADER_LEN);
+        if (nameLen > MAX_NAME) nameLen = MAX_NAME;
+        memcpy(peerName_, data + CONTROL_HEADER_LEN, nameLen);
+        peerName_[nameLen] = '\0';
+        lastHeardUs_ = nowUs;
+        if (port == Port::Data) {
+            if (state_ != State::Connected) haveSequence_ = false;
+            state_ = State::Connected;
+        } else if (state_ == State::Idle) {
+            state_ = State::Inviting;
+        }
+        size_t out = writeHeader("OK", token, reply);
+        const size_t ownLen = strlen(name_);
+        memcpy(reply + out, name_, ownLen + 1);
+        return out + ownLen + 1;
+    }
+
+    if (memcmp(command, "BY", 2) == 0) {
+        if (len >= CONTROL_HEADER_LEN && state_ != State::Idle && readU32(data + 8) == token_) {
+            reset();
+        }
+        return 0;
+    }
+
+    if (memcmp(command, "CK", 2) == 0) {
+        if (len < CK_LEN) {
+            stats_.malformed++;
+            return 0;
+        }
+        if (state_ != State::Connected || readU32(data + 4) != peerSsrc_) return 0;
+        lastHeardUs_ = nowUs;
+        const uint8_t count = data[8];
+        const uint64_t t1 = readU64(data + 12);
+        if (count == 0) {
+            memcpy(reply, data, CK_LEN);
+            writeU32(reply + 4, ssrc_);
+            reply[8] = 1;
+            writeU64(reply + 20, ckNow(nowUs));
+            writeU64(reply + 28, 0);
+            return CK_LEN;
+        }
+        if (count == 2) {
+            // t1 and t3 on the peer's clock, t2 on ours
+            const uint64_t t2 = readU64(data + 20);
+            const uint64_t t3 = readU64(data + 28);
+            if (t3 < t1) {
+                stats_.malformed++;
+                return 0;
+            }
+            const int64_t peerMid = (int64_t)(t1 + t3) / 2;
+            stats_.clockOffsetUs = (peerMid - (int64_t)t2) * (int64_t)CK_TICK_US;
+            stats_.rttUs = (uint32_t)((t3 - t1) * CK_TICK_US);
+            stats_.syncs++;
+        }
+        return 0;
+    }
+
+    // RS and anything newer: nothing to answer
+    return 0;
+}
+
+void Endpoint::handleRtp(const uint8_t* data, size_t len, uint64_t nowUs) {
+    if (len < RTP_HEADER_LEN + 1 || (data[0] >> 6) != 2) {
+        stats_.malformed++;
+        return;
+    }
+    if (readU32(data + 8) != peerSsrc_) return;
+    lastHeardUs_ = nowUs;
+    const uint16_t sequence = readU16(data + 2);
+
+    const uint8_t* payload = data + RTP_HEADER_LEN;
+    size_t payloadLen = len - RTP_HEADER_LEN;
+    const uint8_t flags = payload[0];
+    size_t sectionLen = flags & 0x0F;
+    size_t headerLen = 1;
+    if (flags & FLAG_LONG_HEADER) {
+        if (payloadLen < 2) {
+            stats_.malformed++;
+            return;
+        }
+        sectionLen = (sectionLen << 8) | payload[1];
+        headerLen = 2;
+    }
+    if (payloadLen < headerLen + sectionLen) {
+        stats_.malformed++;
+        return;
+    }
+
+    if (haveSequence_) {
+        const int16_t ahead = (int16_t)(sequence - nextSequence_);
+        if (ahead < 0) {
+            stats_.duplicates++;
+            return;
+        }
+        if (ahead > 0) {
+            const size_t journalAt = headerLen + sectionLen;
+            if (!(flags & FLAG_JOURNAL)) {
+                stats_.lost += (uint32_t)ahead;
+            } else if (!recoverFromJournal(payload + journalAt, payloadLen - journalAt, nextSequence_, sequence)) {
+                stats_.malformed++;
+                stats_.lost += (uint32_t)ahead;
+            }
+        }
+    }
+    haveSequence_ = true;
+    nextSequence_ = (uint16_t)(sequence + 1);
+    stats_.packets++;
+    if (!emitCommands(payload + headerLen, sectionLen, (flags & FLAG_FIRST_DELTA) != 0)) {
+        stats_.malformed++;
+    }
+}
+
+bool Endpoint::recoverFromJournal(const uint8_t* journal, size_t len, uint16_t from, uint16_t to) {
+    if (len < JOURNAL_HEADER_LEN) return false;
+    const uint8_t header = journal[0];
+    const uint16_t checkpoint = readU16(journal + 1);
+    size_t pos = JOURNAL_HEADER_LEN;
+    if (header & JOURNAL_SYSTEM) {
+        // System chapters (sequencer state, SysEx) do not drive the LEDs
+        if (pos + 2 > len) return false;
+        const size_t systemLen = ((size_t)(journal[pos] & 0x03) << 8) | journal[pos + 1];
+        if (systemLen < 2 || pos + systemLen > len) return false;
+        pos += systemLen;
+    }
+    if (header & JOURNAL_CHANNELS) {
+        const size_t channels = (size_t)(header & 0x0F) + 1;
+        for (size_t i = 0; i < channels; i++) {
+            if (pos + CHANNEL_HEADER_LEN > len) return false;
+            const uint8_t channel = (journal[pos] >> 3) & 0x0F;
+            const size_t channelLen = ((size_t)(journal[pos] & 0x03) << 8) | journal[pos + 1];
+            if (channelLen < CHANNEL_HEADER_LEN || pos + channelLen > len) return false;
+            if (!recoverChannel(channel, journal[pos + 2], journal + pos + CHANNEL_HEADER_LEN,
+                                channelLen - CHANNEL_HEADER_LEN)) {
+                return false;
+            }
+            pos += channelLen;
+        }
+    }
+    // The journal describes every packet from the checkpoint on; a gap
+    // reaching further back is only partly repaired.
+    const uint16_t missing = (uint16_t)(to - from);
+    if ((int16_t)(from - checkpoint) >= 0) {
+        stats_.recovered += missing;
+    } else {
+        stats_.lost += missing;
+    }
+    return true;
+}
+
+bool Endpoint::recoverChannel(uint8_t channel, uint8_t toc, const uint8_t* chapters, size_t len) {
+    size_t pos = 0;
+    if (toc & CHAPTER_P) {
+        if (pos + 3 > len) return false;
+        const uint8_t program = chapters[pos] & 0x7F;
+        if (programs_[channel] != program) emit(0xC0 | channel, program, 0, true);
+        pos += 3;
+    }
+    if (toc & CHAPTER_C) {
+        if (pos + 1 > len) return false;
+        const size_t logs = (size_t)(chapters[pos] & 0x7F) + 1;
+        pos++;
+        if (pos + 2 * logs > len) return false;
+        for (size_t i = 0; i < logs; i++, pos += 2) {
+            const uint8_t number = chapters[pos] & 0x7F;
+            // A=1 logs toggle/count tools, not a value
+            if (chapters[pos + 1] & 0x80) continue;
+            const uint8_t value = chapters[pos + 1];
+            if (controllers_[channel][number] != value) emit(0xB0 | channel, number, value, true);
+        }
+    }
+    if (toc & CHAPTER_M) {
+        if (pos + 2 > len) return false;
+        const size_t chapterLen = ((size_t)(chapters[pos] & 0x03) << 8) | chapters[pos + 1];
+        if (chapterLen < 2 || pos + chapterLen > len) return false;
+        pos += chapterLen;
+    }
+    if (toc & CHAPTER_W) {
+        if (pos + 2 > len) return false;
+        const uint8_t lsb = chapters[pos] & 0x7F;
+        const uint8_t msb = chapters[pos + 1] & 0x7F;
+        if (pitchBends_[channel] != (uint16_t)(lsb | msb << 7)) emit(0xE0 | channel, lsb, msb, true);
+        pos += 2;
+    }
+    if (toc & CHAPTER_N) {
+        if (pos + 2 > len) return false;
+        size_t logs = chapters[pos] & 0x7F;
+        const uint8_t low = chapters[pos + 1] >> 4;
+        const uint8_t high = chapters[pos + 1] & 0x0F;
+        if (logs == 127 && low == 15 && high == 0) logs = 128;
+        const size_t offbits = low <= high ? (size_t)(high - low) + 1 : 0;
+        pos += 2;
+        if (pos + 2 * logs + offbits > len) return false;
+        const uint8_t* log = chapters + pos;
+        const uint8_t* off = log + 2 * logs;
+        // Offbit: the note's last command was a NoteOff (MSB = lowest note)
+        auto released = [&](uint8_t note) {
+            const size_t octet = note >> 3;
+            return octet >= low && octet <= high && (off[octet - low] & (0x80 >> (note & 7)));
+        };
+        auto held = [&](uint8_t note) { return (notesOn_[channel][note >> 3] >> (note & 7)) & 1; };
+        for (unsigned note = 0; note < 128; note++) {
+            if (released((uint8_t)note) && held((uint8_t)note)) emit(0x80 | channel, (uint8_t)note, 0, true);
+        }
+        for (size_t i = 0; i < logs; i++) {
+            const uint8_t note = log[2 * i] & 0x7F;
+            const uint8_t velocity = log[2 * i + 1] & 0x7F;
+            // Y=0: the sender advises against a late NoteOn
+            const bool play = (log[2 * i + 1] & 0x80) != 0;
+            if (play && velocity != 0 && !released(note) && !held(note)) {
+                emit(0x90 | channel, note, velocity, true);
+            }
+        }
+    }
+    return true;
+}
+
+void Endpoint::emit(uint8_t status, uint8_t data1, uint8_t data2, bool recovered) {
+    const uint8_t channel = status & 0x0F;
+    switch (status & 0xF0) {
+        case 0x80:
+            notesOn_[channel][data1 >> 3] &= (uint8_t)~(1 << (data1 & 7));
+            break;
+        case 0x90:
+            if (data2 != 0) {
+                notesOn_[channel][data1 >> 3] |= (uint8_t)(1 << (data1 & 7));
+            } else {
+                notesOn_[channel][data1 >> 3] &= (uint8_t)~(1 << (data1 & 7));
+            }
+            break;
+        case 0xB0:
+            controllers_[channel][data1] = data2;
+            break;
+        case 0xC0:
+            programs_[channel] = data1;
+            break;
+        case 0xE0:
+            pitchBends_[channel] = (uint16_t)(data1 | data2 << 7);
+            break;
+        default:
+            break;
+    }
+    const uint8_t type = status < 0xF0 ? midi::MT_CHANNEL_VOICE : midi::MT_SYSTEM;
+    const midi::Event event = {((uint32_t)type << 28) | ((uint32_t)status << 16) | ((uint32_t)data1 << 8) | data2};
+    stats_.commands++;
+    if (handler_) handler_(context_, event, recovered);
+}
+
+bool Endpoint::emitCommands(const uint8_t* section, size_t len, bool firstDelta) {
+    size_t pos = 0;
+    uint8_t running = 0;
+    bool first = true;
+    while (pos < len) {
+        if (!first || firstDelta) {
+            const size_t deltaLen = skipDelta(section + pos, len - pos);
+            if (deltaLen == 0) return false;
+            pos += deltaLen;
+            if (pos >= len) return false;
+        }
+        first = false;
+
+        uint8_t status = section[pos];
+        if (status < 0x80) {
+            if (running == 0) return false;
+            status = running;
+        } else {
+            pos++;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+            // SysEx or a segment of one (F7 starts a continuation): not
+            // visualized, skipped to F7 (end), F0 (more follows) or F4
+            // (cancelled); real-time bytes inside go with it
+            running = 0;
+            while (pos < len && (section[pos] < 0x80 || section[pos] >= 0xF8)) pos++;
+            if (pos == len) return false;
+            const uint8_t end = section[pos++];
+            if (end != 0xF7 && end != 0xF0 && end != 0xF4) return false;
+            continue;
+        }
+        const int count = dataBytes(status);
+        if (count < 0) return false;
+        if (pos + (size_t)count > len) return false;
+        const uint8_t data1 = count > 0 ? section[pos] : 0;
+        const uint8_t data2 = count > 1 ? section[pos + 1] : 0;
+        if ((data1 | data2) & 0x80) return false;
+        pos += (size_t)count;
+
+        if (status < 0xF0) {
+            running = status;
+        } else if (status < 0xF8) {
+            running = 0;
+        }
+        emit(status, data1, data2, false);
+    }
+    return true;
+}
+
+} // namespace applemidi
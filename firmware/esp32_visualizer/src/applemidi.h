@@ -0,0 +1,135 @@
+#pragma once
+
+// Portable AppleMIDI / RTP-MIDI responder, so a DAW can session straight to
+// the visualizer instead of going through the hub and OSC.
+// No Arduino or socket dependencies: the platform feeds received datagrams
+// into `Endpoint::handlePacket` and sends the returned reply back to the
+// sender on the same port. Same code on the ESP32 and in host builds
+// (loopback test against the Rust session, see ../host).
+//
+// Handles:
+// - IN on the control and data port (answered with OK, or NO while a
+//   session with another initiator is up), BY,
+// - CK0 -> CK1 and CK2 (clock offset and round trip), timestamps in 100 us,
+// - RFC 6295 command sections (delta times, running status; SysEx and its
+//   segments skipped),
+// - the RFC 6295 recovery journal: on a sequence gap, chapters P, C, W and
+//   N of the next packet's channel journals bring programs, controllers,
+//   pitch bend and held notes up to date (only the commands that change
+//   the receiver's state are emitted); other chapters and the system
+//   journal are skipped,
+// - sessions whose peer went quiet (no CK or RTP for SESSION_TIMEOUT_US)
+//   are dropped, so the next DAW can invite.
+//
+// Payload layout (RFC 6295 section 3): flags B(long header)=0x80, J=0x40,
+// Z=0x20, P=0x10 and a 4/12-bit section length; the first command has a
+// delta time only when Z is set, every following one has one.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi_event.h"
+
+namespace applemidi {
+
+enum class Port : uint8_t {
+    Control,
+    Data,
+};
+
+enum class State : uint8_t {
+    Idle,
+    // Control port invited, waiting for the data port
+    Inviting,
+    Connected,
+};
+
+// Largest reply (OK with the endpoint name)
+static const size_t MAX_REPLY = 16 + 32;
+static const size_t MAX_NAME = 31;
+
+// A connected peer that sends neither CK nor RTP for this long is dropped.
+// DAWs resync with CK every few seconds while a session is up.
+static const uint64_t SESSION_TIMEOUT_US = 60000000;
+
+// Called for every received MIDI command; `recovered` when it came from the
+// journal of a later packet.
+typedef void (*MidiHandler)(void* context, midi::Event event, bool recovered);
+
+struct Stats {
+    uint32_t packets;
+    uint32_t commands;
+    // Missing packets whose commands were replayed from a journal
+    uint32_t recovered;
+    // Missing packets no journal covered
+    uint32_t lost;
+    uint32_t duplicates;
+    uint32_t malformed;
+    // Last CK exchange (us): peer clock minus ours, and the round trip
+    int64_t clockOffsetUs;
+    uint32_t rttUs;
+    uint32_t syncs;
+    // Sessions dropped after SESSION_TIMEOUT_US without CK or RTP
+    uint32_t timeouts;
+};
+
+class Endpoint {
+public:
+    Endpoint(const char* name, uint32_t ssrc, MidiHandler handler, void* context);
+
+    // Processes one datagram received on `port` at `nowUs` (any monotonic
+    // microsecond clock). Writes a reply for the sender into `reply`
+    // (MAX_REPLY bytes) and returns its length, 0 for none.
+    size_t handlePacket(Port port, const uint8_t* data, size_t len, uint64_t nowUs, uint8_t* reply);
+
+    // Drops the session when the peer has been quiet for
+    // SESSION_TIMEOUT_US; call periodically, packets or not.
+    void poll(uint64_t nowUs);
+
+    State state() const { return state_; }
+    uint32_t peerSsrc() const { return peerSsrc_; }
+    const char* peerName() const { return peerName_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    size_t handleControl(Port port, const uint8_t* data, size_t len, uint64_t nowUs, uint8_t* reply);
+    void handleRtp(const uint8_t* data, size_t len, uint64_t nowUs);
+    // Parses a command section; false when malformed. `firstDelta` is the
+    // Z flag: whether the first command has a delta time.
+    bool emitCommands(const uint8_t* section, size_t len, bool firstDelta);
+    // Applies a recovery journal for the missing sequence numbers
+    // [from, to); false when malformed.
+    bool recoverFromJournal(const uint8_t* journal, size_t len, uint16_t from, uint16_t to);
+    bool recoverChannel(uint8_t channel, uint8_t toc, const uint8_t* chapters, size_t len);
+    // Passes a command to the handler and tracks the state the journal is
+    // compared against.
+    void emit(uint8_t status, uint8_t data1, uint8_t data2, bool recovered);
+    size_t writeHeader(const char command[2], uint32_t token, uint8_t* out) const;
+    uint64_t ckNow(uint64_t nowUs) const;
+    void reset();
+
+    char name_[MAX_NAME + 1];
+    uint32_t ssrc_;
+    MidiHandler handler_;
+    void* context_;
+
+    State state_;
+    uint32_t token_;
+    uint32_t peerSsrc_;
+    char peerName_[MAX_NAME + 1];
+    bool haveSequence_;
+    uint16_t nextSequence_;
+    // Last CK or RTP from the peer
+    uint64_t lastHeardUs_;
+    // Channel state as far as the journal chapters describe it
+    uint8_t notesOn_[16][16];
+    uint8_t controllers_[16][128];
+    uint8_t programs_[16];
+    uint16_t pitchBends_[16];
+    // CK timestamps count from the first packet
+    bool clockStarted_;
+    uint64_t clockStartUs_;
+    Stats stats_;
+};
+
+} // namespace applemidi
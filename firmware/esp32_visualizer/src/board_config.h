@@ -9,16 +9,48 @@
 #define VOLTS         5
 #define MAX_AMPS      1500 // 23 LEDs * 60mA/LED = 1380mA
 
+// LED matrix (0 x 0 = plain strip, notes along it); NUM_LEDS must match.
+// Panels of MATRIX_PANEL_* chained in MATRIX_PANEL_WIRING order, pixels
+// within a panel in MATRIX_WIRING order (canvas.h flags)
+#define MATRIX_WIDTH        0
+#define MATRIX_HEIGHT       0
+#define MATRIX_PANEL_WIDTH  MATRIX_WIDTH
+#define MATRIX_PANEL_HEIGHT MATRIX_HEIGHT
+#define MATRIX_WIRING       canvas::SERPENTINE
+#define MATRIX_PANEL_WIRING canvas::ROW_MAJOR
+
+// LED output backend
+#define LED_BACKEND_ONEWIRE 0 // FastLED, LED_TYPE on LED_PIN
+#define LED_BACKEND_CLOCKED 1 // APA102/SK9822 over SPI with DMA, see apa102_spi.h
+#define LED_BACKEND   LED_BACKEND_ONEWIRE
+// Clocked backend: LED_PIN is data, plus the clock pin and rate
+#define LED_CLOCK_PIN 18
+#define LED_SPI_HZ    12000000 // 1000 LEDs: 2.7 ms per frame
+#define LED_CLOCKED_CHIPSET ledwire::Chipset::Apa102
+#define LED_CLOCKED_ORDER   ledwire::Order::BGR
+
 // Network Configuration
 #define WIFI_SSID     "YourWiFiSSID"
 #define WIFI_PASSWORD "YourWiFiPassword"
 #define OSC_PORT      8000
+// AppleMIDI control port; the data port is APPLEMIDI_PORT + 1
+#define APPLEMIDI_PORT 5004
+#define APPLEMIDI_NAME "esp32-visualizer"
+// Visualizer link from the hub (protocol "esp32" outputs), see viz_link.h
+#define VIZ_LINK_PORT 8100
+// Hub frames replace the local rendering until none came for this long
+#define LINK_FRAME_HOLD_MS 2000
+
+// Task telemetry on the serial log (0 = off), see task_stats.h
+#define TELEMETRY_INTERVAL_MS 5000
+// Warn when a task's free stack drops below this
+#define STACK_WARN_BYTES      512
 
 // Built-in LED for status
 #define BUILTIN_LED   2
 
 // Animation Configuration
-#define ANIMATION_FPS 60
+#define ANIMATION_FPS 60 // one-wire: 23 LEDs take 1 ms on the wire
 #define FADE_SPEED    5
 #define SUSTAIN_HOLD_TIME 2000 // ms
 
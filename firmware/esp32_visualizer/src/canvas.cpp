@@ -0,0 +1,83 @@
+#include "canvas.h"
+
+#include <string.h>
+
+namespace canvas {
+
+namespace {
+
+// Position of (x, y) in a `cols` x `rows` grid walked in `wiring` order
+size_t gridIndex(uint16_t x, uint16_t y, uint16_t cols, uint16_t rows, uint8_t wiring) {
+    if (wiring & FLIP_X) x = (uint16_t)(cols - 1 - x);
+    if (wiring & FLIP_Y) y = (uint16_t)(rows - 1 - y);
+    if (wiring & COLUMN_MAJOR) {
+        if ((wiring & SERPENTINE) && (x & 1)) y = (uint16_t)(rows - 1 - y);
+        return (size_t)x * rows + y;
+    }
+    if ((wiring & SERPENTINE) && (y & 1)) x = (uint16_t)(cols - 1 - x);
+    return (size_t)y * cols + x;
+}
+
+} // namespace
+
+bool buildXyTable(const Layout& layout, uint16_t* table) {
+    const size_t count = pixelCount(layout);
+    if (count == 0 || count > 65535 || layout.panelWidth == 0 || layout.panelHeight == 0 ||
+        layout.width % layout.panelWidth != 0 || layout.height % layout.panelHeight != 0) {
+        return false;
+    }
+    const uint16_t panelCols = layout.width / layout.panelWidth;
+    const uint16_t panelRows = layout.height / layout.panelHeight;
+    const size_t panelPixels = (size_t)layout.panelWidth * layout.panelHeight;
+    for (uint16_t y = 0; y < layout.height; y++) {
+        for (uint16_t x = 0; x < layout.width; x++) {
+            const size_t panel = gridIndex(x / layout.panelWidth, y / layout.panelHeight, panelCols, panelRows,
+                                           layout.panelWiring);
+            const size_t pixel = gridIndex(x % layout.panelWidth, y % layout.panelHeight, layout.panelWidth,
+                                           layout.panelHeight, layout.wiring);
+            table[(size_t)y * layout.width + x] = (uint16_t)(panel * panelPixels + pixel);
+        }
+    }
+    return true;
+}
+
+Canvas::Canvas(const Layout& layout, const uint16_t* table, render::Rgb* frame)
+    : width_(layout.width), height_(layout.height), table_(table), frame_(frame) {}
+
+void Canvas::clear() {
+    memset(frame_, 0, (size_t)width_ * height_ * sizeof(render::Rgb));
+}
+
+void Canvas::present(render::Rgb* strip) const {
+    const size_t count = (size_t)width_ * height_;
+    for (size_t i = 0; i < count; i++) {
+        strip[table_[i]] = frame_[i];
+    }
+}
+
+void renderNoteColumns(const render::NoteState* notes, uint32_t nowMs, const render::RenderConfig& cfg,
+                       Canvas& canvas) {
+    canvas.clear();
+    const uint16_t width = canvas.width();
+    const uint16_t height = canvas.height();
+    if (width == 0 || height == 0 || cfg.velocityMax == 0) return;
+
+    for (size_t note = 0; note < render::NOTE_COUNT; note++) {
+        const render::NoteState& state = notes[note];
+        if (!state.active) continue;
+
+        const uint16_t column = (uint16_t)(note % width);
+        const uint8_t velocity = state.velocity > cfg.velocityMax ? cfg.velocityMax : state.velocity;
+        const uint16_t bar = (uint16_t)(1 + (uint32_t)velocity * (height - 1) / cfg.velocityMax);
+        const render::Rgb color = render::noteColor(note, state, nowMs, cfg);
+        // Row 0 is the top; bars grow from the bottom
+        for (uint16_t y = (uint16_t)(height - bar); y < height; y++) {
+            render::Rgb& pixel = canvas.row(y)[column];
+            pixel.r = render::qadd8(pixel.r, color.r);
+            pixel.g = render::qadd8(pixel.g, color.g);
+            pixel.b = render::qadd8(pixel.b, color.b);
+        }
+    }
+}
+
+} // namespace canvas
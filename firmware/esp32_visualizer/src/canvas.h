@@ -0,0 +1,76 @@
+#pragma once
+
+// 2D canvas over a wired LED matrix.
+// Effects draw into a row-major logical frame (pixel (x, y) at
+// y * width + x, rows addressable as plain arrays) and `present` scatters
+// it onto the strip through an XY -> strip index table built once at boot
+// from the wiring, so effects never compute wiring offsets per pixel.
+// No Arduino dependencies; host tests and benchmarks are in ../host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "render_core.h"
+
+namespace canvas {
+
+// Wiring flags: order of pixels within a panel, or of panels on the chain
+static const uint8_t ROW_MAJOR = 0x00;
+static const uint8_t COLUMN_MAJOR = 0x01;
+// Every other row (column) runs backwards
+static const uint8_t SERPENTINE = 0x02;
+// The first pixel is on the right (bottom) instead of the left (top)
+static const uint8_t FLIP_X = 0x04;
+static const uint8_t FLIP_Y = 0x08;
+
+struct Layout {
+    uint16_t width;
+    uint16_t height;
+    // Size of one panel; a single matrix has the canvas size. Panels are
+    // chained one after another, every panel wired the same way.
+    uint16_t panelWidth;
+    uint16_t panelHeight;
+    uint8_t wiring;
+    uint8_t panelWiring;
+};
+
+// Number of pixels (and table entries)
+inline size_t pixelCount(const Layout& layout) {
+    return (size_t)layout.width * layout.height;
+}
+
+// Fills `table` (pixelCount entries) with the strip index of every logical
+// pixel. False when the panels do not tile the canvas or the strip would
+// exceed 65535 LEDs.
+bool buildXyTable(const Layout& layout, uint16_t* table);
+
+class Canvas {
+public:
+    // `table` from buildXyTable, `frame` pixelCount entries; both outlive
+    // the canvas.
+    Canvas(const Layout& layout, const uint16_t* table, render::Rgb* frame);
+
+    uint16_t width() const { return width_; }
+    uint16_t height() const { return height_; }
+
+    render::Rgb* row(uint16_t y) { return frame_ + (size_t)y * width_; }
+    render::Rgb& at(uint16_t x, uint16_t y) { return frame_[(size_t)y * width_ + x]; }
+
+    void clear();
+
+    // Writes the frame onto `strip` (pixelCount LEDs) in wiring order.
+    void present(render::Rgb* strip) const;
+
+private:
+    uint16_t width_;
+    uint16_t height_;
+    const uint16_t* table_;
+    render::Rgb* frame_;
+};
+
+// Notes as columns: note n lights column n % width from the bottom, as high
+// as its velocity, in its render::noteColor (so it fades like the strip).
+void renderNoteColumns(const render::NoteState* notes, uint32_t nowMs, const render::RenderConfig& cfg,
+                       Canvas& canvas);
+
+} // namespace canvas
@@ -0,0 +1,84 @@
+#include "led_wire.h"
+
+#include <string.h>
+
+namespace ledwire {
+
+namespace {
+
+static const size_t START_BYTES = 4;
+static const size_t SK9822_LATCH_BYTES = 4;
+static const uint8_t LED_FRAME_MARKER = 0xE0;
+static const uint8_t MAX_GLOBAL = 31;
+
+size_t endBytes(Chipset chipset, uint16_t numLeds) {
+    const size_t edges = ((size_t)numLeds + 15) / 16;
+    return chipset == Chipset::Sk9822 ? SK9822_LATCH_BYTES + edges : edges;
+}
+
+} // namespace
+
+bool isClocked(Chipset chipset) {
+    return chipset == Chipset::Apa102 || chipset == Chipset::Sk9822;
+}
+
+size_t frameBytes(Chipset chipset, uint16_t numLeds) {
+    if (!isClocked(chipset)) return 0;
+    return START_BYTES + 4 * (size_t)numLeds + endBytes(chipset, numLeds);
+}
+
+size_t encode(Chipset chipset, const render::Rgb* pixels, uint16_t numLeds, uint8_t brightness, Order order,
+              uint8_t* out) {
+    const size_t len = frameBytes(chipset, numLeds);
+    if (len == 0) return 0;
+    memset(out, 0, START_BYTES);
+
+    // Smallest hardware level that reaches `brightness`, the rest in software
+    // (scale / 256, at most 256)
+    const uint8_t global = (uint8_t)(((uint32_t)brightness * MAX_GLOBAL + 254) / 255);
+    const uint32_t scale = global == 0 ? 0 : ((uint32_t)brightness * MAX_GLOBAL * 256) / ((uint32_t)global * 255);
+
+    uint8_t* led = out + START_BYTES;
+    for (uint16_t i = 0; i < numLeds; i++, led += 4) {
+        const uint8_t r = (uint8_t)((pixels[i].r * scale) >> 8);
+        const uint8_t g = (uint8_t)((pixels[i].g * scale) >> 8);
+        const uint8_t b = (uint8_t)((pixels[i].b * scale) >> 8);
+        led[0] = LED_FRAME_MARKER | global;
+        switch (order) {
+            case Order::RGB:
+                led[1] = r;
+                led[2] = g;
+                led[3] = b;
+                break;
+            case Order::GRB:
+                led[1] = g;
+                led[2] = r;
+                led[3] = b;
+                break;
+            case Order::BGR:
+                led[1] = b;
+                led[2] = g;
+                led[3] = r;
+                break;
+        }
+    }
+    // Zero end frame: bytes past the strip are not LED frames (no 0xE0 marker)
+    memset(led, 0, endBytes(chipset, numLeds));
+    return len;
+}
+
+uint32_t wireTimeUs(Chipset chipset, uint16_t numLeds, uint32_t clockHz) {
+    if (!isClocked(chipset)) {
+        return (uint32_t)(((uint64_t)numLeds * WS2812_LED_NS + 999) / 1000) + WS2812_LATCH_US;
+    }
+    if (clockHz == 0) return 0;
+    const uint64_t bits = (uint64_t)frameBytes(chipset, numLeds) * 8;
+    return (uint32_t)((bits * 1000000 + clockHz - 1) / clockHz);
+}
+
+uint32_t maxFps(Chipset chipset, uint16_t numLeds, uint32_t clockHz) {
+    const uint32_t us = wireTimeUs(chipset, numLeds, clockHz);
+    return us == 0 ? 0 : 1000000 / us;
+}
+
+} // namespace ledwire
@@ -0,0 +1,57 @@
+#pragma once
+
+// LED strip wire formats: frame encoder for clocked strips (APA102, SK9822)
+// and a wire-time model of every supported chipset.
+// No Arduino dependencies; the ESP32 DMA driver is apa102_spi.cpp, host
+// tests and benchmarks are in ../host. The fake ESP32 of the loopback
+// harness (integration_tests/src/fakes.rs, LedWire) uses the same model.
+//
+// Clocked frame: 4 zero bytes (start), per LED 0xE0 | 5-bit global
+// brightness followed by three colour bytes, then the end frame: the data
+// needs numLeds / 2 extra clock edges to reach the last LED
+// (ceil(numLeds / 16) bytes); SK9822 also needs 32 zero bits to latch.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "render_core.h"
+
+namespace ledwire {
+
+enum class Chipset : uint8_t {
+    // One-wire 800 kHz (FastLED)
+    Ws2812,
+    Apa102,
+    Sk9822,
+};
+
+// Byte order on the wire
+enum class Order : uint8_t {
+    RGB,
+    GRB,
+    BGR,
+};
+
+// WS2812B: 24 bits at 1.25 us, then the latch (280 us on current parts)
+static const uint32_t WS2812_LED_NS = 30000;
+static const uint32_t WS2812_LATCH_US = 280;
+
+bool isClocked(Chipset chipset);
+
+// Size of one clocked frame for `numLeds` (0 for one-wire chipsets)
+size_t frameBytes(Chipset chipset, uint16_t numLeds);
+
+// Encodes `pixels` into `out` (frameBytes bytes) and returns the length.
+// `brightness` (0-255) goes to the 5-bit hardware brightness, rounded up,
+// and the remainder scales the colours, so dim frames keep their colour
+// resolution instead of losing bits to software scaling.
+size_t encode(Chipset chipset, const render::Rgb* pixels, uint16_t numLeds, uint8_t brightness, Order order,
+              uint8_t* out);
+
+// Time one frame occupies the wire; `clockHz` is ignored for WS2812.
+uint32_t wireTimeUs(Chipset chipset, uint16_t numLeds, uint32_t clockHz);
+
+// Highest frame rate the wire allows
+uint32_t maxFps(Chipset chipset, uint16_t numLeds, uint32_t clockHz);
+
+} // namespace ledwire
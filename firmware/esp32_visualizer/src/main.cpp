@@ -1,33 +1,72 @@
 #include <Arduino.h>
 #include <WiFi.h>
+#include <WiFiUdp.h>
 #include <ESPmDNS.h>
 #include <ArduinoOSC.h>
 #include <FastLED.h>
+#include <esp_timer.h>
+#include "apa102_spi.h"
+#include "applemidi.h"
 #include "board_config.h"
+#include "canvas.h"
+#include "led_wire.h"
+#include "midi_event.h"
+#include "render_core.h"
+#include "task_stats.h"
+#include "viz_link.h"
 
 // LED strip configuration
 CRGB leds[NUM_LEDS];
+#if LED_BACKEND == LED_BACKEND_CLOCKED
+Apa102Spi clockedStrip;
+#endif
 
 // OSC server
 OscWiFiServer osc_server;
 
+// AppleMIDI session straight from the DAW (control and data port)
+WiFiUDP appleMidiControl;
+WiFiUDP appleMidiData;
+
+// Visualizer link: events and hub-rendered frames. Slices land in
+// linkStaging on the network task; a completed frame is copied to linkFrame
+// for the animation task under linkMux.
+WiFiUDP vizLinkUdp;
+render::Rgb linkStaging[NUM_LEDS];
+render::Rgb linkFrame[NUM_LEDS];
+uint32_t linkFrameMs = 0;
+bool linkFrameValid = false;
+portMUX_TYPE linkMux = portMUX_INITIALIZER_UNLOCKED;
+
 // FreeRTOS handles
 TaskHandle_t networkTaskHandle = NULL;
 TaskHandle_t animationTaskHandle = NULL;
 QueueHandle_t commandQueue = NULL;
 
 // MIDI note state tracking
-struct NoteState {
-    bool active;
-    uint8_t velocity;
-    unsigned long startTime;
-    unsigned long fadeStartTime;
-    bool fading;
-};
+using render::NoteState;
+
+NoteState noteStates[render::NOTE_COUNT] = {0};
 
-NoteState noteStates[128] = {0};
+static_assert(sizeof(CRGB) == sizeof(render::Rgb), "CRGB must stay layout-compatible with render::Rgb");
+static const render::RenderConfig renderConfig = {NUM_LEDS, VELOCITY_MAX, SUSTAIN_HOLD_TIME};
 bool sustainPedal = false;
 
+#if MATRIX_WIDTH > 0
+static_assert(MATRIX_WIDTH * MATRIX_HEIGHT == NUM_LEDS, "NUM_LEDS must cover the matrix");
+static_assert(NUM_LEDS <= 65535, "the XY table holds 16-bit strip indices");
+static_assert(MATRIX_PANEL_WIDTH > 0 && MATRIX_PANEL_HEIGHT > 0, "matrix panels need a size");
+static_assert(MATRIX_WIDTH % MATRIX_PANEL_WIDTH == 0 && MATRIX_HEIGHT % MATRIX_PANEL_HEIGHT == 0,
+              "matrix panels must tile the canvas");
+static const canvas::Layout matrixLayout = {
+    MATRIX_WIDTH, MATRIX_HEIGHT, MATRIX_PANEL_WIDTH, MATRIX_PANEL_HEIGHT, MATRIX_WIRING, MATRIX_PANEL_WIRING,
+};
+// XY -> strip index, built in setup(); effects draw into matrixFrame
+uint16_t matrixTable[NUM_LEDS];
+render::Rgb matrixFrame[NUM_LEDS];
+canvas::Canvas matrix(matrixLayout, matrixTable, matrixFrame);
+#endif
+
 // Command structure for queue
 struct OscCommand {
     enum Type {
@@ -47,6 +86,104 @@ struct OscCommand {
     uint8_t effectId;
 };
 
+// Maps a MIDI event (from /midi or AppleMIDI) onto the animation queue
+void queueMidiEvent(const midi::Event& event) {
+    OscCommand cmd;
+    if (event.isNoteOn()) {
+        cmd.type = OscCommand::NOTE_ON;
+        cmd.note = event.data1();
+        cmd.velocity = event.data2();
+    } else if (event.isNoteOff()) {
+        cmd.type = OscCommand::NOTE_OFF;
+        cmd.note = event.data1();
+    } else if (event.isChannelVoice() && event.kind() == 0xB0) {
+        cmd.type = OscCommand::CC;
+        cmd.controller = event.data1();
+        cmd.value = event.data2();
+    } else if (event.isChannelVoice() && event.kind() == 0xE0) {
+        cmd.type = OscCommand::PITCH_BEND;
+        cmd.bendValue = event.pitchBend();
+    } else if (event.isChannelVoice() && event.kind() == 0xC0) {
+        cmd.type = OscCommand::PROGRAM_CHANGE;
+        cmd.effectId = event.data1();
+    } else {
+        return;
+    }
+
+    if (xQueueSend(commandQueue, &cmd, 0) != pdTRUE) {
+        Serial.println("Failed to queue MIDI event");
+    }
+}
+
+void onAppleMidi(void* context, midi::Event event, bool recovered) {
+    queueMidiEvent(event);
+}
+
+// Feeds every pending datagram on `udp` to the endpoint and answers the sender
+void pollAppleMidi(WiFiUDP& udp, applemidi::Port port, applemidi::Endpoint& endpoint) {
+    static uint8_t packet[512];
+    while (int size = udp.parsePacket()) {
+        const int len = udp.read(packet, sizeof(packet));
+        if (len <= 0 || size > (int)sizeof(packet)) continue;
+        uint8_t reply[applemidi::MAX_REPLY];
+        // 64-bit clock: micros() wraps after ~71 min, mid-session
+        const size_t replyLen = endpoint.handlePacket(port, packet, (size_t)len, esp_timer_get_time(), reply);
+        if (replyLen > 0) {
+            udp.beginPacket(udp.remoteIP(), udp.remotePort());
+            udp.write(reply, replyLen);
+            udp.endPacket();
+        }
+    }
+}
+
+void onVizLinkEvent(void* context, midi::Event event) {
+    queueMidiEvent(event);
+}
+
+// Feeds every pending link datagram to the receiver, publishes completed frames
+void pollVizLink(vizlink::Receiver& receiver) {
+    static uint8_t packet[vizlink::MAX_DATAGRAM];
+    while (int size = vizLinkUdp.parsePacket()) {
+        const int len = vizLinkUdp.read(packet, sizeof(packet));
+        if (len <= 0 || size > (int)sizeof(packet)) continue;
+        if (receiver.handlePacket(packet, (size_t)len)) {
+            const uint32_t now = millis();
+            portENTER_CRITICAL(&linkMux);
+            memcpy(linkFrame, linkStaging, sizeof(linkFrame));
+            linkFrameMs = now;
+            linkFrameValid = true;
+            portEXIT_CRITICAL(&linkMux);
+        }
+    }
+}
+
+// Copies the newest hub frame into `leds`; false when none is recent
+bool copyLinkFrame() {
+    const uint32_t now = millis();
+    bool fresh;
+    portENTER_CRITICAL(&linkMux);
+    fresh = linkFrameValid && now - linkFrameMs < LINK_FRAME_HOLD_MS;
+    if (fresh) memcpy(leds, linkFrame, sizeof(linkFrame));
+    portEXIT_CRITICAL(&linkMux);
+    return fresh;
+}
+
+// Logs per-task CPU load, idle share per core and stack headroom
+void logTaskStats() {
+    static taskstats::Sampler sampler;
+    static taskstats::Snapshot snapshot;
+    static char line[512];
+    if (!sampler.sample(snapshot) && snapshot.overflow == 0) {
+        return;
+    }
+    taskstats::formatLine(snapshot, line, sizeof(line));
+    Serial.printf("Tasks: %s\n", line);
+    const taskstats::TaskLoad& tightest = snapshot.tasks[snapshot.minStackIndex];
+    if (snapshot.count > 0 && tightest.stackFreeBytes < STACK_WARN_BYTES) {
+        Serial.printf("Low stack: %s has %lu bytes left\n", tightest.name, (unsigned long)tightest.stackFreeBytes);
+    }
+}
+
 // Network task (Core 0)
 void networkTask(void *parameter) {
     Serial.println("Network task started on core " + String(xPortGetCoreID()));
@@ -64,10 +201,21 @@ void networkTask(void *parameter) {
     if (MDNS.begin("esp32-visualizer")) {
         Serial.println("mDNS responder started");
         MDNS.addService("osc", "udp", OSC_PORT);
+        MDNS.addService("apple-midi", "udp", APPLEMIDI_PORT);
+        MDNS.addService("vizlink", "udp", VIZ_LINK_PORT);
     }
     
     // Setup OSC server
     osc_server.bind(OSC_PORT);
+
+    // Setup AppleMIDI endpoint (bypasses the hub)
+    static applemidi::Endpoint appleMidi(APPLEMIDI_NAME, (uint32_t)ESP.getEfuseMac(), onAppleMidi, NULL);
+    appleMidiControl.begin(APPLEMIDI_PORT);
+    appleMidiData.begin(APPLEMIDI_PORT + 1);
+
+    // Visualizer link from the hub
+    static vizlink::Receiver vizLink(linkStaging, NUM_LEDS, onVizLinkEvent, NULL);
+    vizLinkUdp.begin(VIZ_LINK_PORT);
     
     // OSC message handlers
     osc_server.on("/noteOn", [](OscMessage& m) {
@@ -112,6 +260,11 @@ void networkTask(void *parameter) {
         }
     });
     
+    // Packed UMP word from OscSender::send_event; one message for every kind
+    osc_server.on("/midi", [](OscMessage& m) {
+        queueMidiEvent({static_cast<uint32_t>(m.arg<int>(0))});
+    });
+    
     osc_server.on("/config/setEffect", [](OscMessage& m) {
         OscCommand cmd;
         cmd.type = OscCommand::PROGRAM_CHANGE;
@@ -123,21 +276,62 @@ void networkTask(void *parameter) {
     });
     
     // Main network loop
+    unsigned long lastTelemetry = 0;
     while (true) {
         osc_server.parse();
+        pollAppleMidi(appleMidiControl, applemidi::Port::Control, appleMidi);
+        pollAppleMidi(appleMidiData, applemidi::Port::Data, appleMidi);
+        appleMidi.poll(esp_timer_get_time());
+        pollVizLink(vizLink);
+        if (TELEMETRY_INTERVAL_MS > 0 && millis() - lastTelemetry >= TELEMETRY_INTERVAL_MS) {
+            lastTelemetry = millis();
+            logTaskStats();
+            const vizlink::Stats& link = vizLink.stats();
+            if (link.packets > 0) {
+                Serial.printf("Link: %lu packets, %lu events, %lu frames, %lu lost, %lu late\n",
+                              (unsigned long)link.packets, (unsigned long)link.events, (unsigned long)link.frames,
+                              (unsigned long)link.lost, (unsigned long)link.late);
+            }
+        }
         delay(1); // Small delay to prevent watchdog issues
     }
 }
 
-// Animation task (Core 1)
-void animationTask(void *parameter) {
-    Serial.println("Animation task started on core " + String(xPortGetCoreID()));
-    
-    // Initialize FastLED
+// Sends `leds` to the strip
+void ledsShow() {
+#if LED_BACKEND == LED_BACKEND_CLOCKED
+    // Brightness goes to the chips' 5-bit global brightness (led_wire.h)
+    clockedStrip.show(reinterpret_cast<const render::Rgb*>(leds), BRIGHTNESS, LED_CLOCKED_ORDER);
+#else
+    FastLED.show();
+#endif
+}
+
+// Starts the LED backend from board_config.h with a dark strip
+void ledsBegin() {
+#if LED_BACKEND == LED_BACKEND_CLOCKED
+    if (!clockedStrip.begin(LED_CLOCKED_CHIPSET, LED_PIN, LED_CLOCK_PIN, LED_SPI_HZ, NUM_LEDS)) {
+        Serial.println("Failed to set up the clocked LED strip");
+    }
+    Serial.printf("Clocked LEDs: %u us per frame, up to %u fps\n",
+                  (unsigned)ledwire::wireTimeUs(LED_CLOCKED_CHIPSET, NUM_LEDS, LED_SPI_HZ),
+                  (unsigned)ledwire::maxFps(LED_CLOCKED_CHIPSET, NUM_LEDS, LED_SPI_HZ));
+    fill_solid(leds, NUM_LEDS, CRGB::Black);
+    ledsShow();
+#else
     FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS);
     FastLED.setBrightness(BRIGHTNESS);
     FastLED.clear();
     FastLED.show();
+#endif
+}
+
+// Animation task (Core 1)
+void animationTask(void *parameter) {
+    Serial.println("Animation task started on core " + String(xPortGetCoreID()));
+    
+    // Initialize the LED strip
+    ledsBegin();
     
     unsigned long lastFrame = 0;
     const unsigned long frameInterval = 1000 / ANIMATION_FPS;
@@ -234,39 +428,32 @@ void updateNoteAnimations(unsigned long currentTime) {
 }
 
 void renderFrame() {
-    // Clear all LEDs
-    FastLED.clear();
-    
-    // Map MIDI notes to LED positions (chromatic scale)
-    for (int note = 0; note < 128; note++) {
-        if (noteStates[note].active) {
-            int ledIndex = note % NUM_LEDS;
-            
-            // Calculate color based on note and velocity
-            uint8_t hue = (note * 2) % 256; // Color based on note
-            uint8_t saturation = 255;
-            uint8_t value = map(noteStates[note].velocity, 0, VELOCITY_MAX, 50, 255);
-            
-            // Apply fade effect
-            if (noteStates[note].fading) {
-                unsigned long fadeTime = millis() - noteStates[note].fadeStartTime;
-                uint8_t fadeValue = map(fadeTime, 0, SUSTAIN_HOLD_TIME, value, 0);
-                value = fadeValue;
-            }
-            
-            // Blend with existing LED color
-            CRGB newColor = CHSV(hue, saturation, value);
-            leds[ledIndex] += newColor;
-        }
+    // The hub renders for this board while its frames keep coming
+    if (copyLinkFrame()) {
+        ledsShow();
+        return;
     }
+#if MATRIX_WIDTH > 0
+    // Notes as columns in logical coordinates, then onto the wiring, see canvas.cpp
+    canvas::renderNoteColumns(noteStates, millis(), renderConfig, matrix);
+    matrix.present(reinterpret_cast<render::Rgb*>(leds));
+#else
+    // Map MIDI notes to LED positions (chromatic scale), see render_core.cpp
+    render::renderNotes(noteStates, millis(), renderConfig, reinterpret_cast<render::Rgb*>(leds));
+#endif
     
     // Show the frame
-    FastLED.show();
+    ledsShow();
 }
 
 void setup() {
     Serial.begin(115200);
     Serial.println("ESP32 Visualizer Starting...");
+
+#if MATRIX_WIDTH > 0
+    // Cannot fail: the tiling is checked at compile time above
+    canvas::buildXyTable(matrixLayout, matrixTable);
+#endif
     
     // Create command queue
     commandQueue = xQueueCreate(32, sizeof(OscCommand));
@@ -0,0 +1,40 @@
+#pragma once
+
+// Packed MIDI event as sent by the host in `/midi ,i <word>` OSC messages.
+// Mirrors rtp_midi_core::MidiEvent: one 32-bit UMP word
+//   | type (4) | group (4) | status (8) | data1 (8) | data2 (8) |
+// Header-only and free of Arduino dependencies.
+
+#include <stdint.h>
+
+namespace midi {
+
+static const uint8_t MT_SYSTEM = 0x1;
+static const uint8_t MT_CHANNEL_VOICE = 0x2;
+static const uint8_t MT_SYSEX = 0x3;
+
+struct Event {
+    uint32_t word;
+
+    uint8_t messageType() const { return word >> 28; }
+    uint8_t status() const { return (word >> 16) & 0xFF; }
+    // Status without the channel nibble for channel voice messages
+    uint8_t kind() const { return status() >= 0xF0 ? status() : (status() & 0xF0); }
+    uint8_t channel() const { return status() & 0x0F; }
+    uint8_t data1() const { return (word >> 8) & 0xFF; }
+    uint8_t data2() const { return word & 0xFF; }
+
+    bool isChannelVoice() const { return messageType() == MT_CHANNEL_VOICE; }
+    // A Note On with velocity 0 is a Note Off
+    bool isNoteOn() const { return isChannelVoice() && kind() == 0x90 && data2() > 0; }
+    bool isNoteOff() const {
+        return isChannelVoice() && (kind() == 0x80 || (kind() == 0x90 && data2() == 0));
+    }
+    // Pitch bend normalised to -1.0 .. +1.0
+    float pitchBend() const {
+        int value = (int(data2()) << 7) | data1();
+        return (value - 8192) / 8192.0f;
+    }
+};
+
+} // namespace midi
@@ -0,0 +1,71 @@
+#include "render_core.h"
+
+#include <string.h>
+
+namespace render {
+
+namespace {
+
+// Arduino map() with the result clamped to the output range
+long mapClamped(long x, long inMin, long inMax, long outMin, long outMax) {
+    if (inMax == inMin) return outMin;
+    long v = (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+    long lo = outMin < outMax ? outMin : outMax;
+    long hi = outMin < outMax ? outMax : outMin;
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+} // namespace
+
+Rgb hsvToRgb(uint8_t hue, uint8_t saturation, uint8_t value) {
+    // Six sectors of ~43 hue steps each
+    uint8_t sector = hue / 43;
+    uint8_t remainder = (uint8_t)((hue - sector * 43) * 6);
+
+    uint8_t p = (uint8_t)((value * (255 - saturation)) >> 8);
+    uint8_t q = (uint8_t)((value * (255 - ((saturation * remainder) >> 8))) >> 8);
+    uint8_t t = (uint8_t)((value * (255 - ((saturation * (255 - remainder)) >> 8))) >> 8);
+
+    switch (sector) {
+        case 0:  return Rgb{value, t, p};
+        case 1:  return Rgb{q, value, p};
+        case 2:  return Rgb{p, value, t};
+        case 3:  return Rgb{p, q, value};
+        case 4:  return Rgb{t, p, value};
+        default: return Rgb{value, p, q};
+    }
+}
+
+Rgb noteColor(size_t note, const NoteState& state, uint32_t nowMs, const RenderConfig& cfg) {
+    // Calculate color based on note and velocity
+    uint8_t hue = (uint8_t)((note * 2) % 256);
+    uint8_t value = (uint8_t)mapClamped(state.velocity, 0, cfg.velocityMax, 50, 255);
+
+    // Apply fade effect
+    if (state.fading) {
+        uint32_t fadeTime = nowMs - state.fadeStartTime;
+        value = (uint8_t)mapClamped(fadeTime, 0, cfg.fadeTimeMs, value, 0);
+    }
+    return hsvToRgb(hue, 255, value);
+}
+
+void renderNotes(const NoteState* notes, uint32_t nowMs, const RenderConfig& cfg, Rgb* out) {
+    memset(out, 0, cfg.numLeds * sizeof(Rgb));
+    if (cfg.numLeds == 0) return;
+
+    for (size_t note = 0; note < NOTE_COUNT; note++) {
+        const NoteState& state = notes[note];
+        if (!state.active) continue;
+
+        size_t ledIndex = note % cfg.numLeds;
+
+        // Blend with existing LED color
+        Rgb color = noteColor(note, state, nowMs, cfg);
+        Rgb& led = out[ledIndex];
+        led.r = qadd8(led.r, color.r);
+        led.g = qadd8(led.g, color.g);
+        led.b = qadd8(led.b, color.b);
+    }
+}
+
+} // namespace render
@@ -0,0 +1,53 @@
+#pragma once
+
+// Portable render core of the visualizer.
+// No Arduino/FastLED dependencies, so the same code runs on the ESP32
+// and in host builds (benchmarks, see ../host).
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace render {
+
+// Layout-compatible with FastLED's CRGB (r, g, b bytes)
+struct Rgb {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+// MIDI note state tracking
+struct NoteState {
+    bool active;
+    uint8_t velocity;
+    uint32_t startTime;
+    uint32_t fadeStartTime;
+    bool fading;
+};
+
+static const size_t NOTE_COUNT = 128;
+
+struct RenderConfig {
+    uint16_t numLeds;
+    uint8_t velocityMax;
+    uint32_t fadeTimeMs;
+};
+
+// Saturating 8-bit add (FastLED's qadd8); how overlapping light adds up
+inline uint8_t qadd8(uint8_t a, uint8_t b) {
+    const unsigned sum = (unsigned)a + b;
+    return sum > 255 ? 255 : (uint8_t)sum;
+}
+
+// Integer HSV -> RGB (8-bit hue wheel, like FastLED's CHSV)
+Rgb hsvToRgb(uint8_t hue, uint8_t saturation, uint8_t value);
+
+// Colour of an active note: hue by note, value by velocity, faded out over
+// cfg.fadeTimeMs once released
+Rgb noteColor(size_t note, const NoteState& state, uint32_t nowMs, const RenderConfig& cfg);
+
+// Renders all active notes into `out` (cfg.numLeds entries).
+// Notes map chromatically onto the strip; overlapping notes add with saturation.
+void renderNotes(const NoteState* notes, uint32_t nowMs, const RenderConfig& cfg, Rgb* out);
+
+} // namespace render
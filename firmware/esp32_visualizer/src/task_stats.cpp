@@ -0,0 +1,146 @@
+#include "task_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ESP-IDF 4.x (FreeRTOS 10.2) still reports the total as uint32_t
+#ifndef configRUN_TIME_COUNTER_TYPE
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
+namespace taskstats {
+
+namespace {
+
+#if configGENERATE_RUN_TIME_STATS
+static const bool HAVE_RUN_TIME = true;
+#else
+static const bool HAVE_RUN_TIME = false;
+#endif
+
+int8_t coreOf(const TaskStatus_t& status) {
+#if configTASKLIST_INCLUDE_COREID
+    if (status.xCoreID >= 0 && (size_t)status.xCoreID < CORES) return (int8_t)status.xCoreID;
+#else
+    (void)status;
+#endif
+    return ANY_CORE;
+}
+
+uint32_t runTimeOf(const TaskStatus_t& status) {
+#if configGENERATE_RUN_TIME_STATS
+    return (uint32_t)status.ulRunTimeCounter;
+#else
+    (void)status;
+    return 0;
+#endif
+}
+
+// Share of `interval` in permille, capped (counters are sampled one task
+// at a time, so a busy task can overshoot slightly).
+uint16_t permille(uint32_t part, uint32_t interval) {
+    if (interval == 0) return 0;
+    const uint64_t value = (uint64_t)part * 1000u / interval;
+    return value > 1000 ? 1000 : (uint16_t)value;
+}
+
+// Scratch for uxTaskGetSystemState; only the sampling task uses it.
+TaskStatus_t statusBuffer[MAX_TASKS];
+
+} // namespace
+
+Sampler::Sampler() : previous_(0), previousCount_(0), previousTotal_(0), havePrevious_(false) {}
+
+uint32_t Sampler::previousRunTime(uint32_t taskNumber) const {
+    const Previous* previous = buffers_[previous_];
+    for (size_t i = 0; i < previousCount_; i++) {
+        if (previous[i].taskNumber == taskNumber) return previous[i].runTime;
+    }
+    // Started since the last sample: all of its run time is new
+    return 0;
+}
+
+bool Sampler::sample(Snapshot& out) {
+    memset(&out, 0, sizeof(out));
+    const UBaseType_t taskCount = uxTaskGetNumberOfTasks();
+    if (taskCount > MAX_TASKS) {
+        out.overflow = taskCount > 255 ? 255 : (uint8_t)taskCount;
+        havePrevious_ = false;
+        return false;
+    }
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const UBaseType_t count = uxTaskGetSystemState(statusBuffer, MAX_TASKS, &total);
+
+    const uint32_t interval = (uint32_t)total - previousTotal_;
+    out.hasLoad = HAVE_RUN_TIME && havePrevious_ && interval > 0;
+    out.interval = out.hasLoad ? interval : 0;
+    Previous* current = buffers_[previous_ ^ 1];
+    uint32_t minStack = UINT32_MAX;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& status = statusBuffer[i];
+        TaskLoad& task = out.tasks[out.count];
+        strncpy(task.name, status.pcTaskName, MAX_NAME);
+        task.name[MAX_NAME] = '\0';
+        task.core = coreOf(status);
+        task.stackFreeBytes = (uint32_t)status.usStackHighWaterMark * sizeof(StackType_t);
+        const uint32_t runTime = runTimeOf(status);
+        if (out.hasLoad) {
+            task.loadPermille = permille(runTime - previousRunTime(status.xTaskNumber), interval);
+            if (strncmp(task.name, "IDLE", 4) == 0 && task.core != ANY_CORE) {
+                out.idlePermille[task.core] = task.loadPermille;
+            }
+        }
+        if (task.stackFreeBytes < minStack) {
+            minStack = task.stackFreeBytes;
+            out.minStackIndex = out.count;
+        }
+        current[i].taskNumber = status.xTaskNumber;
+        current[i].runTime = runTime;
+        out.count++;
+    }
+    previous_ ^= 1;
+    previousCount_ = count;
+    previousTotal_ = (uint32_t)total;
+    const bool hadPrevious = havePrevious_;
+    havePrevious_ = count > 0;
+    return hadPrevious && count > 0;
+}
+
+size_t formatLine(const Snapshot& snapshot, char* out, size_t size) {
+    if (size == 0) return 0;
+    size_t len = 0;
+    auto append = [&](int written) {
+        if (written > 0) len += (size_t)written;
+        if (len >= size) len = size - 1;
+    };
+    if (snapshot.overflow > 0) {
+        append(snprintf(out, size, "%u tasks, more than %u", snapshot.overflow, (unsigned)MAX_TASKS));
+        return len;
+    }
+    if (snapshot.hasLoad) {
+        append(snprintf(out, size, "idle"));
+        for (size_t core = 0; core < CORES; core++) {
+            const unsigned idle = snapshot.idlePermille[core];
+            append(snprintf(out + len, size - len, " %u.%u%%", idle / 10, idle % 10));
+        }
+    } else {
+        append(snprintf(out, size, "no run-time stats"));
+    }
+    for (size_t i = 0; i < snapshot.count; i++) {
+        const TaskLoad& task = snapshot.tasks[i];
+        if (strncmp(task.name, "IDLE", 4) == 0) continue;
+        char core[8] = "c-";
+        if (task.core != ANY_CORE) snprintf(core, sizeof(core), "c%d", task.core);
+        append(snprintf(out + len, size - len, " | %s %s", task.name, core));
+        if (snapshot.hasLoad) {
+            append(snprintf(out + len, size - len, " %u.%u%%", task.loadPermille / 10, task.loadPermille % 10));
+        }
+        append(snprintf(out + len, size - len, " %luB", (unsigned long)task.stackFreeBytes));
+    }
+    return len;
+}
+
+} // namespace taskstats
@@ -0,0 +1,79 @@
+#pragma once
+
+// Per-task CPU load and stack headroom from FreeRTOS run-time stats.
+// `Sampler::sample` reads uxTaskGetSystemState (one short scheduler
+// suspension) and turns the run-time counters into loads over the interval
+// since the previous sample, so call it rarely (TELEMETRY_INTERVAL_MS).
+// Builds against the ESP-IDF FreeRTOS headers on the board and against the
+// shim in ../host/shim for host tests.
+//
+// Loads are in permille of one core: a task that kept its core busy for the
+// whole interval reports 1000, and the IDLE task of each core gives that
+// core's idle share. Without configGENERATE_RUN_TIME_STATS only the stack
+// watermarks are filled in (`hasLoad` false).
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace taskstats {
+
+static const size_t MAX_TASKS = 24;
+static const size_t MAX_NAME = 15;
+static const size_t CORES = 2;
+// Task not pinned to a core
+static const int8_t ANY_CORE = -1;
+
+struct TaskLoad {
+    char name[MAX_NAME + 1];
+    int8_t core;
+    uint16_t loadPermille;
+    // Least free stack seen since the task started (high-water mark)
+    uint32_t stackFreeBytes;
+};
+
+struct Snapshot {
+    TaskLoad tasks[MAX_TASKS];
+    uint8_t count;
+    // Number of tasks when there are more than MAX_TASKS (none listed then)
+    uint8_t overflow;
+    bool hasLoad;
+    uint16_t idlePermille[CORES];
+    // Run-time counter ticks (us on the ESP32) since the previous sample
+    uint32_t interval;
+    // Task with the least free stack (index into `tasks`)
+    uint8_t minStackIndex;
+};
+
+class Sampler {
+public:
+    Sampler();
+
+    // Reads the current task states into `out`. Loads need a previous
+    // sample; the first call only sets up the baseline and returns false,
+    // as does a call that found more than MAX_TASKS tasks.
+    bool sample(Snapshot& out);
+
+private:
+    struct Previous {
+        uint32_t taskNumber;
+        uint32_t runTime;
+    };
+
+    uint32_t previousRunTime(uint32_t taskNumber) const;
+
+    // Run times of the last sample in buffers_[previous_]; `sample` fills
+    // the other buffer and swaps them afterwards, since the lookups of a
+    // reordered task list still need the old values.
+    Previous buffers_[2][MAX_TASKS];
+    uint8_t previous_;
+    size_t previousCount_;
+    uint32_t previousTotal_;
+    bool havePrevious_;
+};
+
+// One-line summary for the serial log, e.g.
+//   "idle 97.1% 80.4% | NetworkTask c0 2.3% 5120B | AnimationTask c1 19.5% 1480B"
+// Returns the length written (truncated to `size` - 1).
+size_t formatLine(const Snapshot& snapshot, char* out, size_t size);
+
+} // namespace taskstats
@@ -0,0 +1,99 @@
+#include "viz_link.h"
+
+#include <string.h>
+
+namespace vizlink {
+
+namespace {
+
+static_assert(sizeof(render::Rgb) == 3, "frame slices are copied as packed RGB");
+
+static const size_t EVENTS_HEADER = 2;
+static const size_t FRAME_HEADER = 6;
+
+uint16_t readU16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+uint32_t readU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Length of the record at `p` (`left` bytes remain), 0 when it is cut off
+// or unknown
+size_t recordLen(const uint8_t* p, size_t left) {
+    size_t len = 0;
+    if (p[0] == RECORD_EVENTS && left >= EVENTS_HEADER) {
+        len = EVENTS_HEADER + (size_t)p[1] * 4;
+    } else if (p[0] == RECORD_FRAME && left >= FRAME_HEADER) {
+        len = FRAME_HEADER + (size_t)readU16(p + 4) * 3;
+    }
+    return len <= left ? len : 0;
+}
+
+} // namespace
+
+Receiver::Receiver(render::Rgb* frame, uint16_t numLeds, EventHandler handler, void* context)
+    : frame_(frame), numLeds_(numLeds), handler_(handler), context_(context), started_(false), nextSeq_(0), lateRun_(0) {
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+bool Receiver::handlePacket(const uint8_t* data, size_t len) {
+    if (len < HEADER_LEN || data[0] != MAGIC || data[1] != VERSION) {
+        stats_.malformed++;
+        return false;
+    }
+    // Check every record first so a damaged datagram changes nothing
+    for (size_t at = HEADER_LEN; at < len;) {
+        const size_t record = recordLen(data + at, len - at);
+        if (record == 0) {
+            stats_.malformed++;
+            return false;
+        }
+        at += record;
+    }
+    stats_.packets++;
+
+    const uint16_t seq = readU16(data + 2);
+    const uint16_t ahead = (uint16_t)(seq - nextSeq_);
+    bool late = false;
+    if (started_ && ahead < 0x8000) {
+        stats_.lost += ahead;
+    } else if (started_ && (uint16_t)(nextSeq_ - seq) <= RESYNC_DISTANCE && ++lateRun_ < RESYNC_LATE_RUN) {
+        stats_.late++;
+        late = true;
+    }
+    if (!late) {
+        started_ = true;
+        nextSeq_ = (uint16_t)(seq + 1);
+        lateRun_ = 0;
+    }
+    if (!late) stats_.lastTimestampUs = readU32(data + 4);
+
+    bool pushed = false;
+    for (size_t at = HEADER_LEN; at < len;) {
+        const uint8_t* record = data + at;
+        at += recordLen(record, len - at);
+        if (record[0] == RECORD_EVENTS) {
+            for (size_t i = 0; i < record[1]; i++) {
+                stats_.events++;
+                if (handler_) handler_(context_, midi::Event{readU32(record + EVENTS_HEADER + i * 4)});
+            }
+            continue;
+        }
+        if (late) continue;
+        const uint16_t offset = readU16(record + 2);
+        const uint16_t count = readU16(record + 4);
+        if (offset < numLeds_) {
+            const uint16_t fit = count < numLeds_ - offset ? count : (uint16_t)(numLeds_ - offset);
+            memcpy(frame_ + offset, record + FRAME_HEADER, (size_t)fit * 3);
+        }
+        if (record[1] & FRAME_PUSH) {
+            stats_.frames++;
+            pushed = true;
+        }
+    }
+    return pushed;
+}
+
+} // namespace vizlink
@@ -0,0 +1,76 @@
+#pragma once
+
+// Receiver of the hub's visualizer link (crates/hal-esp32/src/link.rs).
+// A datagram is an 8-byte header ('E', version, u16 sequence, u32 hub
+// timestamp in us, big-endian) followed by records:
+//   0x01 count:u8, count x packed UMP word   batched MIDI events
+//   0x02 flags:u8 offset:u16 count:u16 RGB   slice of an LED frame
+// The last slice of a frame carries PUSH. Datagrams stay below the MTU, so
+// frames of any length arrive without IP reassembly.
+// No Arduino or socket dependencies, like applemidi.h: the platform feeds
+// received datagrams into `Receiver::handlePacket`. Host test in ../host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi_event.h"
+#include "render_core.h"
+
+namespace vizlink {
+
+static const uint8_t MAGIC = 'E';
+static const uint8_t VERSION = 1;
+static const size_t HEADER_LEN = 8;
+// Largest datagram the hub sends
+static const size_t MAX_DATAGRAM = 1400;
+
+static const uint8_t RECORD_EVENTS = 0x01;
+static const uint8_t RECORD_FRAME = 0x02;
+static const uint8_t FRAME_PUSH = 0x01;
+
+// A datagram this far behind the newest one, or this many late ones in a
+// row, mean the hub restarted
+static const uint16_t RESYNC_DISTANCE = 256;
+static const uint8_t RESYNC_LATE_RUN = 4;
+
+typedef void (*EventHandler)(void* context, midi::Event event);
+
+struct Stats {
+    uint32_t packets;
+    uint32_t events;
+    // Frames completed (PUSH)
+    uint32_t frames;
+    // Datagrams missing from the sequence
+    uint32_t lost;
+    // Datagrams older than the newest one; their events still count, their
+    // frame slices are dropped
+    uint32_t late;
+    uint32_t malformed;
+    // Hub clock of the newest datagram (us, low 32 bits)
+    uint32_t lastTimestampUs;
+};
+
+class Receiver {
+public:
+    // Frame slices land in `frame` (`numLeds` pixels, the rest is cut off);
+    // `handler` gets every event.
+    Receiver(render::Rgb* frame, uint16_t numLeds, EventHandler handler, void* context);
+
+    // Processes one datagram. True when it completed a frame in `frame`.
+    // Malformed datagrams are dropped whole.
+    bool handlePacket(const uint8_t* data, size_t len);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    render::Rgb* frame_;
+    uint16_t numLeds_;
+    EventHandler handler_;
+    void* context_;
+    bool started_;
+    uint16_t nextSeq_;
+    uint8_t lateRun_;
+    Stats stats_;
+};
+
+} // namespace vizlink
@@ -0,0 +1,20 @@
+# CTest `hub_loopback`: the Rust hub against a fake DAW, WLED and ESP32 on
+# loopback (integration_tests/src/bin/loopback.rs). Fails when a path drops
+# more than 5 % of its probes; the JSON report lands in the build directory.
+#
+#   include(<repo>/integration_tests/loopback.cmake)
+#   ctest -R hub_loopback --output-on-failure
+get_filename_component(RTP_MIDI_ROOT "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+find_program(CARGO cargo)
+if(NOT CARGO)
+    message(STATUS "cargo not found, skipping hub_loopback test")
+    return()
+endif()
+
+enable_testing()
+add_test(NAME hub_loopback
+    COMMAND ${CARGO} run --release -p integration_tests --bin loopback --
+            --seconds 5 --json ${CMAKE_CURRENT_BINARY_DIR}/loopback.json
+    WORKING_DIRECTORY ${RTP_MIDI_ROOT})
+# The first run compiles the hub.
+set_tests_properties(hub_loopback PROPERTIES TIMEOUT 1800)
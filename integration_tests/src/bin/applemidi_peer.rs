@@ -0,0 +1,148 @@
+//! RTP-MIDI initiator for the firmware AppleMIDI loopback test
+//! (firmware/esp32_visualizer/host/applemidi_loopback.cpp).
+//!
+//!   applemidi_peer --target 127.0.0.1:5004 [--notes 200] [--drop-every 7]
+//!
+//! Invites the control port, then sets up the data port session with
+//! `RtpMidiSession` (invitation and CK exchange), sends `--notes` Note
+//! On/Off pairs for keys 21 + i % 88, dropping every `--drop-every`-th RTP
+//! packet before it leaves, and ends with a CC 120 sentinel and BY.
+//!
+//! The firmware endpoint speaks RFC 6295 like the DAWs it is advertised
+//! to, so the RTP packets come from the network crate's `Rfc6295Sender`
+//! (one command each, recovery journal with chapters C and N) rather than
+//! the session's `PacketBuilder`.
+
+use anyhow::{anyhow, Context, Result};
+use network::midi::rtp::control_message::{AppleMidiMessage, Exit, Invitation};
+use network::midi::rtp::rfc6295::Rfc6295Sender;
+use network::midi::rtp::session::RtpMidiSession;
+use rtp_midi_core::clock::monotonic_us;
+use std::env;
+use std::net::{SocketAddr, UdpSocket};
+use std::process::ExitCode;
+use std::sync::Arc;
+use std::time::Duration;
+
+const NAME: &str = "rtp-midi-peer";
+
+// Sends IN to the control port until OK arrives.
+fn invite_control(socket: &UdpSocket, target: SocketAddr, token: u32) -> Result<()> {
+    let invitation = AppleMidiMessage::Invitation(Invitation::new(token, 1, NAME.to_string()));
+    socket.set_read_timeout(Some(Duration::from_millis(200)))?;
+    let mut buf = [0u8; 256];
+    for _ in 0..10 {
+        socket.send_to(&invitation.serialize(), target)?;
+        if let Ok((len, _)) = socket.recv_from(&mut buf) {
+            match AppleMidiMessage::parse(&buf[..len]) {
+                Ok(AppleMidiMessage::InvitationAccepted(ok))
+                    if ok.header.initiator_token == token =>
+                {
+                    return Ok(())
+                }
+                Ok(other) => return Err(anyhow!("unexpected reply {other:?}")),
+                Err(_) => continue,
+            }
+        }
+    }
+    Err(anyhow!("no OK on the control port"))
+}
+
+async fn run(target: SocketAddr, notes: usize, drop_every: usize) -> Result<()> {
+    let data_target = SocketAddr::new(target.ip(), target.port() + 1);
+    let control = UdpSocket::bind("127.0.0.1:0")?;
+    let data = Arc::new(UdpSocket::bind("127.0.0.1:0")?);
+    let session = Arc::new(RtpMidiSession::new(NAME.to_string(), 0, None).await?);
+    invite_control(&control, target, session.initiator_token).context("control port")?;
+
+    // The session only sends control messages (IN, CK).
+    let sink_socket = data.clone();
+    session
+        .add_outgoing_packet_handler(move |ip: String, port: u16, packet: Vec<u8>| {
+            let _ = sink_socket.send_to(&packet, (ip.as_str(), port));
+        })
+        .await;
+
+    // Replies (OK, CK1) go through the session's control handler.
+    let (receive_socket, receive_session) = (data.clone(), session.clone());
+    receive_socket.set_read_timeout(Some(Duration::from_millis(100)))?;
+    let receiver = tokio::task::spawn_blocking(move || {
+        let runtime = tokio::runtime::Handle::current();
+        let mut buf = [0u8; 1500];
+        while Arc::strong_count(&receive_session) > 1 {
+            if let Ok((len, from)) = receive_socket.recv_from(&mut buf) {
+                if let Ok(msg) = AppleMidiMessage::parse(&buf[..len]) {
+                    let _ = runtime.block_on(receive_session.handle_control_message(msg, from));
+                }
+            }
+        }
+    });
+
+    session
+        .initiate_handshake(data_target, "esp32-visualizer")
+        .await
+        .context("data port")?;
+
+    // RTP packets are dropped on request before they leave.
+    let mut rtp = Rfc6295Sender::new(session.ssrc(), 0, session.media_clock());
+    let mut rtp_packets = 0usize;
+    let mut send = |command: [u8; 3], may_drop: bool| -> Result<()> {
+        let packet = rtp.packet(monotonic_us(), &command);
+        rtp_packets += 1;
+        if !(may_drop && drop_every > 0 && rtp_packets % drop_every == 0) {
+            data.send_to(&packet, data_target)?;
+        }
+        Ok(())
+    };
+    for i in 0..notes {
+        let key = 21 + (i % 88) as u8;
+        let velocity = 1 + (i % 127) as u8;
+        send([0x90, key, velocity], true)?;
+        tokio::time::sleep(Duration::from_millis(3)).await;
+        send([0x80, key, 0], true)?;
+        tokio::time::sleep(Duration::from_millis(3)).await;
+    }
+    // The sentinel's journal covers a drop just before it.
+    tokio::time::sleep(Duration::from_millis(10)).await;
+    send([0xB0, 120, 0], false)?;
+    session.end_session().await?;
+    tokio::time::sleep(Duration::from_millis(50)).await;
+
+    let bye = AppleMidiMessage::Exit(Exit::new(session.initiator_token, 1)).serialize();
+    control.send_to(&bye, target)?;
+    data.send_to(&bye, data_target)?;
+    println!(
+        "sent {} RTP packets, dropped every {}",
+        rtp_packets, drop_every
+    );
+    drop(session);
+    let _ = receiver.await;
+    Ok(())
+}
+
+#[tokio::main]
+async fn main() -> ExitCode {
+    let args: Vec<String> = env::args().collect();
+    let arg = |name: &str| {
+        args.iter()
+            .position(|a| a == name)
+            .and_then(|i| args.get(i + 1))
+            .map(|s| s.as_str())
+    };
+    let Some(Ok(target)) = arg("--target").map(str::parse::<SocketAddr>) else {
+        eprintln!("--target <ip:control port> required");
+        return ExitCode::from(2);
+    };
+    let notes = arg("--notes").and_then(|s| s.parse().ok()).unwrap_or(200);
+    let drop_every = arg("--drop-every")
+        .and_then(|s| s.parse().ok())
+        .unwrap_or(7);
+
+    match run(target, notes, drop_every).await {
+        Ok(()) => ExitCode::SUCCESS,
+        Err(e) => {
+            eprintln!("applemidi_peer failed: {e:#}");
+            ExitCode::FAILURE
+        }
+    }
+}
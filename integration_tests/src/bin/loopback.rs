@@ -0,0 +1,86 @@
+//! Loopback throughput harness: the hub against a fake DAW, WLED and ESP32.
+//!
+//!   loopback [--seconds 10] [--rate 1000] [--loss 0.01] [--probe-rate 20]
+//!            [--fps 60] [--seed 1] [--json report.json] [--max-drop-ratio 0.05]
+//!            [--esp32-wire ws2812|apa102:<MHz>|sk9822:<MHz>]
+//!
+//! Exits with 1 when a path received no probe or dropped more than
+//! `--max-drop-ratio` of them, so it can run as a CTest.
+
+use integration_tests::fakes::LedWire;
+use integration_tests::harness::{self, HarnessConfig};
+use std::env;
+use std::process::ExitCode;
+use std::time::Duration;
+
+#[tokio::main]
+async fn main() -> ExitCode {
+    let args: Vec<String> = env::args().collect();
+    let arg = |name: &str| {
+        args.iter()
+            .position(|a| a == name)
+            .and_then(|i| args.get(i + 1))
+            .map(|s| s.as_str())
+    };
+    let number = |name: &str, default: f64| match arg(name).map(str::parse::<f64>) {
+        None => default,
+        Some(Ok(value)) => value,
+        Some(Err(_)) => {
+            eprintln!("{name}: expected a number");
+            std::process::exit(2);
+        }
+    };
+
+    let mut config = HarnessConfig::default();
+    config.duration = Duration::from_secs_f64(number("--seconds", 10.0).max(0.1));
+    config.daw.rate = number("--rate", config.daw.rate).max(0.0);
+    config.daw.loss = number("--loss", config.daw.loss).clamp(0.0, 1.0);
+    // A key is reused after 88 probes; it must go dark in between.
+    config.daw.probe_rate = number("--probe-rate", config.daw.probe_rate).clamp(0.0, 100.0);
+    config.fps = number("--fps", config.fps as f64).max(1.0) as u32;
+    config.daw.seed = number("--seed", config.daw.seed as f64) as u64;
+    let max_drop_ratio = number("--max-drop-ratio", 0.05);
+    if let Some(wire) = arg("--esp32-wire") {
+        let Some(wire) = LedWire::parse(wire) else {
+            eprintln!("--esp32-wire: expected ws2812, apa102:<MHz> or sk9822:<MHz>");
+            return ExitCode::from(2);
+        };
+        config.esp32_wire = Some(wire);
+    }
+
+    let report = match harness::run(&config).await {
+        Ok(report) => report,
+        Err(e) => {
+            eprintln!("loopback failed: {e:#}");
+            return ExitCode::FAILURE;
+        }
+    };
+    print!("{report}");
+    if let Some(path) = arg("--json") {
+        let json = serde_json::to_string_pretty(&report).expect("report serializes");
+        if let Err(e) = std::fs::write(path, json) {
+            eprintln!("{path}: {e}");
+            return ExitCode::FAILURE;
+        }
+    }
+
+    let mut ok = true;
+    for path in &report.paths {
+        let drop_ratio = path.drops as f64 / path.probes.max(1) as f64;
+        if path.received == 0 || drop_ratio > max_drop_ratio {
+            eprintln!(
+                "{}: {} of {} probes dropped (limit {:.0}%)",
+                path.path,
+                path.drops,
+                path.probes,
+                max_drop_ratio * 100.0
+            );
+            ok = false;
+        }
+    }
+    if ok {
+        ExitCode::SUCCESS
+    } else {
+        ExitCode::FAILURE
+    }
+}
@@ -0,0 +1,491 @@
+//! Fake peers of the hub on loopback.
+//!
+//! - `run_daw`: RTP-MIDI DAW that invites itself into the hub's session and
+//!   streams load notes at a configurable rate, dropping a share of its
+//!   packets before they reach the socket (the hub has to recover them from
+//!   the journal of the following packets), plus probe notes and CCs.
+//! - `FakeWled`: WLED with the HTTP JSON API and a DDP receiver.
+//! - `FakeEsp32`: OSC sink of the `/leds` pixel blobs, optionally with the
+//!   wire time of its LED strip (`LedWire`).
+//!
+//! Every receipt is timestamped on the process monotonic clock, the same
+//! clock the DAW stamps its probes with.
+
+use crate::latency::ProbeTracker;
+use network::midi::rtp::clock::MediaClock;
+use network::midi::rtp::control_message::{AppleMidiMessage, Invitation};
+use network::midi::rtp::sender::PacketBuilder;
+use rtp_midi_core::clock::monotonic_us;
+use serde::Serialize;
+use std::collections::VecDeque;
+use std::io;
+use std::net::SocketAddr;
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream, UdpSocket};
+use tokio::task::JoinHandle;
+use tokio::time::{timeout, Instant, MissedTickBehavior};
+
+/// Probe bookkeeping shared between the fake DAW and one fake peer.
+pub type Probes = Arc<Mutex<ProbeTracker>>;
+
+/// Lowest key of the piano range; probe key `FIRST_KEY + i` lights LED `i`.
+pub const FIRST_KEY: u8 = 21;
+/// Keys of the piano range, one LED each.
+pub const KEYS: u8 = 88;
+/// Controller carrying the HTTP probes; its value is the probe id.
+pub const PROBE_CC: u8 = 20;
+// Load notes stay below the piano range so they never light an LED.
+const LOAD_KEYS: u8 = FIRST_KEY;
+const PROBE_NOTE_US: u64 = 50_000;
+const INVITE_TIMEOUT: Duration = Duration::from_secs(5);
+
+// Tasks of a fake peer, stopped when it is dropped.
+struct Tasks(Vec<JoinHandle<()>>);
+
+impl Drop for Tasks {
+    fn drop(&mut self) {
+        for task in &self.0 {
+            task.abort();
+        }
+    }
+}
+
+// Deterministic packet loss (xorshift64).
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+
+    // Uniform in 0.0..1.0.
+    fn unit(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+}
+
+/// Traffic of the fake DAW.
+#[derive(Debug, Clone)]
+pub struct DawConfig {
+    /// Load messages per second (Note On/Off pairs below the piano range).
+    pub rate: f64,
+    /// Share of packets dropped before sending (0.0..1.0).
+    pub loss: f64,
+    /// Probe notes (and probe CCs) per second.
+    pub probe_rate: f64,
+    pub seed: u64,
+}
+
+/// What the fake DAW sent.
+#[derive(Debug, Clone, Copy, Default, Serialize)]
+pub struct DawStats {
+    pub messages: u64,
+    pub packets: u64,
+    /// Packets dropped on purpose (simulated loss).
+    pub lost_packets: u64,
+}
+
+/// Where the fake DAW registers its probes.
+#[derive(Clone, Default)]
+pub struct DawProbes {
+    /// Paths observing probe notes as lit LEDs.
+    pub notes: Vec<Probes>,
+    /// Path observing probe CCs as WLED brightness.
+    pub cc: Option<Probes>,
+}
+
+/// Joins the hub's session at `service` and streams for `duration`.
+pub async fn run_daw(
+    config: &DawConfig,
+    service: SocketAddr,
+    duration: Duration,
+    probes: &DawProbes,
+) -> io::Result<DawStats> {
+    let mut rng = Rng(config.seed | 1);
+    let socket = UdpSocket::bind("127.0.0.1:0").await?;
+    let ssrc = rng.next() as u32;
+    invite(&socket, service, rng.next() as u32, ssrc).await?;
+
+    let mut builder = PacketBuilder::new(ssrc, rng.next() as u16, MediaClock::start());
+    let mut stats = DawStats::default();
+    let mut ticker = tokio::time::interval(Duration::from_millis(1));
+    ticker.set_missed_tick_behavior(MissedTickBehavior::Delay);
+    let (mut load_due, mut probe_due) = (0.0, 0.0);
+    let (mut load_n, mut probe_n) = (0u64, 0u64);
+    let mut note_offs = VecDeque::new();
+    let mut packets = Vec::new();
+    let started_us = monotonic_us();
+    let end_us = started_us + duration.as_micros() as u64;
+    let mut last_us = started_us;
+    loop {
+        ticker.tick().await;
+        let now_us = monotonic_us();
+        if now_us >= end_us {
+            break;
+        }
+        let dt = (now_us - last_us) as f64 / 1e6;
+        last_us = now_us;
+        let mut push = |command: &[u8]| {
+            stats.messages += 1;
+            packets.extend(builder.push(now_us, command));
+        };
+
+        load_due += config.rate * dt;
+        while load_due >= 1.0 {
+            load_due -= 1.0;
+            let key = (load_n / 2 % LOAD_KEYS as u64) as u8;
+            if load_n % 2 == 0 {
+                push(&[0x90, key, 64]);
+            } else {
+                push(&[0x80, key, 0]);
+            }
+            load_n += 1;
+        }
+        while note_offs.front().is_some_and(|&(at_us, _)| at_us <= now_us) {
+            let (_, key) = note_offs.pop_front().unwrap();
+            push(&[0x80, key, 0]);
+        }
+        probe_due += config.probe_rate * dt;
+        while probe_due >= 1.0 {
+            probe_due -= 1.0;
+            let key = FIRST_KEY + (probe_n % KEYS as u64) as u8;
+            let value = (probe_n % 128) as u8;
+            probe_n += 1;
+            push(&[0x90, key, 100]);
+            note_offs.push_back((now_us + PROBE_NOTE_US, key));
+            for path in &probes.notes {
+                path.lock().unwrap().sent(key, now_us);
+            }
+            if let Some(path) = &probes.cc {
+                push(&[0xB0, PROBE_CC, value]);
+                path.lock().unwrap().sent(value, now_us);
+            }
+        }
+
+        packets.extend(builder.finish());
+        for packet in packets.drain(..) {
+            stats.packets += 1;
+            if rng.unit() < config.loss {
+                stats.lost_packets += 1;
+            } else {
+                socket.send_to(&packet, service).await?;
+            }
+        }
+    }
+    Ok(stats)
+}
+
+// Sends IN until the hub answers OK (it may still be binding its socket).
+async fn invite(socket: &UdpSocket, service: SocketAddr, token: u32, ssrc: u32) -> io::Result<()> {
+    let invitation = Invitation::new(token, ssrc, "loopback-daw".into()).serialize();
+    let deadline = Instant::now() + INVITE_TIMEOUT;
+    let mut buf = [0u8; 1500];
+    while Instant::now() < deadline {
+        socket.send_to(&invitation, service).await?;
+        if let Ok(Ok((len, _))) =
+            timeout(Duration::from_millis(100), socket.recv_from(&mut buf)).await
+        {
+            if let Ok(AppleMidiMessage::InvitationAccepted(_)) =
+                AppleMidiMessage::parse(&buf[..len])
+            {
+                return Ok(());
+            }
+        }
+    }
+    Err(io::Error::new(
+        io::ErrorKind::TimedOut,
+        format!("RTP-MIDI session at {service} did not accept the invitation"),
+    ))
+}
+
+// Dark-to-lit transitions of the LEDs of one receiver.
+#[derive(Default)]
+struct LitLeds {
+    lit: Vec<bool>,
+}
+
+impl LitLeds {
+    fn frame(&mut self, pixels: &[u8], at_us: u64, probes: &Probes) {
+        let mut probes = probes.lock().unwrap();
+        probes.message();
+        let leds = pixels.len() / 3;
+        if self.lit.len() < leds {
+            self.lit.resize(leds, false);
+        }
+        for (led, rgb) in pixels.chunks_exact(3).enumerate() {
+            let on = rgb.iter().any(|&c| c > 0);
+            if on && !self.lit[led] && led < KEYS as usize {
+                probes.observed(FIRST_KEY + led as u8, at_us);
+            }
+            self.lit[led] = on;
+        }
+    }
+}
+
+/// Applies one DDP packet to `frame`; returns true when it completes the
+/// frame (push flag).
+pub fn apply_ddp_packet(packet: &[u8], frame: &mut Vec<u8>) -> bool {
+    if packet.len() < 10 {
+        return false;
+    }
+    let flags = packet[0];
+    // Timecode flag: four more header bytes.
+    let header = if flags & 0x10 != 0 { 14 } else { 10 };
+    let offset = u32::from_be_bytes([packet[4], packet[5], packet[6], packet[7]]) as usize;
+    let len = u16::from_be_bytes([packet[8], packet[9]]) as usize;
+    let Some(data) = packet.get(header..header + len) else {
+        return false;
+    };
+    if frame.len() < offset + len {
+        frame.resize(offset + len, 0);
+    }
+    frame[offset..offset + len].copy_from_slice(data);
+    flags & 0x01 != 0
+}
+
+/// Pixels of an OSC `/leds ,b` message.
+pub fn osc_leds_blob(packet: &[u8]) -> Option<&[u8]> {
+    // OSC strings are NUL-terminated and padded to four bytes.
+    let padded = |end: usize| (end + 4) & !3;
+    let address_end = packet.iter().position(|&b| b == 0)?;
+    if &packet[..address_end] != b"/leds" {
+        return None;
+    }
+    let tags = padded(address_end);
+    let tags_end = tags + packet.get(tags..)?.iter().position(|&b| b == 0)?;
+    if &packet[tags..tags_end] != b",b" {
+        return None;
+    }
+    let at = padded(tags_end);
+    let len = i32::from_be_bytes(packet.get(at..at + 4)?.try_into().ok()?);
+    packet.get(at + 4..at + 4 + usize::try_from(len).ok()?)
+}
+
+/// Brightness set by a WLED JSON state request: the hub's serialized
+/// `WledOutputAction` or WLED's own `bri`.
+pub fn json_brightness(body: &[u8]) -> Option<u8> {
+    let json: serde_json::Value = serde_json::from_slice(body).ok()?;
+    json.pointer("/SetBrightness/value")
+        .or_else(|| json.get("bri"))
+        .and_then(serde_json::Value::as_u64)
+        .map(|value| value as u8)
+}
+
+/// Fake WLED: HTTP JSON API and DDP receiver on loopback.
+pub struct FakeWled {
+    pub http_addr: SocketAddr,
+    pub ddp_addr: SocketAddr,
+    _tasks: Tasks,
+}
+
+impl FakeWled {
+    /// `http` observes probe CCs, `ddp` probe notes.
+    pub async fn start(http: Probes, ddp: Probes) -> io::Result<Self> {
+        let listener = TcpListener::bind("127.0.0.1:0").await?;
+        let socket = UdpSocket::bind("127.0.0.1:0").await?;
+        let (http_addr, ddp_addr) = (listener.local_addr()?, socket.local_addr()?);
+        let http_task = tokio::spawn(async move {
+            while let Ok((stream, _)) = listener.accept().await {
+                tokio::spawn(serve_http(stream, http.clone()));
+            }
+        });
+        let ddp_task = tokio::spawn(async move {
+            let (mut buf, mut frame) = (vec![0u8; 65_536], Vec::new());
+            let mut leds = LitLeds::default();
+            while let Ok(len) = socket.recv(&mut buf).await {
+                if apply_ddp_packet(&buf[..len], &mut frame) {
+                    leds.frame(&frame, monotonic_us(), &ddp);
+                }
+            }
+        });
+        Ok(Self {
+            http_addr,
+            ddp_addr,
+            _tasks: Tasks(vec![http_task, ddp_task]),
+        })
+    }
+}
+
+// Answers `POST /json/state` requests of one (keep-alive) connection.
+async fn serve_http(mut stream: TcpStream, probes: Probes) {
+    let mut buf = Vec::new();
+    let mut chunk = [0u8; 4096];
+    loop {
+        let header_end = loop {
+            if let Some(at) = buf.windows(4).position(|w| w == b"\r\n\r\n") {
+                break at + 4;
+            }
+            match stream.read(&mut chunk).await {
+                Ok(0) | Err(_) => return,
+                Ok(n) => buf.extend_from_slice(&chunk[..n]),
+            }
+        };
+        let content_length = String::from_utf8_lossy(&buf[..header_end])
+            .lines()
+            .find_map(|line| {
+                let (name, value) = line.split_once(':')?;
+                name.trim()
+                    .eq_ignore_ascii_case("content-length")
+                    .then(|| value.trim().parse::<usize>().ok())?
+            })
+            .unwrap_or(0);
+        while buf.len() < header_end + content_length {
+            match stream.read(&mut chunk).await {
+                Ok(0) | Err(_) => return,
+                Ok(n) => buf.extend_from_slice(&chunk[..n]),
+            }
+        }
+        let at_us = monotonic_us();
+        {
+            let mut probes = probes.lock().unwrap();
+            probes.message();
+            if let Some(value) = json_brightness(&buf[header_end..header_end + content_length]) {
+                probes.observed(value, at_us);
+            }
+        }
+        buf.drain(..header_end + content_length);
+        let response = b"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 16\r\n\r\n{\"success\":true}";
+        if stream.write_all(response).await.is_err() {
+            return;
+        }
+    }
+}
+
+/// Wire-time model of the ESP32's LED strip, the same as the firmware's
+/// `ledwire::wireTimeUs` (firmware/esp32_visualizer/src/led_wire.h).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum LedWire {
+    /// One-wire 800 kHz: 30 µs per LED plus a 280 µs latch.
+    Ws2812,
+    /// Clocked strip: start frame, 4 bytes per LED, end frame.
+    Apa102 { clock_hz: u32 },
+    /// As APA102 with a 32-bit latch in the end frame.
+    Sk9822 { clock_hz: u32 },
+}
+
+impl LedWire {
+    /// Parses `ws2812`, `apa102:<MHz>` or `sk9822:<MHz>`.
+    pub fn parse(text: &str) -> Option<Self> {
+        let (chip, mhz) = match text.split_once(':') {
+            Some((chip, mhz)) => (chip, Some(mhz.parse::<f64>().ok()?)),
+            None => (text, None),
+        };
+        let clock_hz = (mhz.unwrap_or(12.0) * 1e6) as u32;
+        match chip {
+            "ws2812" => Some(Self::Ws2812),
+            "apa102" => Some(Self::Apa102 { clock_hz }),
+            "sk9822" => Some(Self::Sk9822 { clock_hz }),
+            _ => None,
+        }
+    }
+
+    /// Time one frame of `leds` occupies the wire.
+    pub fn frame_us(&self, leds: usize) -> u64 {
+        let leds = leds as u64;
+        let (clock_hz, latch_bytes) = match *self {
+            Self::Ws2812 => return (leds * 30_000).div_ceil(1000) + 280,
+            Self::Apa102 { clock_hz } => (clock_hz, 0),
+            Self::Sk9822 { clock_hz } => (clock_hz, 4),
+        };
+        if clock_hz == 0 {
+            return 0;
+        }
+        let bytes = 4 + 4 * leds + latch_bytes + leds.div_ceil(16);
+        (bytes * 8 * 1_000_000).div_ceil(clock_hz as u64)
+    }
+}
+
+/// Fake ESP32 visualizer: OSC sink of `/leds` pixel blobs.
+pub struct FakeEsp32 {
+    pub addr: SocketAddr,
+    _tasks: Tasks,
+}
+
+impl FakeEsp32 {
+    /// With `wire`, a frame lights its LEDs only once it has been clocked
+    /// out, after the frames still on the wire.
+    pub async fn start(probes: Probes, wire: Option<LedWire>) -> io::Result<Self> {
+        let socket = UdpSocket::bind("127.0.0.1:0").await?;
+        let addr = socket.local_addr()?;
+        let task = tokio::spawn(async move {
+            let mut buf = vec![0u8; 65_536];
+            let mut leds = LitLeds::default();
+            let mut wire_free_us = 0;
+            while let Ok(len) = socket.recv(&mut buf).await {
+                if let Some(pixels) = osc_leds_blob(&buf[..len]) {
+                    let mut at_us = monotonic_us();
+                    if let Some(wire) = wire {
+                        wire_free_us = at_us.max(wire_free_us) + wire.frame_us(pixels.len() / 3);
+                        at_us = wire_free_us;
+                    }
+                    leds.frame(pixels, at_us, &probes);
+                }
+            }
+        });
+        Ok(Self {
+            addr,
+            _tasks: Tasks(vec![task]),
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn parses_what_the_hub_sends() {
+        let mut osc = Vec::new();
+        output::osc_output::OscPixelSender::encode_pixels(&[1, 2, 3, 4, 5, 6], &mut osc);
+        assert_eq!(osc_leds_blob(&osc), Some(&[1, 2, 3, 4, 5, 6][..]));
+        assert_eq!(osc_leds_blob(b"/note\0\0\0,ii\0"), None);
+
+        // Two packets with timecode; the second one pushes the frame.
+        let mut frame = Vec::new();
+        let first = [0x50, 0, 1, 1, 0, 0, 0, 0, 0, 3, 9, 9, 9, 9, 10, 20, 30];
+        let second = [0x51, 0, 1, 1, 0, 0, 0, 3, 0, 3, 9, 9, 9, 9, 40, 50, 60];
+        assert!(!apply_ddp_packet(&first, &mut frame));
+        assert!(apply_ddp_packet(&second, &mut frame));
+        assert_eq!(frame, vec![10, 20, 30, 40, 50, 60]);
+
+        let action = rtp_midi_core::WledOutputAction::SetBrightness { value: 77 };
+        assert_eq!(
+            json_brightness(&serde_json::to_vec(&action).unwrap()),
+            Some(77)
+        );
+        assert_eq!(json_brightness(br#"{"bri":128}"#), Some(128));
+    }
+
+    #[test]
+    fn led_wire_matches_the_firmware_model() {
+        // The same numbers as firmware/esp32_visualizer/host/led_wire_test.cpp
+        assert_eq!(LedWire::Ws2812.frame_us(23), 23 * 30 + 280);
+        assert_eq!(LedWire::parse("apa102:12").unwrap().frame_us(1000), 2712);
+        assert_eq!(
+            LedWire::parse("sk9822"),
+            Some(LedWire::Sk9822 {
+                clock_hz: 12_000_000
+            })
+        );
+        assert_eq!(LedWire::Apa102 { clock_hz: 0 }.frame_us(10), 0);
+        assert_eq!(LedWire::parse("ws2811"), None);
+        assert_eq!(LedWire::parse("apa102:fast"), None);
+    }
+
+    #[test]
+    fn lit_leds_report_probe_keys_once() {
+        let probes = Probes::default();
+        probes.lock().unwrap().sent(FIRST_KEY + 1, 100);
+        let mut leds = LitLeds::default();
+        leds.frame(&[0, 0, 0, 0, 9, 0], 300, &probes);
+        leds.frame(&[0, 0, 0, 0, 9, 0], 400, &probes);
+        let report = probes.lock().unwrap().report("ddp", 1.0);
+        assert_eq!((report.messages, report.received), (2, 1));
+        assert_eq!(report.p50_ms, Some(0.2));
+    }
+}
@@ -0,0 +1,221 @@
+//! End-to-end loopback run of the hub service.
+//!
+//! Starts the fake WLED and ESP32, then the real service loop configured
+//! against them (88 LEDs mirrored to both, audio off, one WLED brightness
+//! mapping per value of the probe CC), then the fake DAW. After the DAW
+//! stops, probes still in flight get `settle` to arrive; the rest are
+//! drops. Paths:
+//!
+//! - `midi->ddp`: probe Note On to the LED lit in a WLED DDP frame,
+//! - `midi->osc`: the same LED in an ESP32 OSC `/leds` blob (once clocked
+//!   out to the strip with `esp32_wire`),
+//! - `midi->http`: probe CC to the WLED JSON brightness request.
+
+use crate::fakes::{
+    run_daw, DawConfig, DawProbes, DawStats, FakeEsp32, FakeWled, LedWire, Probes, KEYS, PROBE_CC,
+};
+use crate::latency::PathReport;
+use anyhow::{anyhow, Context, Result};
+use rtp_midi_core::clock::monotonic_us;
+use rtp_midi_core::{
+    ColorCorrection, ColorOrder, Config, InputEvent, Mapping, MappingOutput, OutputSegment,
+    OutputTarget, WledOutputAction,
+};
+use serde::Serialize;
+use std::fmt;
+use std::net::{SocketAddr, UdpSocket};
+use std::time::Duration;
+use tokio::sync::watch;
+
+/// Parameters of one run.
+#[derive(Debug, Clone)]
+pub struct HarnessConfig {
+    pub duration: Duration,
+    pub daw: DawConfig,
+    /// LED frame rate of the service.
+    pub fps: u32,
+    /// Time given to in-flight probes after the DAW stops.
+    pub settle: Duration,
+    /// Wire time of the fake ESP32's strip; `None` lights LEDs on receipt.
+    pub esp32_wire: Option<LedWire>,
+}
+
+impl Default for HarnessConfig {
+    fn default() -> Self {
+        Self {
+            duration: Duration::from_secs(10),
+            daw: DawConfig {
+                rate: 1_000.0,
+                loss: 0.01,
+                probe_rate: 20.0,
+                seed: 1,
+            },
+            fps: 60,
+            settle: Duration::from_millis(500),
+            esp32_wire: None,
+        }
+    }
+}
+
+/// Result of a run.
+#[derive(Debug, Clone, Serialize)]
+pub struct Report {
+    pub duration_s: f64,
+    pub midi: DawStats,
+    pub midi_messages_per_s: f64,
+    pub paths: Vec<PathReport>,
+}
+
+impl Report {
+    /// Path by name.
+    pub fn path(&self, name: &str) -> Option<&PathReport> {
+        self.paths.iter().find(|path| path.path == name)
+    }
+}
+
+impl fmt::Display for Report {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        writeln!(
+            f,
+            "loopback {:.1} s: {} MIDI messages ({:.0}/s) in {} packets, {} dropped by the fake DAW",
+            self.duration_s,
+            self.midi.messages,
+            self.midi_messages_per_s,
+            self.midi.packets,
+            self.midi.lost_packets
+        )?;
+        writeln!(
+            f,
+            "{:<11} {:>7} {:>8} {:>6} {:>8} {:>8} {:>10}",
+            "path", "probes", "received", "drops", "p50 ms", "p99 ms", "msg/s"
+        )?;
+        let ms = |value: Option<f64>| value.map_or("-".to_string(), |ms| format!("{ms:.2}"));
+        for path in &self.paths {
+            writeln!(
+                f,
+                "{:<11} {:>7} {:>8} {:>6} {:>8} {:>8} {:>10.1}",
+                path.path,
+                path.probes,
+                path.received,
+                path.drops,
+                ms(path.p50_ms),
+                ms(path.p99_ms),
+                path.throughput_per_s
+            )?;
+        }
+        Ok(())
+    }
+}
+
+// A UDP port free right now on loopback.
+fn free_udp_port() -> Result<u16> {
+    Ok(UdpSocket::bind("127.0.0.1:0")?.local_addr()?.port())
+}
+
+fn service_config(
+    config: &HarnessConfig,
+    midi_port: u16,
+    wled: &FakeWled,
+    esp32: SocketAddr,
+) -> Result<Config> {
+    let mut service: Config = serde_json::from_value(serde_json::json!({
+        "wled_ip": wled.http_addr.to_string(),
+        "led_count": KEYS,
+        "audio_device": "none",
+        "midi_port": midi_port,
+        "led_fps": config.fps,
+        "signaling_server_address": "127.0.0.1:0",
+        "audio_sample_rate": 48_000,
+        "audio_channels": 1,
+        "audio_buffer_size": 1024,
+        "audio_smoothing_factor": 0.5,
+    }))
+    .context("service config")?;
+    let segment = |target| OutputSegment {
+        target,
+        offset: 0,
+        length: KEYS as usize,
+        color_order: ColorOrder::Rgb,
+        color: ColorCorrection::default(),
+        fps: None,
+    };
+    service.outputs = Some(vec![
+        segment(OutputTarget::Ddp {
+            ip: wled.ddp_addr.ip().to_string(),
+            port: Some(wled.ddp_addr.port()),
+        }),
+        segment(OutputTarget::Osc {
+            address: esp32.to_string(),
+        }),
+    ]);
+    // The brightness sent to WLED identifies the probe CC.
+    service.mappings = Some(
+        (0..=127)
+            .map(|value| Mapping {
+                input: InputEvent::MidiControlChange {
+                    controller: Some(PROBE_CC),
+                    value: Some(value),
+                },
+                output: vec![MappingOutput::Wled(WledOutputAction::SetBrightness {
+                    value,
+                })],
+            })
+            .collect(),
+    );
+    Ok(service)
+}
+
+/// Runs the service against the fake peers; needs a multi-threaded runtime.
+pub async fn run(config: &HarnessConfig) -> Result<Report> {
+    let (ddp, osc, http) = (Probes::default(), Probes::default(), Probes::default());
+    let wled = FakeWled::start(http.clone(), ddp.clone()).await?;
+    let esp32 = FakeEsp32::start(osc.clone(), config.esp32_wire).await?;
+    let midi_port = free_udp_port()?;
+    let service_config = service_config(config, midi_port, &wled, esp32.addr)?;
+
+    let (shutdown_tx, shutdown_rx) = watch::channel(false);
+    let service = tokio::spawn(rtp_midi_lib::run_service_loop(service_config, shutdown_rx));
+    let probes = DawProbes {
+        notes: vec![ddp.clone(), osc.clone()],
+        cc: Some(http.clone()),
+    };
+    let started_us = monotonic_us();
+    let daw = run_daw(
+        &config.daw,
+        SocketAddr::from(([127, 0, 0, 1], midi_port)),
+        config.duration,
+        &probes,
+    )
+    .await;
+    let duration_s = (monotonic_us() - started_us) as f64 / 1e6;
+    tokio::time::sleep(config.settle).await;
+
+    let _ = shutdown_tx.send(true);
+    if tokio::time::timeout(Duration::from_secs(5), service)
+        .await
+        .is_err()
+    {
+        return Err(anyhow!("service did not shut down"));
+    }
+    let midi = daw.context("fake DAW")?;
+
+    let now_us = monotonic_us();
+    let paths = [
+        ("midi->ddp", &ddp),
+        ("midi->osc", &osc),
+        ("midi->http", &http),
+    ]
+    .into_iter()
+    .map(|(name, probes)| {
+        let mut probes = probes.lock().unwrap();
+        probes.expire(now_us, 0);
+        probes.report(name, duration_s)
+    })
+    .collect();
+    Ok(Report {
+        duration_s,
+        midi,
+        midi_messages_per_s: midi.messages as f64 / duration_s.max(1e-9),
+        paths,
+    })
+}
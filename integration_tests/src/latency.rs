@@ -0,0 +1,168 @@
+//! Latency samples and probe bookkeeping of one measured path.
+//!
+//! A probe is a MIDI message the fake DAW sends with a small id (the key of
+//! a Note On, the value of a Control Change). The fake peer that sees the
+//! effect of the probe (a lit LED, a JSON brightness) reports the same id;
+//! the time in between is one latency sample. Probes never seen within the
+//! timeout, or superseded by a new probe with the same id, are drops.
+
+use serde::Serialize;
+
+const IDS: usize = 128;
+
+/// Latency samples (µs) with percentiles.
+#[derive(Debug, Clone, Default)]
+pub struct LatencyStats {
+    samples: Vec<u64>,
+}
+
+impl LatencyStats {
+    pub fn record(&mut self, latency_us: u64) {
+        self.samples.push(latency_us);
+    }
+
+    pub fn len(&self) -> usize {
+        self.samples.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.samples.is_empty()
+    }
+
+    /// Nearest-rank percentile (`p` in 0.0..=1.0); `None` without samples.
+    pub fn percentile(&self, p: f64) -> Option<u64> {
+        if self.samples.is_empty() {
+            return None;
+        }
+        let mut sorted = self.samples.clone();
+        sorted.sort_unstable();
+        let rank = (p.clamp(0.0, 1.0) * sorted.len() as f64).ceil() as usize;
+        Some(sorted[rank.clamp(1, sorted.len()) - 1])
+    }
+}
+
+/// Probes in flight on one path and what became of them.
+#[derive(Debug, Clone)]
+pub struct ProbeTracker {
+    in_flight: [Option<u64>; IDS],
+    sent: u64,
+    received: u64,
+    dropped: u64,
+    // Messages the fake peer got on this path (frames, HTTP requests).
+    messages: u64,
+    latency: LatencyStats,
+}
+
+impl Default for ProbeTracker {
+    fn default() -> Self {
+        Self {
+            in_flight: [None; IDS],
+            sent: 0,
+            received: 0,
+            dropped: 0,
+            messages: 0,
+            latency: LatencyStats::default(),
+        }
+    }
+}
+
+impl ProbeTracker {
+    /// A probe with `id` left the fake DAW at `at_us`.
+    pub fn sent(&mut self, id: u8, at_us: u64) {
+        let slot = &mut self.in_flight[id as usize % IDS];
+        if slot.replace(at_us).is_some() {
+            self.dropped += 1;
+        }
+        self.sent += 1;
+    }
+
+    /// The fake peer saw the effect of probe `id` at `at_us`. Returns false
+    /// when no such probe is in flight (e.g. an LED lit by other traffic).
+    pub fn observed(&mut self, id: u8, at_us: u64) -> bool {
+        match self.in_flight[id as usize % IDS].take() {
+            Some(sent_us) => {
+                self.received += 1;
+                self.latency.record(at_us.saturating_sub(sent_us));
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Counts one message received by the fake peer.
+    pub fn message(&mut self) {
+        self.messages += 1;
+    }
+
+    /// Drops probes sent more than `timeout_us` before `now_us`.
+    pub fn expire(&mut self, now_us: u64, timeout_us: u64) {
+        for slot in &mut self.in_flight {
+            if slot.is_some_and(|sent_us| now_us.saturating_sub(sent_us) > timeout_us) {
+                *slot = None;
+                self.dropped += 1;
+            }
+        }
+    }
+
+    pub fn report(&self, path: &str, duration_s: f64) -> PathReport {
+        let ms = |p| self.latency.percentile(p).map(|us| us as f64 / 1000.0);
+        PathReport {
+            path: path.to_string(),
+            probes: self.sent,
+            received: self.received,
+            drops: self.dropped,
+            p50_ms: ms(0.5),
+            p99_ms: ms(0.99),
+            messages: self.messages,
+            throughput_per_s: self.messages as f64 / duration_s.max(1e-9),
+        }
+    }
+}
+
+/// Result of one path.
+#[derive(Debug, Clone, Serialize)]
+pub struct PathReport {
+    pub path: String,
+    pub probes: u64,
+    pub received: u64,
+    pub drops: u64,
+    pub p50_ms: Option<f64>,
+    pub p99_ms: Option<f64>,
+    /// Frames or requests the fake peer received, and their rate.
+    pub messages: u64,
+    pub throughput_per_s: f64,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn percentiles_use_nearest_rank() {
+        let mut stats = LatencyStats::default();
+        assert_eq!(stats.percentile(0.5), None);
+        for us in (1..=100).rev() {
+            stats.record(us);
+        }
+        assert_eq!(stats.percentile(0.5), Some(50));
+        assert_eq!(stats.percentile(0.99), Some(99));
+        assert_eq!(stats.percentile(1.0), Some(100));
+        assert_eq!(stats.percentile(0.0), Some(1));
+    }
+
+    #[test]
+    fn unanswered_and_superseded_probes_are_drops() {
+        let mut probes = ProbeTracker::default();
+        probes.sent(60, 1_000);
+        probes.sent(61, 1_000);
+        assert!(probes.observed(60, 3_000));
+        assert!(!probes.observed(60, 4_000));
+        // 61 is sent again before it was seen.
+        probes.sent(61, 5_000);
+        probes.sent(62, 5_000);
+        probes.expire(1_000_000, 500_000);
+        let report = probes.report("test", 1.0);
+        assert_eq!((report.probes, report.received, report.drops), (4, 1, 3));
+        assert_eq!(report.p50_ms, Some(2.0));
+    }
+}
@@ -1,2 +1,13 @@
-// integration_tests/src/lib.rs
-// This crate will contain integration tests for the rtp-midi project.
+//! Integration tests and the loopback harness of the hub.
+//!
+//! The harness runs the real service loop against fake peers on loopback
+//! and reports throughput, p50/p99 latency and drops per output path:
+//!
+//!   cargo run --release -p integration_tests --bin loopback -- --seconds 10 --rate 2000 --loss 0.02
+//!
+//! The same binary is registered as a test of the C++ host builds (CTest in
+//! `firmware/esp32_visualizer/host` and `benches/ffi`, `make check` in `qt_ui`).
+
+pub mod fakes;
+pub mod harness;
+pub mod latency;
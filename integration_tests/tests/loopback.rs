@@ -0,0 +1,27 @@
+//! Short loopback run: every path delivers probes despite packet loss.
+
+use integration_tests::harness::{self, HarnessConfig};
+use std::time::Duration;
+
+#[tokio::test(flavor = "multi_thread", worker_threads = 4)]
+async fn probes_reach_every_fake_peer() {
+    let mut config = HarnessConfig {
+        duration: Duration::from_secs(2),
+        ..Default::default()
+    };
+    config.daw.rate = 500.0;
+    config.daw.loss = 0.05;
+    config.daw.probe_rate = 25.0;
+    let report = harness::run(&config).await.expect("loopback run");
+
+    assert!(report.midi.lost_packets > 0);
+    for name in ["midi->ddp", "midi->osc", "midi->http"] {
+        let path = report.path(name).unwrap();
+        assert!(path.received > 0, "{name}: no probe arrived\n{report}");
+        assert!(path.messages >= path.received, "{name}\n{report}");
+        assert!(path.p50_ms.unwrap() <= path.p99_ms.unwrap());
+    }
+    // The journal recovers lost packets; the LED paths keep most probes.
+    let ddp = report.path("midi->ddp").unwrap();
+    assert!(ddp.received * 10 >= ddp.probes * 8, "{report}");
+}
@@ -0,0 +1,82 @@
+//! Service on a virtual clock: ten seconds of LED keepalive frames run in a
+//! fraction of the time and arrive in an exact count.
+
+use rtp_midi_core::clock::VirtualClock;
+use rtp_midi_core::{ColorCorrection, ColorOrder, Config, OutputSegment, OutputTarget};
+use std::net::UdpSocket;
+use std::time::{Duration, Instant};
+use tokio::sync::watch;
+
+const LEDS: usize = 16;
+
+fn service_config(osc_addr: String) -> Config {
+    let mut config: Config = serde_json::from_value(serde_json::json!({
+        "wled_ip": "127.0.0.1:9",
+        "led_count": LEDS,
+        "audio_device": "none",
+        "midi_port": UdpSocket::bind("127.0.0.1:0").unwrap().local_addr().unwrap().port(),
+        "led_fps": 60,
+        "signaling_server_address": "127.0.0.1:0",
+        "audio_sample_rate": 48_000,
+        "audio_channels": 1,
+        "audio_buffer_size": 1024,
+        "audio_smoothing_factor": 0.5,
+    }))
+    .unwrap();
+    config.outputs = Some(vec![OutputSegment {
+        target: OutputTarget::Osc { address: osc_addr },
+        offset: 0,
+        length: LEDS,
+        color_order: ColorOrder::Rgb,
+        color: ColorCorrection::default(),
+        fps: None,
+    }]);
+    config
+}
+
+// Datagrams arriving until the socket stays quiet for `quiet`.
+fn count_datagrams(socket: &UdpSocket, quiet: Duration) -> usize {
+    socket.set_read_timeout(Some(quiet)).unwrap();
+    let mut buf = [0u8; 2048];
+    let mut count = 0;
+    while socket.recv(&mut buf).is_ok() {
+        count += 1;
+    }
+    count
+}
+
+#[tokio::test(flavor = "multi_thread", worker_threads = 4)]
+async fn keepalive_frames_follow_virtual_time() {
+    let esp32 = UdpSocket::bind("127.0.0.1:0").unwrap();
+    let config = service_config(esp32.local_addr().unwrap().to_string());
+    let clock = VirtualClock::new(1_000_000);
+    let (shutdown_tx, shutdown_rx) = watch::channel(false);
+    let service = tokio::spawn(rtp_midi_lib::run_service_loop_with_clock(
+        config,
+        shutdown_rx,
+        clock.shared(),
+    ));
+
+    let started = Instant::now();
+    let driver = clock.clone();
+    let frames = tokio::task::spawn_blocking(move || {
+        // Main loop, DDP receiver and LED frame clock.
+        driver.wait_for_sleepers(3);
+        driver.advance(10_000_000);
+        count_datagrams(&esp32, Duration::from_millis(300))
+    })
+    .await
+    .unwrap();
+    let elapsed = started.elapsed();
+
+    // The scene stays black: the first frame, then a keepalive on the first
+    // 60 fps tick a second or more after the previous send (every 61 ticks).
+    assert_eq!(frames, 10);
+    assert!(elapsed < Duration::from_secs(5), "took {elapsed:?}");
+
+    let _ = shutdown_tx.send(true);
+    tokio::time::timeout(Duration::from_secs(5), service)
+        .await
+        .expect("service did not shut down")
+        .unwrap();
+}
@@ -0,0 +1,128 @@
+//! Benchmarky odesílací cesty RTP-MIDI: balení příkazů do paketů s journalem.
+//!
+//! `legacy_per_command` napodobuje původní `send_midi` (jeden paket na příkaz,
+//! klon celé historie do journalu, opětovné parsování kvůli journalu);
+//! `coalesced/N` balí N příkazů do jednoho paketu přes `PacketBuilder`.
+//! Propustnost je v příkazech, takže čas na příkaz je přímo porovnatelný.
+//!
+//! Spuštění: `cargo bench -p network`.
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use network::midi::rtp::clock::MediaClock;
+use network::midi::rtp::message::{MidiMessage, RtpMidiPacket};
+use network::midi::rtp::sender::{PacketBuilder, SendConfig, SendPipeline};
+use rtp_midi_core::journal_engine::TimedMidiCommand;
+use rtp_midi_core::{parse_midi_message, JournalData, JournalEntry};
+use std::collections::VecDeque;
+use std::hint::black_box;
+use std::net::SocketAddr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Duration;
+
+const HISTORY: usize = 64;
+
+fn note(i: usize) -> [u8; 3] {
+    [0x90, 36 + (i % 48) as u8, 100]
+}
+
+fn bench_packing(c: &mut Criterion) {
+    let mut group = c.benchmark_group("send_path");
+
+    group.throughput(Throughput::Elements(1));
+    let mut seq = 0u16;
+    let mut history: VecDeque<JournalEntry> = VecDeque::with_capacity(HISTORY);
+    group.bench_function("legacy_per_command", |b| {
+        b.iter(|| {
+            let command = note(seq as usize).to_vec();
+            let mut packet = RtpMidiPacket::new(1, seq, seq as u32);
+            packet.midi_commands = vec![MidiMessage::new(0, command.clone())];
+            if !history.is_empty() {
+                packet.journal_data = Some(JournalData::Enhanced {
+                    a_bit: false,
+                    ch_bits: 0,
+                    checkpoint_sequence_number: history[0].sequence_nr as u8,
+                    entries: history.iter().cloned().collect(),
+                });
+            }
+            black_box(packet.serialize().unwrap());
+            if history.len() == HISTORY {
+                history.pop_front();
+            }
+            let (cmd, _) = parse_midi_message(&command).unwrap();
+            history.push_back(JournalEntry {
+                sequence_nr: seq,
+                commands: vec![TimedMidiCommand {
+                    delta_time: 0,
+                    command: cmd,
+                }],
+            });
+            seq = seq.wrapping_add(1);
+        })
+    });
+
+    for per_packet in [1usize, 8, 32] {
+        group.throughput(Throughput::Elements(per_packet as u64));
+        let mut builder = PacketBuilder::new(1, 0, MediaClock::anchored_at(0));
+        let mut t = 0u64;
+        group.bench_with_input(
+            BenchmarkId::new("coalesced", per_packet),
+            &per_packet,
+            |b, &per_packet| {
+                b.iter(|| {
+                    for i in 0..per_packet {
+                        t += 100;
+                        black_box(builder.push(t, &note(i)));
+                    }
+                    black_box(builder.finish())
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+/// Celá pipeline přes kanál a vlastnický task (okno 0: balí, co je ve frontě).
+fn bench_pipeline(c: &mut Criterion) {
+    let runtime = tokio::runtime::Builder::new_current_thread()
+        .enable_all()
+        .build()
+        .unwrap();
+    let packets = Arc::new(AtomicUsize::new(0));
+    let pipeline = runtime.block_on(async {
+        let pipeline = SendPipeline::spawn(SendConfig {
+            ssrc: 1,
+            initial_sequence: 0,
+            clock: MediaClock::anchored_at(0),
+            coalesce_window: Duration::ZERO,
+        });
+        let counter = packets.clone();
+        pipeline
+            .set_sink(Arc::new(move |_: SocketAddr, _| {
+                counter.fetch_add(1, Ordering::Relaxed);
+            }))
+            .await;
+        pipeline
+            .set_peer(Some("127.0.0.1:5004".parse().unwrap()))
+            .await;
+        pipeline
+    });
+
+    const BURST: usize = 64;
+    let mut group = c.benchmark_group("send_pipeline");
+    group.throughput(Throughput::Elements(BURST as u64));
+    group.bench_function(BenchmarkId::new("burst", BURST), |b| {
+        b.iter(|| {
+            runtime.block_on(async {
+                for i in 0..BURST {
+                    pipeline.send(i as u64, &note(i)).await.unwrap();
+                }
+                pipeline.flush().await
+            })
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_packing, bench_pipeline);
+criterion_main!(benches);
@@ -0,0 +1,88 @@
+//! Benchmark příjmu RTP-MIDI v `SessionHost` podle počtu peerů.
+//!
+//! Každá iterace pošle `ROUND` paketů na peera (pozvaných předem) a počká,
+//! až je workery zpracují. Propustnost je v paketech, takže při lineárním
+//! škálování zůstává čas na paket stejný od 1 do 128 peerů.
+//!
+//! Spuštění: `cargo bench -p network --bench session_host`.
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use network::midi::rtp::control_message::Invitation;
+use network::midi::rtp::message::{MidiMessage, RtpMidiPacket};
+use network::midi::rtp::session_host::{SessionHost, SessionHostConfig};
+use std::hint::black_box;
+use std::net::SocketAddr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+
+const WORKERS: usize = 4;
+const ROUND: u16 = 16;
+
+fn peer_addr(peer: u32) -> SocketAddr {
+    SocketAddr::from(([127, 0, 0, 1], 6000 + peer as u16))
+}
+
+fn bench_peers(c: &mut Criterion) {
+    let runtime = tokio::runtime::Builder::new_multi_thread()
+        .worker_threads(WORKERS)
+        .enable_all()
+        .build()
+        .unwrap();
+    let mut group = c.benchmark_group("session_host");
+    for peers in [1u32, 8, 32, 64, 128] {
+        let commands = Arc::new(AtomicUsize::new(0));
+        let counter = commands.clone();
+        let host = runtime.block_on(async {
+            let host = SessionHost::start(
+                SessionHostConfig {
+                    name: "bench".into(),
+                    workers: WORKERS,
+                    ..Default::default()
+                },
+                Arc::new(move |midi| {
+                    counter.fetch_add(midi.events.len(), Ordering::Relaxed);
+                }),
+                Arc::new(|_, _| {}),
+            );
+            for peer in 0..peers {
+                let inv = Invitation::new(peer, 1000 + peer, "bench".into());
+                host.dispatch(inv.serialize().to_vec(), peer_addr(peer), 0)
+                    .await;
+            }
+            host
+        });
+        // Sequence numbers are patched in place so no packet is a duplicate.
+        let templates: Vec<Vec<u8>> = (0..peers)
+            .map(|peer| {
+                let mut packet = RtpMidiPacket::new(1000 + peer, 0, 0);
+                packet.midi_commands = vec![MidiMessage::new(0, vec![0x90, 60, 100])];
+                packet.serialize().unwrap().to_vec()
+            })
+            .collect();
+        let mut seq = 0u16;
+
+        group.throughput(Throughput::Elements(peers as u64 * ROUND as u64));
+        group.bench_function(BenchmarkId::new("peers", peers), |b| {
+            b.iter(|| {
+                runtime.block_on(async {
+                    for _ in 0..ROUND {
+                        for (peer, template) in templates.iter().enumerate() {
+                            let mut data = template.clone();
+                            data[2..4].copy_from_slice(&seq.to_be_bytes());
+                            host.dispatch(data, peer_addr(peer as u32), 0).await;
+                        }
+                        seq = seq.wrapping_add(1);
+                    }
+                    // Stats drain every worker queue.
+                    black_box(host.stats().await)
+                })
+            })
+        });
+        runtime.block_on(host.shutdown());
+        assert!(commands.load(Ordering::Relaxed) > 0);
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_peers);
+criterion_main!(benches);
@@ -3,27 +3,40 @@ use std::net::IpAddr;
 use std::thread;
 use log::{info, warn, error};
 use std::collections::HashMap;
-use std::sync::{Arc, Mutex};
+use std::sync::Arc;
+use std::time::Duration;
+
+use crate::discovery_cache::{DiscoveryCache, APPLE_MIDI_SERVICE, OSC_SERVICE};
+
+/// TTL of PTR/SRV records recommended by RFC 6762; the daemon reports
+/// goodbyes and expiries earlier via `ServiceRemoved`.
+const SERVICE_TTL: Duration = Duration::from_secs(4500);
 
 pub struct MdnsDiscovery {
     mdns: ServiceDaemon,
-    discovered_services: Arc<Mutex<HashMap<String, (IpAddr, u16)>>>,
+    cache: Arc<DiscoveryCache>,
 }
 
 impl MdnsDiscovery {
     pub fn new() -> Self {
+        Self::with_cache(Arc::new(DiscoveryCache::new()))
+    }
+
+    /// Creates the daemon feeding an existing (e.g. restored) cache.
+    pub fn with_cache(cache: Arc<DiscoveryCache>) -> Self {
         let mdns = ServiceDaemon::new().expect("Failed to create mDNS daemon");
-        Self { 
-            mdns,
-            discovered_services: Arc::new(Mutex::new(HashMap::new())),
-        }
+        Self { mdns, cache }
+    }
+
+    /// Shared cache of everything this daemon resolved.
+    pub fn cache(&self) -> Arc<DiscoveryCache> {
+        Arc::clone(&self.cache)
     }
 
     /// Advertise the _apple-midi._udp service for DAWs to discover
     pub fn advertise_apple_midi(&self, instance_name: &str, port: u16, ip: IpAddr) {
-        let service_type = "_apple-midi._udp.local.";
         let service_info = ServiceInfo::new(
-            service_type,
+            APPLE_MIDI_SERVICE,
             instance_name,
             ip,
             port,
@@ -34,93 +47,72 @@ impl MdnsDiscovery {
     }
 
     /// Browse for _osc._udp services (e.g., ESP32 visualizers)
-    pub fn browse_osc_services<F>(&self, mut on_found: F)
+    pub fn browse_osc_services<F>(&self, on_found: F)
     where
         F: FnMut(String, IpAddr, u16) + Send + 'static,
     {
-        let receiver = self.mdns.browse("_osc._udp.local.").expect("Failed to browse for OSC services");
-        let discovered_services = Arc::clone(&self.discovered_services);
-        thread::spawn(move || {
-            for event in receiver.listen() {
-                match event {
-                    ServiceEvent::ServiceResolved(info) => {
-                        if let Some(addr) = info.get_addresses().get(0) {
-                            let name = info.get_fullname().to_string();
-                            let port = info.get_port();
-                            info!("mDNS: Found OSC service {} at {}:{}", name, addr, port);
-                            
-                            // Store in discovered services
-                            if let Ok(mut services) = discovered_services.lock() {
-                                services.insert(name.clone(), (*addr, port));
-                            }
-                            
-                            on_found(name, *addr, port);
-                        }
-                    }
-                    ServiceEvent::ServiceRemoved(name, _) => {
-                        info!("mDNS: OSC service removed: {}", name);
-                        if let Ok(mut services) = discovered_services.lock() {
-                            services.remove(&name);
-                        }
-                    }
-                    _ => {}
-                }
-            }
-        });
+        self.browse(OSC_SERVICE, "OSC", on_found);
     }
 
     /// Browse for _apple-midi._udp services (e.g., DAWs)
-    pub fn browse_apple_midi_services<F>(&self, mut on_found: F)
+    pub fn browse_apple_midi_services<F>(&self, on_found: F)
     where
         F: FnMut(String, IpAddr, u16) + Send + 'static,
     {
-        let receiver = self.mdns.browse("_apple-midi._udp.local.").expect("Failed to browse for AppleMIDI services");
-        let discovered_services = Arc::clone(&self.discovered_services);
+        self.browse(APPLE_MIDI_SERVICE, "AppleMIDI", on_found);
+    }
+
+    fn browse<F>(&self, service_type: &'static str, label: &'static str, mut on_found: F)
+    where
+        F: FnMut(String, IpAddr, u16) + Send + 'static,
+    {
+        let receiver = match self.mdns.browse(service_type) {
+            Ok(receiver) => receiver,
+            Err(e) => {
+                error!("mDNS: Failed to browse for {} services: {}", label, e);
+                return;
+            }
+        };
+        let cache = Arc::clone(&self.cache);
         thread::spawn(move || {
             for event in receiver.listen() {
                 match event {
                     ServiceEvent::ServiceResolved(info) => {
-                        if let Some(addr) = info.get_addresses().get(0) {
+                        if let Some(addr) = info.get_addresses().iter().next() {
                             let name = info.get_fullname().to_string();
                             let port = info.get_port();
-                            info!("mDNS: Found AppleMIDI service {} at {}:{}", name, addr, port);
-                            
-                            // Store in discovered services
-                            if let Ok(mut services) = discovered_services.lock() {
-                                services.insert(name.clone(), (*addr, port));
-                            }
-                            
+                            info!("mDNS: Found {} service {} at {}:{}", label, name, addr, port);
+                            cache.upsert(&name, service_type, *addr, port, SERVICE_TTL);
                             on_found(name, *addr, port);
                         }
                     }
-                    ServiceEvent::ServiceRemoved(name, _) => {
-                        info!("mDNS: AppleMIDI service removed: {}", name);
-                        if let Ok(mut services) = discovered_services.lock() {
-                            services.remove(&name);
-                        }
+                    ServiceEvent::ServiceRemoved(_, name) => {
+                        info!("mDNS: {} service removed: {}", label, name);
+                        cache.remove(&name);
                     }
                     _ => {}
                 }
             }
+            warn!("mDNS: {} browse channel closed.", label);
         });
     }
 
     /// Get a discovered service by name
     pub fn get_discovered_service(&self, name: &str) -> Option<(IpAddr, u16)> {
-        if let Ok(services) = self.discovered_services.lock() {
-            services.get(name).copied()
-        } else {
-            None
-        }
+        self.cache
+            .snapshot()
+            .into_iter()
+            .find(|s| s.name == name)
+            .map(|s| (s.addr, s.port))
     }
 
     /// Get all discovered services
     pub fn get_all_discovered_services(&self) -> HashMap<String, (IpAddr, u16)> {
-        if let Ok(services) = self.discovered_services.lock() {
-            services.clone()
-        } else {
-            HashMap::new()
-        }
+        self.cache
+            .snapshot()
+            .into_iter()
+            .map(|s| (s.name, (s.addr, s.port)))
+            .collect()
     }
 }
 
@@ -0,0 +1,498 @@
+// src/discovery_cache.rs
+
+//! Live, TTL-aware cache of discovered network services.
+//!
+//! mDNS browsing (`discovery::MdnsDiscovery`) feeds resolved services into the
+//! cache; consumers (service loop, FFI, UI) read snapshots or subscribe to
+//! change callbacks instead of browsing on their own. The last-known-good set
+//! is persisted as JSON so the hub can reconnect immediately on start, while
+//! browsing refreshes the entries in the background.
+//!
+//! Záznamy obnovené z disku jsou označené jako `stale`, dokud je mDNS znovu
+//! nepotvrdí; nepotvrzené po uplynutí `RESTORED_GRACE` vyprší.
+
+use anyhow::Result;
+use log::{info, warn};
+use rtp_midi_core::clock::monotonic_us;
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+use std::net::IpAddr;
+use std::path::Path;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, SystemTime, UNIX_EPOCH};
+
+/// mDNS service type of ESP32 visualizers.
+pub const OSC_SERVICE: &str = "_osc._udp.local.";
+/// mDNS service type of DAWs and other RTP-MIDI peers.
+pub const APPLE_MIDI_SERVICE: &str = "_apple-midi._udp.local.";
+
+/// How long a restored entry stays usable without live confirmation.
+const RESTORED_GRACE: Duration = Duration::from_secs(600);
+/// Entries older than this are not restored at all.
+const MAX_PERSISTED_AGE: Duration = Duration::from_secs(7 * 24 * 3600);
+
+/// One resolved service instance.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct DiscoveredService {
+    /// Full instance name, e.g. `esp32-led._osc._udp.local.`.
+    pub name: String,
+    pub service_type: String,
+    pub addr: IpAddr,
+    pub port: u16,
+    /// Wall-clock time of the last confirmation, seconds since the UNIX epoch.
+    pub last_seen_unix: u64,
+    /// Restored from disk and not yet confirmed by a live announcement.
+    #[serde(skip)]
+    pub stale: bool,
+}
+
+/// Change notification delivered to subscribers.
+#[derive(Debug, Clone, PartialEq)]
+pub enum DiscoveryChange {
+    Added(DiscoveredService),
+    Updated(DiscoveredService),
+    /// Removed by a goodbye announcement or TTL expiry.
+    Removed(DiscoveredService),
+}
+
+type Listener = Arc<dyn Fn(&DiscoveryChange) + Send + Sync>;
+
+struct CachedEntry {
+    service: DiscoveredService,
+    expires_at_us: u64,
+}
+
+#[derive(Default)]
+struct CacheInner {
+    entries: HashMap<String, CachedEntry>,
+    listeners: Vec<(u64, Listener)>,
+    next_listener_id: u64,
+    // Bumped by every change of the entries; tells maintenance when to save.
+    generation: u64,
+}
+
+/// Thread-safe discovery cache, usually shared as `Arc<DiscoveryCache>`.
+#[derive(Default)]
+pub struct DiscoveryCache {
+    inner: Mutex<CacheInner>,
+}
+
+impl DiscoveryCache {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Loads the last-known-good set from `path`; a missing file yields an
+    /// empty cache.
+    pub fn load(path: &Path) -> Result<Self> {
+        let cache = Self::new();
+        if !path.exists() {
+            return Ok(cache);
+        }
+        let services: Vec<DiscoveredService> =
+            serde_json::from_str(&std::fs::read_to_string(path)?)?;
+        let restored = cache.restore_at(services, monotonic_us(), unix_now());
+        info!(
+            "Discovery cache: restored {} services from {}",
+            restored,
+            path.display()
+        );
+        Ok(cache)
+    }
+
+    /// Persists all entries to `path`. Restored entries not confirmed yet
+    /// keep their original `last_seen_unix`, so they age out on disk too.
+    pub fn save(&self, path: &Path) -> Result<()> {
+        let services = self.snapshot();
+        let tmp = path.with_extension("tmp");
+        std::fs::write(&tmp, serde_json::to_vec_pretty(&services)?)?;
+        std::fs::rename(&tmp, path)?;
+        Ok(())
+    }
+
+    /// Inserts or refreshes a service announced with the given TTL.
+    pub fn upsert(&self, name: &str, service_type: &str, addr: IpAddr, port: u16, ttl: Duration) {
+        self.upsert_at(name, service_type, addr, port, ttl, monotonic_us());
+    }
+
+    /// Removes a service (mDNS goodbye).
+    pub fn remove(&self, name: &str) {
+        let change = {
+            let mut inner = self.inner.lock().unwrap();
+            let removed = inner.entries.remove(name);
+            inner.generation += removed.is_some() as u64;
+            removed.map(|e| DiscoveryChange::Removed(e.service))
+        };
+        if let Some(change) = change {
+            self.notify(&[change]);
+        }
+    }
+
+    /// Drops entries whose TTL elapsed; returns how many were removed.
+    pub fn expire(&self) -> usize {
+        self.expire_at(monotonic_us())
+    }
+
+    /// All current entries, sorted by name.
+    pub fn snapshot(&self) -> Vec<DiscoveredService> {
+        let inner = self.inner.lock().unwrap();
+        let mut services: Vec<_> = inner.entries.values().map(|e| e.service.clone()).collect();
+        services.sort_by(|a, b| a.name.cmp(&b.name));
+        services
+    }
+
+    /// Best instance of a service type: live entries first, then the most
+    /// recently seen.
+    pub fn best(&self, service_type: &str) -> Option<DiscoveredService> {
+        let inner = self.inner.lock().unwrap();
+        inner
+            .entries
+            .values()
+            .map(|e| &e.service)
+            .filter(|s| s.service_type == service_type)
+            .max_by_key(|s| (!s.stale, s.last_seen_unix))
+            .cloned()
+    }
+
+    fn generation(&self) -> u64 {
+        self.inner.lock().unwrap().generation
+    }
+
+    /// Registers a change callback; returns an id for `unsubscribe`.
+    ///
+    /// Callbacks run on the thread that modified the cache, outside its lock.
+    pub fn subscribe<F>(&self, listener: F) -> u64
+    where
+        F: Fn(&DiscoveryChange) + Send + Sync + 'static,
+    {
+        let mut inner = self.inner.lock().unwrap();
+        let id = inner.next_listener_id;
+        inner.next_listener_id += 1;
+        inner.listeners.push((id, Arc::new(listener)));
+        id
+    }
+
+    pub fn unsubscribe(&self, id: u64) {
+        self.inner
+            .lock()
+            .unwrap()
+            .listeners
+            .retain(|(listener_id, _)| *listener_id != id);
+    }
+
+    fn upsert_at(
+        &self,
+        name: &str,
+        service_type: &str,
+        addr: IpAddr,
+        port: u16,
+        ttl: Duration,
+        now_us: u64,
+    ) {
+        let service = DiscoveredService {
+            name: name.to_string(),
+            service_type: service_type.to_string(),
+            addr,
+            port,
+            last_seen_unix: unix_now(),
+            stale: false,
+        };
+        let expires_at_us = now_us + ttl.as_micros() as u64;
+        let change = {
+            let mut inner = self.inner.lock().unwrap();
+            let change = match inner.entries.get_mut(name) {
+                Some(entry) => {
+                    let changed = entry.service.addr != addr
+                        || entry.service.port != port
+                        || entry.service.stale;
+                    entry.service = service.clone();
+                    entry.expires_at_us = expires_at_us;
+                    changed.then_some(DiscoveryChange::Updated(service))
+                }
+                None => {
+                    inner.entries.insert(
+                        name.to_string(),
+                        CachedEntry {
+                            service: service.clone(),
+                            expires_at_us,
+                        },
+                    );
+                    Some(DiscoveryChange::Added(service))
+                }
+            };
+            inner.generation += change.is_some() as u64;
+            change
+        };
+        // A plain TTL refresh is not a change worth notifying.
+        if let Some(change) = change {
+            self.notify(&[change]);
+        }
+    }
+
+    fn expire_at(&self, now_us: u64) -> usize {
+        let removed: Vec<DiscoveryChange> = {
+            let mut inner = self.inner.lock().unwrap();
+            let expired: Vec<String> = inner
+                .entries
+                .iter()
+                .filter(|(_, e)| e.expires_at_us <= now_us)
+                .map(|(name, _)| name.clone())
+                .collect();
+            inner.generation += expired.len() as u64;
+            expired
+                .iter()
+                .filter_map(|name| inner.entries.remove(name))
+                .map(|e| DiscoveryChange::Removed(e.service))
+                .collect()
+        };
+        self.notify(&removed);
+        removed.len()
+    }
+
+    fn restore_at(&self, services: Vec<DiscoveredService>, now_us: u64, now_unix: u64) -> usize {
+        let mut inner = self.inner.lock().unwrap();
+        let mut restored = 0;
+        for mut service in services {
+            if now_unix.saturating_sub(service.last_seen_unix) > MAX_PERSISTED_AGE.as_secs() {
+                continue;
+            }
+            service.stale = true;
+            inner.entries.insert(
+                service.name.clone(),
+                CachedEntry {
+                    service,
+                    expires_at_us: now_us + RESTORED_GRACE.as_micros() as u64,
+                },
+            );
+            restored += 1;
+        }
+        restored
+    }
+
+    fn notify(&self, changes: &[DiscoveryChange]) {
+        if changes.is_empty() {
+            return;
+        }
+        let listeners: Vec<Listener> = self
+            .inner
+            .lock()
+            .unwrap()
+            .listeners
+            .iter()
+            .map(|(_, l)| l.clone())
+            .collect();
+        for change in changes {
+            for listener in &listeners {
+                listener(change);
+            }
+        }
+    }
+}
+
+/// Every `interval` expires entries and persists the cache if it changed
+/// since it was loaded or last saved, until `shutdown` turns true.
+pub async fn run_maintenance(
+    cache: Arc<DiscoveryCache>,
+    persist_path: Option<std::path::PathBuf>,
+    interval: Duration,
+    mut shutdown: tokio::sync::watch::Receiver<bool>,
+) {
+    // The first tick comes after one interval, not right away: the file
+    // was just restored and nothing changed yet.
+    let mut ticker = tokio::time::interval_at(tokio::time::Instant::now() + interval, interval);
+    let mut saved = cache.generation();
+    loop {
+        tokio::select! {
+            _ = ticker.tick() => {}
+            _ = shutdown.changed() => {
+                if *shutdown.borrow() {
+                    break;
+                }
+            }
+        }
+        cache.expire();
+        let generation = cache.generation();
+        if generation == saved {
+            continue;
+        }
+        if let Some(path) = &persist_path {
+            match cache.save(path) {
+                Ok(()) => saved = generation,
+                Err(e) => warn!(
+                    "Discovery cache: failed to persist to {}: {}",
+                    path.display(),
+                    e
+                ),
+            }
+        }
+    }
+}
+
+fn unix_now() -> u64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map(|d| d.as_secs())
+        .unwrap_or(0)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::net::Ipv4Addr;
+
+    fn ip(last: u8) -> IpAddr {
+        IpAddr::V4(Ipv4Addr::new(10, 0, 0, last))
+    }
+
+    #[test]
+    fn ttl_expiry_and_change_callbacks() {
+        let cache = DiscoveryCache::new();
+        let changes = Arc::new(Mutex::new(Vec::new()));
+        let sink = changes.clone();
+        cache.subscribe(move |c| sink.lock().unwrap().push(c.clone()));
+
+        cache.upsert_at("a", OSC_SERVICE, ip(1), 8000, Duration::from_secs(2), 0);
+        // TTL refresh without changes is silent; a new address is an update.
+        cache.upsert_at(
+            "a",
+            OSC_SERVICE,
+            ip(1),
+            8000,
+            Duration::from_secs(2),
+            1_000_000,
+        );
+        cache.upsert_at(
+            "a",
+            OSC_SERVICE,
+            ip(2),
+            8000,
+            Duration::from_secs(2),
+            1_500_000,
+        );
+        assert_eq!(cache.expire_at(3_000_000), 0);
+        assert_eq!(cache.expire_at(3_500_000), 1);
+
+        let changes = changes.lock().unwrap();
+        assert_eq!(changes.len(), 3);
+        assert!(matches!(changes[0], DiscoveryChange::Added(_)));
+        assert!(matches!(&changes[1], DiscoveryChange::Updated(s) if s.addr == ip(2)));
+        assert!(matches!(changes[2], DiscoveryChange::Removed(_)));
+        assert!(cache.snapshot().is_empty());
+    }
+
+    fn temp_path(name: &str) -> std::path::PathBuf {
+        std::env::temp_dir().join(format!("{}_{}.json", name, std::process::id()))
+    }
+
+    #[test]
+    fn restored_entries_connect_before_live_discovery() {
+        use std::net::UdpSocket;
+        let path = temp_path("discovery_cache");
+        // The ESP32 stand-in listens on loopback.
+        let esp32 = UdpSocket::bind("127.0.0.1:0").unwrap();
+        esp32
+            .set_read_timeout(Some(Duration::from_secs(1)))
+            .unwrap();
+        let esp32_addr = esp32.local_addr().unwrap();
+        let first = DiscoveryCache::new();
+        first.upsert(
+            "esp32._osc._udp.local.",
+            OSC_SERVICE,
+            esp32_addr.ip(),
+            esp32_addr.port(),
+            Duration::from_secs(120),
+        );
+        first.save(&path).unwrap();
+
+        // Simulated restart: restore, pick the target and send it the first
+        // datagram before any mDNS response.
+        let started = std::time::Instant::now();
+        let second = DiscoveryCache::load(&path).unwrap();
+        let target = second.best(OSC_SERVICE).unwrap();
+        let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        socket.connect((target.addr, target.port)).unwrap();
+        socket.send(b"/leds").unwrap();
+        let mut buf = [0u8; 16];
+        let len = esp32.recv(&mut buf).unwrap();
+        let time_to_connected = started.elapsed();
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(&buf[..len], b"/leds");
+        assert!(target.stale);
+        assert!(
+            time_to_connected < Duration::from_millis(100),
+            "{time_to_connected:?}"
+        );
+
+        // Live confirmation from the mDNS stand-in clears the stale flag and
+        // takes precedence over other restored entries.
+        second.upsert(
+            "esp32._osc._udp.local.",
+            OSC_SERVICE,
+            esp32_addr.ip(),
+            esp32_addr.port(),
+            Duration::from_secs(120),
+        );
+        assert!(!second.best(OSC_SERVICE).unwrap().stale);
+        assert!(second.best(APPLE_MIDI_SERVICE).is_none());
+    }
+
+    #[tokio::test]
+    async fn maintenance_keeps_restored_entries_and_saves_changes() {
+        let path = temp_path("discovery_maintenance");
+        let first = DiscoveryCache::new();
+        first.upsert(
+            "daw",
+            APPLE_MIDI_SERVICE,
+            ip(5),
+            5004,
+            Duration::from_secs(120),
+        );
+        first.save(&path).unwrap();
+        let persisted = || -> Vec<(String, bool)> {
+            let saved: Vec<DiscoveredService> =
+                serde_json::from_str(&std::fs::read_to_string(&path).unwrap()).unwrap();
+            saved.into_iter().map(|s| (s.name, s.stale)).collect()
+        };
+
+        let cache = Arc::new(DiscoveryCache::load(&path).unwrap());
+        let (shutdown_tx, shutdown_rx) = tokio::sync::watch::channel(false);
+        let task = tokio::spawn(run_maintenance(
+            cache.clone(),
+            Some(path.clone()),
+            Duration::from_millis(20),
+            shutdown_rx,
+        ));
+        // Unconfirmed ticks leave the restored file alone.
+        tokio::time::sleep(Duration::from_millis(70)).await;
+        assert_eq!(persisted(), [("daw".to_string(), false)]);
+
+        // A new service is saved next to the still unconfirmed one.
+        cache.upsert("esp32", OSC_SERVICE, ip(7), 8000, Duration::from_secs(120));
+        tokio::time::sleep(Duration::from_millis(70)).await;
+        shutdown_tx.send(true).unwrap();
+        task.await.unwrap();
+        let saved = persisted();
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(
+            saved,
+            [("daw".to_string(), false), ("esp32".to_string(), false)]
+        );
+    }
+
+    #[test]
+    fn outdated_persisted_entries_are_skipped() {
+        let cache = DiscoveryCache::new();
+        let old = DiscoveredService {
+            name: "old".into(),
+            service_type: APPLE_MIDI_SERVICE.into(),
+            addr: ip(3),
+            port: 5004,
+            last_seen_unix: 0,
+            stale: false,
+        };
+        assert_eq!(
+            cache.restore_at(vec![old], 0, MAX_PERSISTED_AGE.as_secs() + 1),
+            0
+        );
+    }
+}
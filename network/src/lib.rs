@@ -13,5 +13,6 @@ mod tests {
     }
 }
 
+pub mod discovery_cache;
 pub mod midi;
 pub mod network_interface;
@@ -0,0 +1,317 @@
+// src/midi/rtp/clock.rs
+
+//! Per-peer clock model for RTP-MIDI playout.
+//!
+//! Maps a peer's RTP timestamps onto the local monotonic clock
+//! (`rtp_midi_core::clock`). Two sources feed the model:
+//!
+//! * AppleMIDI CK exchanges, which give the round-trip time and the offset
+//!   between the peer's CK clock and ours;
+//! * RTP packet arrivals, which give `arrival - rtp_time` transit samples.
+//!
+//! The minimum transit over a sliding window is the sample least affected by
+//! network jitter; it equals clock offset plus one-way delay. Subtracting half
+//! the CK round trip leaves the pure clock offset, so every command can be
+//! stamped with the local time at which the peer actually generated it.
+//!
+//! Our own side is described by `MediaClock`: one monotonic time base per
+//! session that both outgoing RTP timestamps and CK timestamps derive from,
+//! as AppleMIDI peers expect.
+
+use rtp_midi_core::clock::{monotonic_us, Clock};
+
+/// AppleMIDI CK timestamps are expressed in 100 µs units.
+pub const CK_TICKS_PER_SEC: u64 = 10_000;
+
+/// RTP timestamp rate of RTP-MIDI streams.
+pub const MIDI_CLOCK_HZ: u64 = 31_250;
+
+/// Number of transit samples kept for the minimum filter.
+const TRANSIT_WINDOW: usize = 64;
+
+/// Monotonic media clock of one session, anchored at session start.
+///
+/// RTP timestamps (`MIDI_CLOCK_HZ`) and CK timestamps (100 µs) both count
+/// from the same anchor, so a peer that measured our CK offset can map our
+/// RTP timestamps onto its own clock. Times passed in are on the process
+/// monotonic clock (`rtp_midi_core::clock`).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MediaClock {
+    anchor_us: u64,
+}
+
+impl MediaClock {
+    /// Starts a clock anchored at the current monotonic time.
+    pub fn start() -> Self {
+        Self::anchored_at(monotonic_us())
+    }
+
+    /// Starts a clock anchored at the current time of `clock`.
+    pub fn start_on(clock: &dyn Clock) -> Self {
+        Self::anchored_at(clock.now_us())
+    }
+
+    /// Clock anchored at a given monotonic time (µs).
+    pub fn anchored_at(anchor_us: u64) -> Self {
+        Self { anchor_us }
+    }
+
+    pub fn anchor_us(&self) -> u64 {
+        self.anchor_us
+    }
+
+    /// Media time (µs since the anchor) of a monotonic instant; instants
+    /// before the anchor map to zero.
+    pub fn media_us(&self, monotonic_us: u64) -> u64 {
+        monotonic_us.saturating_sub(self.anchor_us)
+    }
+
+    /// RTP timestamp of a monotonic instant (wraps at 32 bits).
+    pub fn rtp_timestamp(&self, monotonic_us: u64) -> u32 {
+        (self.media_us(monotonic_us) * MIDI_CLOCK_HZ / 1_000_000) as u32
+    }
+
+    /// CK timestamp of a monotonic instant.
+    pub fn ck_timestamp(&self, monotonic_us: u64) -> u64 {
+        self.media_us(monotonic_us) / (1_000_000 / CK_TICKS_PER_SEC)
+    }
+
+    /// CK timestamp of the current time, for outgoing CK messages.
+    pub fn now_ck(&self) -> u64 {
+        self.ck_timestamp(monotonic_us())
+    }
+}
+
+/// Result of one completed CK exchange.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct ClockSyncSample {
+    /// Peer CK clock minus local CK clock, in microseconds.
+    pub offset_us: i64,
+    /// Round-trip time of the exchange, in microseconds.
+    pub rtt_us: u64,
+}
+
+impl ClockSyncSample {
+    /// Builds a sample from a complete CK0/CK1/CK2 exchange.
+    ///
+    /// `t1` and `t3` are stamped by the initiator, `t2` by the responder.
+    /// `local_is_initiator` tells which side of the exchange we were on.
+    pub fn from_exchange(timestamps: [u64; 3], local_is_initiator: bool) -> Option<Self> {
+        let [t1, t2, t3] = timestamps;
+        if t3 < t1 {
+            return None;
+        }
+        let tick_us = (1_000_000 / CK_TICKS_PER_SEC) as i64;
+        // Offset of the responder clock against the initiator clock.
+        let responder_minus_initiator = t2 as i64 - ((t1 + t3) / 2) as i64;
+        let offset_ticks = if local_is_initiator {
+            responder_minus_initiator
+        } else {
+            -responder_minus_initiator
+        };
+        Some(Self {
+            offset_us: offset_ticks * tick_us,
+            rtt_us: (t3 - t1) * tick_us as u64,
+        })
+    }
+}
+
+/// Clock model of a single remote peer.
+#[derive(Debug, Clone)]
+pub struct PeerClock {
+    rtp_clock_hz: f64,
+    sync: Option<ClockSyncSample>,
+    // Extended (unwrapped) RTP timestamp of the last packet.
+    last_rtp_ext: Option<u64>,
+    transit: [i64; TRANSIT_WINDOW],
+    transit_len: usize,
+    transit_pos: usize,
+    // Minimum of `transit`, recomputed when the window moves.
+    min_transit_us: Option<i64>,
+    last_transit_us: Option<i64>,
+    // RFC 3550 interarrival jitter estimate, in microseconds.
+    jitter_us: f64,
+}
+
+impl PeerClock {
+    /// Creates a model for a peer whose RTP timestamps run at `rtp_clock_hz`.
+    pub fn new(rtp_clock_hz: f64) -> Self {
+        Self {
+            rtp_clock_hz,
+            sync: None,
+            last_rtp_ext: None,
+            transit: [0; TRANSIT_WINDOW],
+            transit_len: 0,
+            transit_pos: 0,
+            min_transit_us: None,
+            last_transit_us: None,
+            jitter_us: 0.0,
+        }
+    }
+
+    /// Records the result of a CK exchange.
+    pub fn observe_sync(&mut self, sample: ClockSyncSample) {
+        self.sync = Some(sample);
+    }
+
+    /// Last clock-sync result, if any exchange completed.
+    pub fn sync(&self) -> Option<ClockSyncSample> {
+        self.sync
+    }
+
+    /// Interarrival jitter (RFC 3550) in microseconds.
+    pub fn jitter_us(&self) -> u64 {
+        self.jitter_us as u64
+    }
+
+    /// Feeds the arrival of an RTP packet and returns its local event time.
+    pub fn observe_rtp(&mut self, rtp_timestamp: u32, arrival_us: u64) -> u64 {
+        let ext = self.extend(rtp_timestamp);
+        let transit = arrival_us as i64 - self.ticks_to_us(ext) as i64;
+
+        if let Some(prev) = self.last_transit_us {
+            let d = (transit - prev).abs() as f64;
+            self.jitter_us += (d - self.jitter_us) / 16.0;
+        }
+        self.last_transit_us = Some(transit);
+
+        let evicted = if self.transit_len == TRANSIT_WINDOW {
+            Some(self.transit[self.transit_pos])
+        } else {
+            self.transit_len += 1;
+            None
+        };
+        self.transit[self.transit_pos] = transit;
+        self.transit_pos = (self.transit_pos + 1) % TRANSIT_WINDOW;
+
+        self.min_transit_us = match (self.min_transit_us, evicted) {
+            // The evicted sample was the minimum: rescan the window.
+            (Some(min), Some(old)) if old == min => {
+                self.transit[..self.transit_len].iter().copied().min()
+            }
+            (Some(min), _) => Some(min.min(transit)),
+            (None, _) => Some(transit),
+        };
+
+        self.rtp_to_local_us(rtp_timestamp)
+    }
+
+    /// One-way latency of a packet: its arrival on our media clock minus the
+    /// time the peer stamped it, translated through the CK offset. Valid when
+    /// the peer derives RTP and CK timestamps from one anchor (AppleMIDI
+    /// does); `None` before the first CK exchange.
+    pub fn one_way_latency_us(&self, rtp_timestamp: u32, arrival_media_us: u64) -> Option<i64> {
+        let sync = self.sync?;
+        let peer_us = self.ticks_to_us(self.extend_readonly(rtp_timestamp)) as i64;
+        Some(arrival_media_us as i64 - (peer_us - sync.offset_us))
+    }
+
+    /// Maps an RTP timestamp (packet timestamp plus accumulated delta times)
+    /// to the local monotonic time at which the peer generated it.
+    pub fn rtp_to_local_us(&self, rtp_timestamp: u32) -> u64 {
+        let ext = self.extend_readonly(rtp_timestamp);
+        let base = self.min_transit_us.unwrap_or(0);
+        // Minimum transit = clock offset + one-way delay; remove the delay.
+        let one_way = self.sync.map_or(0, |s| (s.rtt_us / 2) as i64);
+        let local = self.ticks_to_us(ext) as i64 + base - one_way;
+        local.max(0) as u64
+    }
+
+    fn ticks_to_us(&self, ticks: u64) -> u64 {
+        (ticks as f64 * 1_000_000.0 / self.rtp_clock_hz) as u64
+    }
+
+    fn extend(&mut self, ts: u32) -> u64 {
+        let ext = self.extend_readonly(ts);
+        if self.last_rtp_ext.is_none_or(|last| ext > last) {
+            self.last_rtp_ext = Some(ext);
+        }
+        ext
+    }
+
+    // Unwraps a 32-bit RTP timestamp against the last seen one without
+    // updating state (late packets map slightly into the past).
+    fn extend_readonly(&self, ts: u32) -> u64 {
+        match self.last_rtp_ext {
+            None => ts as u64,
+            Some(last) => {
+                let diff = ts.wrapping_sub(last as u32) as i32 as i64;
+                (last as i64 + diff).max(0) as u64
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn ck_exchange_offset_and_rtt() {
+        // Initiator clock at 1000, responder 500 ticks ahead, 20 ticks RTT.
+        let sample = ClockSyncSample::from_exchange([1000, 1510, 1020], true).unwrap();
+        assert_eq!(sample.offset_us, 500 * 100);
+        assert_eq!(sample.rtt_us, 20 * 100);
+
+        let responder = ClockSyncSample::from_exchange([1000, 1510, 1020], false).unwrap();
+        assert_eq!(responder.offset_us, -500 * 100);
+    }
+
+    #[test]
+    fn jittered_arrivals_map_to_min_transit() {
+        let mut clock = PeerClock::new(10_000.0);
+        // Peer sends every 10 ms (100 ticks); network adds 2..6 ms.
+        let delays = [4_000u64, 2_000, 6_000, 3_000, 5_000];
+        for (i, d) in delays.iter().enumerate() {
+            let ts = 100 * i as u32;
+            clock.observe_rtp(ts, 1_000_000 + 10_000 * i as u64 + d);
+        }
+        // Event times follow the sender cadence, not the arrival jitter.
+        assert_eq!(clock.rtp_to_local_us(0), 1_002_000);
+        assert_eq!(clock.rtp_to_local_us(300), 1_032_000);
+        assert!(clock.jitter_us() > 0);
+    }
+
+    #[test]
+    fn ck_rtt_removes_one_way_delay() {
+        let mut clock = PeerClock::new(10_000.0);
+        clock.observe_sync(ClockSyncSample {
+            offset_us: 0,
+            rtt_us: 4_000,
+        });
+        clock.observe_rtp(0, 1_002_000);
+        assert_eq!(clock.rtp_to_local_us(0), 1_000_000);
+    }
+
+    #[test]
+    fn media_clock_shares_anchor_between_rtp_and_ck() {
+        let clock = MediaClock::anchored_at(5_000_000);
+        assert_eq!(clock.rtp_timestamp(5_000_000), 0);
+        assert_eq!(clock.rtp_timestamp(6_000_000), MIDI_CLOCK_HZ as u32);
+        assert_eq!(clock.ck_timestamp(6_000_000), CK_TICKS_PER_SEC);
+        assert_eq!(clock.rtp_timestamp(4_000_000), 0);
+    }
+
+    #[test]
+    fn one_way_latency_from_ck_offset() {
+        // Peer media clock runs 2 s ahead of ours; packet stamped at peer
+        // time 3 s arrives at our time 1.003 s.
+        let mut clock = PeerClock::new(MIDI_CLOCK_HZ as f64);
+        assert_eq!(clock.one_way_latency_us(0, 0), None);
+        clock.observe_sync(ClockSyncSample {
+            offset_us: 2_000_000,
+            rtt_us: 6_000,
+        });
+        let ts = 3 * MIDI_CLOCK_HZ as u32;
+        clock.observe_rtp(ts, 1_003_000);
+        assert_eq!(clock.one_way_latency_us(ts, 1_003_000), Some(3_000));
+    }
+
+    #[test]
+    fn rtp_timestamp_wraparound() {
+        let mut clock = PeerClock::new(10_000.0);
+        clock.observe_rtp(u32::MAX - 99, 1_000_000);
+        let t = clock.observe_rtp(0, 1_010_000);
+        assert_eq!(t, 1_010_000);
+    }
+}
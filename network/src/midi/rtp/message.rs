@@ -2,10 +2,20 @@
 
 use anyhow::{anyhow, Result};
 use bytes::{Buf, BufMut, Bytes, BytesMut};
-use rtp_midi_core::midi_command_length;
-use rtp_midi_core::ParsedPacket;
+use rtp_midi_core::{parse_command_section, MidiBatch, ParsedPacket};
 use serde::{Deserialize, Serialize};
 
+/// Payload flags: journal present, all delta times zero, SysEx start.
+pub const FLAG_JOURNAL: u8 = 0b1000_0000;
+pub const FLAG_ZERO_DELTA: u8 = 0b0100_0000;
+pub const FLAG_SYSEX_START: u8 = 0b0010_0000;
+/// Long header: the length field continues in the next byte (12 bits).
+pub const FLAG_LONG_HEADER: u8 = 0b0001_0000;
+/// Largest command section a short header can describe.
+pub const SHORT_SECTION_MAX: usize = 0x0F;
+/// Largest command section a long header can describe.
+pub const LONG_SECTION_MAX: usize = 0x0FFF;
+
 /// Represents a single MIDI message with its delta-time.
 #[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub struct MidiMessage {
@@ -64,26 +74,60 @@ impl RtpMidiPacket {
     /// Parses the RTP-MIDI specific payload from a ParsedPacket.
     pub fn parse_midi_payload(parsed_rtp: &ParsedPacket) -> Result<Self> {
         let mut reader = Bytes::copy_from_slice(&parsed_rtp.payload);
-
-        // First byte of payload contains flags
-        let flags = reader.get_u8();
-        let has_journal = (flags & 0b1000_0000) != 0;
-        let delta_time_is_zero = (flags & 0b0100_0000) != 0; // 'Y' flag
-        let is_sysex_start = (flags & 0b0010_0000) != 0; // 'P' flag
-        let command_section_len = flags & 0b0000_1111; // 'L' field
+        let (flags, command_section_len) = read_section_header(&mut reader)?;
 
         let mut midi_commands = Vec::new();
         if command_section_len > 0 {
-            midi_commands =
-                Self::parse_midi_command_section(&mut reader, command_section_len as usize)?;
+            midi_commands = Self::parse_midi_command_section(&mut reader, command_section_len)?;
+        }
+        let journal_data = Self::parse_journal(&mut reader, flags)?;
+        Ok(Self::from_parts(
+            parsed_rtp,
+            flags,
+            midi_commands,
+            journal_data,
+        ))
+    }
+
+    /// Parses the payload like `parse_midi_payload`, but decodes the command
+    /// section in one pass into the columns of `batch` (appending; SysEx into
+    /// `batch.sysex`); the returned packet has no `midi_commands`. Row times
+    /// are RTP ticks after `timestamp`, see `MidiBatch::events`.
+    pub fn parse_midi_payload_batch(
+        parsed_rtp: &ParsedPacket,
+        batch: &mut MidiBatch,
+    ) -> Result<Self> {
+        let mut header = &parsed_rtp.payload[..];
+        let (flags, command_section_len) = read_section_header(&mut header)?;
+        if header.len() < command_section_len {
+            return Err(anyhow!("Incomplete MIDI command section"));
         }
+        let (section, rest) = header.split_at(command_section_len);
+        parse_command_section(section, batch)?;
+
+        let journal_data = Self::parse_journal(&mut Bytes::copy_from_slice(rest), flags)?;
+        Ok(Self::from_parts(
+            parsed_rtp,
+            flags,
+            Vec::new(),
+            journal_data,
+        ))
+    }
 
-        let mut journal_data = None;
-        if has_journal {
-            journal_data = Some(rtp_midi_core::JournalData::parse_enhanced(&mut reader)?);
+    fn parse_journal(reader: &mut Bytes, flags: u8) -> Result<Option<rtp_midi_core::JournalData>> {
+        if flags & FLAG_JOURNAL == 0 {
+            return Ok(None);
         }
+        Ok(Some(rtp_midi_core::JournalData::parse_enhanced(reader)?))
+    }
 
-        Ok(Self {
+    fn from_parts(
+        parsed_rtp: &ParsedPacket,
+        flags: u8,
+        midi_commands: Vec<MidiMessage>,
+        journal_data: Option<rtp_midi_core::JournalData>,
+    ) -> Self {
+        Self {
             version: parsed_rtp.version,
             padding: parsed_rtp.padding,
             extension: parsed_rtp.extension,
@@ -94,9 +138,9 @@ impl RtpMidiPacket {
             ssrc: parsed_rtp.ssrc,
             midi_commands,
             journal_data,
-            delta_time_is_zero,
-            is_sysex_start,
-        })
+            delta_time_is_zero: (flags & FLAG_ZERO_DELTA) != 0, // 'Y' flag
+            is_sysex_start: (flags & FLAG_SYSEX_START) != 0,    // 'P' flag
+        }
     }
 
     /// Serializes the packet into a byte buffer for sending.
@@ -124,15 +168,18 @@ impl RtpMidiPacket {
             midi_payload.put(&msg.command[..]);
         }
         let command_section_len = midi_payload.len();
-        if command_section_len > 15 {
-            return Err(anyhow!("MIDI command section too long (max 15 bytes)"));
+        if command_section_len > LONG_SECTION_MAX {
+            return Err(anyhow!(
+                "MIDI command section too long (max {} bytes)",
+                LONG_SECTION_MAX
+            ));
         }
 
         // --- Journal Payload ---
         let mut journal_payload = BytesMut::new();
         let has_journal_flag = if let Some(journal) = &self.journal_data {
             journal_payload.put_slice(&journal.serialize_enhanced()?);
-            0b1000_0000 // has_journal_flag for the main payload flags
+            FLAG_JOURNAL // has_journal_flag for the main payload flags
         } else {
             0
         };
@@ -140,10 +187,8 @@ impl RtpMidiPacket {
         // --- Final Assembly ---
         let flags = has_journal_flag
             | ((self.delta_time_is_zero as u8) << 6)
-            | ((self.is_sysex_start as u8) << 5)
-            | (command_section_len as u8);
-
-        buf.put_u8(flags);
+            | ((self.is_sysex_start as u8) << 5);
+        put_section_header(&mut buf, flags, command_section_len);
         buf.put(midi_payload);
         buf.put(journal_payload);
 
@@ -156,26 +201,28 @@ impl RtpMidiPacket {
         if reader.remaining() < len {
             return Err(anyhow!("Incomplete MIDI command section"));
         }
-        let mut command_reader = reader.split_to(len);
-        let mut commands = Vec::new();
-
-        while command_reader.has_remaining() {
-            let (delta_time, bytes_read) = parse_variable_length_quantity(command_reader.chunk())?;
-            command_reader.advance(bytes_read);
-
-            let status_byte = *command_reader
-                .chunk()
-                .first()
-                .ok_or_else(|| anyhow!("Missing status byte"))?;
-
-            let cmd_len = midi_command_length(status_byte)?;
-
-            if command_reader.remaining() < cmd_len {
-                return Err(anyhow!("Incomplete MIDI command data"));
-            }
-            let command_data = command_reader.copy_to_bytes(cmd_len);
-            commands.push(MidiMessage::new(delta_time, command_data.to_vec()));
-        }
+        let section = reader.split_to(len);
+        let mut batch = MidiBatch::new();
+        parse_command_section(&section, &mut batch)?;
+
+        // Running status is expanded: every message carries its status byte.
+        let mut previous_ticks = 0;
+        let commands = (0..batch.len())
+            .map(|i| {
+                let delta_time = batch.ticks[i].wrapping_sub(previous_ticks);
+                previous_ticks = batch.ticks[i];
+                let event = batch.event(i, 0);
+                let command = match event.sysex_index() {
+                    Some(index) => batch.sysex.get(index).unwrap_or_default().to_vec(),
+                    None => {
+                        let mut bytes = [0u8; 3];
+                        let len = event.write_midi1(&mut bytes);
+                        bytes[..len].to_vec()
+                    }
+                };
+                MidiMessage::new(delta_time, command)
+            })
+            .collect();
         Ok(commands)
     }
 
@@ -184,28 +231,35 @@ impl RtpMidiPacket {
     }
 }
 
-fn parse_variable_length_quantity(mut data: &[u8]) -> Result<(u32, usize)> {
-    let mut value = 0u32;
-    let mut length = 0;
-    for _ in 0..4 {
-        // VLQ is max 4 bytes
-        if !data.has_remaining() {
-            return Err(anyhow!("Incomplete Variable Length Quantity"));
-        }
-        let byte = data.get_u8();
-        length += 1;
-        value = (value << 7) | (byte & 0x7F) as u32;
-        if (byte & 0x80) == 0 {
-            // Last byte of VLQ
-            return Ok((value, length));
+/// Reads the flags byte and the command section length ('L' field, 12 bits
+/// with the long header).
+fn read_section_header<B: Buf>(reader: &mut B) -> Result<(u8, usize)> {
+    if !reader.has_remaining() {
+        return Err(anyhow!("Empty RTP-MIDI payload"));
+    }
+    let flags = reader.get_u8();
+    let mut len = (flags & 0b0000_1111) as usize;
+    if flags & FLAG_LONG_HEADER != 0 {
+        if !reader.has_remaining() {
+            return Err(anyhow!("Missing long header length byte"));
         }
+        len = (len << 8) | reader.get_u8() as usize;
+    }
+    Ok((flags, len))
+}
+
+/// Writes the flags byte with the section length, switching to the two-byte
+/// long header when the section does not fit into four bits.
+pub fn put_section_header(buf: &mut BytesMut, flags: u8, section_len: usize) {
+    if section_len > SHORT_SECTION_MAX {
+        buf.put_u8(flags | FLAG_LONG_HEADER | ((section_len >> 8) as u8 & 0x0F));
+        buf.put_u8(section_len as u8);
+    } else {
+        buf.put_u8(flags | section_len as u8);
     }
-    Err(anyhow!(
-        "Variable Length Quantity exceeded 4 bytes or malformed"
-    ))
 }
 
-fn encode_variable_length_quantity(value: u32, buf: &mut [u8; 4]) -> Result<usize> {
+pub fn encode_variable_length_quantity(value: u32, buf: &mut [u8; 4]) -> Result<usize> {
     if value == 0 {
         buf[0] = 0;
         return Ok(1);
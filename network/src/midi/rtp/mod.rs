@@ -1,3 +1,7 @@
+pub mod clock;
 pub mod control_message;
 pub mod message;
+pub mod rfc6295;
+pub mod sender;
 pub mod session;
+pub mod session_host;
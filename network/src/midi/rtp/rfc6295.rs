@@ -0,0 +1,229 @@
+//! RTP-MIDI packets in the RFC 6295 payload format, for peers that expect the
+//! standard recovery journal (DAWs, the ESP32 visualizer's AppleMIDI
+//! endpoint) rather than the entry journal of `PacketBuilder`.
+//!
+//! Each packet carries one command in a short-header command section (Z=0,
+//! no delta time) and a recovery journal over the last `JOURNAL_WINDOW`
+//! packets: one channel journal per channel touched, with chapter C (last
+//! value of each controller) and chapter N (a note log for every note left
+//! on, an offbit for every note left off). Other commands are sent but not
+//! journaled.
+
+use bytes::{BufMut, Bytes, BytesMut};
+use std::collections::{BTreeMap, VecDeque};
+
+use super::clock::MediaClock;
+
+/// Packets each journal covers; the checkpoint is the oldest of them.
+pub const JOURNAL_WINDOW: usize = 8;
+
+const PAYLOAD_TYPE: u8 = 97;
+const FLAG_JOURNAL: u8 = 0x40;
+// Journal header: A (channel journals follow), TOTCHAN in the low nibble.
+const JOURNAL_A: u8 = 0x20;
+// Channel journal TOC bits.
+const CHAPTER_C: u8 = 0x40;
+const CHAPTER_N: u8 = 0x08;
+
+/// Journaled state of one channel over the window.
+#[derive(Default)]
+struct ChannelState {
+    // note -> velocity of its last Note On, 0 when last released
+    notes: BTreeMap<u8, u8>,
+    controllers: BTreeMap<u8, u8>,
+}
+
+/// Sender of one RFC 6295 stream.
+pub struct Rfc6295Sender {
+    ssrc: u32,
+    clock: MediaClock,
+    sequence: u16,
+    // Recently sent packets (sequence, command), oldest first.
+    history: VecDeque<(u16, [u8; 3])>,
+}
+
+impl Rfc6295Sender {
+    pub fn new(ssrc: u32, initial_sequence: u16, clock: MediaClock) -> Self {
+        Self {
+            ssrc,
+            clock,
+            sequence: initial_sequence,
+            history: VecDeque::with_capacity(JOURNAL_WINDOW + 1),
+        }
+    }
+
+    /// Sequence number of the next packet.
+    pub fn sequence(&self) -> u16 {
+        self.sequence
+    }
+
+    /// Next packet carrying `command` (a channel or system command of at
+    /// most 15 bytes), stamped with its monotonic time.
+    pub fn packet(&mut self, at_us: u64, command: &[u8]) -> Bytes {
+        debug_assert!(!command.is_empty() && command.len() <= 0x0F);
+        let journal = self.journal();
+        let mut out = BytesMut::with_capacity(13 + command.len() + journal.len());
+        // V=2, dynamic payload type
+        out.put_u8(2 << 6);
+        out.put_u8(PAYLOAD_TYPE);
+        out.put_u16(self.sequence);
+        out.put_u32(self.clock.rtp_timestamp(at_us));
+        out.put_u32(self.ssrc);
+        // Short header, Z=0: the only command has no delta time
+        let journal_flag = if journal.is_empty() { 0 } else { FLAG_JOURNAL };
+        out.put_u8(journal_flag | command.len() as u8);
+        out.put_slice(command);
+        out.put_slice(&journal);
+
+        let mut journaled = [0u8; 3];
+        let len = command.len().min(3);
+        journaled[..len].copy_from_slice(&command[..len]);
+        self.history.push_back((self.sequence, journaled));
+        if self.history.len() > JOURNAL_WINDOW {
+            self.history.pop_front();
+        }
+        self.sequence = self.sequence.wrapping_add(1);
+        out.freeze()
+    }
+
+    // Recovery journal of the packets in `history`; empty before the first.
+    fn journal(&self) -> Vec<u8> {
+        let Some(&(checkpoint, _)) = self.history.front() else {
+            return Vec::new();
+        };
+        let mut channels: BTreeMap<u8, ChannelState> = BTreeMap::new();
+        for &(_, [status, data1, data2]) in &self.history {
+            let channel = status & 0x0F;
+            match status & 0xF0 {
+                0x80 | 0x90 => {
+                    let velocity = if status & 0xF0 == 0x90 { data2 } else { 0 };
+                    channels
+                        .entry(channel)
+                        .or_default()
+                        .notes
+                        .insert(data1, velocity);
+                }
+                0xB0 => {
+                    channels
+                        .entry(channel)
+                        .or_default()
+                        .controllers
+                        .insert(data1, data2);
+                }
+                _ => {}
+            }
+        }
+
+        let [checkpoint_hi, checkpoint_lo] = checkpoint.to_be_bytes();
+        if channels.is_empty() {
+            return vec![0x00, checkpoint_hi, checkpoint_lo];
+        }
+        let mut journal = vec![
+            JOURNAL_A | (channels.len() - 1) as u8,
+            checkpoint_hi,
+            checkpoint_lo,
+        ];
+        for (channel, state) in &channels {
+            let (toc, chapters) = channel_chapters(state);
+            let length = 3 + chapters.len();
+            journal.push(channel << 3 | (length >> 8) as u8 & 0x03);
+            journal.push(length as u8);
+            journal.push(toc);
+            journal.extend_from_slice(&chapters);
+        }
+        journal
+    }
+}
+
+// TOC and chapter bytes (C, then N) of one channel journal.
+fn channel_chapters(state: &ChannelState) -> (u8, Vec<u8>) {
+    let mut toc = 0u8;
+    let mut chapters = Vec::new();
+    if !state.controllers.is_empty() {
+        toc |= CHAPTER_C;
+        chapters.push((state.controllers.len() - 1) as u8);
+        for (&number, &value) in &state.controllers {
+            chapters.extend_from_slice(&[number, value]);
+        }
+    }
+    if !state.notes.is_empty() {
+        toc |= CHAPTER_N;
+        let logs: Vec<(u8, u8)> = state
+            .notes
+            .iter()
+            .filter(|(_, &velocity)| velocity > 0)
+            .map(|(&note, &velocity)| (note, velocity))
+            .collect();
+        let released: Vec<u8> = state
+            .notes
+            .iter()
+            .filter(|(_, &velocity)| velocity == 0)
+            .map(|(&note, _)| note)
+            .collect();
+        // LOW > HIGH: no offbits
+        let (low, high) = match (released.first(), released.last()) {
+            (Some(first), Some(last)) => (first / 8, last / 8),
+            _ => (1, 0),
+        };
+        chapters.push(logs.len() as u8);
+        chapters.push(low << 4 | high);
+        for (note, velocity) in logs {
+            // Y=1: play the recovered NoteOn
+            chapters.extend_from_slice(&[note, 0x80 | velocity]);
+        }
+        if low <= high {
+            let mut offbits = vec![0u8; (high - low + 1) as usize];
+            for note in released {
+                offbits[(note / 8 - low) as usize] |= 0x80 >> (note % 8);
+            }
+            chapters.extend_from_slice(&offbits);
+        }
+    }
+    (toc, chapters)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn first_packet_has_no_journal() {
+        let mut sender = Rfc6295Sender::new(0x1122_3344, 10, MediaClock::anchored_at(0));
+        let packet = sender.packet(0, &[0x90, 60, 100]);
+        assert_eq!(&packet[..2], &[0x80, 0x61]);
+        assert_eq!(&packet[2..4], &10u16.to_be_bytes());
+        assert_eq!(&packet[8..12], &0x1122_3344u32.to_be_bytes());
+        assert_eq!(&packet[12..], &[0x03, 0x90, 60, 100]);
+        assert_eq!(sender.sequence(), 11);
+    }
+
+    #[test]
+    fn journal_has_a_channel_journal_per_channel() {
+        let mut sender = Rfc6295Sender::new(1, 100, MediaClock::anchored_at(0));
+        sender.packet(0, &[0x90, 60, 100]);
+        sender.packet(0, &[0xB3, 7, 90]);
+        sender.packet(0, &[0x80, 60, 0]);
+        let packet = sender.packet(0, &[0x90, 62, 80]);
+        assert_eq!(&packet[12..16], &[0x43, 0x90, 62, 80]);
+        let expected: &[u8] = &[
+            0x21, 0, 100, // A, TOTCHAN 1, checkpoint 100
+            0x00, 6, CHAPTER_N, // channel 1: N only
+            0x00, 0x77, 0x08, // no logs, offbits for octet 7: note 60
+            0x18, 6, CHAPTER_C, // channel 4: C only
+            0x00, 7, 90,
+        ];
+        assert_eq!(&packet[16..], expected);
+    }
+
+    #[test]
+    fn checkpoint_follows_the_window() {
+        let mut sender = Rfc6295Sender::new(1, 0xFFFE, MediaClock::anchored_at(0));
+        for _ in 0..JOURNAL_WINDOW + 2 {
+            sender.packet(0, &[0xF8]);
+        }
+        let packet = sender.packet(0, &[0xF8]);
+        // Only system commands: checkpoint without channel journals
+        let checkpoint = 0xFFFEu16.wrapping_add(2);
+        assert_eq!(&packet[12..], &[0x41, 0xF8, 0x00, 0, checkpoint as u8]);
+    }
+}
@@ -0,0 +1,634 @@
+// src/midi/rtp/sender.rs
+
+//! Coalescing, single-owner RTP-MIDI send pipeline.
+//!
+//! One task owns all send state (sequence number, peer, journal history), so
+//! producers never take a lock: they push commands into a channel. Commands
+//! arriving within the coalescing window (0–2 ms) after the first pending one
+//! are packed into a single packet with delta times; a window of zero still
+//! packs whatever is already queued.
+//!
+//! The journal history keeps each sent command section as ready-made entry
+//! bytes (sequence number followed by the delta-time/command bytes, the same
+//! layout `JournalEntry::serialize` produces), so journaling a packet needs no
+//! re-parsing and later packets only copy those bytes. SysEx is left out of
+//! the entries: RFC 6295 journals it in a chapter of its own, and a dump
+//! would crowd the notes out of the journal's byte budget.
+
+use bytes::{BufMut, Bytes, BytesMut};
+use log::warn;
+use rtp_midi_core::journal_engine::command_length;
+use rtp_midi_core::midi_command_length;
+use std::collections::VecDeque;
+use std::net::SocketAddr;
+use tokio::sync::{mpsc, oneshot};
+use tokio::time::{sleep_until, Duration, Instant};
+
+use super::clock::{MediaClock, MIDI_CLOCK_HZ};
+use super::message::{
+    encode_variable_length_quantity, put_section_header, FLAG_JOURNAL, FLAG_SYSEX_START,
+    FLAG_ZERO_DELTA, LONG_SECTION_MAX,
+};
+use super::session_host::PacketSink;
+
+/// Longest single command (SysEx) that fits a long-header section.
+pub const MAX_COMMAND_BYTES: usize = LONG_SECTION_MAX - 4;
+/// Upper bound of the coalescing window.
+pub const MAX_COALESCE_WINDOW: Duration = Duration::from_millis(2);
+/// Command section size at which a packet is closed early (keeps packets
+/// with journal below a typical MTU).
+pub const MAX_SECTION_BYTES: usize = 512;
+
+// How many sent packets to keep in the journal.
+const HISTORY_SIZE: usize = 64;
+// Journal bytes carried per packet; the oldest entries are dropped beyond it.
+const HISTORY_BYTES: usize = 768;
+const CHANNEL_DEPTH: usize = 1024;
+const RTP_HEADER_LEN: usize = 12;
+const PAYLOAD_TYPE: u8 = 97;
+
+/// Converts a duration in RTP timestamp ticks (e.g. a delta time) to µs.
+pub fn rtp_ticks_to_us(ticks: u32) -> u64 {
+    ticks as u64 * 1_000_000 / MIDI_CLOCK_HZ
+}
+
+/// Configuration of a `SendPipeline`.
+#[derive(Debug, Clone)]
+pub struct SendConfig {
+    pub ssrc: u32,
+    pub initial_sequence: u16,
+    /// Session media clock; packet timestamps are taken from it.
+    pub clock: MediaClock,
+    /// How long the first pending command may wait for others; clamped to
+    /// `MAX_COALESCE_WINDOW`.
+    pub coalesce_window: Duration,
+}
+
+impl Default for SendConfig {
+    fn default() -> Self {
+        Self {
+            ssrc: rand::random(),
+            initial_sequence: rand::random(),
+            clock: MediaClock::start(),
+            coalesce_window: Duration::from_millis(1),
+        }
+    }
+}
+
+/// Builds RTP-MIDI packets from individual commands and keeps the journal.
+///
+/// Synchronous core of the pipeline; usable on its own (and in benchmarks).
+pub struct PacketBuilder {
+    ssrc: u32,
+    clock: MediaClock,
+    sequence: u16,
+    // Command section of the packet being built, prefixed by two bytes
+    // reserved for the sequence number so it can become a journal entry.
+    section: BytesMut,
+    commands: usize,
+    first_ticks: u32,
+    last_ticks: u32,
+    zero_delta: bool,
+    sysex_start: bool,
+    // Any SysEx in the section: its journal entry has to be filtered.
+    has_sysex: bool,
+    history: VecDeque<Bytes>,
+    history_bytes: usize,
+}
+
+impl PacketBuilder {
+    pub fn new(ssrc: u32, initial_sequence: u16, clock: MediaClock) -> Self {
+        let mut section = BytesMut::with_capacity(MAX_SECTION_BYTES + 2);
+        section.put_u16(0);
+        Self {
+            ssrc,
+            clock,
+            sequence: initial_sequence,
+            section,
+            commands: 0,
+            first_ticks: 0,
+            last_ticks: 0,
+            zero_delta: true,
+            sysex_start: false,
+            has_sysex: false,
+            history: VecDeque::with_capacity(HISTORY_SIZE),
+            history_bytes: 0,
+        }
+    }
+
+    /// Sequence number of the next packet.
+    pub fn sequence(&self) -> u16 {
+        self.sequence
+    }
+
+    /// Number of commands waiting in the current packet.
+    pub fn pending(&self) -> usize {
+        self.commands
+    }
+
+    /// Appends a command stamped with its monotonic time. Returns the packet
+    /// closed to make room when the current one is full. The command must
+    /// not exceed `MAX_COMMAND_BYTES`.
+    pub fn push(&mut self, at_us: u64, command: &[u8]) -> Option<Bytes> {
+        let mut closed = None;
+        if self.commands > 0 && self.section.len() - 2 + 4 + command.len() > MAX_SECTION_BYTES {
+            closed = self.finish();
+        }
+        let ticks = self.clock.rtp_timestamp(at_us);
+        let delta = if self.commands == 0 {
+            self.first_ticks = ticks;
+            self.last_ticks = ticks;
+            self.sysex_start = command.first() == Some(&0xF0);
+            0
+        } else {
+            // Commands are sent in queue order; one stamped earlier than its
+            // predecessor is sent without delay.
+            (ticks.wrapping_sub(self.last_ticks) as i32).max(0) as u32
+        };
+        self.last_ticks = self.last_ticks.wrapping_add(delta);
+        self.zero_delta &= delta == 0;
+        self.has_sysex |= command.first() == Some(&0xF0);
+
+        let mut vlq = [0u8; 4];
+        let vlq_len = encode_variable_length_quantity(delta, &mut vlq).unwrap_or(1);
+        self.section.put_slice(&vlq[..vlq_len]);
+        self.section.put_slice(command);
+        self.commands += 1;
+        closed
+    }
+
+    /// Closes the current packet: serializes it with the journal of earlier
+    /// packets and records it in the history. Returns `None` when empty.
+    pub fn finish(&mut self) -> Option<Bytes> {
+        if self.commands == 0 {
+            return None;
+        }
+        let section_len = self.section.len() - 2;
+        let journal_len = if self.history.is_empty() {
+            0
+        } else {
+            4 + self.history_bytes + 2 * self.history.len()
+        };
+        let mut packet = BytesMut::with_capacity(RTP_HEADER_LEN + 2 + section_len + journal_len);
+
+        // --- RTP Header --- (V=2, marker set, dynamic payload type)
+        packet.put_u8(2 << 6);
+        packet.put_u8(0x80 | PAYLOAD_TYPE);
+        packet.put_u16(self.sequence);
+        packet.put_u32(self.first_ticks);
+        packet.put_u32(self.ssrc);
+
+        // --- MIDI Payload ---
+        let mut flags = 0;
+        if !self.history.is_empty() {
+            flags |= FLAG_JOURNAL;
+        }
+        if self.zero_delta {
+            flags |= FLAG_ZERO_DELTA;
+        }
+        if self.sysex_start {
+            flags |= FLAG_SYSEX_START;
+        }
+        put_section_header(&mut packet, flags, section_len);
+        packet.put_slice(&self.section[2..2 + section_len]);
+
+        // --- Journal --- (enhanced, length-prefixed entries)
+        if let Some(checkpoint) = self.history.front() {
+            packet.put_u8(0b1000_0000);
+            packet.put_u8(checkpoint[1]);
+            packet.put_u16(self.history.len() as u16);
+            for entry in &self.history {
+                packet.put_u16(entry.len() as u16);
+                packet.put_slice(entry);
+            }
+        }
+
+        // The section becomes this packet's journal entry as is, unless it
+        // holds SysEx.
+        self.section[..2].copy_from_slice(&self.sequence.to_be_bytes());
+        let entry = if self.has_sysex {
+            let entry = entry_without_sysex(&self.section);
+            self.section.clear();
+            entry
+        } else {
+            std::mem::replace(
+                &mut self.section,
+                BytesMut::with_capacity(MAX_SECTION_BYTES + 2),
+            )
+        };
+        self.record_history(entry.freeze());
+        self.section.put_u16(0);
+
+        self.sequence = self.sequence.wrapping_add(1);
+        self.commands = 0;
+        self.zero_delta = true;
+        self.sysex_start = false;
+        self.has_sysex = false;
+        Some(packet.freeze())
+    }
+
+    fn record_history(&mut self, entry: Bytes) {
+        self.history_bytes += entry.len();
+        self.history.push_back(entry);
+        while self.history.len() > HISTORY_SIZE
+            || (self.history_bytes > HISTORY_BYTES && self.history.len() > 1)
+        {
+            if let Some(old) = self.history.pop_front() {
+                self.history_bytes -= old.len();
+            }
+        }
+    }
+}
+
+// Journal entry of a section (sequence number first) with its SysEx
+// commands left out; their delta times carry over to the next command.
+fn entry_without_sysex(section: &[u8]) -> BytesMut {
+    let mut entry = BytesMut::with_capacity(section.len());
+    entry.put_slice(&section[..2]);
+    let mut rest = &section[2..];
+    let mut carried = 0u32;
+    while let Some(vlq_len) = rest.iter().position(|&b| b & 0x80 == 0).map(|i| i + 1) {
+        let delta = rest[..vlq_len]
+            .iter()
+            .fold(0u32, |value, &b| (value << 7) | (b & 0x7F) as u32);
+        rest = &rest[vlq_len..];
+        let Ok(len) = command_length(rest) else {
+            break;
+        };
+        let (command, tail) = rest.split_at(len.min(rest.len()));
+        rest = tail;
+        if command[0] == 0xF0 {
+            carried = carried.saturating_add(delta);
+            continue;
+        }
+        let mut vlq = [0u8; 4];
+        let vlq_len = encode_variable_length_quantity(carried + delta, &mut vlq).unwrap_or(1);
+        entry.put_slice(&vlq[..vlq_len]);
+        entry.put_slice(command);
+        carried = 0;
+    }
+    entry
+}
+
+/// Counters of a running pipeline.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct SendStats {
+    pub commands: u64,
+    pub packets: u64,
+    pub bytes: u64,
+    /// Packets built while no peer or sink was set.
+    pub dropped: u64,
+}
+
+// A queued command: channel and system messages inline, only SysEx (the one
+// variable-length command) on the heap.
+enum Command {
+    Short([u8; 3], u8),
+    Sysex(Vec<u8>),
+}
+
+impl Command {
+    fn new(bytes: &[u8]) -> Self {
+        match bytes.len() {
+            len @ 1..=3 if bytes[0] != 0xF0 => {
+                let mut short = [0u8; 3];
+                short[..len].copy_from_slice(bytes);
+                Command::Short(short, len as u8)
+            }
+            _ => Command::Sysex(bytes.to_vec()),
+        }
+    }
+
+    fn bytes(&self) -> &[u8] {
+        match self {
+            Command::Short(bytes, len) => &bytes[..*len as usize],
+            Command::Sysex(bytes) => bytes,
+        }
+    }
+}
+
+enum SendMsg {
+    Command { at_us: u64, command: Command },
+    Peer(Option<SocketAddr>),
+    Sink(PacketSink),
+    Window(Duration),
+    Flush(oneshot::Sender<SendStats>),
+}
+
+/// Handle to the send task. Dropping it flushes pending commands and stops
+/// the task.
+pub struct SendPipeline {
+    tx: mpsc::Sender<SendMsg>,
+}
+
+impl SendPipeline {
+    /// Spawns the owning task. Must be called inside a Tokio runtime.
+    pub fn spawn(config: SendConfig) -> Self {
+        let (tx, rx) = mpsc::channel(CHANNEL_DEPTH);
+        let task = SendTask {
+            builder: PacketBuilder::new(config.ssrc, config.initial_sequence, config.clock),
+            window: config.coalesce_window.min(MAX_COALESCE_WINDOW),
+            peer: None,
+            sink: None,
+            stats: SendStats::default(),
+        };
+        tokio::spawn(task.run(rx));
+        Self { tx }
+    }
+
+    /// Queues a raw MIDI command generated at `at_us` (monotonic clock).
+    /// Only SysEx is copied to the heap on the way to the send task.
+    pub async fn send(&self, at_us: u64, command: &[u8]) -> anyhow::Result<()> {
+        self.tx
+            .send(SendMsg::Command {
+                at_us,
+                command: Command::new(command),
+            })
+            .await
+            .map_err(|_| anyhow::anyhow!("RTP-MIDI send pipeline stopped"))
+    }
+
+    /// Queues a command without waiting; fails when the queue is full.
+    pub fn try_send(&self, at_us: u64, command: &[u8]) -> anyhow::Result<()> {
+        self.tx
+            .try_send(SendMsg::Command {
+                at_us,
+                command: Command::new(command),
+            })
+            .map_err(|e| anyhow::anyhow!("RTP-MIDI send queue: {}", e))
+    }
+
+    /// Sets the destination; `None` discards packets until a peer is set.
+    pub async fn set_peer(&self, peer: Option<SocketAddr>) {
+        let _ = self.tx.send(SendMsg::Peer(peer)).await;
+    }
+
+    /// Sets the callback that puts packets on the wire.
+    pub async fn set_sink(&self, sink: PacketSink) {
+        let _ = self.tx.send(SendMsg::Sink(sink)).await;
+    }
+
+    /// Changes the coalescing window (clamped to `MAX_COALESCE_WINDOW`).
+    pub async fn set_coalesce_window(&self, window: Duration) {
+        let _ = self.tx.send(SendMsg::Window(window)).await;
+    }
+
+    /// Sends everything queued so far and returns the counters.
+    pub async fn flush(&self) -> SendStats {
+        let (reply_tx, reply_rx) = oneshot::channel();
+        if self.tx.send(SendMsg::Flush(reply_tx)).await.is_err() {
+            return SendStats::default();
+        }
+        reply_rx.await.unwrap_or_default()
+    }
+}
+
+struct SendTask {
+    builder: PacketBuilder,
+    window: Duration,
+    peer: Option<SocketAddr>,
+    sink: Option<PacketSink>,
+    stats: SendStats,
+}
+
+impl SendTask {
+    async fn run(mut self, mut rx: mpsc::Receiver<SendMsg>) {
+        let mut deadline = Instant::now();
+        loop {
+            let msg = if self.builder.pending() == 0 {
+                rx.recv().await
+            } else {
+                tokio::select! {
+                    msg = rx.recv() => msg,
+                    _ = sleep_until(deadline) => {
+                        self.flush();
+                        continue;
+                    }
+                }
+            };
+            let Some(msg) = msg else {
+                self.flush();
+                return;
+            };
+            if self.builder.pending() == 0 {
+                deadline = Instant::now() + self.window;
+            }
+            self.handle(msg);
+            // Take everything already queued before waiting on the window.
+            while let Ok(msg) = rx.try_recv() {
+                self.handle(msg);
+            }
+            if self.window.is_zero() || Instant::now() >= deadline {
+                self.flush();
+            }
+        }
+    }
+
+    fn handle(&mut self, msg: SendMsg) {
+        match msg {
+            SendMsg::Command { at_us, command } => {
+                let bytes = command.bytes();
+                if bytes.is_empty() || bytes.len() > MAX_COMMAND_BYTES {
+                    warn!("Dropping MIDI command of {} bytes.", bytes.len());
+                    return;
+                }
+                self.stats.commands += 1;
+                if let Some(packet) = self.builder.push(at_us, bytes) {
+                    self.emit(packet);
+                }
+            }
+            SendMsg::Peer(peer) => self.peer = peer,
+            SendMsg::Sink(sink) => self.sink = Some(sink),
+            SendMsg::Window(window) => self.window = window.min(MAX_COALESCE_WINDOW),
+            SendMsg::Flush(reply) => {
+                self.flush();
+                let _ = reply.send(self.stats);
+            }
+        }
+    }
+
+    fn flush(&mut self) {
+        if let Some(packet) = self.builder.finish() {
+            self.emit(packet);
+        }
+    }
+
+    fn emit(&mut self, packet: Bytes) {
+        match (self.peer, &self.sink) {
+            (Some(peer), Some(sink)) => {
+                self.stats.packets += 1;
+                self.stats.bytes += packet.len() as u64;
+                sink(peer, packet.to_vec());
+            }
+            _ => {
+                self.stats.dropped += 1;
+                if self.stats.dropped == 1 {
+                    warn!("RTP-MIDI packet dropped: no peer or outgoing handler set.");
+                }
+            }
+        }
+    }
+}
+
+/// Checks that `command` is one complete MIDI message (used to validate raw
+/// input without fully parsing it).
+pub fn is_complete_command(command: &[u8]) -> bool {
+    match command.first() {
+        Some(&0xF0) => command.last() == Some(&0xF7),
+        Some(&status) => midi_command_length(status).is_ok_and(|len| len == command.len()),
+        None => false,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::message::RtpMidiPacket;
+    use super::*;
+    use rtp_midi_core::{parse_rtp_packet, JournalData, MidiCommand};
+    use std::sync::{Arc, Mutex};
+
+    fn parse(packet: &[u8]) -> RtpMidiPacket {
+        RtpMidiPacket::parse_midi_payload(&parse_rtp_packet(packet).unwrap()).unwrap()
+    }
+
+    #[test]
+    fn coalesced_commands_carry_delta_times() {
+        let clock = MediaClock::anchored_at(500_000);
+        let mut builder = PacketBuilder::new(0x1234, 10, clock);
+        // 32 µs is one RTP tick at 31.25 kHz.
+        assert!(builder.push(1_000_000, &[0x90, 60, 100]).is_none());
+        assert!(builder.push(1_000_320, &[0x90, 64, 100]).is_none());
+        assert!(builder.push(1_000_320, &[0x80, 60, 0]).is_none());
+        let packet = parse(&builder.finish().unwrap());
+
+        assert_eq!(packet.sequence_number, 10);
+        assert_eq!(packet.timestamp, clock.rtp_timestamp(1_000_000));
+        assert_eq!(packet.timestamp, 15_625);
+        let deltas: Vec<u32> = packet.midi_commands.iter().map(|m| m.delta_time).collect();
+        assert_eq!(deltas, vec![0, 10, 0]);
+        assert_eq!(packet.midi_commands[2].command, vec![0x80, 60, 0]);
+        assert!(packet.journal_data.is_none());
+        assert!(builder.finish().is_none());
+    }
+
+    #[test]
+    fn long_header_and_journal_of_previous_packets() {
+        let mut builder = PacketBuilder::new(1, u16::MAX, MediaClock::anchored_at(0));
+        builder.push(0, &[0xB0, 7, 100]);
+        builder.finish().unwrap();
+        builder.push(0, &[0xC0, 5]);
+        builder.finish().unwrap();
+        // Ten commands need more than the 15 bytes of a short header.
+        for key in 0..10 {
+            builder.push(0, &[0x90, 60 + key, 100]);
+        }
+        let packet = parse(&builder.finish().unwrap());
+
+        assert_eq!(packet.sequence_number, 1);
+        assert_eq!(packet.midi_commands.len(), 10);
+        assert!(packet.delta_time_is_zero);
+        let JournalData::Enhanced { entries, .. } = packet.journal_data.unwrap();
+        let seqs: Vec<u16> = entries.iter().map(|e| e.sequence_nr).collect();
+        assert_eq!(seqs, vec![u16::MAX, 0]);
+        assert_eq!(entries[1].commands.len(), 1);
+    }
+
+    #[test]
+    fn full_section_closes_packet() {
+        let mut builder = PacketBuilder::new(1, 0, MediaClock::anchored_at(0));
+        let mut closed = Vec::new();
+        for i in 0..400u64 {
+            if let Some(packet) = builder.push(i, &[0x90, 60, 100]) {
+                closed.push(packet);
+            }
+        }
+        closed.extend(builder.finish());
+        let commands: usize = closed.iter().map(|p| parse(p).midi_commands.len()).sum();
+        assert_eq!(commands, 400);
+        assert!(closed.len() > 1);
+    }
+
+    #[test]
+    fn sysex_stays_out_of_the_journal() {
+        let mut builder = PacketBuilder::new(1, 0, MediaClock::anchored_at(0));
+        builder.push(0, &[0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7]);
+        builder.finish().unwrap();
+        builder.push(0, &[0x90, 60, 100]);
+        builder.push(100, &[0xF0, 0x43, 0x10, 0xF7]);
+        builder.push(200, &[0x80, 60, 0]);
+        builder.finish().unwrap();
+
+        // Notes after the SysEx still parse, their journal without SysEx.
+        builder.push(300, &[0x90, 64, 100]);
+        let packet = parse(&builder.finish().unwrap());
+        assert_eq!(packet.midi_commands.len(), 1);
+        let JournalData::Enhanced { entries, .. } = packet.journal_data.unwrap();
+        assert_eq!(entries.len(), 2);
+        assert!(entries[0].commands.is_empty());
+        let commands: Vec<_> = entries[1]
+            .commands
+            .iter()
+            .map(|c| (c.delta_time, c.command.clone()))
+            .collect();
+        let ticks = |us: u64| MediaClock::anchored_at(0).rtp_timestamp(us);
+        assert_eq!(
+            commands,
+            vec![
+                (
+                    0,
+                    MidiCommand::NoteOn {
+                        channel: 0,
+                        key: 60,
+                        velocity: 100
+                    }
+                ),
+                (
+                    ticks(200),
+                    MidiCommand::NoteOff {
+                        channel: 0,
+                        key: 60,
+                        velocity: 0
+                    }
+                ),
+            ]
+        );
+    }
+
+    #[test]
+    fn raw_command_validation() {
+        assert!(is_complete_command(&[0x90, 60, 100]));
+        assert!(is_complete_command(&[0xF0, 0x7E, 0xF7]));
+        assert!(!is_complete_command(&[0x90, 60]));
+        assert!(!is_complete_command(&[]));
+    }
+
+    #[tokio::test]
+    async fn pipeline_coalesces_queued_commands() {
+        let sent = Arc::new(Mutex::new(Vec::new()));
+        let pipeline = SendPipeline::spawn(SendConfig {
+            ssrc: 7,
+            initial_sequence: 0,
+            clock: MediaClock::anchored_at(0),
+            coalesce_window: Duration::from_millis(2),
+        });
+        let sink_sent = sent.clone();
+        pipeline
+            .set_sink(Arc::new(move |addr, data| {
+                sink_sent.lock().unwrap().push((addr, data))
+            }))
+            .await;
+        let peer: SocketAddr = "127.0.0.1:5004".parse().unwrap();
+        pipeline.set_peer(Some(peer)).await;
+
+        for key in 0..8 {
+            pipeline.send(1_000, &[0x90, 60 + key, 1]).await.unwrap();
+        }
+        let stats = pipeline.flush().await;
+
+        assert_eq!(stats.commands, 8);
+        assert_eq!(stats.packets, 1);
+        let sent = sent.lock().unwrap();
+        assert_eq!(sent[0].0, peer);
+        assert_eq!(parse(&sent[0].1).midi_commands.len(), 8);
+    }
+}
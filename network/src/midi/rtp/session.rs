@@ -3,31 +3,49 @@
 
 use anyhow::{anyhow, Result};
 use log::{error, info, warn};
+use rtp_midi_core::clock::monotonic_us;
 use rtp_midi_core::event_bus::Event;
-use rtp_midi_core::journal_engine::TimedMidiCommand;
 use rtp_midi_core::{
-    DataStreamNetReceiver, DataStreamNetSender, JournalData, JournalEntry, StreamError,
+    DataStreamNetReceiver, DataStreamNetSender, JournalData, JournalEntry, MidiEvent, StreamError,
+    SysexArena,
 };
-use std::collections::{BTreeSet, VecDeque};
+use std::collections::BTreeSet;
 use std::net::SocketAddr;
 use std::sync::Arc;
 use tokio::sync::broadcast::Sender as BroadcastSender;
 use tokio::sync::Mutex;
 
+use super::clock::{ClockSyncSample, MediaClock, PeerClock, MIDI_CLOCK_HZ};
 use super::control_message::{
     AppleMidiMessage, Invitation, InvitationAccepted, Sync as AppleMidiSync,
 };
 use super::message::{MidiMessage, RtpMidiPacket};
+use super::sender::{is_complete_command, rtp_ticks_to_us, SendConfig, SendPipeline};
 use rtp_midi_core::parse_rtp_packet;
 use std::pin::Pin;
 use tokio::time::{sleep, Duration, Sleep};
 
-// The listener now receives only the MIDI commands, not the whole packet, for cleaner separation.
-type MidiCommandListener = Arc<Mutex<dyn Fn(Vec<MidiMessage>) + Send + Sync>>;
+// The listener receives the MIDI commands of one packet with their local event times.
+type MidiCommandListener = Arc<Mutex<dyn Fn(ReceivedMidi) + Send + Sync>>;
 type OutgoingPacketHandler = Arc<Mutex<dyn Fn(String, u16, Vec<u8>) + Send + Sync>>;
 
-const HISTORY_SIZE: usize = 64; // How many sent packets to keep in the journal buffer
-const MIDI_CLOCK_HZ: f64 = 31250.0; // Standard MIDI clock frequency in Hz
+/// MIDI commands carried by one incoming RTP packet, stamped on the local clock.
+#[derive(Debug, Clone)]
+pub struct ReceivedMidi {
+    pub peer: SocketAddr,
+    pub ssrc: u32,
+    /// Packet arrival on the monotonic clock (µs), kernel-stamped where available.
+    pub arrival_us: u64,
+    /// One-way network latency of the packet (µs), once a CK exchange gave
+    /// the peer's clock offset.
+    pub latency_us: Option<i64>,
+    /// The packet's commands, each stamped (`time_us`) with the local
+    /// monotonic time at which the peer generated it: packet timestamp plus
+    /// accumulated delta times, mapped through the peer clock model.
+    pub events: Vec<MidiEvent>,
+    /// Payloads of SysEx events in `events`.
+    pub sysex: SysexArena,
+}
 
 /// Represents the AppleMIDI session state.
 #[derive(Debug, Clone, PartialEq)]
@@ -49,18 +67,19 @@ pub struct RtpMidiSession {
 
     // --- Session State ---
     ssrc: u32,
-    sequence_number: Arc<Mutex<u16>>,
+    // Time base of our RTP and CK timestamps, anchored at session start.
+    media_clock: MediaClock,
+    // Owns sequence number, send journal and destination of outgoing MIDI.
+    sender: SendPipeline,
 
     // --- Journaling State ---
-    // History of packets we have sent, to be included in the journal of outgoing packets.
-    send_history: Arc<Mutex<VecDeque<JournalEntry>>>,
     // The sequence numbers of packets we have received, to detect gaps.
     receive_history: Arc<Mutex<BTreeSet<u16>>>,
 
     // --- Peer information ---
     peer_addr: Arc<Mutex<Option<SocketAddr>>>,
-    // Timestamp of the last sent packet, for calculating delta-time
-    last_sent_timestamp: Arc<Mutex<u32>>,
+    // Mapping of the peer's RTP/CK clocks onto our monotonic clock.
+    peer_clock: Arc<Mutex<PeerClock>>,
 
     // --- AppleMIDI State ---
     pub session_state: Arc<Mutex<SessionState>>,
@@ -81,17 +100,23 @@ impl RtpMidiSession {
     ) -> Result<Self> {
         // The port parameter is now advisory; actual binding is done by network_interface.
         info!("RTP-MIDI session '{}' created.", name);
+        let ssrc = rand::random();
+        let media_clock = MediaClock::start();
 
         Ok(Self {
             name,
             midi_command_listener: Arc::new(Mutex::new(None)),
             outgoing_packet_handler: Arc::new(Mutex::new(None)),
-            ssrc: rand::random(),
-            sequence_number: Arc::new(Mutex::new(rand::random())),
-            send_history: Arc::new(Mutex::new(VecDeque::with_capacity(HISTORY_SIZE))),
+            ssrc,
+            media_clock,
+            sender: SendPipeline::spawn(SendConfig {
+                ssrc,
+                clock: media_clock,
+                ..SendConfig::default()
+            }),
             receive_history: Arc::new(Mutex::new(BTreeSet::new())),
             peer_addr: Arc::new(Mutex::new(None)),
-            last_sent_timestamp: Arc::new(Mutex::new(0)),
+            peer_clock: Arc::new(Mutex::new(PeerClock::new(MIDI_CLOCK_HZ as f64))),
             session_state: Arc::new(Mutex::new(SessionState::Idle)),
             handshake_timer: Arc::new(Mutex::new(None)),
             sync_timer: Arc::new(Mutex::new(None)),
@@ -103,12 +128,28 @@ impl RtpMidiSession {
     }
 
     /// Handles an incoming raw UDP packet, parses it, and processes MIDI commands or journal data.
+    ///
+    /// AppleMIDI control packets (0xFFFF signature) are routed to `handle_control_message`.
+    /// `received_at_us` is the arrival time on the monotonic clock.
     pub async fn handle_incoming_packet(
         &mut self,
         data: Vec<u8>,
         event_sender: &tokio::sync::broadcast::Sender<Event>,
         peer_addr: SocketAddr,
+        received_at_us: u64,
     ) {
+        if data.starts_with(&[0xFF, 0xFF]) {
+            match AppleMidiMessage::parse(&data) {
+                Ok(msg) => {
+                    if let Err(e) = self.handle_control_message(msg, peer_addr).await {
+                        warn!("Failed to handle AppleMIDI control message: {}", e);
+                    }
+                }
+                Err(e) => error!("Failed to parse AppleMIDI control message: {}", e),
+            }
+            return;
+        }
+
         let parsed_rtp = match parse_rtp_packet(&data) {
             Ok(p) => p,
             Err(e) => {
@@ -199,11 +240,36 @@ impl RtpMidiSession {
                 // Check if we've already processed this packet (from a journal).
                 if !history.contains(&packet.sequence_number) {
                     history.insert(packet.sequence_number);
+                    let mut clock = self.peer_clock.lock().await;
+                    clock.observe_rtp(packet.timestamp, received_at_us);
+                    let latency_us = clock.one_way_latency_us(
+                        packet.timestamp,
+                        self.media_clock.media_us(received_at_us),
+                    );
                     if !packet.midi_commands.is_empty() {
                         if let Some(cb) = &*self.midi_command_listener.lock().await {
+                            // Delta times accumulate from the packet timestamp (RFC 6295).
+                            let mut rtp_time = packet.timestamp;
+                            let mut sysex = SysexArena::new();
+                            let events = packet
+                                .midi_commands
+                                .iter()
+                                .filter_map(|msg| {
+                                    rtp_time = rtp_time.wrapping_add(msg.delta_time);
+                                    let time_us = clock.rtp_to_local_us(rtp_time);
+                                    MidiEvent::decode(&msg.command, time_us, &mut sysex)
+                                        .map(|(event, _)| event)
+                                })
+                                .collect();
                             let cb_clone = cb.clone();
-                            // Pass only the MIDI commands to the listener.
-                            cb_clone.lock().await(packet.midi_commands);
+                            cb_clone.lock().await(ReceivedMidi {
+                                peer: peer_addr,
+                                ssrc: packet.ssrc,
+                                arrival_us: received_at_us,
+                                latency_us,
+                                events,
+                                sysex,
+                            });
                         }
                     }
                 }
@@ -214,6 +280,16 @@ impl RtpMidiSession {
         }
     }
 
+    /// SSRC of our RTP stream, as announced in the invitation.
+    pub fn ssrc(&self) -> u32 {
+        self.ssrc
+    }
+
+    /// Media clock behind our outgoing RTP and CK timestamps.
+    pub fn media_clock(&self) -> MediaClock {
+        self.media_clock
+    }
+
     /// Connects the session to a specific remote peer. All sent packets will go here.
     pub async fn connect(&self, peer_addr_str: &str) -> Result<()> {
         let mut peer_addr_lock = self.peer_addr.lock().await;
@@ -222,6 +298,7 @@ impl RtpMidiSession {
             .next()
             .ok_or_else(|| anyhow!("Could not resolve peer address: {}", peer_addr_str))?;
         *peer_addr_lock = Some(addr);
+        self.sender.set_peer(Some(addr)).await;
         info!("Session '{}' connected to peer {}", self.name, addr);
         Ok(())
     }
@@ -229,7 +306,7 @@ impl RtpMidiSession {
     /// Adds a listener that will be called with MIDI commands from valid, non-duplicate packets.
     pub async fn add_midi_command_handler<F>(&self, callback: F)
     where
-        F: Fn(Vec<MidiMessage>) + Send + Sync + 'static,
+        F: Fn(ReceivedMidi) + Send + Sync + 'static,
     {
         let mut listener_lock = self.midi_command_listener.lock().await;
         *listener_lock = Some(Arc::new(Mutex::new(callback)));
@@ -240,87 +317,38 @@ impl RtpMidiSession {
     where
         F: Fn(String, u16, Vec<u8>) + Send + Sync + 'static,
     {
+        let callback = Arc::new(callback);
+        let midi_callback = callback.clone();
+        self.sender
+            .set_sink(Arc::new(move |peer: SocketAddr, data| {
+                midi_callback(peer.ip().to_string(), peer.port(), data)
+            }))
+            .await;
         let mut handler_lock = self.outgoing_packet_handler.lock().await;
-        *handler_lock = Some(Arc::new(Mutex::new(callback)));
+        *handler_lock = Some(Arc::new(Mutex::new(move |ip, port, data| {
+            callback(ip, port, data)
+        })));
     }
 
-    /// Sends a list of MIDI commands, publishing the raw packet via the outgoing handler.
+    /// Sets how long outgoing MIDI commands wait to be packed with others
+    /// (0–2 ms; larger values are clamped).
+    pub async fn set_coalesce_window(&self, window: Duration) {
+        self.sender.set_coalesce_window(window).await;
+    }
+
+    /// Queues MIDI commands for sending. `delta_time` of each command is in
+    /// RTP ticks relative to the previous one, the first relative to now.
+    /// Commands queued within the coalescing window share one packet.
     pub async fn send_midi(&self, commands: Vec<MidiMessage>) -> Result<()> {
         if *self.session_state.lock().await != SessionState::Established {
             return Err(anyhow!("Cannot send MIDI data: session not established."));
         }
 
-        let peer_guard = self.peer_addr.lock().await;
-        let peer = peer_guard.ok_or_else(|| anyhow!("Cannot send MIDI, no peer connected."))?;
-
-        let mut seq_num_lock = self.sequence_number.lock().await;
-        let mut last_sent_ts_lock = self.last_sent_timestamp.lock().await;
-
-        let current_timestamp =
-            (tokio::time::Instant::now().elapsed().as_secs_f64() * MIDI_CLOCK_HZ) as u32;
-        let delta_time_is_zero = commands.iter().all(|cmd| cmd.delta_time == 0);
-        let is_sysex_start = commands
-            .first()
-            .is_some_and(|cmd| cmd.command.first().is_some_and(|&b| b == 0xF0));
-
-        let mut packet = RtpMidiPacket::new(self.ssrc, *seq_num_lock, current_timestamp);
-        packet.midi_commands = commands.clone();
-        packet.delta_time_is_zero = delta_time_is_zero;
-        packet.is_sysex_start = is_sysex_start;
-
-        // Add journal from our send history (Enhanced Journal).
-        let history_lock = self.send_history.lock().await;
-        if !history_lock.is_empty() {
-            let checkpoint_seq = history_lock.front().map_or(0, |entry| entry.sequence_nr);
-            packet.journal_data = Some(JournalData::Enhanced {
-                a_bit: false,
-                ch_bits: 0,
-                checkpoint_sequence_number: checkpoint_seq as u8,
-                entries: history_lock.iter().cloned().collect(),
-            });
-        }
-        drop(history_lock);
-
-        // Serialize the packet.
-        let buffer = packet.serialize()?;
-
-        // Send the packet via the outgoing handler (event bus).
-        if let Some(handler) = &*self.outgoing_packet_handler.lock().await {
-            handler.lock().await(peer.ip().to_string(), peer.port(), buffer.to_vec());
-        } else {
-            warn!("No outgoing packet handler registered. Packet not sent.");
-        }
-
-        // Update last sent timestamp
-        *last_sent_ts_lock = current_timestamp;
-
-        // Add this packet to our send history for future journals.
-        let mut history_lock = self.send_history.lock().await;
-        if history_lock.len() == HISTORY_SIZE {
-            history_lock.pop_front(); // Keep the history buffer from growing indefinitely.
+        let mut at_us = monotonic_us();
+        for msg in commands {
+            at_us += rtp_ticks_to_us(msg.delta_time);
+            self.sender.send(at_us, &msg.command).await?;
         }
-        history_lock.push_back(JournalEntry {
-            sequence_nr: packet.sequence_number,
-            commands: commands
-                .iter()
-                .filter_map(
-                    |msg| match rtp_midi_core::parse_midi_message(&msg.command) {
-                        Ok((cmd, _)) => Some(TimedMidiCommand {
-                            delta_time: msg.delta_time,
-                            command: cmd,
-                        }),
-                        Err(e) => {
-                            warn!("Failed to parse MidiMessage for journaling: {}", e);
-                            None
-                        }
-                    },
-                )
-                .collect(),
-        });
-
-        // Increment sequence number for the next packet.
-        *seq_num_lock = seq_num_lock.wrapping_add(1);
-
         Ok(())
     }
 
@@ -355,7 +383,10 @@ impl RtpMidiSession {
             return Err(anyhow!("Handshake already in progress or established."));
         }
         *state = SessionState::AwaitingOK;
+        // Release the state lock: the OK and CK handlers need it.
+        drop(state);
         *self.peer_addr.lock().await = Some(peer_addr);
+        self.sender.set_peer(Some(peer_addr)).await;
 
         info!("Initiating handshake with {} at {}", name, peer_addr);
 
@@ -394,6 +425,11 @@ impl RtpMidiSession {
                 if let Some(sender) = &self.event_sender {
                     let _ = sender.send(Event::SessionEstablished { peer: peer_addr });
                 }
+                // The peer accepted: a lost CK0 or CK1 is retried by the
+                // clock sync and does not fail the handshake.
+                if let Err(e) = self.initiate_clock_sync(peer_addr).await {
+                    warn!("{}", e);
+                }
                 break;
             }
             attempts += 1;
@@ -427,6 +463,7 @@ impl RtpMidiSession {
                 if *state == SessionState::Idle {
                     info!("Received invitation from {}. Accepting.", inv.name);
                     *self.peer_addr.lock().await = Some(peer_addr);
+                    self.sender.set_peer(Some(peer_addr)).await;
                     *self.peer_ssrc.lock().await = Some(inv.header.ssrc);
                     // Send OK response
                     let response = AppleMidiMessage::InvitationAccepted(InvitationAccepted::new(
@@ -444,35 +481,34 @@ impl RtpMidiSession {
                 {
                     info!("Invitation accepted by {}. Session established.", ok.name);
                     *self.peer_ssrc.lock().await = Some(ok.header.ssrc);
+                    // The CK exchange follows in initiate_handshake, with its own retries.
                     *state = SessionState::Established;
-                    // Optional: start clock sync
-                    self.initiate_clock_sync(peer_addr).await?;
                 }
             }
             AppleMidiMessage::Sync(sync) => {
-                // This is a simplified clock sync. A full implementation would handle CK0, CK1, CK2.
                 if *state == SessionState::Established || *state == SessionState::ClockSync {
+                    let [t1, t2, _] = sync.timestamps;
                     if sync.count == 0 {
-                        // Peer initiated sync (CK0)
+                        // Peer initiated sync (CK0): add our receive time as t2.
                         info!("Received CK0, responding with CK1.");
                         let response = AppleMidiMessage::Sync(AppleMidiSync::new(
                             self.ssrc,
                             1,
-                            sync.timestamps, // Echo back timestamps
+                            [t1, self.media_clock.now_ck(), 0],
                         ));
                         self.send_control_message(&response).await?;
                     } else if sync.count == 1 {
-                        // We initiated, this is CK1 response
-                        info!("Received CK1, sending CK2 and finalizing sync.");
-                        let response = AppleMidiMessage::Sync(AppleMidiSync::new(
-                            self.ssrc,
-                            2,
-                            sync.timestamps,
-                        ));
+                        // We initiated, this is CK1 response: stamp t3 and close the exchange.
+                        let t3 = self.media_clock.now_ck();
+                        let response =
+                            AppleMidiMessage::Sync(AppleMidiSync::new(self.ssrc, 2, [t1, t2, t3]));
                         self.send_control_message(&response).await?;
-                        *state = SessionState::ClockSync;
+                        self.record_clock_sync([t1, t2, t3], true, peer_addr).await;
+                        *state = SessionState::Established;
                     } else if sync.count == 2 {
-                        info!("Received CK2, clock sync complete.");
+                        // Peer initiated; t1/t3 are on its clock, t2 on ours.
+                        self.record_clock_sync(sync.timestamps, false, peer_addr)
+                            .await;
                         *state = SessionState::Established;
                     }
                 }
@@ -485,6 +521,38 @@ impl RtpMidiSession {
         Ok(())
     }
 
+    /// Sends CK0 carrying our t1 timestamp.
+    async fn send_clock_sync_start(&self) -> Result<()> {
+        let sync_msg = AppleMidiMessage::Sync(AppleMidiSync::new(
+            self.ssrc,
+            0,
+            [self.media_clock.now_ck(), 0, 0],
+        ));
+        self.send_control_message(&sync_msg).await
+    }
+
+    /// Feeds a completed CK exchange into the peer clock model.
+    async fn record_clock_sync(
+        &self,
+        timestamps: [u64; 3],
+        local_is_initiator: bool,
+        peer_addr: SocketAddr,
+    ) {
+        match ClockSyncSample::from_exchange(timestamps, local_is_initiator) {
+            Some(sample) => {
+                info!(
+                    "Clock sync with {}: offset {} us, RTT {} us.",
+                    peer_addr, sample.offset_us, sample.rtt_us
+                );
+                self.peer_clock.lock().await.observe_sync(sample);
+                if let Some(sender) = &self.event_sender {
+                    let _ = sender.send(Event::SyncStatusChanged { peer: peer_addr });
+                }
+            }
+            None => warn!("Discarding malformed CK exchange: {:?}", timestamps),
+        }
+    }
+
     /// Sends a control message to the currently connected peer.
     async fn send_control_message(&self, msg: &AppleMidiMessage) -> Result<()> {
         if let Some(peer) = *self.peer_addr.lock().await {
@@ -507,21 +575,17 @@ impl RtpMidiSession {
             return Ok(());
         }
         *state = SessionState::ClockSync;
+        // Release the state lock: the CK1 handler needs it to finish the exchange.
+        drop(state);
         info!("Initiating clock sync with peer at {}", peer_addr);
 
-        let sync_msg = AppleMidiMessage::Sync(AppleMidiSync::new(
-            self.ssrc,
-            0,         // This is CK0
-            [0, 0, 0], // Timestamps are filled by the receiver
-        ));
-
         let mut attempts = 0;
         let max_attempts = 5;
         let mut backoff = Duration::from_millis(200);
         let max_backoff = Duration::from_secs(2);
         let timeout = Duration::from_secs(2);
         while attempts < max_attempts {
-            self.send_control_message(&sync_msg).await?;
+            self.send_clock_sync_start().await?;
             info!("Sent CK0 (clock sync), attempt {}", attempts + 1);
             // Wait for CK1 or timeout
             let mut ck1_received = false;
@@ -540,10 +604,8 @@ impl RtpMidiSession {
                 }
             }
             if ck1_received {
+                // SyncStatusChanged is emitted by record_clock_sync.
                 info!("Clock sync complete.");
-                if let Some(sender) = &self.event_sender {
-                    let _ = sender.send(Event::SyncStatusChanged { peer: peer_addr });
-                }
                 break;
             }
             attempts += 1;
@@ -554,9 +616,13 @@ impl RtpMidiSession {
             sleep(backoff).await;
             backoff = std::cmp::min(backoff * 2, max_backoff); // Exponential backoff
         }
-        if *self.session_state.lock().await != SessionState::Established {
+        let mut state = self.session_state.lock().await;
+        if *state != SessionState::Established {
             warn!("Clock sync failed after {} attempts.", max_attempts);
-            *self.session_state.lock().await = SessionState::Idle;
+            // The session itself stays up; only its clock is unsynchronized.
+            if *state == SessionState::ClockSync {
+                *state = SessionState::Established;
+            }
             if let Some(sender) = &self.event_sender {
                 let _ = sender.send(Event::SyncFailed { peer: peer_addr });
             }
@@ -569,7 +635,9 @@ impl RtpMidiSession {
     pub async fn end_session(&self) -> Result<()> {
         let mut state = self.session_state.lock().await;
         *state = SessionState::Terminated;
-        // Clean up resources, etc.
+        // Pending commands still go out; nothing is sent afterwards.
+        self.sender.flush().await;
+        self.sender.set_peer(None).await;
         Ok(())
     }
 
@@ -584,38 +652,18 @@ impl DataStreamNetSender for RtpMidiSession {
         // Zde lze inicializovat síťové zdroje, pokud je potřeba
         Ok(())
     }
-    fn send(&mut self, _ts: u64, payload: &[u8]) -> Result<(), StreamError> {
-        // Odeslání raw MIDI packetu (payload) s timestampem ts
-        // Zde by bylo potřeba převést payload na MidiMessage a zavolat send_midi
-        // Pro jednoduchost předpokládáme, že payload je již správně připravený
-        // (v praxi by zde byla serializace/deserializace)
-        // TODO: Implementace podle konkrétního formátu
-        match rtp_midi_core::parse_midi_message(payload) {
-            Ok((_cmd, _)) => {
-                // Wrap in MidiMessage with delta_time = 0 for now
-                let midi_msg = MidiMessage {
-                    delta_time: 0,
-                    command: payload.to_vec(),
-                };
-                // This is a sync function, but send_midi is async, so we just log for now
-                // In production, this should be refactored for async context
-                warn!(
-                    "DataStreamNetSender::send called, but send_midi is async. Message: {:?}",
-                    midi_msg
-                );
-                Ok(())
-            }
-            Err(e) => {
-                warn!(
-                    "Failed to parse MIDI payload in DataStreamNetSender::send: {}",
-                    e
-                );
-                Err(StreamError::Other(format!(
-                    "Failed to parse MIDI payload: {}",
-                    e
-                )))
-            }
+    fn send(&mut self, ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+        // Odeslání raw MIDI zprávy (payload) s časem ts (monotónní µs, 0 = hned)
+        if !is_complete_command(payload) {
+            return Err(StreamError::Other(format!(
+                "Invalid MIDI payload in DataStreamNetSender::send: {:02X?}",
+                payload
+            )));
         }
+        let at_us = if ts == 0 { monotonic_us() } else { ts };
+        self.sender
+            .try_send(at_us, payload)
+            .map_err(|e| StreamError::Other(e.to_string()))
     }
 }
 
@@ -642,3 +690,75 @@ impl JournalEntries for JournalData {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use tokio::sync::mpsc;
+
+    // Delivers the control messages `from` sends to `to`, as arriving from
+    // `from_addr`, dropping those `drop` selects.
+    async fn wire(
+        from: &RtpMidiSession,
+        to: Arc<RtpMidiSession>,
+        from_addr: SocketAddr,
+        drop: impl Fn(&AppleMidiMessage) -> bool + Send + 'static,
+    ) {
+        let (tx, mut rx) = mpsc::unbounded_channel::<Vec<u8>>();
+        from.add_outgoing_packet_handler(move |_, _, packet| {
+            let _ = tx.send(packet);
+        })
+        .await;
+        tokio::spawn(async move {
+            while let Some(packet) = rx.recv().await {
+                let Ok(msg) = AppleMidiMessage::parse(&packet) else {
+                    continue;
+                };
+                if !drop(&msg) {
+                    let _ = to.handle_control_message(msg, from_addr).await;
+                }
+            }
+        });
+    }
+
+    #[tokio::test]
+    async fn handshake_survives_a_lost_ck1() {
+        let initiator_addr: SocketAddr = "127.0.0.1:5004".parse().unwrap();
+        let responder_addr: SocketAddr = "127.0.0.1:5006".parse().unwrap();
+        let initiator = Arc::new(
+            RtpMidiSession::new("initiator".into(), 0, None)
+                .await
+                .unwrap(),
+        );
+        let responder = Arc::new(
+            RtpMidiSession::new("responder".into(), 0, None)
+                .await
+                .unwrap(),
+        );
+        wire(&initiator, responder.clone(), initiator_addr, |_| false).await;
+        let ck1_sent = Arc::new(AtomicUsize::new(0));
+        let counter = ck1_sent.clone();
+        wire(&responder, initiator.clone(), responder_addr, move |msg| {
+            matches!(msg, AppleMidiMessage::Sync(sync) if sync.count == 1)
+                && counter.fetch_add(1, Ordering::Relaxed) == 0
+        })
+        .await;
+
+        initiator
+            .initiate_handshake(responder_addr, "responder")
+            .await
+            .unwrap();
+        assert_eq!(
+            *initiator.session_state.lock().await,
+            SessionState::Established
+        );
+        // The second CK1 got through and completed the exchange.
+        assert_eq!(ck1_sent.load(Ordering::Relaxed), 2);
+        assert!(initiator.peer_clock.lock().await.sync().is_some());
+        assert_eq!(
+            *responder.session_state.lock().await,
+            SessionState::Established
+        );
+    }
+}
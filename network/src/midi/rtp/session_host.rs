@@ -0,0 +1,858 @@
+// src/midi/rtp/session_host.rs
+
+//! Multi-peer RTP-MIDI session host.
+//!
+//! `RtpMidiSession` models exactly one peer behind a set of mutexes. The host
+//! instead accepts any number of concurrent peers: their state is sharded per
+//! SSRC into flat maps owned by a fixed pool of worker tasks, so a peer is
+//! always processed by the same worker and no state is shared between them.
+//!
+//! Each worker keeps a bounded queue per peer and serves ready peers
+//! round-robin, one packet per peer per round. A peer flooding the host can
+//! therefore only delay its own packets; when its queue overflows the oldest
+//! packets are dropped and counted in its stats.
+//!
+//! A peer gets its shard with its AppleMIDI invitation; packets of SSRCs that
+//! never invited are dropped. Shards end with BY or after
+//! `PEER_IDLE_TIMEOUT_US` without any packet (RTP or CK), so the maps stay
+//! bounded by the live sessions.
+
+use bytes::Bytes;
+use log::{info, warn};
+use rtp_midi_core::clock::{system_clock, SharedClock};
+use rtp_midi_core::trace::{self, Stage};
+use rtp_midi_core::{parse_rtp_packet, MidiBatch, MidiEvent, SysexArena};
+use std::collections::{HashMap, VecDeque};
+use std::net::SocketAddr;
+use std::sync::Arc;
+use tokio::sync::{mpsc, oneshot};
+use tokio::task::JoinHandle;
+
+use super::clock::{ClockSyncSample, MediaClock, PeerClock, MIDI_CLOCK_HZ};
+use super::control_message::{AppleMidiMessage, InvitationAccepted, Sync as AppleMidiSync};
+use super::message::RtpMidiPacket;
+use super::session::ReceivedMidi;
+
+/// Callback receiving decoded MIDI from any peer.
+pub type MidiSink = Arc<dyn Fn(ReceivedMidi) + Send + Sync>;
+/// Callback sending a raw datagram to a peer.
+pub type PacketSink = Arc<dyn Fn(SocketAddr, Vec<u8>) + Send + Sync>;
+
+// Packets buffered per peer before the oldest are dropped.
+const PEER_QUEUE_LIMIT: usize = 256;
+// Messages buffered per worker channel.
+const WORKER_CHANNEL_DEPTH: usize = 1024;
+// A peer without any packet for this long is forgotten. AppleMIDI initiators
+// repeat CK at least once a minute, so a live session never gets close.
+const PEER_IDLE_TIMEOUT_US: u64 = 120_000_000;
+// How often a worker looks for idle peers.
+const IDLE_SWEEP_INTERVAL_US: u64 = 1_000_000;
+
+/// Configuration of a `SessionHost`.
+#[derive(Debug, Clone)]
+pub struct SessionHostConfig {
+    /// Name announced in AppleMIDI OK responses.
+    pub name: String,
+    /// Number of worker tasks; peers are assigned by SSRC.
+    pub workers: usize,
+    /// Time base of CK responses and the media clock.
+    pub clock: SharedClock,
+}
+
+impl Default for SessionHostConfig {
+    fn default() -> Self {
+        let workers = std::thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(2)
+            .clamp(1, 8);
+        Self {
+            name: "Rust WLED Hub".to_string(),
+            workers,
+            clock: system_clock(),
+        }
+    }
+}
+
+/// Per-peer counters, collected from the owning worker on request.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct PeerStats {
+    pub ssrc: u32,
+    pub addr: Option<SocketAddr>,
+    pub name: Option<String>,
+    /// True once the peer completed the AppleMIDI invitation.
+    pub invited: bool,
+    pub packets: u64,
+    pub bytes: u64,
+    pub commands: u64,
+    pub duplicates: u64,
+    /// Packets never seen and not recovered from a journal.
+    pub lost: u64,
+    /// Packets whose commands were recovered from a journal.
+    pub recovered: u64,
+    /// Packets dropped because the peer's queue was full.
+    pub dropped: u64,
+    pub jitter_us: u64,
+    pub clock_offset_us: Option<i64>,
+    /// One-way latency of the last packet, once the peer completed CK.
+    pub latency_us: Option<i64>,
+    pub last_seen_us: u64,
+}
+
+enum WorkerMsg {
+    Packet {
+        ssrc: u32,
+        data: Bytes,
+        addr: SocketAddr,
+        received_at_us: u64,
+    },
+    Stats(oneshot::Sender<Vec<PeerStats>>),
+}
+
+/// Handle to a running multi-peer host. Dropping it stops the workers.
+pub struct SessionHost {
+    workers: Vec<mpsc::Sender<WorkerMsg>>,
+    handles: Vec<JoinHandle<()>>,
+    ssrc: u32,
+}
+
+impl SessionHost {
+    /// Starts the worker pool. Must be called inside a Tokio runtime.
+    pub fn start(config: SessionHostConfig, midi_sink: MidiSink, packet_sink: PacketSink) -> Self {
+        let ssrc: u32 = rand::random();
+        let context = Arc::new(WorkerContext {
+            name: config.name,
+            ssrc,
+            clock: MediaClock::start_on(&*config.clock),
+            time: config.clock,
+            midi_sink,
+            packet_sink,
+        });
+        let worker_count = config.workers.max(1);
+        let mut workers = Vec::with_capacity(worker_count);
+        let mut handles = Vec::with_capacity(worker_count);
+        for _ in 0..worker_count {
+            let (tx, rx) = mpsc::channel(WORKER_CHANNEL_DEPTH);
+            let worker = Worker::new(context.clone());
+            handles.push(tokio::spawn(worker.run(rx)));
+            workers.push(tx);
+        }
+        info!(
+            "RTP-MIDI session host '{}' started with {} workers.",
+            context.name, worker_count
+        );
+        Self {
+            workers,
+            handles,
+            ssrc,
+        }
+    }
+
+    /// Our SSRC, used in all responses.
+    pub fn ssrc(&self) -> u32 {
+        self.ssrc
+    }
+
+    /// Routes an incoming datagram to the worker owning its SSRC.
+    ///
+    /// Returns false if the datagram carries no recognizable SSRC.
+    pub async fn dispatch(&self, data: Vec<u8>, addr: SocketAddr, received_at_us: u64) -> bool {
+        let Some(ssrc) = route_ssrc(&data) else {
+            return false;
+        };
+        let worker = &self.workers[ssrc as usize % self.workers.len()];
+        worker
+            .send(WorkerMsg::Packet {
+                ssrc,
+                data: Bytes::from(data),
+                addr,
+                received_at_us,
+            })
+            .await
+            .is_ok()
+    }
+
+    /// Collects per-peer stats from all workers, sorted by SSRC.
+    pub async fn stats(&self) -> Vec<PeerStats> {
+        let mut all = Vec::new();
+        for worker in &self.workers {
+            let (tx, rx) = oneshot::channel();
+            if worker.send(WorkerMsg::Stats(tx)).await.is_ok() {
+                if let Ok(stats) = rx.await {
+                    all.extend(stats);
+                }
+            }
+        }
+        all.sort_by_key(|s| s.ssrc);
+        all
+    }
+
+    /// Stops all workers after they drained their queues.
+    pub async fn shutdown(self) {
+        drop(self.workers);
+        for handle in self.handles {
+            let _ = handle.await;
+        }
+    }
+}
+
+/// Extracts the sender SSRC from an RTP or AppleMIDI control datagram.
+pub fn route_ssrc(data: &[u8]) -> Option<u32> {
+    let read = |at: usize| -> Option<u32> {
+        data.get(at..at + 4)
+            .map(|b| u32::from_be_bytes([b[0], b[1], b[2], b[3]]))
+    };
+    if data.starts_with(&[0xFF, 0xFF]) {
+        match data.get(2..4)? {
+            b"IN" | b"OK" | b"NO" | b"BY" => read(12),
+            b"CK" | b"RS" => read(4),
+            _ => None,
+        }
+    } else if data.len() >= 12 && data[0] >> 6 == 2 {
+        read(8)
+    } else {
+        None
+    }
+}
+
+// An AppleMIDI IN, the only packet that opens a session.
+fn is_invitation(data: &[u8]) -> bool {
+    data.starts_with(&[0xFF, 0xFF]) && data.get(2..4) == Some(b"IN")
+}
+
+struct WorkerContext {
+    name: String,
+    ssrc: u32,
+    // Host media clock; all CK responses are stamped from it.
+    clock: MediaClock,
+    time: SharedClock,
+    midi_sink: MidiSink,
+    packet_sink: PacketSink,
+}
+
+impl WorkerContext {
+    fn now_ck(&self) -> u64 {
+        self.clock.ck_timestamp(self.time.now_us())
+    }
+}
+
+/// Outcome of feeding a sequence number to `SeqTracker`.
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum SeqOutcome {
+    /// Newest packet so far; `gap` packets in between were skipped.
+    Advanced {
+        gap: u16,
+    },
+    /// An older packet that was still missing.
+    Late,
+    Duplicate,
+}
+
+/// Extended sequence tracking with a 64-packet duplicate window.
+#[derive(Debug, Clone, Default)]
+struct SeqTracker {
+    highest: Option<u16>,
+    // Bit n set = packet (highest - n) was seen.
+    window: u64,
+}
+
+impl SeqTracker {
+    fn observe(&mut self, seq: u16) -> SeqOutcome {
+        let Some(highest) = self.highest else {
+            self.highest = Some(seq);
+            self.window = 1;
+            return SeqOutcome::Advanced { gap: 0 };
+        };
+        let diff = seq.wrapping_sub(highest) as i16;
+        if diff > 0 {
+            let shift = diff as u32;
+            self.window = if shift >= 64 { 0 } else { self.window << shift };
+            self.window |= 1;
+            self.highest = Some(seq);
+            SeqOutcome::Advanced {
+                gap: diff as u16 - 1,
+            }
+        } else {
+            let back = (-(diff as i32)) as u32;
+            if back >= 64 {
+                return SeqOutcome::Duplicate;
+            }
+            let bit = 1u64 << back;
+            if self.window & bit != 0 {
+                SeqOutcome::Duplicate
+            } else {
+                self.window |= bit;
+                SeqOutcome::Late
+            }
+        }
+    }
+
+    /// Whether `seq` lies in the gap just skipped (between `prev` and the new highest).
+    fn in_gap(prev: u16, seq: u16, highest: u16) -> bool {
+        let span = highest.wrapping_sub(prev);
+        let offset = seq.wrapping_sub(prev);
+        offset > 0 && offset < span
+    }
+
+    /// Marks a packet as seen (e.g. recovered from a journal).
+    fn mark(&mut self, seq: u16) {
+        if let Some(highest) = self.highest {
+            let back = highest.wrapping_sub(seq) as u32;
+            if back < 64 {
+                self.window |= 1u64 << back;
+            }
+        }
+    }
+}
+
+struct PeerShard {
+    stats: PeerStats,
+    clock: PeerClock,
+    seq: SeqTracker,
+    pending: VecDeque<(Bytes, SocketAddr, u64)>,
+    // Reused parse buffer; keeps its capacity between packets.
+    batch: MidiBatch,
+}
+
+impl PeerShard {
+    fn new(ssrc: u32) -> Self {
+        Self {
+            stats: PeerStats {
+                ssrc,
+                ..Default::default()
+            },
+            clock: PeerClock::new(MIDI_CLOCK_HZ as f64),
+            seq: SeqTracker::default(),
+            pending: VecDeque::new(),
+            batch: MidiBatch::new(),
+        }
+    }
+}
+
+struct Worker {
+    context: Arc<WorkerContext>,
+    peers: HashMap<u32, PeerShard>,
+    // Peers with queued packets, in service order.
+    ready: VecDeque<u32>,
+    // Packets of SSRCs without a session.
+    rejected: u64,
+    last_sweep_us: u64,
+}
+
+impl Worker {
+    fn new(context: Arc<WorkerContext>) -> Self {
+        Self {
+            context,
+            peers: HashMap::new(),
+            ready: VecDeque::new(),
+            rejected: 0,
+            last_sweep_us: 0,
+        }
+    }
+
+    async fn run(mut self, mut rx: mpsc::Receiver<WorkerMsg>) {
+        loop {
+            if self.ready.is_empty() {
+                match rx.recv().await {
+                    Some(msg) => self.accept(msg),
+                    None => break,
+                }
+            }
+            while let Ok(msg) = rx.try_recv() {
+                self.accept(msg);
+            }
+            // One fair round: at most one packet per ready peer.
+            for _ in 0..self.ready.len() {
+                if let Some(ssrc) = self.ready.pop_front() {
+                    self.serve(ssrc);
+                }
+            }
+            if !self.ready.is_empty() {
+                tokio::task::yield_now().await;
+            }
+        }
+        // Channel closed: drain what is left.
+        self.drain();
+    }
+
+    // Processes every queued packet, still one per peer per round.
+    fn drain(&mut self) {
+        while let Some(ssrc) = self.ready.pop_front() {
+            self.serve(ssrc);
+        }
+    }
+
+    // Processes the oldest packet of a ready peer and requeues it if more wait.
+    fn serve(&mut self, ssrc: u32) {
+        let Some((data, addr, at)) = self
+            .peers
+            .get_mut(&ssrc)
+            .and_then(|shard| shard.pending.pop_front())
+        else {
+            return;
+        };
+        self.process(ssrc, data, addr, at);
+        if self
+            .peers
+            .get(&ssrc)
+            .is_some_and(|shard| !shard.pending.is_empty())
+        {
+            self.ready.push_back(ssrc);
+        }
+    }
+
+    fn accept(&mut self, msg: WorkerMsg) {
+        match msg {
+            WorkerMsg::Packet {
+                ssrc,
+                data,
+                addr,
+                received_at_us,
+            } => {
+                self.evict_idle(received_at_us);
+                if !self.peers.contains_key(&ssrc) && !is_invitation(&data) {
+                    self.rejected += 1;
+                    if self.rejected.is_power_of_two() {
+                        warn!(
+                            "Session host: {} packets from peers without a session (last {:08x} from {}).",
+                            self.rejected, ssrc, addr
+                        );
+                    }
+                    return;
+                }
+                let shard = self
+                    .peers
+                    .entry(ssrc)
+                    .or_insert_with(|| PeerShard::new(ssrc));
+                shard.stats.last_seen_us = received_at_us;
+                if shard.pending.is_empty() {
+                    self.ready.push_back(ssrc);
+                }
+                if shard.pending.len() == PEER_QUEUE_LIMIT {
+                    shard.pending.pop_front();
+                    shard.stats.dropped += 1;
+                }
+                shard.pending.push_back((data, addr, received_at_us));
+            }
+            WorkerMsg::Stats(reply) => {
+                // Stats reflect every packet dispatched before the request.
+                self.drain();
+                let stats = self
+                    .peers
+                    .values()
+                    .map(|shard| {
+                        let mut stats = shard.stats.clone();
+                        stats.jitter_us = shard.clock.jitter_us();
+                        stats.clock_offset_us = shard.clock.sync().map(|s| s.offset_us);
+                        stats
+                    })
+                    .collect();
+                let _ = reply.send(stats);
+            }
+        }
+    }
+
+    // Forgets peers silent for `PEER_IDLE_TIMEOUT_US`, at most once per
+    // `IDLE_SWEEP_INTERVAL_US`.
+    fn evict_idle(&mut self, now_us: u64) {
+        if now_us.saturating_sub(self.last_sweep_us) < IDLE_SWEEP_INTERVAL_US {
+            return;
+        }
+        self.last_sweep_us = now_us;
+        self.peers.retain(|ssrc, shard| {
+            let idle = shard.pending.is_empty()
+                && now_us.saturating_sub(shard.stats.last_seen_us) >= PEER_IDLE_TIMEOUT_US;
+            if idle {
+                info!("Session host: peer {:08x} timed out.", ssrc);
+            }
+            !idle
+        });
+    }
+
+    fn process(&mut self, ssrc: u32, data: Bytes, addr: SocketAddr, received_at_us: u64) {
+        let _span = trace::span(Stage::SessionParse, received_at_us);
+        if data.starts_with(&[0xFF, 0xFF]) {
+            self.process_control(ssrc, &data, addr);
+            return;
+        }
+        let Some(shard) = self.peers.get_mut(&ssrc) else {
+            return;
+        };
+        shard.stats.addr = Some(addr);
+        shard.stats.packets += 1;
+        shard.stats.bytes += data.len() as u64;
+
+        // The command section decodes in one pass into the shard's batch.
+        shard.batch.clear();
+        let packet = match parse_rtp_packet(&data)
+            .and_then(|parsed| RtpMidiPacket::parse_midi_payload_batch(&parsed, &mut shard.batch))
+        {
+            Ok(packet) => packet,
+            Err(e) => {
+                warn!("Peer {:08x}: malformed RTP-MIDI packet: {}", ssrc, e);
+                return;
+            }
+        };
+
+        let previous = shard.seq.highest;
+        match shard.seq.observe(packet.sequence_number) {
+            SeqOutcome::Duplicate => {
+                shard.stats.duplicates += 1;
+                return;
+            }
+            SeqOutcome::Late => {
+                // Counted as lost when the gap was detected.
+                shard.stats.lost = shard.stats.lost.saturating_sub(1);
+            }
+            SeqOutcome::Advanced { gap } if gap > 0 => {
+                let recovered = Self::recover_from_journal(
+                    shard,
+                    &self.context,
+                    &packet,
+                    previous.unwrap_or(packet.sequence_number),
+                    addr,
+                    received_at_us,
+                );
+                shard.stats.recovered += recovered as u64;
+                shard.stats.lost += gap.saturating_sub(recovered) as u64;
+            }
+            SeqOutcome::Advanced { .. } => {}
+        }
+
+        shard.clock.observe_rtp(packet.timestamp, received_at_us);
+        let latency_us = shard.clock.one_way_latency_us(
+            packet.timestamp,
+            self.context.clock.media_us(received_at_us),
+        );
+        if latency_us.is_some() {
+            shard.stats.latency_us = latency_us;
+        }
+        if shard.batch.is_empty() {
+            return;
+        }
+        shard.stats.commands += shard.batch.len() as u64;
+        let events = shard
+            .batch
+            .events(packet.timestamp)
+            .map(|mut event| {
+                event.time_us = shard.clock.rtp_to_local_us(event.time_us as u32);
+                event
+            })
+            .collect();
+        let sysex = std::mem::take(&mut shard.batch.sysex);
+        (self.context.midi_sink)(ReceivedMidi {
+            peer: addr,
+            ssrc,
+            arrival_us: received_at_us,
+            latency_us,
+            events,
+            sysex,
+        });
+    }
+
+    // Delivers journal entries covering the skipped sequence numbers.
+    fn recover_from_journal(
+        shard: &mut PeerShard,
+        context: &WorkerContext,
+        packet: &RtpMidiPacket,
+        previous: u16,
+        addr: SocketAddr,
+        received_at_us: u64,
+    ) -> u16 {
+        let Some(rtp_midi_core::JournalData::Enhanced { entries, .. }) = &packet.journal_data
+        else {
+            return 0;
+        };
+        let mut recovered = 0u16;
+        let mut events = Vec::new();
+        let mut sysex = SysexArena::new();
+        for entry in entries {
+            if !SeqTracker::in_gap(previous, entry.sequence_nr, packet.sequence_number) {
+                continue;
+            }
+            shard.seq.mark(entry.sequence_nr);
+            recovered += 1;
+            // Recovered commands are late by definition: play them now.
+            events.extend(entry.commands.iter().filter_map(|timed| {
+                MidiEvent::from_command(&timed.command, received_at_us, &mut sysex)
+            }));
+        }
+        if !events.is_empty() {
+            shard.stats.commands += events.len() as u64;
+            (context.midi_sink)(ReceivedMidi {
+                peer: addr,
+                ssrc: shard.stats.ssrc,
+                arrival_us: received_at_us,
+                latency_us: None,
+                events,
+                sysex,
+            });
+        }
+        recovered
+    }
+
+    fn process_control(&mut self, ssrc: u32, data: &[u8], addr: SocketAddr) {
+        let msg = match AppleMidiMessage::parse(data) {
+            Ok(msg) => msg,
+            Err(e) => {
+                warn!("Peer {:08x}: malformed AppleMIDI message: {}", ssrc, e);
+                // A broken invitation does not open a session.
+                if self
+                    .peers
+                    .get(&ssrc)
+                    .is_some_and(|shard| !shard.stats.invited)
+                {
+                    self.peers.remove(&ssrc);
+                }
+                return;
+            }
+        };
+        match msg {
+            AppleMidiMessage::Invitation(inv) => {
+                info!(
+                    "Session host: invitation from '{}' ({:08x}).",
+                    inv.name, ssrc
+                );
+                if let Some(shard) = self.peers.get_mut(&ssrc) {
+                    shard.stats.addr = Some(addr);
+                    shard.stats.name = Some(inv.name.clone());
+                    shard.stats.invited = true;
+                }
+                let ok = AppleMidiMessage::InvitationAccepted(InvitationAccepted::new(
+                    inv.header.initiator_token,
+                    self.context.ssrc,
+                    self.context.name.clone(),
+                ));
+                (self.context.packet_sink)(addr, ok.serialize().to_vec());
+            }
+            AppleMidiMessage::Sync(sync) => {
+                let [t1, t2, _] = sync.timestamps;
+                match sync.count {
+                    0 => {
+                        let ck1 = AppleMidiMessage::Sync(AppleMidiSync::new(
+                            self.context.ssrc,
+                            1,
+                            [t1, self.context.now_ck(), 0],
+                        ));
+                        (self.context.packet_sink)(addr, ck1.serialize().to_vec());
+                    }
+                    2 => {
+                        if let (Some(shard), Some(sample)) = (
+                            self.peers.get_mut(&ssrc),
+                            ClockSyncSample::from_exchange(sync.timestamps, false),
+                        ) {
+                            shard.clock.observe_sync(sample);
+                        }
+                    }
+                    _ => {
+                        // The host never initiates CK; a stray CK1 is answered so
+                        // the peer can still complete its measurement.
+                        let ck2 = AppleMidiMessage::Sync(AppleMidiSync::new(
+                            self.context.ssrc,
+                            2,
+                            [t1, t2, self.context.now_ck()],
+                        ));
+                        (self.context.packet_sink)(addr, ck2.serialize().to_vec());
+                    }
+                }
+            }
+            AppleMidiMessage::Exit(_) => {
+                info!("Session host: peer {:08x} ended the session.", ssrc);
+                self.peers.remove(&ssrc);
+            }
+            other => warn!("Session host: unexpected control message {:?}", other),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::message::MidiMessage;
+    use super::*;
+    use rtp_midi_core::clock::VirtualClock;
+    use std::sync::Mutex as StdMutex;
+
+    fn rtp_packet(ssrc: u32, seq: u16, ts: u32, note: u8) -> Vec<u8> {
+        let mut packet = RtpMidiPacket::new(ssrc, seq, ts);
+        packet.midi_commands = vec![MidiMessage::new(0, vec![0x90, note, 100])];
+        packet.serialize().unwrap().to_vec()
+    }
+
+    fn addr(port: u16) -> SocketAddr {
+        SocketAddr::from(([127, 0, 0, 1], port))
+    }
+
+    fn invitation(ssrc: u32) -> Vec<u8> {
+        super::super::control_message::Invitation::new(ssrc, ssrc, "daw".into())
+            .serialize()
+            .to_vec()
+    }
+
+    // Host counting delivered events per SSRC.
+    fn counting_host(workers: usize) -> (SessionHost, Arc<StdMutex<HashMap<u32, usize>>>) {
+        let received = Arc::new(StdMutex::new(HashMap::<u32, usize>::new()));
+        let sink_received = received.clone();
+        let host = SessionHost::start(
+            SessionHostConfig {
+                name: "test".into(),
+                workers,
+                ..Default::default()
+            },
+            Arc::new(move |midi: ReceivedMidi| {
+                *sink_received.lock().unwrap().entry(midi.ssrc).or_default() += midi.events.len();
+            }),
+            Arc::new(|_, _| {}),
+        );
+        (host, received)
+    }
+
+    #[test]
+    fn seq_tracker_detects_gaps_and_duplicates() {
+        let mut t = SeqTracker::default();
+        assert_eq!(t.observe(10), SeqOutcome::Advanced { gap: 0 });
+        assert_eq!(t.observe(13), SeqOutcome::Advanced { gap: 2 });
+        assert_eq!(t.observe(11), SeqOutcome::Late);
+        assert_eq!(t.observe(11), SeqOutcome::Duplicate);
+        // Too old for the window.
+        assert_eq!(t.observe(13u16.wrapping_sub(100)), SeqOutcome::Duplicate);
+        let mut w = SeqTracker::default();
+        w.observe(u16::MAX);
+        assert_eq!(w.observe(1), SeqOutcome::Advanced { gap: 1 });
+    }
+
+    #[test]
+    fn route_ssrc_reads_rtp_and_control_headers() {
+        let rtp = rtp_packet(0xAABBCCDD, 1, 0, 60);
+        assert_eq!(route_ssrc(&rtp), Some(0xAABBCCDD));
+        let ck = AppleMidiSync::new(0x01020304, 0, [0, 0, 0]).serialize();
+        assert_eq!(route_ssrc(&ck), Some(0x01020304));
+        let inv = super::super::control_message::Invitation::new(7, 0x0A0B0C0D, "daw".into());
+        assert_eq!(route_ssrc(&inv.serialize()), Some(0x0A0B0C0D));
+        assert_eq!(route_ssrc(&[0u8; 4]), None);
+    }
+
+    #[tokio::test]
+    async fn host_serves_many_peers_with_separate_stats() {
+        const PEERS: u32 = 32;
+        const PACKETS: u16 = 50;
+        let (host, received) = counting_host(4);
+
+        for peer in 0..PEERS {
+            assert!(
+                host.dispatch(invitation(1000 + peer), addr(6000 + peer as u16), 0)
+                    .await
+            );
+        }
+        for seq in 0..PACKETS {
+            for peer in 0..PEERS {
+                // Peer 0 loses every tenth packet.
+                if peer == 0 && seq % 10 == 5 {
+                    continue;
+                }
+                let data = rtp_packet(1000 + peer, seq, seq as u32 * 100, 60);
+                assert!(host.dispatch(data, addr(6000 + peer as u16), 0).await);
+            }
+        }
+        let stats = host.stats().await;
+        host.shutdown().await;
+
+        assert_eq!(stats.len(), PEERS as usize);
+        let received = received.lock().unwrap();
+        for s in &stats {
+            let expected = if s.ssrc == 1000 { PACKETS - 5 } else { PACKETS };
+            assert_eq!(received[&s.ssrc], expected as usize);
+            assert_eq!(s.packets, expected as u64);
+            assert_eq!(s.lost, (PACKETS - expected) as u64);
+            assert_eq!(s.addr, Some(addr(6000 + (s.ssrc - 1000) as u16)));
+            assert!(s.invited);
+        }
+    }
+
+    #[tokio::test]
+    async fn packets_without_invitation_open_no_session() {
+        let (host, received) = counting_host(1);
+        for seq in 0..10 {
+            host.dispatch(rtp_packet(7, seq, 0, 60), addr(5004), 0)
+                .await;
+        }
+        let ck0 = AppleMidiSync::new(8, 0, [1, 0, 0]);
+        host.dispatch(ck0.serialize().to_vec(), addr(5004), 0).await;
+        assert!(host.stats().await.is_empty());
+
+        host.dispatch(invitation(7), addr(5004), 0).await;
+        host.dispatch(rtp_packet(7, 10, 0, 60), addr(5004), 0).await;
+        let stats = host.stats().await;
+        host.shutdown().await;
+        assert_eq!(stats.len(), 1);
+        assert_eq!(stats[0].packets, 1);
+        assert_eq!(received.lock().unwrap()[&7], 1);
+    }
+
+    #[tokio::test]
+    async fn idle_peers_are_evicted() {
+        let (host, _) = counting_host(1);
+        host.dispatch(invitation(1), addr(5004), 1_000_000).await;
+        host.dispatch(invitation(2), addr(5006), 1_000_000).await;
+        // Served before time moves on
+        assert_eq!(host.stats().await.len(), 2);
+        // Peer 2 keeps its session alive with CK only.
+        for s in 1..=3u64 {
+            let ck0 = AppleMidiSync::new(2, 0, [0, 0, 0]);
+            let at = 1_000_000 + s * PEER_IDLE_TIMEOUT_US / 2;
+            host.dispatch(ck0.serialize().to_vec(), addr(5006), at)
+                .await;
+        }
+        let stats = host.stats().await;
+        assert_eq!(stats.iter().map(|s| s.ssrc).collect::<Vec<_>>(), [2]);
+
+        // The forgotten peer has to invite again.
+        let late = 1_000_000 + 2 * PEER_IDLE_TIMEOUT_US;
+        host.dispatch(rtp_packet(1, 0, 0, 60), addr(5004), late)
+            .await;
+        assert_eq!(host.stats().await.len(), 1);
+        host.shutdown().await;
+    }
+
+    #[tokio::test]
+    async fn host_answers_invitation_and_clock_sync() {
+        let sent = Arc::new(StdMutex::new(Vec::<Vec<u8>>::new()));
+        let sink_sent = sent.clone();
+        let clock = VirtualClock::new(5_000_000);
+        let host = SessionHost::start(
+            SessionHostConfig {
+                name: "hub".into(),
+                workers: 1,
+                clock: clock.shared(),
+            },
+            Arc::new(|_| {}),
+            Arc::new(move |_, data| sink_sent.lock().unwrap().push(data)),
+        );
+        let inv = super::super::control_message::Invitation::new(42, 7, "daw".into());
+        host.dispatch(inv.serialize().to_vec(), addr(5004), 0).await;
+        // CK answers are stamped from the host's clock: 1 s = 10 000 ticks.
+        clock.advance(1_000_000);
+        let ck0 = AppleMidiSync::new(7, 0, [1234, 0, 0]);
+        host.dispatch(ck0.serialize().to_vec(), addr(5004), 0).await;
+        let stats = host.stats().await;
+        let host_ssrc = host.ssrc();
+        host.shutdown().await;
+
+        assert_eq!(stats[0].name.as_deref(), Some("daw"));
+        assert!(stats[0].invited);
+        let sent = sent.lock().unwrap();
+        match AppleMidiMessage::parse(&sent[0]).unwrap() {
+            AppleMidiMessage::InvitationAccepted(ok) => {
+                assert_eq!(ok.header.initiator_token, 42);
+                assert_eq!(ok.header.ssrc, host_ssrc);
+            }
+            other => panic!("expected OK, got {:?}", other),
+        }
+        match AppleMidiMessage::parse(&sent[1]).unwrap() {
+            AppleMidiMessage::Sync(ck1) => {
+                assert_eq!(ck1.count, 1);
+                assert_eq!(ck1.timestamps[0], 1234);
+                assert_eq!(ck1.timestamps[1], 10_000);
+            }
+            other => panic!("expected CK1, got {:?}", other),
+        }
+    }
+}
@@ -1,21 +1,164 @@
 // rtp_midi_lib/src/network_interface.rs
 
 use anyhow::Result;
-use log::{error, info};
+use log::{debug, error, info};
+use std::net::SocketAddr;
 use std::sync::Arc;
 use tokio::net::UdpSocket;
 use tokio::sync::{broadcast, watch};
 
+use rtp_midi_core::clock::{Clock, SharedClock};
 use rtp_midi_core::event_bus::Event;
+use rtp_midi_core::trace::{self, Stage};
+
+/// Receives one datagram and its arrival time on `clock`.
+///
+/// On Linux the kernel receive timestamp (SO_TIMESTAMPNS) is used, so the
+/// arrival time excludes scheduling delay of this task; its age is taken
+/// off the clock's current time. Elsewhere the time is taken when the
+/// datagram is read.
+async fn recv_timestamped(
+    socket: &UdpSocket,
+    buf: &mut [u8],
+    clock: &dyn Clock,
+) -> std::io::Result<(usize, SocketAddr, u64)> {
+    #[cfg(target_os = "linux")]
+    {
+        loop {
+            socket.readable().await?;
+            match socket.try_io(tokio::io::Interest::READABLE, || {
+                kernel_timestamps::recv_from(socket, buf)
+            }) {
+                Ok((len, addr, Some(ts))) => {
+                    let age_us = std::time::SystemTime::now()
+                        .duration_since(ts)
+                        .map_or(0, |age| age.as_micros() as u64);
+                    return Ok((len, addr, clock.now_us().saturating_sub(age_us)));
+                }
+                Ok((len, addr, None)) => return Ok((len, addr, clock.now_us())),
+                Err(e) if e.kind() == std::io::ErrorKind::WouldBlock => continue,
+                Err(e) => return Err(e),
+            }
+        }
+    }
+    #[cfg(not(target_os = "linux"))]
+    {
+        let (len, addr) = socket.recv_from(buf).await?;
+        Ok((len, addr, clock.now_us()))
+    }
+}
+
+#[cfg(target_os = "linux")]
+mod kernel_timestamps {
+    use std::net::{Ipv4Addr, Ipv6Addr, SocketAddr, SocketAddrV4, SocketAddrV6};
+    use std::os::fd::AsRawFd;
+    use std::time::{Duration, SystemTime, UNIX_EPOCH};
+
+    /// Asks the kernel to attach a receive timestamp to every datagram.
+    pub fn enable(socket: &impl AsRawFd) -> std::io::Result<()> {
+        let on: libc::c_int = 1;
+        // SAFETY: valid fd and a c_int option value of the declared size.
+        let rc = unsafe {
+            libc::setsockopt(
+                socket.as_raw_fd(),
+                libc::SOL_SOCKET,
+                libc::SO_TIMESTAMPNS,
+                &on as *const _ as *const libc::c_void,
+                std::mem::size_of::<libc::c_int>() as libc::socklen_t,
+            )
+        };
+        if rc == 0 {
+            Ok(())
+        } else {
+            Err(std::io::Error::last_os_error())
+        }
+    }
+
+    /// Non-blocking `recvmsg` returning the kernel timestamp if one was attached.
+    pub fn recv_from(
+        socket: &impl AsRawFd,
+        buf: &mut [u8],
+    ) -> std::io::Result<(usize, SocketAddr, Option<SystemTime>)> {
+        // SAFETY: all pointers reference live, correctly sized local buffers.
+        unsafe {
+            let mut addr: libc::sockaddr_storage = std::mem::zeroed();
+            let mut iov = libc::iovec {
+                iov_base: buf.as_mut_ptr() as *mut libc::c_void,
+                iov_len: buf.len(),
+            };
+            let mut control = [0u64; 16];
+            let mut msg: libc::msghdr = std::mem::zeroed();
+            msg.msg_name = &mut addr as *mut _ as *mut libc::c_void;
+            msg.msg_namelen = std::mem::size_of::<libc::sockaddr_storage>() as libc::socklen_t;
+            msg.msg_iov = &mut iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.as_mut_ptr() as *mut libc::c_void;
+            msg.msg_controllen = std::mem::size_of_val(&control) as _;
+
+            let len = libc::recvmsg(socket.as_raw_fd(), &mut msg, libc::MSG_DONTWAIT);
+            if len < 0 {
+                return Err(std::io::Error::last_os_error());
+            }
+
+            let mut timestamp = None;
+            let mut cmsg = libc::CMSG_FIRSTHDR(&msg);
+            while !cmsg.is_null() {
+                if (*cmsg).cmsg_level == libc::SOL_SOCKET
+                    && (*cmsg).cmsg_type == libc::SCM_TIMESTAMPNS
+                {
+                    let ts =
+                        std::ptr::read_unaligned(libc::CMSG_DATA(cmsg) as *const libc::timespec);
+                    timestamp =
+                        Some(UNIX_EPOCH + Duration::new(ts.tv_sec as u64, ts.tv_nsec as u32));
+                }
+                cmsg = libc::CMSG_NXTHDR(&msg, cmsg);
+            }
+
+            let source = match addr.ss_family as libc::c_int {
+                libc::AF_INET => {
+                    let a = &*(&addr as *const _ as *const libc::sockaddr_in);
+                    SocketAddr::V4(SocketAddrV4::new(
+                        Ipv4Addr::from(u32::from_be(a.sin_addr.s_addr)),
+                        u16::from_be(a.sin_port),
+                    ))
+                }
+                libc::AF_INET6 => {
+                    let a = &*(&addr as *const _ as *const libc::sockaddr_in6);
+                    SocketAddr::V6(SocketAddrV6::new(
+                        Ipv6Addr::from(a.sin6_addr.s6_addr),
+                        u16::from_be(a.sin6_port),
+                        a.sin6_flowinfo,
+                        a.sin6_scope_id,
+                    ))
+                }
+                _ => {
+                    return Err(std::io::Error::new(
+                        std::io::ErrorKind::InvalidData,
+                        "unsupported source address family",
+                    ))
+                }
+            };
+            Ok((len as usize, source, timestamp))
+        }
+    }
+}
 
 pub async fn start_network_interface(
     mut receiver: broadcast::Receiver<Event>,
     sender: broadcast::Sender<Event>,
     listen_port: u16,
     shutdown: &mut watch::Receiver<bool>,
+    clock: SharedClock,
 ) -> Result<()> {
     let socket = Arc::new(UdpSocket::bind(format!("0.0.0.0:{}", listen_port)).await?);
     info!("Network interface bound to port {}", listen_port);
+    #[cfg(target_os = "linux")]
+    if let Err(e) = kernel_timestamps::enable(socket.as_ref()) {
+        log::warn!(
+            "Kernel receive timestamps unavailable, using read time: {}",
+            e
+        );
+    }
 
     let r_socket = socket.clone();
     let r_sender = sender.clone();
@@ -30,15 +173,17 @@ pub async fn start_network_interface(
                         break;
                     }
                 }
-                res = r_socket.recv_from(&mut buf) => {
+                res = recv_timestamped(&r_socket, &mut buf, &*clock) => {
                     match res {
-                        Ok((len, addr)) => {
+                        Ok((len, addr, received_at_us)) => {
                             if let Err(e) = r_sender.send(Event::RawPacketReceived {
                                 payload: buf[..len].to_vec(),
                                 source_addr: addr,
+                                received_at_us,
                             }) {
                                 error!("Failed to send RawPacketReceived event: {}", e);
                             }
+                            trace::record(Stage::UdpReceive, received_at_us, received_at_us, clock.now_us());
                         },
                         Err(e) => error!("UDP receive error: {}", e),
                     }
@@ -59,8 +204,9 @@ pub async fn start_network_interface(
                 match res {
                     Ok(event) => {
                         if let Event::SendPacket { payload, dest_addr } = event {
+                            let _span = trace::span(Stage::SocketSend, 0);
                             match socket.send_to(&payload, dest_addr).await {
-                                Ok(len) => info!("Sent {} bytes to {}", len, dest_addr),
+                                Ok(len) => debug!("Sent {} bytes to {}", len, dest_addr),
                                 Err(e) => error!("Failed to send UDP packet to {}: {}", dest_addr, e),
                             }
                         }
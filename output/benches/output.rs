@@ -0,0 +1,290 @@
+//! Benchmarky výstupní cesty: mapování LED, kódování OSC a DDP odesílání.
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use hal_esp32::{link, Esp32Sender};
+use output::color_pipeline::ColorPipeline;
+use output::ddp_output::{create_ddp_sender, DdpSender};
+use output::light_mapper::{map_leds_with_preset, MappingPreset};
+use output::note_renderer::{NoteRenderer, NoteRendererConfig};
+use output::osc_output::{OscPixelSender, OscSender};
+use output::router::OutputRouter;
+use output::show::{RecorderConfig, ShowPlayer, ShowRecorder};
+use rosc::{OscMessage, OscType};
+use rtp_midi_core::{ColorCorrection, ColorOrder, DataStreamNetSender, MidiEvent};
+use rtp_midi_core::{OutputSegment, OutputTarget, StreamError};
+use std::hint::black_box;
+
+fn magnitudes(len: usize) -> Vec<f32> {
+    (0..len).map(|i| (i % 17) as f32 / 17.0).collect()
+}
+
+fn bench_map_leds(c: &mut Criterion) {
+    let mut group = c.benchmark_group("map_leds_with_preset");
+    let mags = magnitudes(512);
+    for led_count in [60usize, 300] {
+        group.throughput(Throughput::Elements(led_count as u64));
+        for (name, preset) in [
+            ("spectrum", MappingPreset::Spectrum),
+            ("vumeter", MappingPreset::VuMeter),
+        ] {
+            group.bench_with_input(BenchmarkId::new(name, led_count), &mags, |b, mags| {
+                b.iter(|| map_leds_with_preset(black_box(mags), led_count, preset))
+            });
+        }
+    }
+    group.finish();
+}
+
+/// Glissando přes všech 88 kláves: všechny hlasy svítí nebo doznívají.
+fn bench_note_renderer(c: &mut Criterion) {
+    let mut group = c.benchmark_group("note_renderer");
+    for led_count in [300usize, 1000] {
+        let mut notes = NoteRenderer::new(NoteRendererConfig {
+            led_count,
+            release_us: u64::MAX / 2,
+            ..Default::default()
+        });
+        for (i, key) in (21..=108).enumerate() {
+            notes.handle(&MidiEvent::note_on(0, key, 100, i as u64 * 1_000));
+            notes.handle(&MidiEvent::note_off(0, key, 0, i as u64 * 1_000 + 500));
+        }
+        let mut frame = vec![0u8; led_count * 3];
+        group.throughput(Throughput::Elements(led_count as u64));
+        group.bench_function(BenchmarkId::new("glissando", led_count), |b| {
+            b.iter(|| notes.render(black_box(100_000), &mut frame))
+        });
+    }
+    group.finish();
+}
+
+fn bench_osc_encode(c: &mut Criterion) {
+    let mut group = c.benchmark_group("osc_encode");
+    group.bench_function("note_on", |b| {
+        b.iter(|| {
+            OscSender::encode(OscMessage {
+                addr: "/noteOn".to_string(),
+                args: vec![OscType::Int(black_box(60)), OscType::Int(100)],
+            })
+            .unwrap()
+        })
+    });
+    group.bench_function("pitch_bend", |b| {
+        b.iter(|| {
+            OscSender::encode(OscMessage {
+                addr: "/pitchBend".to_string(),
+                args: vec![OscType::Float(black_box(0.25))],
+            })
+            .unwrap()
+        })
+    });
+    group.finish();
+}
+
+fn bench_ddp_send(c: &mut Criterion) {
+    // Rámce jdou na lokální port bez posluchače; měří se celá cesta
+    // DdpSender -> ddp-rs -> sendto().
+    let receiver = std::net::UdpSocket::bind("127.0.0.1:0").unwrap();
+    let port = receiver.local_addr().unwrap().port();
+    let mut group = c.benchmark_group("ddp_send");
+    for led_count in [60usize, 480] {
+        let mut sender =
+            DdpSender::new(create_ddp_sender("127.0.0.1", port, led_count, false).unwrap());
+        let frame = vec![0x40u8; led_count * 3];
+        group.throughput(Throughput::Bytes(frame.len() as u64));
+        group.bench_with_input(
+            BenchmarkId::from_parameter(led_count),
+            &frame,
+            |b, frame| b.iter(|| sender.send(0, black_box(frame)).unwrap()),
+        );
+    }
+    group.finish();
+}
+
+/// ESP32 vizualizér: OSC (`/midi` po jedné zprávě, `/leds` blob) proti
+/// binárnímu linku z hal-esp32 (dávka not, snímek v řezech pod MTU). Bajty na
+/// vzduchu porovnává test v osc_output.rs, viz benches/README.md.
+fn bench_visualizer_link(c: &mut Criterion) {
+    let mut group = c.benchmark_group("visualizer_link");
+    let notes: Vec<MidiEvent> = (0..8)
+        .map(|i| MidiEvent::note_on(0, 60 + i, 100, 0))
+        .collect();
+    let mut buf = Vec::with_capacity(link::MAX_DATAGRAM);
+    group.throughput(Throughput::Elements(notes.len() as u64));
+    group.bench_function(BenchmarkId::new("osc_notes", notes.len()), |b| {
+        b.iter(|| {
+            notes
+                .iter()
+                .map(|event| OscSender::encode_event(black_box(event)).len())
+                .sum::<usize>()
+        })
+    });
+    group.bench_function(BenchmarkId::new("link_notes", notes.len()), |b| {
+        b.iter(|| {
+            link::begin(&mut buf, 0, 0);
+            link::push_events(&mut buf, black_box(&notes))
+        })
+    });
+
+    // Celá cesta na lokální port bez posluchače, každý snímek jiný.
+    let receiver = std::net::UdpSocket::bind("127.0.0.1:0").unwrap();
+    let address = receiver.local_addr().unwrap().to_string();
+    for led_count in [300usize, 1000] {
+        let mut frame = vec![0x40u8; led_count * 3];
+        group.throughput(Throughput::Bytes(frame.len() as u64));
+        group.bench_function(BenchmarkId::new("osc_frame", led_count), |b| {
+            b.iter(|| OscPixelSender::encode_pixels(black_box(&frame), &mut buf))
+        });
+        group.bench_function(BenchmarkId::new("link_frame", led_count), |b| {
+            b.iter(|| {
+                for (i, slice) in frame.chunks(link::MAX_SLICE_PIXELS * 3).enumerate() {
+                    link::begin(&mut buf, i as u16, 0);
+                    link::push_frame(
+                        &mut buf,
+                        i * link::MAX_SLICE_PIXELS,
+                        black_box(slice),
+                        false,
+                    );
+                }
+            })
+        });
+        let mut sender = Esp32Sender::open(&address, 0).unwrap();
+        let mut n = 0u8;
+        group.bench_function(BenchmarkId::new("link_send", led_count), |b| {
+            b.iter(|| {
+                n = n.wrapping_add(1);
+                frame.fill(n);
+                sender.send(0, black_box(&frame)).unwrap()
+            })
+        });
+    }
+    group.finish();
+}
+
+/// Barevná korekce segmentu (gamma, vyvážení bílé, pořadí kanálů) přes LUT,
+/// s extrakcí bílé pro RGBW i bez ní.
+fn bench_color_pipeline(c: &mut Criterion) {
+    let mut group = c.benchmark_group("color_pipeline");
+    for pixels in [100usize, 1000] {
+        let input: Vec<u8> = (0..pixels * 3).map(|i| (i * 7) as u8).collect();
+        let mut out = Vec::with_capacity(pixels * 4);
+        group.throughput(Throughput::Elements(pixels as u64));
+        for (name, rgbw) in [("rgb", false), ("rgbw", true)] {
+            let pipeline = ColorPipeline::new(
+                ColorOrder::Grb,
+                &ColorCorrection {
+                    gamma: 2.2,
+                    white_balance: [1.0, 0.9, 0.8],
+                    rgbw,
+                },
+            );
+            group.bench_with_input(BenchmarkId::new(name, pixels), &input, |b, input| {
+                b.iter(|| pipeline.process(black_box(input), pixels, &mut out))
+            });
+        }
+    }
+    group.finish();
+}
+
+/// Rozdělení plátna na 16 DDP cílů (lokální porty); měří se jen cesta
+/// volajícího, odesílání běží ve vláknech segmentů.
+fn bench_router(c: &mut Criterion) {
+    const PIXELS: usize = 64;
+    let receivers: Vec<std::net::UdpSocket> = (0..16)
+        .map(|_| std::net::UdpSocket::bind("127.0.0.1:0").unwrap())
+        .collect();
+    let segments: Vec<OutputSegment> = receivers
+        .iter()
+        .enumerate()
+        .map(|(i, socket)| OutputSegment {
+            target: OutputTarget::Ddp {
+                ip: "127.0.0.1".into(),
+                port: Some(socket.local_addr().unwrap().port()),
+            },
+            offset: i * PIXELS,
+            length: PIXELS,
+            color_order: ColorOrder::Grb,
+            color: ColorCorrection::default(),
+            fps: None,
+        })
+        .collect();
+    let mut router = OutputRouter::open(&segments).unwrap();
+    let canvas = vec![0x40u8; segments.len() * PIXELS * 3];
+    let mut group = c.benchmark_group("output_router");
+    group.throughput(Throughput::Bytes(canvas.len() as u64));
+    group.bench_function(BenchmarkId::new("route", segments.len()), |b| {
+        b.iter(|| router.route(0, black_box(&canvas)))
+    });
+    group.finish();
+}
+
+/// Výstup, který snímky jen zahodí; měří se samotné přehrávání.
+struct NullSender;
+
+impl DataStreamNetSender for NullSender {
+    fn init(&mut self) -> Result<(), StreamError> {
+        Ok(())
+    }
+    fn send(&mut self, _ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+        black_box(payload);
+        Ok(())
+    }
+}
+
+/// Záznam a přehrávání show: 60 s při 60 fps, 300 LED a 20 MIDI událostí/s.
+/// `replay` posílá všechny snímky bez čekání (60 s show / čas = násobek
+/// reálného času), `seek` hledá snímek v náhodném čase.
+fn bench_show(c: &mut Criterion) {
+    const FRAME_US: u64 = 16_667;
+    let path = std::env::temp_dir().join(format!("bench_show_{}.rmshow", std::process::id()));
+    let frame = vec![0x40u8; 300 * 3];
+    let mut recorder = ShowRecorder::create(&path, RecorderConfig::default()).unwrap();
+    for i in 0..3_600u64 {
+        if i % 3 == 0 {
+            recorder.record_midi(&MidiEvent::note_on(0, 60, 100, i * FRAME_US));
+        }
+        recorder.record_frame(i * FRAME_US, &frame);
+    }
+    recorder.finish().unwrap();
+    let player = ShowPlayer::open(&path).unwrap();
+
+    let mut group = c.benchmark_group("show");
+    let mut recorder =
+        ShowRecorder::create(&path.with_extension("tmp"), RecorderConfig::default()).unwrap();
+    let mut time_us = 0;
+    group.bench_function(BenchmarkId::new("record_frame", 300), |b| {
+        b.iter(|| {
+            time_us += FRAME_US;
+            recorder.record_frame(time_us, black_box(&frame))
+        })
+    });
+    group.throughput(Throughput::Elements(3_600));
+    group.bench_function(BenchmarkId::new("replay", "60s"), |b| {
+        b.iter(|| player.play_frames(0, 0.0, &mut NullSender).unwrap())
+    });
+    group.throughput(Throughput::Elements(1));
+    let mut out = Vec::with_capacity(frame.len());
+    let mut t = 0u64;
+    group.bench_function(BenchmarkId::new("seek", 3_600), |b| {
+        b.iter(|| {
+            t = (t + 7_777_777) % (3_600 * FRAME_US);
+            player.frame_at(black_box(t), &mut out)
+        })
+    });
+    group.finish();
+    drop(recorder);
+    let _ = std::fs::remove_file(path.with_extension("tmp"));
+    let _ = std::fs::remove_file(&path);
+}
+
+criterion_group!(
+    benches,
+    bench_map_leds,
+    bench_note_renderer,
+    bench_osc_encode,
+    bench_ddp_send,
+    bench_visualizer_link,
+    bench_color_pipeline,
+    bench_router,
+    bench_show
+);
+criterion_main!(benches);
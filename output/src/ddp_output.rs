@@ -1,6 +1,7 @@
 #![deny(warnings)]
 use anyhow::Result;
 use ddp_rs::connection::DDPConnection;
+use ddp_rs::protocol::{DataType, PixelConfig, PixelFormat};
 use rtp_midi_core::{DataStreamNetReceiver, DataStreamNetSender, StreamError};
 
 /// Wrapper pro DDP odesílač implementující sjednocené API.
@@ -40,13 +41,28 @@ pub fn send_ddp_frame(sender: &mut DDPConnection, data: &[u8]) -> Result<()> {
     Ok(())
 }
 
+/// Pixel format announced in the DDP header. WLED reads data type 0x1B
+/// (RGBW, 8 bits per channel) as four channels per LED, anything else as RGB.
+pub fn pixel_config(rgbw: bool) -> PixelConfig {
+    if rgbw {
+        PixelConfig {
+            data_type: DataType::RGBW,
+            data_size: PixelFormat::Pixel8Bits,
+            ..PixelConfig::default()
+        }
+    } else {
+        PixelConfig::default()
+    }
+}
+
+/// Opens a DDP connection; `rgbw` frames carry four bytes per LED.
 pub fn create_ddp_sender(
     ip: &str,
     port: u16,
     _led_count: usize,
-    _rgbw: bool,
+    rgbw: bool,
 ) -> Result<DDPConnection> {
-    let pixel_config = ddp_rs::protocol::PixelConfig::default(); // Always RGB
+    let pixel_config = pixel_config(rgbw);
     let addr = format!("{ip}:{port}");
     let socket = std::net::UdpSocket::bind("0.0.0.0:0")?;
     let sender =
@@ -125,6 +141,15 @@ mod ddp_tests {
         assert!(result.is_ok());
     }
 
+    #[test]
+    fn rgbw_segments_announce_rgbw_pixels() {
+        assert_eq!(pixel_config(false), PixelConfig::default());
+        let rgbw = pixel_config(true);
+        assert_eq!(rgbw.data_type, DataType::RGBW);
+        assert_eq!(rgbw.data_size, PixelFormat::Pixel8Bits);
+        assert!(create_ddp_sender("127.0.0.1", 4048, 10, true).is_ok());
+    }
+
     #[test]
     fn test_create_ddp_sender_invalid_addr() {
         // This test might fail if the address is somehow resolvable or if DDPConnection handles it gracefully
@@ -0,0 +1,526 @@
+//! Frame-clocked LED output.
+//!
+//! LED frames are produced at a fixed rate on their own thread instead of
+//! whenever an audio buffer happens to arrive. Each tick renders from the
+//! latest state (`LiveState`: last audio analysis plus held MIDI notes),
+//! skips frames identical to the last one sent (but resends it every
+//! `keepalive`, so the receiver does not time out to its own effect), and
+//! hands the frame to a sender thread through a single-slot mailbox. When
+//! the target is slower than the frame rate, the newest frame replaces the
+//! one still waiting, so output never queues up behind the strip.
+//!
+//! Ticks follow absolute deadlines (start + n × interval): a late tick does
+//! not shift the following ones, and ticks missed entirely are skipped.
+//! Deadlines and frame times come from the scheduler's `Clock`, so on a
+//! `VirtualClock` the clock thread ticks in lockstep with the test.
+
+use crate::light_mapper::{map_leds_into, MappingPreset};
+use crate::note_renderer::{NoteRenderer, NoteRendererConfig};
+use log::{error, info};
+use rtp_midi_core::clock::{system_clock, Clock, ClockAttachment, SharedClock};
+use rtp_midi_core::trace::{self, Stage};
+use rtp_midi_core::{DataStreamNetSender, MidiEvent};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+/// Highest supported frame rate.
+pub const MAX_FPS: u32 = 1000;
+
+/// Configuration of a `FrameScheduler`.
+#[derive(Debug, Clone, Copy)]
+pub struct FrameSchedulerConfig {
+    /// Output frame rate; clamped to 1..=`MAX_FPS`.
+    pub fps: u32,
+    /// Longest time an unchanged frame is not resent.
+    pub keepalive: Duration,
+}
+
+impl Default for FrameSchedulerConfig {
+    fn default() -> Self {
+        Self {
+            fps: 60,
+            keepalive: Duration::from_secs(1),
+        }
+    }
+}
+
+impl FrameSchedulerConfig {
+    pub fn interval(&self) -> Duration {
+        Duration::from_secs(1) / self.fps.clamp(1, MAX_FPS)
+    }
+}
+
+/// Counters and timing of the frame clock.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FrameStats {
+    pub ticks: u64,
+    /// Frames handed to the target.
+    pub sent: u64,
+    /// Unchanged frames that were not resent.
+    pub unchanged: u64,
+    /// Unchanged frames resent because `keepalive` elapsed.
+    pub keepalives: u64,
+    /// Frames replaced in the mailbox before the target took them.
+    pub dropped: u64,
+    /// Ticks skipped because the clock thread fell a full interval behind.
+    pub missed_ticks: u64,
+    pub send_errors: u64,
+    /// Largest deviation of a tick from its deadline (µs).
+    pub jitter_max_us: u64,
+    jitter_sum_us: u64,
+    render_sum_us: u64,
+    interval_us: u64,
+}
+
+impl FrameStats {
+    /// Mean deviation of ticks from their deadlines (µs).
+    pub fn jitter_mean_us(&self) -> f64 {
+        self.jitter_sum_us as f64 / self.ticks.max(1) as f64
+    }
+
+    /// Mean render time per tick (µs).
+    pub fn render_mean_us(&self) -> f64 {
+        self.render_sum_us as f64 / self.ticks.max(1) as f64
+    }
+
+    /// Share of the frame interval spent rendering (0.0..=1.0 and above when
+    /// rendering cannot keep up).
+    pub fn cpu_load(&self) -> f64 {
+        self.render_mean_us() / self.interval_us.max(1) as f64
+    }
+}
+
+/// Latest audio analysis and MIDI note state the frames are rendered from.
+///
+/// Writers (audio and MIDI processing) only replace values; the frame clock
+/// reads whatever is current at each tick.
+pub struct LiveState {
+    led_count: usize,
+    preset: MappingPreset,
+    magnitudes: Mutex<Vec<f32>>,
+    notes: Mutex<NoteRenderer>,
+    midi_delay_us: AtomicU64,
+}
+
+impl LiveState {
+    pub fn new(led_count: usize, preset: MappingPreset, notes: NoteRendererConfig) -> Self {
+        Self {
+            led_count,
+            preset,
+            magnitudes: Mutex::new(Vec::new()),
+            notes: Mutex::new(NoteRenderer::new(NoteRendererConfig { led_count, ..notes })),
+            midi_delay_us: AtomicU64::new(0),
+        }
+    }
+
+    /// Replaces the audio analysis (FFT magnitudes).
+    pub fn set_magnitudes(&self, magnitudes: &[f32]) {
+        let mut current = self.magnitudes.lock().unwrap();
+        current.clear();
+        current.extend_from_slice(magnitudes);
+    }
+
+    /// Feeds a MIDI event to the note renderer.
+    pub fn handle_midi(&self, event: &MidiEvent) {
+        self.notes.lock().unwrap().handle(event);
+    }
+
+    /// Holds MIDI-driven output back by `delay_us` so it lines up with the
+    /// slower audio path (see `rtp_midi_core::av_sync`).
+    pub fn set_midi_delay_us(&self, delay_us: u64) {
+        self.midi_delay_us.store(delay_us, Ordering::Relaxed);
+    }
+
+    /// Renders the audio preset and composites the notes sounding at
+    /// `now_us` minus the MIDI delay on top of it; reuses `frame` without
+    /// allocating.
+    pub fn render(&self, now_us: u64, frame: &mut Vec<u8>) {
+        {
+            let magnitudes = self.magnitudes.lock().unwrap();
+            map_leds_into(&magnitudes, self.led_count, self.preset, frame);
+        }
+        let notes_us = now_us.saturating_sub(self.midi_delay_us.load(Ordering::Relaxed));
+        self.notes.lock().unwrap().render(notes_us, frame);
+    }
+}
+
+#[derive(Default)]
+struct MailboxSlot {
+    frame: Vec<u8>,
+    ts: u64,
+    full: bool,
+    closed: bool,
+}
+
+/// Single-slot, latest-frame-wins handoff between the frame clock and the
+/// sender thread. Buffers are swapped, not copied or reallocated.
+#[derive(Default)]
+pub struct FrameMailbox {
+    slot: Mutex<MailboxSlot>,
+    ready: Condvar,
+}
+
+impl FrameMailbox {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Publishes `frame` (swapped with a spare buffer, left in `frame`);
+    /// returns true when it replaced a frame nobody had taken yet.
+    pub fn publish(&self, frame: &mut Vec<u8>, ts: u64) -> bool {
+        let mut slot = self.slot.lock().unwrap();
+        let replaced = slot.full;
+        std::mem::swap(&mut slot.frame, frame);
+        slot.ts = ts;
+        slot.full = true;
+        drop(slot);
+        self.ready.notify_one();
+        replaced
+    }
+
+    /// Waits for a frame and swaps it into `frame`; returns its timestamp, or
+    /// `None` once the mailbox is closed.
+    pub fn take(&self, frame: &mut Vec<u8>) -> Option<u64> {
+        let mut slot = self.slot.lock().unwrap();
+        while !slot.full && !slot.closed {
+            slot = self.ready.wait(slot).unwrap();
+        }
+        if !slot.full {
+            return None;
+        }
+        slot.full = false;
+        std::mem::swap(&mut slot.frame, frame);
+        Some(slot.ts)
+    }
+
+    /// Like `take`, but returns `None` right away when no frame is waiting.
+    pub fn try_take(&self, frame: &mut Vec<u8>) -> Option<u64> {
+        let mut slot = self.slot.lock().unwrap();
+        if !slot.full {
+            return None;
+        }
+        slot.full = false;
+        std::mem::swap(&mut slot.frame, frame);
+        Some(slot.ts)
+    }
+
+    pub fn close(&self) {
+        self.slot.lock().unwrap().closed = true;
+        self.ready.notify_all();
+    }
+}
+
+/// Renders frames at a fixed rate and sends them from a separate thread.
+pub struct FrameScheduler {
+    clock: SharedClock,
+    running: Arc<AtomicBool>,
+    stats: Arc<Mutex<FrameStats>>,
+    threads: Vec<JoinHandle<()>>,
+}
+
+impl FrameScheduler {
+    /// Starts the frame clock. `render` fills the frame buffer for the
+    /// given monotonic time (µs); `sender` receives the frames to send.
+    pub fn spawn<R, S>(config: FrameSchedulerConfig, render: R, sender: S) -> Self
+    where
+        R: FnMut(u64, &mut Vec<u8>) + Send + 'static,
+        S: DataStreamNetSender + Send + 'static,
+    {
+        Self::spawn_with_clock(config, system_clock(), render, sender)
+    }
+
+    /// Like `spawn`, with ticks and frame times taken from `clock`.
+    pub fn spawn_with_clock<R, S>(
+        config: FrameSchedulerConfig,
+        clock: SharedClock,
+        render: R,
+        sender: S,
+    ) -> Self
+    where
+        R: FnMut(u64, &mut Vec<u8>) + Send + 'static,
+        S: DataStreamNetSender + Send + 'static,
+    {
+        let running = Arc::new(AtomicBool::new(true));
+        let mailbox = Arc::new(FrameMailbox::new());
+        let stats = Arc::new(Mutex::new(FrameStats {
+            interval_us: config.interval().as_micros() as u64,
+            ..Default::default()
+        }));
+
+        let clock_thread = {
+            let (running, mailbox, stats) = (running.clone(), mailbox.clone(), stats.clone());
+            let attachment = ClockAttachment::new(&clock);
+            let clock = clock.clone();
+            thread::Builder::new()
+                .name("led-frame-clock".into())
+                .spawn(move || {
+                    let _attachment = attachment;
+                    run_clock(config, &*clock, render, &running, &mailbox, &stats)
+                })
+                .expect("failed to spawn LED frame clock")
+        };
+        let send = {
+            let (mailbox, stats) = (mailbox.clone(), stats.clone());
+            thread::Builder::new()
+                .name("led-frame-send".into())
+                .spawn(move || run_sender(sender, &mailbox, &stats))
+                .expect("failed to spawn LED frame sender")
+        };
+        info!(
+            "LED frame clock started at {} fps",
+            config.fps.clamp(1, MAX_FPS)
+        );
+
+        Self {
+            clock,
+            running,
+            stats,
+            threads: vec![clock_thread, send],
+        }
+    }
+
+    pub fn stats(&self) -> FrameStats {
+        *self.stats.lock().unwrap()
+    }
+
+    /// Stops both threads; a frame already in the mailbox is still sent.
+    pub fn stop(&mut self) {
+        self.running.store(false, Ordering::Relaxed);
+        // A clock thread asleep on a virtual clock would wait forever.
+        self.clock.wake();
+        for thread in self.threads.drain(..) {
+            // The clock thread exits first and closes the mailbox.
+            let _ = thread.join();
+        }
+    }
+}
+
+impl Drop for FrameScheduler {
+    fn drop(&mut self) {
+        self.stop();
+    }
+}
+
+fn run_clock<R>(
+    config: FrameSchedulerConfig,
+    clock: &dyn Clock,
+    mut render: R,
+    running: &AtomicBool,
+    mailbox: &FrameMailbox,
+    stats: &Mutex<FrameStats>,
+) where
+    R: FnMut(u64, &mut Vec<u8>),
+{
+    let interval_us = config.interval().as_micros() as u64;
+    let keepalive_us = config.keepalive.as_micros() as u64;
+    let start_us = clock.now_us();
+    let mut tick: u64 = 0;
+    let mut frame = Vec::new();
+    let mut last_sent = Vec::new();
+    let mut last_sent_us: Option<u64> = None;
+
+    while running.load(Ordering::Relaxed) {
+        let deadline_us = start_us + interval_us * tick;
+        clock.sleep_until_us(deadline_us);
+        let now_us = clock.now_us();
+        if now_us < deadline_us {
+            // Woken early (shutdown).
+            continue;
+        }
+        let jitter_us = now_us - deadline_us;
+
+        // Render cost is real CPU time, whatever the clock.
+        let woke = Instant::now();
+        render(now_us, &mut frame);
+        let render_us = woke.elapsed().as_micros() as u64;
+
+        let changed = frame != last_sent;
+        let keepalive_due = last_sent_us.is_none_or(|t| now_us.saturating_sub(t) >= keepalive_us);
+        let mut replaced = false;
+        if changed || keepalive_due {
+            last_sent.clear();
+            last_sent.extend_from_slice(&frame);
+            last_sent_us = Some(now_us);
+            replaced = mailbox.publish(&mut frame, now_us);
+        }
+
+        // Skip deadlines that already passed instead of bursting to catch up.
+        let passed = (clock.now_us() - start_us) / interval_us.max(1);
+        let next = (passed + 1).max(tick + 1);
+
+        let mut s = stats.lock().unwrap();
+        s.ticks += 1;
+        s.jitter_sum_us += jitter_us;
+        s.jitter_max_us = s.jitter_max_us.max(jitter_us);
+        s.render_sum_us += render_us;
+        s.missed_ticks += next - tick - 1;
+        if replaced {
+            s.dropped += 1;
+        }
+        if !changed {
+            if keepalive_due {
+                s.keepalives += 1;
+            } else {
+                s.unchanged += 1;
+            }
+        }
+        drop(s);
+        tick = next;
+    }
+    mailbox.close();
+}
+
+fn run_sender<S: DataStreamNetSender>(
+    mut sender: S,
+    mailbox: &FrameMailbox,
+    stats: &Mutex<FrameStats>,
+) {
+    if let Err(e) = sender.init() {
+        error!("Failed to initialize LED output: {}", e);
+    }
+    let mut frame = Vec::new();
+    while let Some(ts) = mailbox.take(&mut frame) {
+        let result = {
+            let _span = trace::span(Stage::SocketSend, ts);
+            sender.send(ts, &frame)
+        };
+        let mut s = stats.lock().unwrap();
+        match result {
+            Ok(()) => s.sent += 1,
+            Err(e) => {
+                s.send_errors += 1;
+                drop(s);
+                error!("Failed to send LED frame: {}", e);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use rtp_midi_core::clock::VirtualClock;
+    use rtp_midi_core::StreamError;
+
+    struct SlowSender {
+        frames: Arc<Mutex<Vec<Vec<u8>>>>,
+        delay: Duration,
+    }
+
+    impl DataStreamNetSender for SlowSender {
+        fn init(&mut self) -> Result<(), StreamError> {
+            Ok(())
+        }
+        fn send(&mut self, _ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+            thread::sleep(self.delay);
+            self.frames.lock().unwrap().push(payload.to_vec());
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn mailbox_keeps_latest_frame() {
+        let mailbox = FrameMailbox::new();
+        let mut frame = vec![1];
+        assert!(!mailbox.publish(&mut frame, 1));
+        frame = vec![2];
+        assert!(mailbox.publish(&mut frame, 2));
+        let mut out = Vec::new();
+        assert_eq!(mailbox.take(&mut out), Some(2));
+        assert_eq!(out, vec![2]);
+        mailbox.close();
+        assert_eq!(mailbox.take(&mut out), None);
+    }
+
+    #[test]
+    fn unchanged_frames_are_skipped_until_keepalive() {
+        let frames = Arc::new(Mutex::new(Vec::new()));
+        let config = FrameSchedulerConfig {
+            fps: 200,
+            keepalive: Duration::from_millis(40),
+        };
+        let sender = SlowSender {
+            frames: frames.clone(),
+            delay: Duration::ZERO,
+        };
+        // 150 ms on a virtual clock: ticks at 0, 5, …, 150 ms, exactly.
+        let clock = VirtualClock::new(0);
+        let mut scheduler = FrameScheduler::spawn_with_clock(
+            config,
+            clock.shared(),
+            |_, frame| *frame = vec![7; 3],
+            sender,
+        );
+        clock.advance_to(150_000);
+        scheduler.stop();
+
+        let stats = scheduler.stats();
+        assert_eq!(stats.ticks, 31, "{stats:?}");
+        assert_eq!(stats.keepalives, 3, "{stats:?}");
+        assert_eq!(stats.unchanged, 27, "{stats:?}");
+        assert_eq!((stats.missed_ticks, stats.jitter_max_us), (0, 0));
+        assert_eq!(stats.sent, 4);
+        assert_eq!(stats.sent as usize, frames.lock().unwrap().len());
+        assert!(frames.lock().unwrap().iter().all(|f| f == &vec![7; 3]));
+    }
+
+    #[test]
+    fn slow_target_gets_latest_frames_only() {
+        let frames = Arc::new(Mutex::new(Vec::new()));
+        let config = FrameSchedulerConfig {
+            fps: 500,
+            keepalive: Duration::from_secs(1),
+        };
+        let sender = SlowSender {
+            frames: frames.clone(),
+            delay: Duration::from_millis(10),
+        };
+        let mut counter = 0u32;
+        let render = move |_, frame: &mut Vec<u8>| {
+            counter += 1;
+            *frame = counter.to_be_bytes().to_vec();
+        };
+        let mut scheduler = FrameScheduler::spawn(config, render, sender);
+        thread::sleep(Duration::from_millis(100));
+        scheduler.stop();
+
+        let stats = scheduler.stats();
+        assert!(stats.dropped > 0, "{stats:?}");
+        assert!(stats.sent < stats.ticks, "{stats:?}");
+        // Frames reach the target in order, with gaps where they were replaced.
+        let sent: Vec<u32> = frames
+            .lock()
+            .unwrap()
+            .iter()
+            .map(|f| u32::from_be_bytes(f[..4].try_into().unwrap()))
+            .collect();
+        assert!(sent.windows(2).all(|w| w[0] < w[1]), "{sent:?}");
+    }
+
+    #[test]
+    fn live_state_composites_notes_over_audio() {
+        let notes = NoteRendererConfig {
+            attack_us: 0,
+            ..Default::default()
+        };
+        let state = LiveState::new(10, MappingPreset::VuMeter, notes);
+        let mut frame = Vec::new();
+        state.render(0, &mut frame);
+        assert_eq!(frame, vec![10; 30]);
+        state.handle_midi(&MidiEvent::note_on(0, 108, 127, 0));
+        state.render(1, &mut frame);
+        assert_eq!(frame.len(), 30);
+        assert!(frame[27..].iter().any(|&b| b > 10));
+        assert_eq!(&frame[..27], &[10; 27][..]);
+
+        // With a MIDI delay the next note lights up only `delay` later.
+        state.set_midi_delay_us(30_000);
+        state.handle_midi(&MidiEvent::note_on(0, 21, 127, 100_000));
+        state.render(120_000, &mut frame);
+        assert_eq!(&frame[..3], &[10; 3]);
+        state.render(130_000, &mut frame);
+        assert!(frame[..3].iter().any(|&b| b > 10));
+    }
+}
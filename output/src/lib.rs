@@ -13,8 +13,15 @@ mod tests {
     }
 }
 
+pub mod color_pipeline;
 pub mod ddp_output;
+pub mod frame_scheduler;
 pub mod light_mapper;
+pub mod note_renderer;
+pub mod osc_output;
+pub mod router;
+pub mod show;
+pub mod viz_stream;
 pub mod wled_control;
 
 #[cfg(feature = "hal_esp32")]
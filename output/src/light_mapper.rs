@@ -7,21 +7,50 @@ pub enum MappingPreset {
     VuMeter,
 }
 
+impl MappingPreset {
+    /// `"vumeter"` selects the VU meter, anything else the spectrum.
+    pub fn from_name(name: Option<&str>) -> Self {
+        match name {
+            Some("vumeter") => MappingPreset::VuMeter,
+            _ => MappingPreset::Spectrum,
+        }
+    }
+}
+
 /// Main entry: map magnitudes to LED RGB values using the selected preset
 pub fn map_leds_with_preset(
     magnitudes: &[f32],
     led_count: usize,
     preset: MappingPreset,
 ) -> Vec<u8> {
+    let mut leds = Vec::with_capacity(led_count * 3);
+    map_leds_into(magnitudes, led_count, preset, &mut leds);
+    leds
+}
+
+/// Like `map_leds_with_preset`, but fills `leds` (cleared first), so a
+/// reused buffer does not allocate.
+pub fn map_leds_into(
+    magnitudes: &[f32],
+    led_count: usize,
+    preset: MappingPreset,
+    leds: &mut Vec<u8>,
+) {
+    leds.clear();
     match preset {
-        MappingPreset::Spectrum => map_audio_to_leds_spectrum(magnitudes, led_count),
-        MappingPreset::VuMeter => map_audio_to_leds_vumeter(magnitudes, led_count),
+        MappingPreset::Spectrum => spectrum_into(magnitudes, led_count, leds),
+        MappingPreset::VuMeter => vumeter_into(magnitudes, led_count, leds),
     }
 }
 
 /// Spectrum: original hue-based mapping
 pub fn map_audio_to_leds_spectrum(magnitudes: &[f32], led_count: usize) -> Vec<u8> {
     let mut leds = Vec::with_capacity(led_count * 3);
+    spectrum_into(magnitudes, led_count, &mut leds);
+    leds
+}
+
+fn spectrum_into(magnitudes: &[f32], led_count: usize, leds: &mut Vec<u8>) {
     for i in 0..led_count {
         let hue = i as f32 / led_count as f32;
         let magnitude_index = (i as f32 / led_count as f32 * magnitudes.len() as f32) as usize;
@@ -36,18 +65,22 @@ pub fn map_audio_to_leds_spectrum(magnitudes: &[f32], led_count: usize) -> Vec<u
         leds.push(g);
         leds.push(b);
     }
-    leds
 }
 
 /// VuMeter: fill LEDs from start based on average magnitude
 pub fn map_audio_to_leds_vumeter(magnitudes: &[f32], led_count: usize) -> Vec<u8> {
+    let mut leds = Vec::with_capacity(led_count * 3);
+    vumeter_into(magnitudes, led_count, &mut leds);
+    leds
+}
+
+fn vumeter_into(magnitudes: &[f32], led_count: usize, leds: &mut Vec<u8>) {
     let avg = if magnitudes.is_empty() {
         0.0
     } else {
         magnitudes.iter().copied().sum::<f32>() / magnitudes.len() as f32
     };
     let lit_leds = min(led_count, (avg * led_count as f32).round() as usize);
-    let mut leds = Vec::with_capacity(led_count * 3);
     for i in 0..led_count {
         if i < lit_leds {
             leds.push(0);
@@ -59,11 +92,10 @@ pub fn map_audio_to_leds_vumeter(magnitudes: &[f32], led_count: usize) -> Vec<u8
             leds.push(10); // Dim for inactive
         }
     }
-    leds
 }
 
 // Temporary placeholder for color conversion, ideally in a separate util module
-fn hsv_to_rgb(h: f32, s: f32, v: f32) -> (u8, u8, u8) {
+pub(crate) fn hsv_to_rgb(h: f32, s: f32, v: f32) -> (u8, u8, u8) {
     let i = (h * 6.0) as u32;
     let f = h * 6.0 - i as f32;
     let p = v * (1.0 - s);
@@ -0,0 +1,276 @@
+//! Hub-side MIDI note renderer for LED strips (WLED over DDP).
+//!
+//! Keeps per-key voice state and per-channel controller state (sustain
+//! pedal) and draws every sounding note onto its section of the strip:
+//! the keyboard range (`key_low..=key_high`) is spread over the LEDs, the
+//! colour follows the pitch class, brightness follows velocity and an
+//! attack/release envelope. Notes are added (saturating) on top of whatever
+//! is already in the frame, typically the audio-mapped pixels.
+//!
+//! Handling events and rendering never allocate; all state is fixed-size.
+
+use crate::light_mapper::hsv_to_rgb;
+use rtp_midi_core::MidiEvent;
+
+const KEYS: usize = 128;
+const CHANNELS: usize = 16;
+const CC_SUSTAIN: u8 = 64;
+const CC_ALL_SOUND_OFF: u8 = 120;
+const CC_ALL_NOTES_OFF: u8 = 123;
+
+/// Configuration of a `NoteRenderer`.
+#[derive(Debug, Clone, Copy)]
+pub struct NoteRendererConfig {
+    pub led_count: usize,
+    /// Lowest and highest key mapped onto the strip (piano: 21..=108).
+    pub key_low: u8,
+    pub key_high: u8,
+    /// Fade-in after Note On (µs).
+    pub attack_us: u64,
+    /// Fade-out after Note Off / pedal release (µs).
+    pub release_us: u64,
+}
+
+impl Default for NoteRendererConfig {
+    fn default() -> Self {
+        Self {
+            led_count: 60,
+            key_low: 21,
+            key_high: 108,
+            attack_us: 5_000,
+            release_us: 400_000,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+struct Voice {
+    velocity: u8,
+    channel: u8,
+    on_us: u64,
+    // Set while the key is up but the sustain pedal holds the note.
+    held: bool,
+    // Start of the release; `None` while the note sounds.
+    released_us: Option<u64>,
+}
+
+/// Per-key note state rendered into RGB frames.
+pub struct NoteRenderer {
+    config: NoteRendererConfig,
+    voices: [Voice; KEYS],
+    sustain: [bool; CHANNELS],
+    // Colour per pitch class at full brightness.
+    palette: [[u8; 3]; 12],
+    // First LED of every key in range plus the end of the last one.
+    key_leds: [u16; KEYS + 1],
+}
+
+impl NoteRenderer {
+    pub fn new(config: NoteRendererConfig) -> Self {
+        let mut palette = [[0u8; 3]; 12];
+        for (pitch_class, rgb) in palette.iter_mut().enumerate() {
+            let (r, g, b) = hsv_to_rgb(pitch_class as f32 / 12.0, 1.0, 1.0);
+            *rgb = [r, g, b];
+        }
+        let mut renderer = Self {
+            config,
+            voices: [Voice::default(); KEYS],
+            sustain: [false; CHANNELS],
+            palette,
+            key_leds: [0; KEYS + 1],
+        };
+        renderer.set_led_count(config.led_count);
+        renderer
+    }
+
+    pub fn config(&self) -> &NoteRendererConfig {
+        &self.config
+    }
+
+    /// Re-maps the key range onto a strip of `led_count` LEDs. Every key
+    /// gets at least one LED; on short strips neighbouring keys share one.
+    pub fn set_led_count(&mut self, led_count: usize) {
+        self.config.led_count = led_count.min(u16::MAX as usize);
+        let low = self.config.key_low.min(self.config.key_high) as usize;
+        let span = self.config.key_high.max(self.config.key_low) as usize - low + 1;
+        let leds = self.config.led_count;
+        for key in 0..=KEYS {
+            let index = key.clamp(low, low + span) - low;
+            self.key_leds[key] = (index * leds / span) as u16;
+        }
+    }
+
+    /// Applies a MIDI event; `event.time_us` starts attack and release.
+    pub fn handle(&mut self, event: &MidiEvent) {
+        let channel = event.channel() as usize;
+        if event.is_note_on() {
+            self.voices[event.data1() as usize & 0x7F] = Voice {
+                velocity: event.data2(),
+                channel: channel as u8,
+                on_us: event.time_us,
+                held: false,
+                released_us: None,
+            };
+        } else if event.is_note_off() {
+            let sustain = self.sustain[channel];
+            let voice = &mut self.voices[event.data1() as usize & 0x7F];
+            if voice.velocity > 0
+                && voice.released_us.is_none()
+                && voice.channel as usize == channel
+            {
+                if sustain {
+                    voice.held = true;
+                } else {
+                    voice.released_us = Some(event.time_us);
+                }
+            }
+        } else if event.kind() == 0xB0 {
+            match event.data1() {
+                CC_SUSTAIN => {
+                    let on = event.data2() >= 64;
+                    self.sustain[channel] = on;
+                    if !on {
+                        self.release_channel(channel, event.time_us, |v| v.held);
+                    }
+                }
+                CC_ALL_SOUND_OFF | CC_ALL_NOTES_OFF => {
+                    self.release_channel(channel, event.time_us, |_| true);
+                }
+                _ => {}
+            }
+        }
+    }
+
+    fn release_channel(&mut self, channel: usize, time_us: u64, which: impl Fn(&Voice) -> bool) {
+        for voice in &mut self.voices {
+            if voice.velocity > 0
+                && voice.channel as usize == channel
+                && voice.released_us.is_none()
+                && which(voice)
+            {
+                voice.held = false;
+                voice.released_us = Some(time_us);
+            }
+        }
+    }
+
+    /// Number of voices still lit (sounding, held or releasing).
+    pub fn active_voices(&self) -> usize {
+        self.voices.iter().filter(|v| v.velocity > 0).count()
+    }
+
+    // Brightness of a voice at `now_us` (0..=255), retiring finished releases.
+    // Notes starting after `now_us` (delayed rendering) are not lit yet.
+    fn level(config: &NoteRendererConfig, voice: &mut Voice, now_us: u64) -> u32 {
+        if now_us < voice.on_us {
+            return 0;
+        }
+        let peak = voice.velocity as u32 * 2 + 1;
+        let since_on = now_us.saturating_sub(voice.on_us);
+        let attack = if since_on < config.attack_us {
+            (peak as u64 * since_on / config.attack_us) as u32
+        } else {
+            peak
+        };
+        match voice.released_us {
+            None => attack,
+            Some(released) => {
+                let since = now_us.saturating_sub(released);
+                if since >= config.release_us {
+                    *voice = Voice::default();
+                    0
+                } else {
+                    (attack as u64 * (config.release_us - since) / config.release_us) as u32
+                }
+            }
+        }
+    }
+
+    /// Adds all lit notes at `now_us` onto `frame` (RGB, `led_count` × 3
+    /// bytes); LEDs beyond the frame are ignored.
+    pub fn render(&mut self, now_us: u64, frame: &mut [u8]) {
+        let low = self.config.key_low.min(self.config.key_high);
+        let high = self.config.key_high.max(self.config.key_low);
+        for key in low..=high.min(127) {
+            let voice = &mut self.voices[key as usize];
+            if voice.velocity == 0 {
+                continue;
+            }
+            let level = Self::level(&self.config, voice, now_us);
+            if level == 0 {
+                continue;
+            }
+            let color = self.palette[key as usize % 12];
+            let pixel = color.map(|c| (c as u32 * level / 255) as u8);
+            let start = self.key_leds[key as usize] as usize;
+            let end = (self.key_leds[key as usize + 1] as usize).max(start + 1);
+            let end = end.min(frame.len() / 3);
+            for led in frame[start.min(end) * 3..end * 3].chunks_exact_mut(3) {
+                for (out, add) in led.iter_mut().zip(pixel) {
+                    *out = out.saturating_add(add);
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn renderer(led_count: usize) -> NoteRenderer {
+        NoteRenderer::new(NoteRendererConfig {
+            led_count,
+            attack_us: 0,
+            release_us: 1_000,
+            ..Default::default()
+        })
+    }
+
+    #[test]
+    fn note_lights_its_section_and_releases() {
+        let mut notes = renderer(88);
+        let mut frame = vec![0u8; 88 * 3];
+        notes.handle(&MidiEvent::note_on(0, 21, 127, 0));
+        notes.render(10, &mut frame);
+        // Lowest key, pitch class A (9) at full velocity.
+        assert_eq!(&frame[..3], &notes.palette[9]);
+        assert!(frame[3..].iter().all(|&b| b == 0));
+
+        notes.handle(&MidiEvent::note_off(0, 21, 0, 100));
+        frame.fill(0);
+        notes.render(600, &mut frame);
+        assert!(frame[..3].iter().any(|&b| b > 0 && b < 255));
+        notes.render(1_200, &mut frame);
+        assert_eq!(notes.active_voices(), 0);
+    }
+
+    #[test]
+    fn sustain_pedal_holds_notes() {
+        let mut notes = renderer(88);
+        notes.handle(&MidiEvent::control_change(1, CC_SUSTAIN, 127, 0));
+        notes.handle(&MidiEvent::note_on(1, 60, 100, 0));
+        notes.handle(&MidiEvent::note_off(1, 60, 0, 10));
+        let mut frame = vec![0u8; 88 * 3];
+        notes.render(5_000, &mut frame);
+        assert_eq!(notes.active_voices(), 1);
+        notes.handle(&MidiEvent::control_change(1, CC_SUSTAIN, 0, 5_000));
+        notes.render(7_000, &mut frame);
+        assert_eq!(notes.active_voices(), 0);
+    }
+
+    #[test]
+    fn glissando_adds_onto_audio_frame() {
+        let mut notes = renderer(1_000);
+        for (i, key) in (21..=108).enumerate() {
+            notes.handle(&MidiEvent::note_on(0, key, 127, i as u64));
+        }
+        let mut frame = vec![10u8; 1_000 * 3];
+        let capacity = frame.capacity();
+        notes.render(1_000, &mut frame);
+        assert_eq!(notes.active_voices(), 88);
+        assert_eq!(frame.capacity(), capacity);
+        // Every LED belongs to some key; none stays at the audio level.
+        assert!(frame.chunks(3).all(|led| led.iter().any(|&b| b > 10)));
+    }
+}
@@ -1,6 +1,6 @@
 use rosc::{OscPacket, OscMessage, OscType};
 use std::net::UdpSocket;
-use rtp_midi_core::{DataStreamNetSender, StreamError};
+use rtp_midi_core::{DataStreamNetSender, MidiEvent, StreamError};
 use log::{error, info};
 
 pub struct OscSender {
@@ -18,6 +18,18 @@ impl OscSender {
         })
     }
 
+    /// Second sender on the same socket.
+    pub fn try_clone(&self) -> Result<Self, std::io::Error> {
+        Ok(Self {
+            socket: self.socket.try_clone()?,
+            target_addr: self.target_addr.clone(),
+        })
+    }
+
+    pub fn target_addr(&self) -> &str {
+        &self.target_addr
+    }
+
     pub fn send_note_on(&self, note: i32, velocity: i32) {
         let msg = OscMessage {
             addr: "/noteOn".to_string(),
@@ -58,9 +70,36 @@ impl OscSender {
         self.send(msg);
     }
 
+    /// Encodes a packed event as `/midi ,i <word>` without allocating.
+    ///
+    /// The firmware decodes the UMP word directly (see `midi_event.h`).
+    pub fn encode_event(event: &MidiEvent) -> [u8; 16] {
+        let mut buf = [0u8; 16];
+        buf[..5].copy_from_slice(b"/midi");
+        buf[8..10].copy_from_slice(b",i");
+        buf[12..].copy_from_slice(&event.word.to_be_bytes());
+        buf
+    }
+
+    /// Sends a packed event as `/midi`; SysEx events are skipped, their
+    /// word only points into the hub's arena.
+    pub fn send_event(&self, event: &MidiEvent) {
+        if event.is_sysex() {
+            return;
+        }
+        let buf = Self::encode_event(event);
+        if let Err(e) = self.socket.send_to(&buf, &self.target_addr) {
+            log::error!("OSC send error: {}", e);
+        }
+    }
+
+    /// Encodes a message into an OSC datagram.
+    pub fn encode(msg: OscMessage) -> Result<Vec<u8>, rosc::OscError> {
+        rosc::encoder::encode(&OscPacket::Message(msg))
+    }
+
     fn send(&self, msg: OscMessage) {
-        let packet = OscPacket::Message(msg);
-        match rosc::encoder::encode(&packet) {
+        match Self::encode(msg) {
             Ok(buf) => {
                 if let Err(e) = self.socket.send_to(&buf, &self.target_addr) {
                     log::error!("OSC send error: {}", e);
@@ -73,6 +112,47 @@ impl OscSender {
     }
 }
 
+/// Sends LED pixels as OSC `/leds ,b <rgb bytes>` datagrams.
+pub struct OscPixelSender {
+    sender: OscSender,
+    buf: Vec<u8>,
+}
+
+impl OscPixelSender {
+    pub fn new(target_addr: &str) -> Result<Self, std::io::Error> {
+        Ok(Self {
+            sender: OscSender::new(target_addr)?,
+            buf: Vec::new(),
+        })
+    }
+
+    /// Sender of `/midi` events to the same board, for another thread.
+    pub fn event_sender(&self) -> Result<OscSender, std::io::Error> {
+        self.sender.try_clone()
+    }
+
+    /// Encodes `pixels` as a `/leds` blob message into `buf` (cleared first).
+    pub fn encode_pixels(pixels: &[u8], buf: &mut Vec<u8>) {
+        buf.clear();
+        buf.extend_from_slice(b"/leds\0\0\0,b\0\0");
+        buf.extend_from_slice(&(pixels.len() as i32).to_be_bytes());
+        buf.extend_from_slice(pixels);
+        buf.resize(buf.len().next_multiple_of(4), 0);
+    }
+}
+
+impl DataStreamNetSender for OscPixelSender {
+    fn init(&mut self) -> Result<(), StreamError> {
+        self.sender.init()
+    }
+
+    fn send(&mut self, ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+        Self::encode_pixels(payload, &mut self.buf);
+        // The inherent `OscSender::send` takes an `OscMessage`.
+        DataStreamNetSender::send(&mut self.sender, ts, &self.buf)
+    }
+}
+
 impl DataStreamNetSender for OscSender {
     fn init(&mut self) -> Result<(), StreamError> {
         info!("OSC Sender initialized for target: {}", self.target_addr);
@@ -83,7 +163,7 @@ impl DataStreamNetSender for OscSender {
         // For OSC, we expect the payload to be a pre-formatted OSC message
         if let Err(e) = self.socket.send_to(payload, &self.target_addr) {
             error!("OSC send error: {}", e);
-            return Err(StreamError::NetworkError(e.to_string()));
+            return Err(StreamError::Network(e.to_string()));
         }
         Ok(())
     }
@@ -102,7 +182,7 @@ mod tests {
         };
         let packet = OscPacket::Message(msg);
         let buf = rosc::encoder::encode(&packet).unwrap();
-        let (decoded, _) = decoder::decode_udp(&buf).unwrap();
+        let (_, decoded) = decoder::decode_udp(&buf).unwrap();
         match decoded {
             OscPacket::Message(m) => {
                 assert_eq!(m.addr, "/noteOn");
@@ -111,4 +191,76 @@ mod tests {
             _ => panic!("Decoded packet is not a message"),
         }
     }
-} 
\ No newline at end of file
+
+    #[test]
+    fn test_pixel_blob_encoding() {
+        let mut buf = Vec::new();
+        OscPixelSender::encode_pixels(&[1, 2, 3, 4, 5, 6], &mut buf);
+        assert_eq!(buf.len() % 4, 0);
+        let (_, decoded) = decoder::decode_udp(&buf).unwrap();
+        match decoded {
+            OscPacket::Message(m) => {
+                assert_eq!(m.addr, "/leds");
+                assert_eq!(m.args, vec![OscType::Blob(vec![1, 2, 3, 4, 5, 6])]);
+            }
+            _ => panic!("Decoded packet is not a message"),
+        }
+    }
+
+    // Bytes on the air (UDP/IP headers included) for the ESP32 visualizer:
+    // OSC against the hal-esp32 visualizer link, see benches/README.md.
+    #[test]
+    fn visualizer_link_bytes_against_osc() {
+        use hal_esp32::link::{self, MAX_SLICE_PIXELS, WIRE_OVERHEAD};
+
+        // A chord of 8 notes in one tick: 8 `/midi` datagrams or one batch
+        let notes: Vec<MidiEvent> = (0..8)
+            .map(|i| MidiEvent::note_on(0, 60 + i, 100, 0))
+            .collect();
+        let osc: usize = notes
+            .iter()
+            .map(|e| OscSender::encode_event(e).len() + WIRE_OVERHEAD)
+            .sum();
+        let mut buf = Vec::new();
+        link::begin(&mut buf, 0, 0);
+        link::push_events(&mut buf, &notes);
+        assert_eq!((osc, buf.len() + WIRE_OVERHEAD), (352, 70));
+        // A single note costs about the same
+        link::begin(&mut buf, 0, 0);
+        link::push_events(&mut buf, &notes[..1]);
+        assert_eq!(buf.len() + WIRE_OVERHEAD, 42);
+
+        // Frames: one `/leds` datagram (IP-fragmented above the MTU, which
+        // the board drops) or slices of up to MAX_SLICE_PIXELS
+        let mut frame_bytes = |leds: usize| {
+            let pixels = vec![1u8; leds * 3];
+            OscPixelSender::encode_pixels(&pixels, &mut buf);
+            let osc = buf.len() + WIRE_OVERHEAD;
+            let link: usize = pixels
+                .chunks(MAX_SLICE_PIXELS * 3)
+                .map(|slice| {
+                    link::begin(&mut buf, 0, 0);
+                    link::push_frame(&mut buf, 0, slice, false);
+                    buf.len() + WIRE_OVERHEAD
+                })
+                .sum();
+            (osc, link)
+        };
+        assert_eq!(frame_bytes(300), (944, 942));
+        assert_eq!(frame_bytes(1000), (3044, 3126));
+    }
+
+    #[test]
+    fn test_event_encoding_matches_rosc() {
+        let event = MidiEvent::note_on(2, 60, 100, 0);
+        let buf = OscSender::encode_event(&event);
+        let (_, decoded) = decoder::decode_udp(&buf).unwrap();
+        match decoded {
+            OscPacket::Message(m) => {
+                assert_eq!(m.addr, "/midi");
+                assert_eq!(m.args, vec![OscType::Int(event.word as i32)]);
+            }
+            _ => panic!("Decoded packet is not a message"),
+        }
+    }
+}
@@ -0,0 +1,492 @@
+//! Output router: one logical LED canvas split across many devices.
+//!
+//! Each `OutputSegment` cuts `length` pixels starting at `offset` out of the
+//! canvas, runs them through the device's `ColorPipeline` (colour order,
+//! gamma, white balance, optional RGBW) and hands them to
+//! that device's own sender thread through a latest-frame-wins
+//! `FrameMailbox`. Routing a canvas therefore never waits on the network:
+//! a slow or unreachable device only drops its own stale frames while the
+//! others keep their rate. A segment with `fps` set sends at most that
+//! often, always the newest frame.
+//!
+//! `OutputRouter` implements `DataStreamNetSender`, so it plugs into the
+//! `FrameScheduler` in place of a single `DdpSender`. ESP32 visualizer
+//! segments also take the live MIDI events: `event_links` hands out senders
+//! sharing each board's link for the service loop, `osc_event_senders` the
+//! same for OSC boards (`/midi` with the packed event word).
+
+use crate::color_pipeline::ColorPipeline;
+use crate::ddp_output::{create_ddp_sender, DdpSender};
+use crate::frame_scheduler::FrameMailbox;
+use crate::osc_output::{OscPixelSender, OscSender};
+use hal_esp32::Esp32Sender;
+use log::{error, info};
+use rtp_midi_core::{DataStreamNetSender, OutputSegment, OutputTarget, StreamError};
+use std::sync::{Arc, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+const DEFAULT_DDP_PORT: u16 = 4048;
+
+/// Boxed device sender owned by a segment thread.
+pub type SegmentSender = Box<dyn DataStreamNetSender + Send>;
+
+/// Counters of one segment.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct SegmentStats {
+    pub sent: u64,
+    /// Frames replaced before the device thread took them.
+    pub dropped: u64,
+    pub send_errors: u64,
+}
+
+struct Route {
+    segment: OutputSegment,
+    pipeline: ColorPipeline,
+    mailbox: Arc<FrameMailbox>,
+    stats: Arc<Mutex<SegmentStats>>,
+    // Spare buffer swapped with the mailbox; keeps routing allocation-free.
+    scratch: Vec<u8>,
+    thread: Option<JoinHandle<()>>,
+}
+
+/// Splits canvas frames across segment senders, one thread per segment.
+pub struct OutputRouter {
+    routes: Vec<Route>,
+    // Event side of every ESP32 segment's link.
+    esp32_links: Vec<Esp32Sender>,
+    // Event side of every OSC segment.
+    osc_events: Vec<OscSender>,
+}
+
+/// Opens the sender for a configured segment's target.
+pub fn open_target(segment: &OutputSegment) -> Result<SegmentSender, StreamError> {
+    match &segment.target {
+        OutputTarget::Ddp { ip, port } => {
+            let port = port.unwrap_or(DEFAULT_DDP_PORT);
+            let conn = create_ddp_sender(ip, port, segment.length, segment.color.rgbw)
+                .map_err(|e| StreamError::Network(e.to_string()))?;
+            Ok(Box::new(DdpSender::new(conn)))
+        }
+        OutputTarget::Osc { address } => OscPixelSender::new(address)
+            .map(|sender| Box::new(sender) as SegmentSender)
+            .map_err(|e| StreamError::Network(e.to_string())),
+        OutputTarget::Esp32 { address, kbps } => {
+            open_esp32(address, *kbps).map(|sender| Box::new(sender) as SegmentSender)
+        }
+    }
+}
+
+fn open_esp32(address: &str, kbps: Option<u32>) -> Result<Esp32Sender, StreamError> {
+    let bytes_per_sec = kbps.map_or(0, |kbps| kbps as u64 * 1000 / 8);
+    Esp32Sender::open(address, bytes_per_sec).map_err(|e| StreamError::Network(e.to_string()))
+}
+
+impl OutputRouter {
+    /// Opens all configured targets.
+    pub fn open(segments: &[OutputSegment]) -> Result<Self, StreamError> {
+        let mut esp32_links = Vec::new();
+        let mut osc_events = Vec::new();
+        let routes = segments
+            .iter()
+            .map(|segment| {
+                let sender: SegmentSender = match &segment.target {
+                    OutputTarget::Esp32 { address, kbps } => {
+                        let sender = open_esp32(address, *kbps)?;
+                        esp32_links.push(sender.event_link());
+                        Box::new(sender)
+                    }
+                    OutputTarget::Osc { address } => {
+                        let sender = OscPixelSender::new(address)
+                            .map_err(|e| StreamError::Network(e.to_string()))?;
+                        osc_events.push(
+                            sender
+                                .event_sender()
+                                .map_err(|e| StreamError::Network(e.to_string()))?,
+                        );
+                        Box::new(sender)
+                    }
+                    _ => open_target(segment)?,
+                };
+                Ok((segment.clone(), sender))
+            })
+            .collect::<Result<Vec<_>, StreamError>>()?;
+        let mut router = Self::new(routes);
+        router.esp32_links = esp32_links;
+        router.osc_events = osc_events;
+        Ok(router)
+    }
+
+    /// Starts one sender thread per segment.
+    pub fn new(segments: Vec<(OutputSegment, SegmentSender)>) -> Self {
+        let routes = segments
+            .into_iter()
+            .enumerate()
+            .map(|(index, (segment, sender))| {
+                let mailbox = Arc::new(FrameMailbox::new());
+                let stats = Arc::new(Mutex::new(SegmentStats::default()));
+                let interval = segment
+                    .fps
+                    .filter(|&fps| fps > 0)
+                    .map(|fps| Duration::from_secs(1) / fps);
+                let thread = {
+                    let (mailbox, stats) = (mailbox.clone(), stats.clone());
+                    thread::Builder::new()
+                        .name(format!("led-out-{index}"))
+                        .spawn(move || run_segment(sender, interval, &mailbox, &stats))
+                        .expect("failed to spawn LED output thread")
+                };
+                let pipeline = ColorPipeline::new(segment.color_order, &segment.color);
+                Route {
+                    scratch: Vec::with_capacity(segment.length * pipeline.bytes_per_pixel()),
+                    segment,
+                    pipeline,
+                    mailbox,
+                    stats,
+                    thread: Some(thread),
+                }
+            })
+            .collect();
+        Self {
+            routes,
+            esp32_links: Vec::new(),
+            osc_events: Vec::new(),
+        }
+    }
+
+    /// Event senders of the ESP32 segments (one per board link).
+    pub fn event_links(&self) -> Vec<Esp32Sender> {
+        self.esp32_links
+            .iter()
+            .map(Esp32Sender::event_link)
+            .collect()
+    }
+
+    /// `/midi` senders of the OSC segments (one per board).
+    pub fn osc_event_senders(&self) -> Vec<OscSender> {
+        self.osc_events
+            .iter()
+            .filter_map(|sender| sender.try_clone().ok())
+            .collect()
+    }
+
+    /// Canvas size (pixels) covering every segment.
+    pub fn canvas_len(&self) -> usize {
+        self.routes
+            .iter()
+            .map(|route| route.segment.offset + route.segment.length)
+            .max()
+            .unwrap_or(0)
+    }
+
+    pub fn stats(&self) -> Vec<SegmentStats> {
+        self.routes
+            .iter()
+            .map(|route| *route.stats.lock().unwrap())
+            .collect()
+    }
+
+    /// Splits an RGB canvas frame into the segments and queues them; pixels
+    /// missing from a short canvas are sent black.
+    pub fn route(&mut self, ts: u64, canvas: &[u8]) {
+        for route in &mut self.routes {
+            let segment = &route.segment;
+            let start = (segment.offset * 3).min(canvas.len());
+            let end = ((segment.offset + segment.length) * 3).min(canvas.len());
+            route
+                .pipeline
+                .process(&canvas[start..end], segment.length, &mut route.scratch);
+            if route.mailbox.publish(&mut route.scratch, ts) {
+                route.stats.lock().unwrap().dropped += 1;
+            }
+        }
+    }
+
+    /// Stops the segment threads after they sent their pending frames.
+    pub fn shutdown(&mut self) {
+        for route in &self.routes {
+            route.mailbox.close();
+        }
+        for route in &mut self.routes {
+            if let Some(thread) = route.thread.take() {
+                let _ = thread.join();
+            }
+        }
+    }
+}
+
+impl Drop for OutputRouter {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+impl DataStreamNetSender for OutputRouter {
+    fn init(&mut self) -> Result<(), StreamError> {
+        info!(
+            "Output router: {} segments, {} pixel canvas",
+            self.routes.len(),
+            self.canvas_len()
+        );
+        Ok(())
+    }
+
+    fn send(&mut self, ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+        self.route(ts, payload);
+        Ok(())
+    }
+}
+
+fn run_segment(
+    mut sender: SegmentSender,
+    interval: Option<Duration>,
+    mailbox: &FrameMailbox,
+    stats: &Mutex<SegmentStats>,
+) {
+    if let Err(e) = sender.init() {
+        error!("Failed to initialize LED output: {}", e);
+    }
+    let mut frame = Vec::new();
+    let mut last_send: Option<Instant> = None;
+    while let Some(mut ts) = mailbox.take(&mut frame) {
+        if let (Some(interval), Some(last)) = (interval, last_send) {
+            let due = last + interval;
+            let now = Instant::now();
+            if due > now {
+                thread::sleep(due - now);
+                // Send whatever is newest once the rate allows it.
+                if let Some(newer) = mailbox.try_take(&mut frame) {
+                    ts = newer;
+                    stats.lock().unwrap().dropped += 1;
+                }
+            }
+        }
+        last_send = Some(Instant::now());
+        let result = sender.send(ts, &frame);
+        let mut s = stats.lock().unwrap();
+        match result {
+            Ok(()) => s.sent += 1,
+            Err(e) => {
+                s.send_errors += 1;
+                drop(s);
+                error!("Failed to send LED segment: {}", e);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use rtp_midi_core::{ColorCorrection, ColorOrder, MidiEvent};
+    use std::net::UdpSocket;
+
+    fn segment(offset: usize, length: usize, target: OutputTarget) -> OutputSegment {
+        OutputSegment {
+            target,
+            offset,
+            length,
+            color_order: ColorOrder::Rgb,
+            color: ColorCorrection::default(),
+            fps: None,
+        }
+    }
+
+    struct Recorder {
+        frames: Arc<Mutex<Vec<Vec<u8>>>>,
+        delay: Duration,
+    }
+
+    impl DataStreamNetSender for Recorder {
+        fn init(&mut self) -> Result<(), StreamError> {
+            Ok(())
+        }
+        fn send(&mut self, _ts: u64, payload: &[u8]) -> Result<(), StreamError> {
+            thread::sleep(self.delay);
+            self.frames.lock().unwrap().push(payload.to_vec());
+            Ok(())
+        }
+    }
+
+    fn recorder(delay: Duration) -> (SegmentSender, Arc<Mutex<Vec<Vec<u8>>>>) {
+        let frames = Arc::new(Mutex::new(Vec::new()));
+        let sender = Recorder {
+            frames: frames.clone(),
+            delay,
+        };
+        (Box::new(sender), frames)
+    }
+
+    #[test]
+    fn segments_slice_reorder_and_pad() {
+        let target = OutputTarget::Osc {
+            address: "unused".into(),
+        };
+        let (a, frames_a) = recorder(Duration::ZERO);
+        let (b, frames_b) = recorder(Duration::ZERO);
+        let mut grb = segment(1, 3, target.clone());
+        grb.color_order = ColorOrder::Grb;
+        let (c, frames_c) = recorder(Duration::ZERO);
+        let mut rgbw = segment(2, 1, target.clone());
+        rgbw.color.rgbw = true;
+        let mut router = OutputRouter::new(vec![(segment(0, 1, target), a), (grb, b), (rgbw, c)]);
+        assert_eq!(router.canvas_len(), 4);
+
+        // Three canvas pixels; the fourth is missing and goes out black.
+        router.route(1, &[1, 2, 3, 4, 5, 6, 7, 8, 9]);
+        router.shutdown();
+        assert_eq!(frames_a.lock().unwrap()[0], vec![1, 2, 3]);
+        assert_eq!(frames_b.lock().unwrap()[0], vec![5, 4, 6, 8, 7, 9, 0, 0, 0]);
+        assert_eq!(frames_c.lock().unwrap()[0], vec![0, 1, 2, 7]);
+    }
+
+    #[test]
+    fn slow_device_does_not_stall_others() {
+        let target = OutputTarget::Osc {
+            address: "unused".into(),
+        };
+        let (slow, slow_frames) = recorder(Duration::from_millis(50));
+        let (fast, fast_frames) = recorder(Duration::ZERO);
+        let mut router = OutputRouter::new(vec![
+            (segment(0, 1, target.clone()), slow),
+            (segment(1, 1, target), fast),
+        ]);
+        let started = Instant::now();
+        for i in 0..20u8 {
+            router.route(i as u64, &[i, i, i, i, i, i]);
+            thread::sleep(Duration::from_millis(2));
+        }
+        // Routing itself never waited for the slow device.
+        assert!(started.elapsed() < Duration::from_millis(500));
+        router.shutdown();
+
+        let stats = router.stats();
+        assert!(stats[0].dropped > 0, "{stats:?}");
+        assert!(fast_frames.lock().unwrap().len() > slow_frames.lock().unwrap().len());
+        // Both end with the newest frame.
+        assert_eq!(slow_frames.lock().unwrap().last(), Some(&vec![19; 3]));
+        assert_eq!(fast_frames.lock().unwrap().last(), Some(&vec![19; 3]));
+    }
+
+    #[test]
+    fn esp32_segment_carries_frames_and_events_on_one_link() {
+        let board = UdpSocket::bind("127.0.0.1:0").unwrap();
+        board
+            .set_read_timeout(Some(Duration::from_millis(200)))
+            .unwrap();
+        let target = OutputTarget::Esp32 {
+            address: board.local_addr().unwrap().to_string(),
+            kbps: None,
+        };
+        let mut router = OutputRouter::open(&[segment(1, 2, target)]).unwrap();
+        let mut links = router.event_links();
+        assert_eq!(links.len(), 1);
+
+        router.route(7, &[1, 2, 3, 4, 5, 6, 7, 8, 9]);
+        router.shutdown();
+        links[0]
+            .send_events(&[MidiEvent::note_on(0, 60, 100, 8)])
+            .unwrap();
+
+        let mut buf = [0u8; 2048];
+        let mut seqs = Vec::new();
+        let mut records = Vec::new();
+        for _ in 0..2 {
+            let len = board.recv(&mut buf).unwrap();
+            let header =
+                hal_esp32::link::decode(&buf[..len], |record| records.push(format!("{record:?}")))
+                    .unwrap();
+            seqs.push(header.seq);
+        }
+        assert_eq!(seqs, [0, 1]);
+        assert_eq!(
+            records,
+            [
+                "Frame { push: true, offset: 0, pixels: [4, 5, 6, 7, 8, 9] }".to_string(),
+                format!(
+                    "{:?}",
+                    hal_esp32::link::Record::Event(MidiEvent::note_on(0, 60, 100, 8))
+                ),
+            ]
+        );
+    }
+
+    #[test]
+    fn osc_segment_gets_midi_events() {
+        let board = UdpSocket::bind("127.0.0.1:0").unwrap();
+        board
+            .set_read_timeout(Some(Duration::from_millis(200)))
+            .unwrap();
+        let target = OutputTarget::Osc {
+            address: board.local_addr().unwrap().to_string(),
+        };
+        let mut router = OutputRouter::open(&[segment(0, 1, target)]).unwrap();
+        router.shutdown();
+        let senders = router.osc_event_senders();
+        assert_eq!(senders.len(), 1);
+        let note = MidiEvent::note_on(0, 60, 100, 8);
+        senders[0].send_event(&MidiEvent::sysex(0, 0));
+        senders[0].send_event(&note);
+
+        let mut buf = [0u8; 64];
+        let len = board.recv(&mut buf).unwrap();
+        assert_eq!(&buf[..len], OscSender::encode_event(&note));
+    }
+
+    // 16 stand-in receivers on localhost, each getting a 64-pixel DDP segment.
+    #[test]
+    fn fans_out_to_sixteen_ddp_receivers() {
+        const DEVICES: usize = 16;
+        const PIXELS: usize = 64;
+        const FRAMES: usize = 50;
+        let receivers: Vec<UdpSocket> = (0..DEVICES)
+            .map(|_| {
+                let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+                socket
+                    .set_read_timeout(Some(Duration::from_millis(200)))
+                    .unwrap();
+                socket
+            })
+            .collect();
+        let segments: Vec<OutputSegment> = receivers
+            .iter()
+            .enumerate()
+            .map(|(i, socket)| {
+                let target = OutputTarget::Ddp {
+                    ip: "127.0.0.1".into(),
+                    port: Some(socket.local_addr().unwrap().port()),
+                };
+                segment(i * PIXELS, PIXELS, target)
+            })
+            .collect();
+        let mut router = OutputRouter::open(&segments).unwrap();
+        let mut canvas = vec![0u8; DEVICES * PIXELS * 3];
+        for frame in 0..FRAMES {
+            canvas.fill(frame as u8);
+            router.route(frame as u64, &canvas);
+            thread::sleep(Duration::from_micros(500));
+        }
+        router.shutdown();
+
+        let mut buf = [0u8; 2048];
+        let mut total_bytes = 0;
+        for socket in &receivers {
+            let mut last = None;
+            while let Ok(len) = socket.recv(&mut buf) {
+                // Segment pixels are the tail of the DDP packet.
+                assert!(len >= PIXELS * 3);
+                total_bytes += len;
+                last = Some(buf[len - 1]);
+                if last == Some((FRAMES - 1) as u8) {
+                    break;
+                }
+            }
+            assert_eq!(last, Some((FRAMES - 1) as u8));
+        }
+        let stats = router.stats();
+        let sent: u64 = stats.iter().map(|s| s.sent).sum();
+        let dropped: u64 = stats.iter().map(|s| s.dropped).sum();
+        assert_eq!(sent + dropped, (DEVICES * FRAMES) as u64);
+        assert!(total_bytes >= DEVICES * PIXELS * 3);
+    }
+}
@@ -0,0 +1,758 @@
+//! Show recorder and memory-mapped player.
+//!
+//! A show file holds three tracks: MIDI events, audio analysis vectors and
+//! the final LED frames, each timestamped on the monotonic clock. Records
+//! are collected per track into chunks stored column-wise (all times, then
+//! record end offsets, then the record bytes) and an index of all chunks is
+//! appended when the recording is finished:
+//!
+//! ```text
+//! "RMSHOW01"
+//! chunk*:  track u8, 3 × 0, count u32, data_len u32, 0 u32,
+//!          times [u64; count], ends [u32; count] (not for MIDI), data
+//! index:   per chunk: offset u64, first_us u64, last_us u64, track u8, 3 × 0, count u32
+//! footer:  index_offset u64, chunk_count u64, "RMSHOWIX"
+//! ```
+//!
+//! All integers are little endian. MIDI records are the 4-byte UMP word.
+//!
+//! `ShowRecorder` never allocates while recording: records go into
+//! preallocated chunks, full chunks are written by a writer thread and come
+//! back for reuse. When the writer falls behind so far that no chunk is
+//! free, records are dropped and counted instead of blocking the caller
+//! (unless `RecorderConfig::lossless` asks to wait, as offline renders do).
+//!
+//! `ShowPlayer` maps the file and finds any time in O(log n): a binary
+//! search over the chunk index, then over the chunk's time column.
+
+use memmap2::Mmap;
+use rtp_midi_core::{DataStreamNetSender, MidiEvent, StreamError};
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::path::Path;
+use std::sync::mpsc::{self, Receiver, SyncSender};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+const MAGIC: &[u8; 8] = b"RMSHOW01";
+const INDEX_MAGIC: &[u8; 8] = b"RMSHOWIX";
+const CHUNK_HEADER_LEN: usize = 16;
+const INDEX_ENTRY_LEN: usize = 32;
+const FOOTER_LEN: usize = 24;
+
+/// Track of a show file.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+pub enum Track {
+    /// Packed MIDI events (SysEx is not recorded).
+    Midi = 0,
+    /// Audio analysis vectors (`f32` little endian).
+    Analysis = 1,
+    /// LED frames as sent to the outputs.
+    Frames = 2,
+}
+
+impl Track {
+    const ALL: [Track; 3] = [Track::Midi, Track::Analysis, Track::Frames];
+
+    fn from_u8(value: u8) -> Option<Self> {
+        Self::ALL.get(value as usize).copied()
+    }
+
+    // Tracks with variable-length records carry an `ends` column.
+    fn variable(self) -> bool {
+        self != Track::Midi
+    }
+}
+
+/// Configuration of a `ShowRecorder`.
+#[derive(Debug, Clone, Copy)]
+pub struct RecorderConfig {
+    /// Records per chunk.
+    pub chunk_records: usize,
+    /// Record bytes per chunk; larger records are dropped.
+    pub chunk_bytes: usize,
+    /// Chunks in flight to the writer thread per track.
+    pub spare_chunks: usize,
+    /// Wait for the writer instead of dropping records when no chunk is
+    /// free (offline rendering, where nothing runs in real time).
+    pub lossless: bool,
+}
+
+impl Default for RecorderConfig {
+    fn default() -> Self {
+        Self {
+            chunk_records: 1024,
+            chunk_bytes: 256 * 1024,
+            spare_chunks: 4,
+            lossless: false,
+        }
+    }
+}
+
+/// Counters of a recording.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct RecorderStats {
+    pub records: u64,
+    /// Records lost because no chunk was free (or they were too large).
+    pub dropped: u64,
+}
+
+struct Chunk {
+    track: Track,
+    times: Vec<u64>,
+    ends: Vec<u32>,
+    data: Vec<u8>,
+}
+
+impl Chunk {
+    fn new(track: Track, config: &RecorderConfig) -> Self {
+        Self {
+            track,
+            times: Vec::with_capacity(config.chunk_records),
+            ends: Vec::with_capacity(if track.variable() {
+                config.chunk_records
+            } else {
+                0
+            }),
+            data: Vec::with_capacity(config.chunk_bytes),
+        }
+    }
+
+    fn fits(&self, len: usize) -> bool {
+        self.times.len() < self.times.capacity() && self.data.len() + len <= self.data.capacity()
+    }
+
+    fn clear(&mut self) {
+        self.times.clear();
+        self.ends.clear();
+        self.data.clear();
+    }
+}
+
+/// Appends MIDI events, analysis vectors and LED frames to a show file.
+///
+/// The player binary-searches each track's times, so a record stamped
+/// earlier than its track's previous one is stored at that previous time.
+/// MIDI event times come from several peers' clock models and are not
+/// monotonic across peers or when a model re-anchors.
+pub struct ShowRecorder {
+    config: RecorderConfig,
+    // Latest time stored per track.
+    last_us: [u64; 3],
+    open: [Option<Chunk>; 3],
+    spare: [Receiver<Chunk>; 3],
+    full: Option<SyncSender<Chunk>>,
+    writer: Option<JoinHandle<io::Result<()>>>,
+    stats: RecorderStats,
+}
+
+impl ShowRecorder {
+    /// Creates (truncates) `path` and starts the writer thread.
+    pub fn create(path: impl AsRef<Path>, config: RecorderConfig) -> io::Result<Self> {
+        let file = File::create(path)?;
+        let per_track = config.spare_chunks.max(1) + 1;
+        let (full_tx, full_rx) = mpsc::sync_channel(per_track * Track::ALL.len());
+        let mut spare_tx = Vec::new();
+        let mut spare = Vec::new();
+        let mut open = Vec::new();
+        for track in Track::ALL {
+            let (tx, rx) = mpsc::sync_channel(per_track);
+            for _ in 1..per_track {
+                let _ = tx.try_send(Chunk::new(track, &config));
+            }
+            open.push(Some(Chunk::new(track, &config)));
+            spare_tx.push(tx);
+            spare.push(rx);
+        }
+        let writer = thread::Builder::new()
+            .name("show-writer".into())
+            .spawn(move || run_writer(file, full_rx, spare_tx))?;
+        Ok(Self {
+            config,
+            open: open.try_into().ok().expect("three tracks"),
+            spare: spare.try_into().ok().expect("three tracks"),
+            full: Some(full_tx),
+            writer: Some(writer),
+            stats: RecorderStats::default(),
+            last_us: [0; 3],
+        })
+    }
+
+    pub fn stats(&self) -> RecorderStats {
+        self.stats
+    }
+
+    /// Records a MIDI event at its `time_us`; SysEx events are skipped.
+    pub fn record_midi(&mut self, event: &MidiEvent) {
+        if event.is_sysex() {
+            return;
+        }
+        let time_us = self.stamp(Track::Midi, event.time_us);
+        if let Some(chunk) = self.chunk(Track::Midi, 4) {
+            chunk.times.push(time_us);
+            chunk.data.extend_from_slice(&event.word.to_le_bytes());
+        }
+    }
+
+    /// Records an analysis vector (band levels or FFT magnitudes).
+    pub fn record_analysis(&mut self, time_us: u64, values: &[f32]) {
+        let time_us = self.stamp(Track::Analysis, time_us);
+        if let Some(chunk) = self.chunk(Track::Analysis, values.len() * 4) {
+            chunk.times.push(time_us);
+            for value in values {
+                chunk.data.extend_from_slice(&value.to_le_bytes());
+            }
+            chunk.ends.push(chunk.data.len() as u32);
+        }
+    }
+
+    /// Records an LED frame as sent to the outputs.
+    pub fn record_frame(&mut self, time_us: u64, frame: &[u8]) {
+        let time_us = self.stamp(Track::Frames, time_us);
+        if let Some(chunk) = self.chunk(Track::Frames, frame.len()) {
+            chunk.times.push(time_us);
+            chunk.data.extend_from_slice(frame);
+            chunk.ends.push(chunk.data.len() as u32);
+        }
+    }
+
+    // `time_us`, or the track's latest time if that is later.
+    fn stamp(&mut self, track: Track, time_us: u64) -> u64 {
+        let last = &mut self.last_us[track as usize];
+        *last = (*last).max(time_us);
+        *last
+    }
+
+    // Open chunk of `track` with room for a record of `len` bytes.
+    fn chunk(&mut self, track: Track, len: usize) -> Option<&mut Chunk> {
+        let slot = track as usize;
+        if len > self.config.chunk_bytes {
+            self.stats.dropped += 1;
+            return None;
+        }
+        if !self.open[slot]
+            .as_ref()
+            .is_some_and(|chunk| chunk.fits(len))
+        {
+            if let (Some(chunk), Some(full)) = (self.open[slot].take(), &self.full) {
+                if !chunk.times.is_empty() {
+                    // Never full: it holds every chunk there is.
+                    let _ = full.try_send(chunk);
+                } else {
+                    self.open[slot] = Some(chunk);
+                }
+            }
+            if self.open[slot].is_none() {
+                self.open[slot] = if self.config.lossless {
+                    self.spare[slot].recv().ok()
+                } else {
+                    self.spare[slot].try_recv().ok()
+                };
+            }
+        }
+        match self.open[slot].as_mut() {
+            Some(chunk) => {
+                self.stats.records += 1;
+                Some(chunk)
+            }
+            None => {
+                self.stats.dropped += 1;
+                None
+            }
+        }
+    }
+
+    /// Writes the remaining records and the index; returns the counters.
+    pub fn finish(mut self) -> io::Result<RecorderStats> {
+        self.close()?;
+        Ok(self.stats)
+    }
+
+    fn close(&mut self) -> io::Result<()> {
+        if let Some(full) = self.full.take() {
+            for chunk in self.open.iter_mut().filter_map(Option::take) {
+                if !chunk.times.is_empty() {
+                    let _ = full.try_send(chunk);
+                }
+            }
+        }
+        match self.writer.take().map(JoinHandle::join) {
+            Some(Ok(result)) => result,
+            Some(Err(_)) => Err(io::Error::other("show writer thread panicked")),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for ShowRecorder {
+    fn drop(&mut self) {
+        let _ = self.close();
+    }
+}
+
+fn run_writer(file: File, full: Receiver<Chunk>, spare: Vec<SyncSender<Chunk>>) -> io::Result<()> {
+    let mut out = BufWriter::new(file);
+    out.write_all(MAGIC)?;
+    let mut offset = MAGIC.len() as u64;
+    let mut index = Vec::new();
+    for mut chunk in full {
+        let count = chunk.times.len();
+        let mut header = [0u8; CHUNK_HEADER_LEN];
+        header[0] = chunk.track as u8;
+        header[4..8].copy_from_slice(&(count as u32).to_le_bytes());
+        header[8..12].copy_from_slice(&(chunk.data.len() as u32).to_le_bytes());
+        out.write_all(&header)?;
+        for time in &chunk.times {
+            out.write_all(&time.to_le_bytes())?;
+        }
+        for end in &chunk.ends {
+            out.write_all(&end.to_le_bytes())?;
+        }
+        out.write_all(&chunk.data)?;
+
+        let mut entry = [0u8; INDEX_ENTRY_LEN];
+        entry[0..8].copy_from_slice(&offset.to_le_bytes());
+        entry[8..16].copy_from_slice(&chunk.times[0].to_le_bytes());
+        entry[16..24].copy_from_slice(&chunk.times[count - 1].to_le_bytes());
+        entry[24] = chunk.track as u8;
+        entry[28..32].copy_from_slice(&(count as u32).to_le_bytes());
+        index.push(entry);
+        offset += (CHUNK_HEADER_LEN + count * 8 + chunk.ends.len() * 4 + chunk.data.len()) as u64;
+
+        let track = chunk.track as usize;
+        chunk.clear();
+        let _ = spare[track].try_send(chunk);
+    }
+    for entry in &index {
+        out.write_all(entry)?;
+    }
+    out.write_all(&offset.to_le_bytes())?;
+    out.write_all(&(index.len() as u64).to_le_bytes())?;
+    out.write_all(INDEX_MAGIC)?;
+    out.flush()
+}
+
+// Validated location of one chunk inside the mapped file.
+#[derive(Debug, Clone, Copy)]
+struct ChunkEntry {
+    first_us: u64,
+    last_us: u64,
+    count: usize,
+    times: usize,
+    ends: Option<usize>,
+    data: usize,
+    data_len: usize,
+}
+
+/// Position of a record: chunk and record within it (per track).
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub struct Position {
+    pub chunk: usize,
+    pub record: usize,
+}
+
+/// Memory-mapped show file.
+pub struct ShowPlayer {
+    map: Mmap,
+    tracks: [Vec<ChunkEntry>; 3],
+}
+
+fn invalid(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message.to_string())
+}
+
+fn read_u32(bytes: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap())
+}
+
+fn read_u64(bytes: &[u8], at: usize) -> u64 {
+    u64::from_le_bytes(bytes[at..at + 8].try_into().unwrap())
+}
+
+impl ShowPlayer {
+    /// Maps a finished show file and validates its index.
+    pub fn open(path: impl AsRef<Path>) -> io::Result<Self> {
+        let file = File::open(path)?;
+        // The file is only read; a recorder still writing it would fail
+        // the footer check below.
+        let map = unsafe { Mmap::map(&file)? };
+        let bytes = &map[..];
+        if bytes.len() < MAGIC.len() + FOOTER_LEN || &bytes[..MAGIC.len()] != MAGIC {
+            return Err(invalid("not a show file"));
+        }
+        let footer = bytes.len() - FOOTER_LEN;
+        if &bytes[footer + 16..] != INDEX_MAGIC {
+            return Err(invalid("show file has no index (recording not finished)"));
+        }
+        let index_offset = read_u64(bytes, footer) as usize;
+        let chunks = read_u64(bytes, footer + 8) as usize;
+        if chunks
+            .checked_mul(INDEX_ENTRY_LEN)
+            .and_then(|len| len.checked_add(index_offset))
+            != Some(footer)
+        {
+            return Err(invalid("corrupt show index"));
+        }
+
+        let mut tracks: [Vec<ChunkEntry>; 3] = Default::default();
+        for i in 0..chunks {
+            let entry = index_offset + i * INDEX_ENTRY_LEN;
+            let offset = read_u64(bytes, entry) as usize;
+            let track = Track::from_u8(bytes[entry + 24]).ok_or_else(|| invalid("bad track"))?;
+            if offset
+                .checked_add(CHUNK_HEADER_LEN)
+                .is_none_or(|end| end > index_offset)
+            {
+                return Err(invalid("chunk outside the file"));
+            }
+            let count = read_u32(bytes, offset + 4) as usize;
+            let data_len = read_u32(bytes, offset + 8) as usize;
+            let times = offset + CHUNK_HEADER_LEN;
+            let ends = track.variable().then_some(times + count * 8);
+            let data = times + count * 8 + if track.variable() { count * 4 } else { 0 };
+            if bytes[offset] != track as u8
+                || count == 0
+                || count != read_u32(bytes, entry + 28) as usize
+                || data + data_len > index_offset
+                || (!track.variable() && data_len != count * 4)
+            {
+                return Err(invalid("corrupt show chunk"));
+            }
+            let chunk = ChunkEntry {
+                first_us: read_u64(bytes, entry + 8),
+                last_us: read_u64(bytes, entry + 16),
+                count,
+                times,
+                ends,
+                data,
+                data_len,
+            };
+            if let Some(ends) = chunk.ends {
+                let mut previous = 0;
+                for r in 0..count {
+                    let end = read_u32(bytes, ends + r * 4) as usize;
+                    if end < previous || end > data_len {
+                        return Err(invalid("corrupt show record offsets"));
+                    }
+                    previous = end;
+                }
+            }
+            tracks[track as usize].push(chunk);
+        }
+        Ok(Self { map, tracks })
+    }
+
+    /// Number of records in `track`.
+    pub fn len(&self, track: Track) -> usize {
+        self.tracks[track as usize].iter().map(|c| c.count).sum()
+    }
+
+    /// First and last timestamp over all tracks.
+    pub fn time_range(&self) -> Option<(u64, u64)> {
+        let chunks = self.tracks.iter().flatten();
+        let first = chunks.clone().map(|c| c.first_us).min()?;
+        let last = chunks.map(|c| c.last_us).max()?;
+        Some((first, last))
+    }
+
+    fn time(&self, chunk: &ChunkEntry, record: usize) -> u64 {
+        read_u64(&self.map, chunk.times + record * 8)
+    }
+
+    fn record(&self, track: Track, position: Position) -> (u64, &[u8]) {
+        let chunk = &self.tracks[track as usize][position.chunk];
+        let r = position.record;
+        let (start, end) = match chunk.ends {
+            Some(ends) => {
+                let start = if r == 0 {
+                    0
+                } else {
+                    read_u32(&self.map, ends + (r - 1) * 4) as usize
+                };
+                (start, read_u32(&self.map, ends + r * 4) as usize)
+            }
+            None => (r * 4, r * 4 + 4),
+        };
+        debug_assert!(end <= chunk.data_len);
+        let data = &self.map[chunk.data + start..chunk.data + end];
+        (self.time(chunk, r), data)
+    }
+
+    /// First record of `track` at or after `time_us` (past the end if none).
+    pub fn seek(&self, track: Track, time_us: u64) -> Position {
+        let chunks = &self.tracks[track as usize];
+        let chunk = chunks.partition_point(|c| c.last_us < time_us);
+        let Some(entry) = chunks.get(chunk) else {
+            return Position {
+                chunk: chunks.len(),
+                record: 0,
+            };
+        };
+        let (mut low, mut high) = (0, entry.count);
+        while low < high {
+            let mid = (low + high) / 2;
+            if self.time(entry, mid) < time_us {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        Position { chunk, record: low }
+    }
+
+    /// Records of `track` from `from` on, with their timestamps.
+    pub fn records(&self, track: Track, from: Position) -> Records<'_> {
+        Records {
+            player: self,
+            track,
+            position: from,
+        }
+    }
+
+    /// MIDI events with `from_us <= time_us < to_us`.
+    pub fn midi(&self, from_us: u64, to_us: u64) -> impl Iterator<Item = MidiEvent> + '_ {
+        self.records(Track::Midi, self.seek(Track::Midi, from_us))
+            .take_while(move |(time, _)| *time < to_us)
+            .map(|(time_us, word)| MidiEvent {
+                word: read_u32(word, 0),
+                time_us,
+            })
+    }
+
+    /// Latest record of `track` at or before `time_us`.
+    pub fn latest(&self, track: Track, time_us: u64) -> Option<(u64, &[u8])> {
+        let next = self.seek(track, time_us.saturating_add(1));
+        let previous = if next.record > 0 {
+            Position {
+                chunk: next.chunk,
+                record: next.record - 1,
+            }
+        } else {
+            let chunk = next.chunk.checked_sub(1)?;
+            Position {
+                chunk,
+                record: self.tracks[track as usize][chunk].count - 1,
+            }
+        };
+        Some(self.record(track, previous))
+    }
+
+    /// Copies the LED frame shown at `time_us` into `frame`; false before
+    /// the first recorded frame.
+    pub fn frame_at(&self, time_us: u64, frame: &mut Vec<u8>) -> bool {
+        match self.latest(Track::Frames, time_us) {
+            Some((_, bytes)) => {
+                frame.clear();
+                frame.extend_from_slice(bytes);
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Analysis vector current at `time_us`.
+    pub fn analysis_at(&self, time_us: u64, values: &mut Vec<f32>) -> bool {
+        match self.latest(Track::Analysis, time_us) {
+            Some((_, bytes)) => {
+                values.clear();
+                values.extend(
+                    bytes
+                        .chunks_exact(4)
+                        .map(|b| f32::from_le_bytes(b.try_into().unwrap())),
+                );
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Sends the recorded frames from `from_us` on to `sender`, `speed`
+    /// times faster than recorded (0 = as fast as possible). Returns the
+    /// number of frames sent.
+    pub fn play_frames(
+        &self,
+        from_us: u64,
+        speed: f64,
+        sender: &mut dyn DataStreamNetSender,
+    ) -> Result<usize, StreamError> {
+        let started = Instant::now();
+        let mut sent = 0;
+        for (time_us, frame) in self.records(Track::Frames, self.seek(Track::Frames, from_us)) {
+            if speed > 0.0 {
+                let due = Duration::from_secs_f64((time_us - from_us) as f64 / 1e6 / speed);
+                if let Some(wait) = due.checked_sub(started.elapsed()) {
+                    thread::sleep(wait);
+                }
+            }
+            sender.send(time_us, frame)?;
+            sent += 1;
+        }
+        Ok(sent)
+    }
+}
+
+/// Iterator over the records of one track, see `ShowPlayer::records`.
+pub struct Records<'a> {
+    player: &'a ShowPlayer,
+    track: Track,
+    position: Position,
+}
+
+impl<'a> Iterator for Records<'a> {
+    type Item = (u64, &'a [u8]);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let chunks = &self.player.tracks[self.track as usize];
+        let chunk = chunks.get(self.position.chunk)?;
+        if self.position.record >= chunk.count {
+            self.position = Position {
+                chunk: self.position.chunk + 1,
+                record: 0,
+            };
+            return self.next();
+        }
+        let item = self.player.record(self.track, self.position);
+        self.position.record += 1;
+        Some(item)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::path::PathBuf;
+
+    fn temp_path(name: &str) -> PathBuf {
+        std::env::temp_dir().join(format!("show_{}_{}.rmshow", name, std::process::id()))
+    }
+
+    fn small_chunks() -> RecorderConfig {
+        RecorderConfig {
+            chunk_records: 16,
+            chunk_bytes: 1024,
+            spare_chunks: 64,
+            lossless: false,
+        }
+    }
+
+    #[test]
+    fn records_round_trip_across_chunks() {
+        let path = temp_path("round_trip");
+        let mut recorder = ShowRecorder::create(&path, small_chunks()).unwrap();
+        for i in 0..100u64 {
+            recorder.record_midi(&MidiEvent::note_on(0, 60 + (i % 12) as u8, 100, i * 1_000));
+            recorder.record_analysis(i * 1_000 + 1, &[i as f32, 0.5]);
+            recorder.record_frame(i * 1_000 + 2, &[i as u8; 30]);
+        }
+        recorder.record_midi(&MidiEvent::sysex(0, 200_000));
+        let stats = recorder.finish().unwrap();
+        assert_eq!(
+            stats,
+            RecorderStats {
+                records: 300,
+                dropped: 0
+            }
+        );
+
+        let player = ShowPlayer::open(&path).unwrap();
+        assert_eq!(player.len(Track::Midi), 100);
+        assert_eq!(player.len(Track::Frames), 100);
+        assert_eq!(player.time_range(), Some((0, 99_002)));
+
+        let midi: Vec<MidiEvent> = player.midi(10_000, 13_000).collect();
+        assert_eq!(midi.len(), 3);
+        assert_eq!(midi[0], MidiEvent::note_on(0, 70, 100, 10_000));
+
+        let mut frame = Vec::new();
+        assert!(!player.frame_at(1, &mut frame));
+        assert!(player.frame_at(55_500, &mut frame));
+        assert_eq!(frame, vec![55; 30]);
+        let mut values = Vec::new();
+        assert!(player.analysis_at(99_999_999, &mut values));
+        assert_eq!(values, vec![99.0, 0.5]);
+        let start = player.seek(Track::Frames, 0);
+        assert_eq!(
+            start,
+            Position {
+                chunk: 0,
+                record: 0
+            }
+        );
+        assert_eq!(player.records(Track::Frames, start).count(), 100);
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn interleaved_peers_keep_the_midi_track_sorted() {
+        let path = temp_path("interleaved");
+        let mut recorder = ShowRecorder::create(&path, small_chunks()).unwrap();
+        // Peer B's clock model runs 500 µs behind peer A's.
+        for i in 0..40u64 {
+            recorder.record_midi(&MidiEvent::note_on(0, 60, 100, i * 1_000 + 500));
+            recorder.record_midi(&MidiEvent::note_on(1, 62, 100, i * 1_000));
+        }
+        recorder.finish().unwrap();
+
+        let player = ShowPlayer::open(&path).unwrap();
+        let times: Vec<u64> = player
+            .records(Track::Midi, player.seek(Track::Midi, 0))
+            .map(|(time, _)| time)
+            .collect();
+        assert_eq!(times.len(), 80);
+        assert!(times.windows(2).all(|pair| pair[0] <= pair[1]));
+        // B's event lands at the time of A's event before it.
+        let midi: Vec<MidiEvent> = player.midi(20_500, 21_000).collect();
+        assert_eq!(
+            midi,
+            vec![
+                MidiEvent::note_on(0, 60, 100, 20_500),
+                MidiEvent::note_on(1, 62, 100, 20_500)
+            ]
+        );
+        assert_eq!(player.midi(0, 40_000).count(), 80);
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn recording_does_not_allocate_and_drops_when_no_chunk_is_free() {
+        let path = temp_path("no_alloc");
+        let mut recorder = ShowRecorder::create(
+            &path,
+            RecorderConfig {
+                spare_chunks: 1,
+                ..small_chunks()
+            },
+        )
+        .unwrap();
+        let capacity = recorder.open[Track::Frames as usize]
+            .as_ref()
+            .unwrap()
+            .data
+            .capacity();
+        // Oversized records are dropped, never grown into.
+        recorder.record_frame(0, &[0; 2048]);
+        for i in 0..10_000u64 {
+            recorder.record_frame(i, &[1; 64]);
+            if let Some(chunk) = &recorder.open[Track::Frames as usize] {
+                assert_eq!(chunk.data.capacity(), capacity);
+            }
+        }
+        let stats = recorder.finish().unwrap();
+        assert_eq!(stats.records + stats.dropped, 10_001);
+        assert!(stats.dropped >= 1);
+        let player = ShowPlayer::open(&path).unwrap();
+        assert_eq!(player.len(Track::Frames) as u64, stats.records);
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn unfinished_or_foreign_files_are_rejected() {
+        let path = temp_path("invalid");
+        std::fs::write(&path, b"RMSHOW01 not finished").unwrap();
+        assert!(ShowPlayer::open(&path).is_err());
+        std::fs::write(&path, [0u8; 64]).unwrap();
+        assert!(ShowPlayer::open(&path).is_err());
+        std::fs::remove_file(&path).unwrap();
+    }
+}
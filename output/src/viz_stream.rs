@@ -0,0 +1,441 @@
+//! Live visual data for WebRTC clients: binary framing, the process-wide
+//! tap and per-client rate adaptation.
+//!
+//! The frame clock publishes every rendered LED frame and the analysis task
+//! every band vector into `tap()`; a streaming task per client picks the
+//! newest of each up at its own rate, so nothing is rendered twice and a
+//! slow client never holds back the LEDs or another client. Packets go over
+//! an unordered data channel without retransmissions: a lost frame is
+//! replaced by the next one.
+//!
+//! Packet (big-endian, 12-byte header):
+//!
+//! ```text
+//! 0   magic 'V'      1   version (1)     2   kind (1 = LED, 2 = bands)
+//! 3   reserved (0)   4   sequence u32    8   timestamp ms u32 (wrapping)
+//! 12  payload: RGB triplets (LED) or one u8 level per band (bands)
+//! ```
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+pub const MAGIC: u8 = b'V';
+pub const VERSION: u8 = 1;
+pub const HEADER_LEN: usize = 12;
+/// Band vectors are max-pooled down to this many levels.
+pub const MAX_BANDS: usize = 32;
+
+/// What a packet carries.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+pub enum VizKind {
+    Leds = 1,
+    Bands = 2,
+}
+
+impl VizKind {
+    fn from_u8(kind: u8) -> Option<Self> {
+        match kind {
+            1 => Some(VizKind::Leds),
+            2 => Some(VizKind::Bands),
+            _ => None,
+        }
+    }
+}
+
+/// Decoded packet borrowing its payload.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct VizPacket<'a> {
+    pub kind: VizKind,
+    pub sequence: u32,
+    pub timestamp_ms: u32,
+    pub payload: &'a [u8],
+}
+
+/// Writes one packet into `out` (cleared first).
+pub fn encode_packet(
+    kind: VizKind,
+    sequence: u32,
+    timestamp_us: u64,
+    payload: &[u8],
+    out: &mut Vec<u8>,
+) {
+    out.clear();
+    out.reserve(HEADER_LEN + payload.len());
+    out.extend_from_slice(&[MAGIC, VERSION, kind as u8, 0]);
+    out.extend_from_slice(&sequence.to_be_bytes());
+    out.extend_from_slice(&((timestamp_us / 1_000) as u32).to_be_bytes());
+    out.extend_from_slice(payload);
+}
+
+/// Parses a packet; `None` for foreign or truncated data.
+pub fn decode_packet(data: &[u8]) -> Option<VizPacket<'_>> {
+    if data.len() < HEADER_LEN || data[0] != MAGIC || data[1] != VERSION {
+        return None;
+    }
+    let kind = VizKind::from_u8(data[2])?;
+    if kind == VizKind::Leds && (data.len() - HEADER_LEN) % 3 != 0 {
+        return None;
+    }
+    Some(VizPacket {
+        kind,
+        sequence: u32::from_be_bytes(data[4..8].try_into().unwrap()),
+        timestamp_ms: u32::from_be_bytes(data[8..12].try_into().unwrap()),
+        payload: &data[HEADER_LEN..],
+    })
+}
+
+/// Max-pools `magnitudes` into at most `MAX_BANDS` levels scaled to 0..=255
+/// (magnitudes are normalised to 0.0..=1.0).
+pub fn quantize_bands(magnitudes: &[f32], out: &mut Vec<u8>) {
+    out.clear();
+    let bands = magnitudes.len().min(MAX_BANDS);
+    for band in 0..bands {
+        let from = band * magnitudes.len() / bands;
+        let to = (band + 1) * magnitudes.len() / bands;
+        let level = magnitudes[from..to].iter().fold(0.0f32, |a, &m| a.max(m));
+        out.push((level.clamp(0.0, 1.0) * 255.0).round() as u8);
+    }
+}
+
+#[derive(Debug, Default)]
+struct Latest {
+    data: Vec<u8>,
+    timestamp_us: u64,
+    // 0 = nothing published yet.
+    version: u64,
+}
+
+impl Latest {
+    fn publish(&mut self, timestamp_us: u64, data: &[u8]) {
+        self.data.clear();
+        self.data.extend_from_slice(data);
+        self.timestamp_us = timestamp_us;
+        self.version += 1;
+    }
+
+    // Copies the value into `out` if it is newer than `*seen`.
+    fn take_newer(&self, seen: &mut u64, out: &mut Vec<u8>) -> Option<u64> {
+        if self.version == *seen {
+            return None;
+        }
+        *seen = self.version;
+        out.clear();
+        out.extend_from_slice(&self.data);
+        Some(self.timestamp_us)
+    }
+}
+
+/// Newest LED frame and band levels. Publishing is skipped (one atomic
+/// load) while no client is subscribed.
+#[derive(Debug)]
+pub struct VizTap {
+    subscribers: AtomicUsize,
+    leds: Mutex<Latest>,
+    bands: Mutex<Latest>,
+}
+
+static GLOBAL: VizTap = VizTap::new();
+
+/// Process-wide tap fed by the service loop and read by the streaming
+/// server.
+pub fn tap() -> &'static VizTap {
+    &GLOBAL
+}
+
+impl Default for VizTap {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl VizTap {
+    pub const fn new() -> Self {
+        Self {
+            subscribers: AtomicUsize::new(0),
+            leds: Mutex::new(Latest {
+                data: Vec::new(),
+                timestamp_us: 0,
+                version: 0,
+            }),
+            bands: Mutex::new(Latest {
+                data: Vec::new(),
+                timestamp_us: 0,
+                version: 0,
+            }),
+        }
+    }
+
+    pub fn has_subscribers(&self) -> bool {
+        self.subscribers.load(Ordering::Relaxed) > 0
+    }
+
+    /// Publishes a rendered LED frame (RGB).
+    pub fn publish_leds(&self, timestamp_us: u64, frame: &[u8]) {
+        if self.has_subscribers() {
+            self.leds.lock().unwrap().publish(timestamp_us, frame);
+        }
+    }
+
+    /// Publishes the analysis magnitudes as quantized band levels.
+    pub fn publish_bands(&self, timestamp_us: u64, magnitudes: &[f32]) {
+        if self.has_subscribers() {
+            let mut bands = self.bands.lock().unwrap();
+            quantize_bands(magnitudes, &mut bands.data);
+            bands.timestamp_us = timestamp_us;
+            bands.version += 1;
+        }
+    }
+}
+
+/// Rate adaptation of one client.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct RateConfig {
+    pub max_fps: f32,
+    pub min_fps: f32,
+    /// Added to the rate per uncongested send.
+    pub increase_fps: f32,
+    /// Bytes queued in the data channel above which the rate is halved and
+    /// the send skipped.
+    pub high_water: usize,
+}
+
+impl Default for RateConfig {
+    fn default() -> Self {
+        Self {
+            max_fps: 60.0,
+            min_fps: 5.0,
+            increase_fps: 1.0,
+            high_water: 64 * 1024,
+        }
+    }
+}
+
+/// Counters of one client.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct VizClientStats {
+    pub packets: u64,
+    pub bytes: u64,
+    /// Sends skipped because the channel was still backed up.
+    pub congested: u64,
+    pub fps: f32,
+}
+
+/// Streaming state of one client: its current rate (additive increase,
+/// multiplicative decrease on the data channel's queued bytes), what it
+/// last got and its packet sequence.
+#[derive(Debug)]
+pub struct VizClient {
+    config: RateConfig,
+    fps: f32,
+    next_due_us: u64,
+    leds_seen: u64,
+    bands_seen: u64,
+    sequence: u32,
+    scratch: Vec<u8>,
+    packet: Vec<u8>,
+    stats: VizClientStats,
+    tap: &'static VizTap,
+}
+
+impl VizClient {
+    /// Subscribes to `tap` until dropped.
+    pub fn new(tap: &'static VizTap, config: RateConfig) -> Self {
+        tap.subscribers.fetch_add(1, Ordering::Relaxed);
+        Self {
+            fps: config.max_fps,
+            config,
+            next_due_us: 0,
+            leds_seen: 0,
+            bands_seen: 0,
+            sequence: 0,
+            scratch: Vec::new(),
+            packet: Vec::new(),
+            stats: VizClientStats::default(),
+            tap,
+        }
+    }
+
+    /// When the next send is due.
+    pub fn next_due_us(&self) -> u64 {
+        self.next_due_us
+    }
+
+    pub fn stats(&self) -> VizClientStats {
+        VizClientStats {
+            fps: self.fps,
+            ..self.stats
+        }
+    }
+
+    /// Sends what is new since the last call if a send is due at `now_us`.
+    /// `buffered` is the number of bytes still queued in the data channel.
+    pub fn poll<E>(
+        &mut self,
+        now_us: u64,
+        buffered: usize,
+        mut send: impl FnMut(&[u8]) -> Result<(), E>,
+    ) -> Result<(), E> {
+        if now_us < self.next_due_us {
+            return Ok(());
+        }
+        if buffered > self.config.high_water {
+            self.fps = (self.fps / 2.0).max(self.config.min_fps);
+            self.stats.congested += 1;
+        } else {
+            self.fps = (self.fps + self.config.increase_fps).min(self.config.max_fps);
+            let leds = self
+                .tap
+                .leds
+                .lock()
+                .unwrap()
+                .take_newer(&mut self.leds_seen, &mut self.scratch);
+            if let Some(timestamp_us) = leds {
+                self.send(VizKind::Leds, timestamp_us, &mut send)?;
+            }
+            let bands = self
+                .tap
+                .bands
+                .lock()
+                .unwrap()
+                .take_newer(&mut self.bands_seen, &mut self.scratch);
+            if let Some(timestamp_us) = bands {
+                self.send(VizKind::Bands, timestamp_us, &mut send)?;
+            }
+        }
+        self.next_due_us = now_us + (1e6 / self.fps) as u64;
+        Ok(())
+    }
+
+    fn send<E>(
+        &mut self,
+        kind: VizKind,
+        timestamp_us: u64,
+        send: &mut impl FnMut(&[u8]) -> Result<(), E>,
+    ) -> Result<(), E> {
+        encode_packet(
+            kind,
+            self.sequence,
+            timestamp_us,
+            &self.scratch,
+            &mut self.packet,
+        );
+        self.sequence = self.sequence.wrapping_add(1);
+        send(&self.packet)?;
+        self.stats.packets += 1;
+        self.stats.bytes += self.packet.len() as u64;
+        Ok(())
+    }
+}
+
+impl Drop for VizClient {
+    fn drop(&mut self) {
+        self.tap.subscribers.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn leak_tap() -> &'static VizTap {
+        Box::leak(Box::new(VizTap::new()))
+    }
+
+    #[test]
+    fn packets_round_trip() {
+        let mut out = Vec::new();
+        encode_packet(VizKind::Leds, 7, 1_234_567, &[1, 2, 3, 4, 5, 6], &mut out);
+        assert_eq!(out.len(), HEADER_LEN + 6);
+        let packet = decode_packet(&out).unwrap();
+        assert_eq!(packet.kind, VizKind::Leds);
+        assert_eq!((packet.sequence, packet.timestamp_ms), (7, 1_234));
+        assert_eq!(packet.payload, &[1, 2, 3, 4, 5, 6]);
+
+        assert_eq!(decode_packet(&out[..HEADER_LEN - 1]), None);
+        assert_eq!(decode_packet(&out[..HEADER_LEN + 4]), None);
+        out[0] = b'{';
+        assert_eq!(decode_packet(&out), None);
+    }
+
+    #[test]
+    fn bands_are_pooled_and_quantized() {
+        let mut levels = Vec::new();
+        quantize_bands(&[0.0, 0.5, 1.0, 2.0], &mut levels);
+        assert_eq!(levels, [0, 128, 255, 255]);
+        let magnitudes: Vec<f32> = (0..512).map(|i| i as f32 / 511.0).collect();
+        quantize_bands(&magnitudes, &mut levels);
+        assert_eq!(levels.len(), MAX_BANDS);
+        assert_eq!(levels[MAX_BANDS - 1], 255);
+        assert!(levels.windows(2).all(|w| w[0] <= w[1]));
+    }
+
+    #[test]
+    fn publishing_needs_a_subscriber_and_sends_only_new_data() {
+        let tap = leak_tap();
+        tap.publish_leds(1_000, &[9; 6]);
+        let mut client = VizClient::new(tap, RateConfig::default());
+        assert!(poll(&mut client, 0, 0).is_empty());
+
+        tap.publish_leds(2_000, &[1; 6]);
+        tap.publish_bands(2_000, &[0.5; 4]);
+        let sent = poll(&mut client, 20_000, 0);
+        assert!(poll(&mut client, 40_000, 0).is_empty());
+        assert_eq!(sent.len(), 2);
+        let leds = decode_packet(&sent[0]).unwrap();
+        let bands = decode_packet(&sent[1]).unwrap();
+        assert_eq!(
+            (leds.kind, leds.sequence, leds.payload),
+            (VizKind::Leds, 0, &[1u8; 6][..])
+        );
+        assert_eq!((bands.kind, bands.sequence), (VizKind::Bands, 1));
+        assert_eq!(bands.payload, &[128; 4]);
+
+        drop(client);
+        assert!(!tap.has_subscribers());
+    }
+
+    #[test]
+    fn rate_halves_under_backlog_and_recovers() {
+        let tap = leak_tap();
+        let config = RateConfig::default();
+        let mut client = VizClient::new(tap, config);
+        // Not due yet: neither sent nor adapted.
+        poll(&mut client, 0, 0);
+        poll(&mut client, 1, config.high_water + 1);
+        assert_eq!(client.stats().congested, 0);
+
+        let mut sends = 0;
+        let mut now_us = client.next_due_us();
+        for _ in 0..4 {
+            tap.publish_leds(now_us, &[0; 3]);
+            sends += poll(&mut client, now_us, config.high_water + 1).len();
+            now_us = client.next_due_us();
+        }
+        // 60 -> 30 -> 15 -> 7.5 -> 5 (the floor).
+        assert_eq!(client.stats().fps, config.min_fps);
+        assert_eq!(client.stats().congested, 4);
+        assert_eq!(sends, 0);
+
+        for _ in 0..100 {
+            tap.publish_leds(now_us, &[0; 3]);
+            sends += poll(&mut client, now_us, 0).len();
+            now_us = client.next_due_us();
+        }
+        assert_eq!(client.stats().fps, config.max_fps);
+        assert_eq!(sends, 100);
+        assert_eq!(client.stats().bytes, 100 * (HEADER_LEN as u64 + 3));
+    }
+
+    // Packets `client` sends in one poll.
+    fn poll(client: &mut VizClient, now_us: u64, buffered: usize) -> Vec<Vec<u8>> {
+        let mut sent = Vec::new();
+        client
+            .poll(now_us, buffered, |data| {
+                sent.push(data.to_vec());
+                Ok::<_, ()>(())
+            })
+            .unwrap();
+        sent
+    }
+}
@@ -1,6 +1,8 @@
 use std::ffi::{CStr, CString};
+use std::path::{Path, PathBuf};
 use std::sync::{Arc, Mutex};
-use libc::c_char;
+use std::time::Duration;
+use libc::{c_char, c_int, c_void};
 use core::Config;
 use output::wled_control;
 use tokio::runtime::Runtime;
@@ -8,6 +10,10 @@ use log::{error, info};
 use once_cell::sync::Lazy;
 use tokio::sync::watch;
 use rtp_midi_lib;
+use network::discovery::MdnsDiscovery;
+use network::discovery_cache::{
+    run_maintenance, DiscoveryCache, DiscoveryChange, APPLE_MIDI_SERVICE, OSC_SERVICE,
+};
 
 static TOKIO_RUNTIME: Lazy<Runtime> = Lazy::new(|| {
     Runtime::new().expect("Failed to create global Tokio runtime for FFI")
@@ -20,6 +26,73 @@ pub struct ServiceHandle {
     worker_thread: Mutex<Option<tokio::task::JoinHandle<()>>>,
     tokio_rt_handle: tokio::runtime::Handle,
     shutdown_tx: Mutex<Option<watch::Sender<bool>>>,
+    discovery: Arc<DiscoveryCache>,
+    discovery_path: Option<PathBuf>,
+    // Keeps the mDNS daemon (and its browse threads) alive.
+    _mdns: MdnsDiscovery,
+    discovery_shutdown_tx: watch::Sender<bool>,
+}
+
+/// How often the discovery cache expires entries and persists itself.
+const DISCOVERY_MAINTENANCE_INTERVAL: Duration = Duration::from_secs(30);
+
+/// Change kinds passed to `DiscoveryCallback`.
+pub const DISCOVERY_ADDED: c_int = 0;
+pub const DISCOVERY_UPDATED: c_int = 1;
+pub const DISCOVERY_REMOVED: c_int = 2;
+
+/// C callback for discovery changes. The strings are only valid during the call.
+pub type DiscoveryCallback = extern "C" fn(
+    change: c_int,
+    name: *const c_char,
+    service_type: *const c_char,
+    ip: *const c_char,
+    port: u16,
+    user_data: *mut c_void,
+);
+
+// The caller guarantees `user_data` may be used from any thread.
+struct UserData(*mut c_void);
+unsafe impl Send for UserData {}
+unsafe impl Sync for UserData {}
+
+/// Path of the persisted discovery cache: `discovery_cache_path` from the
+/// config, otherwise next to the config file.
+fn discovery_cache_path(config_path: &str, config: Option<&Config>) -> Option<PathBuf> {
+    if let Some(path) = config.and_then(|c| c.discovery_cache_path.as_ref()) {
+        return Some(PathBuf::from(path));
+    }
+    if config_path.is_empty() {
+        return None;
+    }
+    Some(Path::new(config_path).with_file_name("discovery_cache.json"))
+}
+
+/// Restores the last-known-good services and starts background refresh.
+fn start_discovery(
+    path: Option<&Path>,
+) -> (Arc<DiscoveryCache>, MdnsDiscovery, watch::Sender<bool>) {
+    let cache = match path.map(DiscoveryCache::load) {
+        Some(Ok(cache)) => Arc::new(cache),
+        Some(Err(e)) => {
+            error!("Failed to load discovery cache: {}", e);
+            Arc::new(DiscoveryCache::new())
+        }
+        None => Arc::new(DiscoveryCache::new()),
+    };
+
+    let mdns = MdnsDiscovery::with_cache(Arc::clone(&cache));
+    mdns.browse_osc_services(|_, _, _| {});
+    mdns.browse_apple_midi_services(|_, _, _| {});
+
+    let (shutdown_tx, shutdown_rx) = watch::channel(false);
+    TOKIO_RUNTIME.spawn(run_maintenance(
+        Arc::clone(&cache),
+        path.map(Path::to_path_buf),
+        DISCOVERY_MAINTENANCE_INTERVAL,
+        shutdown_rx,
+    ));
+    (cache, mdns, shutdown_tx)
 }
 
 /// Creates a new service instance but does not start it.
@@ -45,11 +118,19 @@ pub unsafe extern "C" fn create_service(config_path: *const c_char) -> *mut Serv
         }
     };
     
+    // Known services are available immediately; mDNS refreshes them in the background.
+    let discovery_path = discovery_cache_path(path_str, config.as_ref());
+    let (discovery, mdns, discovery_shutdown_tx) = start_discovery(discovery_path.as_deref());
+
     let handle = Box::new(ServiceHandle {
         config: Arc::new(Mutex::new(config)),
         worker_thread: Mutex::new(None),
         tokio_rt_handle: TOKIO_RUNTIME.handle().clone(), // Clone handle from global Runtime
         shutdown_tx: Mutex::new(None),
+        discovery,
+        discovery_path,
+        _mdns: mdns,
+        discovery_shutdown_tx,
     });
 
     Box::into_raw(handle)
@@ -126,18 +207,20 @@ pub unsafe extern "C" fn start_android_hub_service(
     };
     drop(config_guard);
 
-    // Parse ESP32 IP address
-    let esp32_ip_str = if !esp32_ip.is_null() {
-        CStr::from_ptr(esp32_ip).to_str().unwrap_or("").to_string()
-    } else {
-        "192.168.1.100".to_string() // Default ESP32 IP
+    // Null addresses are resolved from the discovery cache.
+    let (esp32_ip_str, esp32_port) = match resolve_target(handle_ref, esp32_ip, esp32_port, OSC_SERVICE) {
+        Some(target) => target,
+        None => {
+            error!("Cannot start Android Hub service: no ESP32 address given or discovered.");
+            return;
+        }
     };
-
-    // Parse DAW IP address
-    let daw_ip_str = if !daw_ip.is_null() {
-        CStr::from_ptr(daw_ip).to_str().unwrap_or("").to_string()
-    } else {
-        "192.168.1.50".to_string() // Default DAW IP
+    let (daw_ip_str, daw_port) = match resolve_target(handle_ref, daw_ip, daw_port, APPLE_MIDI_SERVICE) {
+        Some(target) => target,
+        None => {
+            error!("Cannot start Android Hub service: no DAW address given or discovered.");
+            return;
+        }
     };
 
     // Update config with discovered addresses
@@ -160,6 +243,31 @@ pub unsafe extern "C" fn start_android_hub_service(
     info!("Android Hub service started via FFI.");
 }
 
+/// Explicit address if given, otherwise the best cached instance of `service_type`.
+unsafe fn resolve_target(
+    handle: &ServiceHandle,
+    ip: *const c_char,
+    port: u16,
+    service_type: &str,
+) -> Option<(String, u16)> {
+    if !ip.is_null() {
+        if let Ok(ip) = CStr::from_ptr(ip).to_str() {
+            if !ip.is_empty() {
+                return Some((ip.to_string(), port));
+            }
+        }
+    }
+    let service = handle.discovery.best(service_type)?;
+    info!(
+        "Using discovered {} at {}:{}{}",
+        service.name,
+        service.addr,
+        service.port,
+        if service.stale { " (last known)" } else { "" }
+    );
+    Some((service.addr.to_string(), service.port))
+}
+
 /// Stops the running service.
 ///
 /// # Safety
@@ -196,6 +304,15 @@ pub unsafe extern "C" fn destroy_service(handle: *mut ServiceHandle) {
     // This will signal the spawned task to stop.
     stop_service(handle);
 
+    // Persist the last-known-good services for the next start.
+    let handle_ref = &*handle;
+    let _ = handle_ref.discovery_shutdown_tx.send(true);
+    if let Some(path) = handle_ref.discovery_path.as_ref() {
+        if let Err(e) = handle_ref.discovery.save(path) {
+            error!("Failed to persist discovery cache: {}", e);
+        }
+    }
+
     // The ServiceHandle is owned by the Box, which will be dropped when it goes out of scope.
     // This will correctly clean up the Arc and other resources.
     let _ = Box::from_raw(handle);
@@ -207,10 +324,12 @@ async fn run_android_hub_service(config: Config, mut shutdown_rx: watch::Receive
     info!("Android Hub service starting...");
     
     // Initialize OSC sender for ESP32
-    let esp32_target = if let (Some(ip), Some(port)) = (config.esp32_ip.as_ref(), config.esp32_port) {
-        format!("{}:{}", ip, port)
-    } else {
-        "192.168.1.100:8000".to_string() // Default ESP32 address
+    let esp32_target = match (config.esp32_ip.as_ref(), config.esp32_port) {
+        (Some(ip), Some(port)) => format!("{}:{}", ip, port),
+        _ => {
+            error!("Android Hub service has no ESP32 address.");
+            return;
+        }
     };
     
     let mut osc_sender = match output::osc_output::OscSender::new(&esp32_target) {
@@ -222,10 +341,12 @@ async fn run_android_hub_service(config: Config, mut shutdown_rx: watch::Receive
     };
     
     // Initialize RTP-MIDI session for DAW
-    let daw_target = if let (Some(ip), Some(port)) = (config.daw_ip.as_ref(), config.daw_port) {
-        format!("{}:{}", ip, port)
-    } else {
-        "192.168.1.50:5004".to_string() // Default DAW address
+    let daw_target = match (config.daw_ip.as_ref(), config.daw_port) {
+        (Some(ip), Some(port)) => format!("{}:{}", ip, port),
+        _ => {
+            error!("Android Hub service has no DAW address.");
+            return;
+        }
     };
     
     // Start the main service loop with Android Hub specific logic
@@ -279,3 +400,165 @@ pub unsafe extern "C" fn free_string(s: *mut c_char) {
     if s.is_null() { return; }
     let _ = CString::from_raw(s);
 }
+
+/// Returns the discovery cache as a JSON array of
+/// `{name, service_type, addr, port, last_seen_unix}` objects.
+/// The string must be freed with `free_string`.
+/// # Safety
+/// The `handle` must be a valid pointer.
+#[no_mangle]
+pub unsafe extern "C" fn get_discovery_snapshot(handle: *mut ServiceHandle) -> *mut c_char {
+    if handle.is_null() { return std::ptr::null_mut(); }
+    let handle_ref = &*handle;
+    match serde_json::to_string(&handle_ref.discovery.snapshot()) {
+        Ok(json) => CString::new(json).map(CString::into_raw).unwrap_or(std::ptr::null_mut()),
+        Err(_) => std::ptr::null_mut(),
+    }
+}
+
+/// Registers a callback for discovery changes; returns an id for
+/// `unregister_discovery_callback`. The callback may run on any thread.
+/// # Safety
+/// The `handle` must be a valid pointer and `user_data` must stay valid
+/// until the callback is unregistered.
+#[no_mangle]
+pub unsafe extern "C" fn register_discovery_callback(
+    handle: *mut ServiceHandle,
+    callback: DiscoveryCallback,
+    user_data: *mut c_void,
+) -> u64 {
+    if handle.is_null() { return 0; }
+    let handle_ref = &*handle;
+    let user_data = UserData(user_data);
+    handle_ref.discovery.subscribe(move |change| {
+        let (kind, service) = match change {
+            DiscoveryChange::Added(s) => (DISCOVERY_ADDED, s),
+            DiscoveryChange::Updated(s) => (DISCOVERY_UPDATED, s),
+            DiscoveryChange::Removed(s) => (DISCOVERY_REMOVED, s),
+        };
+        let (Ok(name), Ok(service_type), Ok(ip)) = (
+            CString::new(service.name.as_str()),
+            CString::new(service.service_type.as_str()),
+            CString::new(service.addr.to_string()),
+        ) else {
+            return;
+        };
+        callback(kind, name.as_ptr(), service_type.as_ptr(), ip.as_ptr(), service.port, user_data.0);
+    })
+}
+
+/// Removes a callback registered with `register_discovery_callback`.
+/// # Safety
+/// The `handle` must be a valid pointer.
+#[no_mangle]
+pub unsafe extern "C" fn unregister_discovery_callback(handle: *mut ServiceHandle, id: u64) {
+    if handle.is_null() { return; }
+    (&*handle).discovery.unsubscribe(id);
+}
+
+/// Feeds a service resolved by the host platform (e.g. Android NsdManager)
+/// into the discovery cache.
+/// # Safety
+/// The `handle` must be a valid pointer; strings must be valid C strings.
+#[no_mangle]
+pub unsafe extern "C" fn report_discovered_service(
+    handle: *mut ServiceHandle,
+    name: *const c_char,
+    service_type: *const c_char,
+    ip: *const c_char,
+    port: u16,
+    ttl_secs: u32,
+) {
+    if handle.is_null() || name.is_null() || service_type.is_null() || ip.is_null() { return; }
+    let handle_ref = &*handle;
+    let (Ok(name), Ok(service_type), Ok(ip)) = (
+        CStr::from_ptr(name).to_str(),
+        CStr::from_ptr(service_type).to_str(),
+        CStr::from_ptr(ip).to_str(),
+    ) else {
+        return;
+    };
+    match ip.parse() {
+        Ok(addr) => handle_ref.discovery.upsert(
+            name,
+            service_type,
+            addr,
+            port,
+            Duration::from_secs(ttl_secs as u64),
+        ),
+        Err(_) => error!("FFI: Invalid address '{}' for discovered service {}", ip, name),
+    }
+}
+
+/// Enables or disables pipeline span tracing (off by default).
+#[no_mangle]
+pub extern "C" fn trace_set_enabled(enabled: bool) {
+    rtp_midi_core::trace::set_enabled(enabled);
+}
+
+/// Drops all recorded trace spans.
+#[no_mangle]
+pub extern "C" fn trace_clear() {
+    rtp_midi_core::trace::clear();
+}
+
+/// Returns the recorded spans as Chrome trace JSON (chrome://tracing, Perfetto).
+/// The string must be freed with `free_string`.
+#[no_mangle]
+pub extern "C" fn trace_export_chrome_json() -> *mut c_char {
+    CString::new(rtp_midi_core::trace::export_chrome_json())
+        .map(CString::into_raw)
+        .unwrap_or(std::ptr::null_mut())
+}
+
+/// Average capture-to-analysis delay of the audio path (µs).
+#[no_mangle]
+pub extern "C" fn av_sync_audio_delay_us() -> u64 {
+    rtp_midi_core::av_sync::global().audio_delay_us()
+}
+
+/// Delay currently applied to MIDI-driven light (µs; 0 unless `av_sync.mode = "delay_midi"`).
+#[no_mangle]
+pub extern "C" fn av_sync_midi_delay_us() -> u64 {
+    rtp_midi_core::av_sync::global().midi_delay_us()
+}
+
+/// Remaining lag of audio-driven behind MIDI-driven light (µs).
+#[no_mangle]
+pub extern "C" fn av_sync_offset_us() -> i64 {
+    rtp_midi_core::av_sync::global().offset_us()
+}
+
+/// Renders a song offline (WAV plus optional Standard MIDI File, `midi_path`
+/// may be null) into a show file with the service's LED settings. Blocks
+/// until done; returns the number of frames written, or -1 on error.
+/// # Safety
+/// The `handle` must be a valid pointer; the paths valid C strings.
+#[no_mangle]
+pub unsafe extern "C" fn render_show_offline(
+    handle: *mut ServiceHandle,
+    wav_path: *const c_char,
+    midi_path: *const c_char,
+    out_path: *const c_char,
+) -> i64 {
+    if handle.is_null() || wav_path.is_null() || out_path.is_null() { return -1; }
+    let handle_ref = &*handle;
+    let config = match handle_ref.config.lock().unwrap().as_ref() {
+        Some(config) => rtp_midi_lib::offline::OfflineConfig::from_config(config),
+        None => return -1,
+    };
+    let wav = CStr::from_ptr(wav_path).to_string_lossy().into_owned();
+    let out = CStr::from_ptr(out_path).to_string_lossy().into_owned();
+    let midi = (!midi_path.is_null())
+        .then(|| PathBuf::from(CStr::from_ptr(midi_path).to_string_lossy().into_owned()));
+    match rtp_midi_lib::offline::render_files(&wav, midi.as_deref(), &out, &config) {
+        Ok(stats) => {
+            info!("FFI: Rendered {} frames of {} into {}", stats.frames, wav, out);
+            stats.frames as i64
+        }
+        Err(e) => {
+            error!("FFI: Offline render of {} failed: {}", wav, e);
+            -1
+        }
+    }
+}
@@ -6,7 +6,7 @@ import tech.sparrow-ai.rtpmidi 1.0
 ApplicationWindow {
     visible: true
     width: 480
-    height: 320
+    height: 480
     title: "RTP-MIDI Control"
 
     // Instance našeho C++ bridge
@@ -44,6 +44,13 @@ ApplicationWindow {
                 id: ipLabel
                 text: rustService.wledIp
             }
+
+            Label { text: "Audio delay:" }
+            Label {
+                text: rustService.audioDelayMs.toFixed(1) + " ms (MIDI +"
+                      + rustService.midiDelayMs.toFixed(1) + " ms, offset "
+                      + rustService.avOffsetMs.toFixed(1) + " ms)"
+            }
         }
         
         RowLayout {
@@ -83,6 +90,51 @@ ApplicationWindow {
             }
         }
         
+        GroupBox {
+            title: "Tracing"
+            Layout.fillWidth: true
+
+            RowLayout {
+                CheckBox {
+                    id: tracingCheckBox
+                    text: "Record pipeline spans"
+                    onToggled: rustService.setTracingEnabled(checked)
+                }
+                Button {
+                    text: "Export trace"
+                    onClicked: rustService.exportTrace("rtp-midi-trace.json")
+                }
+            }
+        }
+
+        GroupBox {
+            title: "Offline render"
+            Layout.fillWidth: true
+
+            GridLayout {
+                anchors.fill: parent
+                columns: 2
+
+                Label { text: "WAV:" }
+                TextField { id: wavField; placeholderText: "song.wav"; Layout.fillWidth: true }
+                Label { text: "MIDI:" }
+                TextField { id: midiField; placeholderText: "song.mid (optional)"; Layout.fillWidth: true }
+                Label { text: "Show:" }
+                TextField { id: showField; text: "song.rmshow"; Layout.fillWidth: true }
+                Button {
+                    text: rustService.isRendering ? "Rendering..." : "Render"
+                    enabled: !rustService.isRendering && wavField.text.length > 0
+                    onClicked: rustService.renderShow(wavField.text, midiField.text, showField.text)
+                }
+                Label { id: renderResult }
+            }
+        }
+
+        Connections {
+            target: rustService
+            function onRenderFinished(frames) { renderResult.text = frames + " frames rendered" }
+        }
+
         Item { Layout.fillHeight: true } // Spacer
     }
 
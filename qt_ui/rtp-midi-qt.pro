@@ -31,6 +31,11 @@ copy_rust_lib.commands = $$(COPY_FILE) $$RUST_LIB_PATH/$$RUST_LIB_NAME $$OUT_PWD
 QMAKE_EXTRA_TARGETS += copy_rust_lib
 PRE_TARGETDEPS += $$copy_rust_lib.target
 
+# `make check`: hub loopback test (fake DAW, WLED and ESP32), see
+# integration_tests/src/bin/loopback.rs
+check.commands = cd $$PWD/.. && cargo run --release -p integration_tests --bin loopback -- --seconds 5
+QMAKE_EXTRA_TARGETS += check
+
 SOURCES += \
     main.cpp \
     rust_service_bridge.cpp
@@ -1,6 +1,7 @@
 #include "rust_service_bridge.h"
 #include <QDebug>
 #include <QThread>
+#include <QFile>
 
 // Deklarace funkcí z naší Rust knihovny
 extern "C" {
@@ -11,6 +12,14 @@ extern "C" {
     void set_wled_preset(ServiceHandle* handle, int32_t preset_id);
     char* get_wled_ip(ServiceHandle* handle);
     void free_string(char* s);
+    void trace_set_enabled(bool enabled);
+    void trace_clear();
+    char* trace_export_chrome_json();
+    uint64_t av_sync_audio_delay_us();
+    uint64_t av_sync_midi_delay_us();
+    int64_t av_sync_offset_us();
+    int64_t render_show_offline(ServiceHandle* handle, const char* wav_path,
+                                const char* midi_path, const char* out_path);
 }
 
 RustServiceBridge::RustServiceBridge(QObject *parent)
@@ -28,6 +37,10 @@ RustServiceBridge::RustServiceBridge(QObject *parent)
         // Získání počátečních hodnot z Rustu
         updateStatus();
     }
+
+    // Zpoždění audio/MIDI se mění s audio bufferem, proto se průběžně čte
+    connect(&m_latencyTimer, &QTimer::timeout, this, &RustServiceBridge::updateLatency);
+    m_latencyTimer.start(500);
 }
 
 RustServiceBridge::~RustServiceBridge()
@@ -49,6 +62,26 @@ QString RustServiceBridge::wledIp() const
     return m_wledIp;
 }
 
+double RustServiceBridge::audioDelayMs() const
+{
+    return m_audioDelayMs;
+}
+
+double RustServiceBridge::midiDelayMs() const
+{
+    return m_midiDelayMs;
+}
+
+double RustServiceBridge::avOffsetMs() const
+{
+    return m_avOffsetMs;
+}
+
+bool RustServiceBridge::isRendering() const
+{
+    return m_isRendering;
+}
+
 void RustServiceBridge::start()
 {
     if (!m_serviceHandle || m_isRunning) return;
@@ -85,6 +118,66 @@ void RustServiceBridge::setWledPreset(int presetId)
     set_wled_preset(m_serviceHandle, presetId);
 }
 
+void RustServiceBridge::setTracingEnabled(bool enabled)
+{
+    qInfo() << "Pipeline tracing" << (enabled ? "enabled" : "disabled");
+    if (enabled) {
+        trace_clear(); // Každé nahrávání začíná s prázdným bufferem
+    }
+    trace_set_enabled(enabled);
+}
+
+bool RustServiceBridge::exportTrace(const QString& path)
+{
+    char* json = trace_export_chrome_json();
+    if (!json) {
+        emit errorOccurred("Failed to export trace.");
+        return false;
+    }
+    QFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (ok) {
+        ok = file.write(json) >= 0;
+    }
+    free_string(json);
+    if (!ok) {
+        qWarning() << "Failed to write trace to" << path;
+        emit errorOccurred("Failed to write trace file.");
+        return false;
+    }
+    qInfo() << "Trace written to" << path << "(open in chrome://tracing or Perfetto)";
+    return true;
+}
+
+void RustServiceBridge::renderShow(const QString& wavPath, const QString& midiPath, const QString& outPath)
+{
+    if (!m_serviceHandle || m_isRendering) return;
+
+    qInfo() << "Rendering" << wavPath << "offline into" << outPath;
+    m_isRendering = true;
+    emit isRenderingChanged();
+    // Render vytíží všechna jádra, UI vlákno nesmí čekat
+    QThread* thread = QThread::create([this, wavPath, midiPath, outPath]() {
+        const QByteArray wav = wavPath.toUtf8();
+        const QByteArray midi = midiPath.toUtf8();
+        const QByteArray out = outPath.toUtf8();
+        const qint64 frames = render_show_offline(m_serviceHandle, wav.constData(),
+                                                  midi.isEmpty() ? nullptr : midi.constData(),
+                                                  out.constData());
+        QMetaObject::invokeMethod(this, [this, frames]() {
+            m_isRendering = false;
+            emit isRenderingChanged();
+            if (frames < 0) {
+                emit errorOccurred("Offline render failed.");
+            } else {
+                emit renderFinished(frames);
+            }
+        }, Qt::QueuedConnection);
+    });
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    thread->start();
+}
+
 void RustServiceBridge::updateStatus()
 {
     if (!m_serviceHandle) return;
@@ -100,3 +193,17 @@ void RustServiceBridge::updateStatus()
         }
     }
 }
+
+void RustServiceBridge::updateLatency()
+{
+    const double audio = av_sync_audio_delay_us() / 1000.0;
+    const double midi = av_sync_midi_delay_us() / 1000.0;
+    const double offset = av_sync_offset_us() / 1000.0;
+    if (audio == m_audioDelayMs && midi == m_midiDelayMs && offset == m_avOffsetMs) {
+        return;
+    }
+    m_audioDelayMs = audio;
+    m_midiDelayMs = midi;
+    m_avOffsetMs = offset;
+    emit latencyChanged();
+}
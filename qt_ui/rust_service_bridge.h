@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QString>
+#include <QTimer>
 
 // Opaque pointer k Rust struktuře
 struct ServiceHandle;
@@ -12,6 +13,11 @@ class RustServiceBridge : public QObject
     Q_OBJECT
     Q_PROPERTY(bool isRunning READ isRunning NOTIFY isRunningChanged)
     Q_PROPERTY(QString wledIp READ wledIp NOTIFY wledIpChanged)
+    // Zpoždění audio cesty a jeho vyrovnání s MIDI světlem (ms)
+    Q_PROPERTY(double audioDelayMs READ audioDelayMs NOTIFY latencyChanged)
+    Q_PROPERTY(double midiDelayMs READ midiDelayMs NOTIFY latencyChanged)
+    Q_PROPERTY(double avOffsetMs READ avOffsetMs NOTIFY latencyChanged)
+    Q_PROPERTY(bool isRendering READ isRendering NOTIFY isRenderingChanged)
 
 public:
     explicit RustServiceBridge(QObject *parent = nullptr);
@@ -19,15 +25,26 @@ public:
 
     bool isRunning() const;
     QString wledIp() const;
+    double audioDelayMs() const;
+    double midiDelayMs() const;
+    double avOffsetMs() const;
+    bool isRendering() const;
 
 public slots:
     void start();
     void stop();
     void setWledPreset(int presetId);
+    void setTracingEnabled(bool enabled);
+    bool exportTrace(const QString& path);
+    // Offline render písně (WAV + volitelně MIDI) do show souboru
+    void renderShow(const QString& wavPath, const QString& midiPath, const QString& outPath);
 
 signals:
     void isRunningChanged();
     void wledIpChanged();
+    void latencyChanged();
+    void isRenderingChanged();
+    void renderFinished(qint64 frames);
     void errorOccurred(const QString& message);
 
 private:
@@ -35,8 +52,14 @@ private:
     ServiceHandle* m_serviceHandle;
     bool m_isRunning;
     QString m_wledIp;
+    double m_audioDelayMs = 0.0;
+    double m_midiDelayMs = 0.0;
+    double m_avOffsetMs = 0.0;
+    bool m_isRendering = false;
+    QTimer m_latencyTimer;
 
     void updateStatus();
+    void updateLatency();
 };
 
 #endif // RUST_SERVICE_BRIDGE_H
@@ -0,0 +1,60 @@
+//! Benchmark offline renderu: 30 s písně (48 kHz stereo, banka filtrů,
+//! 300 LED, 60 fps, nota každou čtvrtinu) do show souboru. Pětiminutová
+//! píseň trvá zhruba desetinásobek.
+
+use audio::wav::WavFile;
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use rtp_midi_core::MidiEvent;
+use rtp_midi_lib::offline::{render, OfflineConfig};
+
+const RATE: u32 = 48_000;
+const SECONDS: usize = 30;
+
+fn song() -> WavFile {
+    let frames = RATE as usize * SECONDS;
+    let mut bytes = b"RIFF\0\0\0\0WAVEfmt ".to_vec();
+    for field in [16u32, 0x0002_0001, RATE, RATE * 4, 0x0010_0004] {
+        bytes.extend_from_slice(&field.to_le_bytes());
+    }
+    bytes.extend_from_slice(b"data");
+    bytes.extend_from_slice(&(frames as u32 * 4).to_le_bytes());
+    for i in 0..frames {
+        let hz = if (i / 24_000) % 2 == 0 { 80.0 } else { 2_000.0 };
+        let phase = 2.0 * std::f32::consts::PI * hz * i as f32 / RATE as f32;
+        let sample = ((phase.sin() * 12_000.0) as i16).to_le_bytes();
+        bytes.extend_from_slice(&sample);
+        bytes.extend_from_slice(&sample);
+    }
+    WavFile::from_bytes(bytes).unwrap()
+}
+
+fn bench_offline_render(c: &mut Criterion) {
+    let audio = song();
+    let midi: Vec<MidiEvent> = (0..SECONDS as u64 * 2)
+        .flat_map(|i| {
+            let key = 36 + (i % 48) as u8;
+            [
+                MidiEvent::note_on(0, key, 100, i * 500_000),
+                MidiEvent::note_off(0, key, 0, i * 500_000 + 250_000),
+            ]
+        })
+        .collect();
+    let config = OfflineConfig {
+        led_count: 300,
+        analysis: Some("filterbank".into()),
+        ..Default::default()
+    };
+    let path = std::env::temp_dir().join(format!("bench_offline_{}.rmshow", std::process::id()));
+
+    let mut group = c.benchmark_group("offline_render");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(SECONDS as u64 * 60));
+    group.bench_function("filterbank/30s", |b| {
+        b.iter(|| render(&audio, &midi, &path, &config).unwrap())
+    });
+    group.finish();
+    let _ = std::fs::remove_file(&path);
+}
+
+criterion_group!(benches, bench_offline_render);
+criterion_main!(benches);
@@ -1,21 +1,35 @@
-use std::net::{IpAddr, Ipv4Addr, SocketAddr};
-use std::sync::Arc;
-use std::time::{Duration, SystemTime, UNIX_EPOCH};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
 
-use log::{error, info};
+use log::{debug, error, info, warn};
 
 // --- Modular Crate Imports ---
-use audio::audio_analysis::compute_fft_magnitudes;
+use audio::audio_analysis::Analyzer;
 use audio::audio_input;
-use network::midi::rtp::message::MidiMessage;
-use network::midi::rtp::session::RtpMidiSession;
-use output::ddp_output::{create_ddp_sender, DdpReceiver, DdpSender};
-use output::light_mapper::{map_leds_with_preset, MappingPreset};
+use network::midi::rtp::session::ReceivedMidi;
+use network::midi::rtp::session_host::{SessionHost, SessionHostConfig};
+use output::ddp_output::DdpReceiver;
+use output::frame_scheduler::{FrameScheduler, FrameSchedulerConfig, LiveState};
+use output::light_mapper::MappingPreset;
+use output::note_renderer::NoteRendererConfig;
+use output::router::OutputRouter;
+use output::show::{RecorderConfig, ShowPlayer, ShowRecorder};
+use output::viz_stream;
 use output::wled_control::WledSender;
+use rtp_midi_core::av_sync;
+use rtp_midi_core::clock::{system_clock, ClockAttachment, SharedClock};
+use rtp_midi_core::trace::{self, Stage};
 use rtp_midi_core::{event_bus, DataStreamNetReceiver, DataStreamNetSender};
-use rtp_midi_core::{parse_midi_message, InputEvent, MappingOutput, MidiCommand};
+use rtp_midi_core::{ColorCorrection, ColorOrder, InputEvent, MappingOutput};
+use rtp_midi_core::{OutputSegment, OutputTarget};
+use tokio::sync::broadcast;
 use tokio::sync::watch;
-use tokio::sync::Mutex;
+
+pub mod offline;
+
+// RTP-MIDI packets queued for the main loop between two of its 10 ms ticks.
+const MIDI_QUEUE_PACKETS: usize = 1024;
 
 // --- Structs defined at the library root ---
 
@@ -32,6 +46,17 @@ use tokio::sync::Mutex;
 /// if let MappingOutput::Wled(action) = ... { wled_sender.send(...); }
 /// if let MappingOutput::Ddp(action) = ... { ddp_sender.send(...); }
 pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>) {
+    run_service_loop_with_clock(config, shutdown_rx, system_clock()).await
+}
+
+/// Service loop paced by `clock`: the main loop, DDP receiver polling, LED
+/// frame clock and session host all take their time from it. With a
+/// `VirtualClock` a test drives the service faster than real time.
+pub async fn run_service_loop_with_clock(
+    config: Config,
+    mut shutdown_rx: watch::Receiver<bool>,
+    clock: SharedClock,
+) {
     info!("Service loop starting...");
 
     let wled_ip = config.wled_ip.clone();
@@ -41,18 +66,43 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
 
     // --- Výstupní zařízení ---
     let mut wled_sender = WledSender::new(wled_ip.clone());
-    let ddp_ip = wled_ip.clone();
-    let mut ddp_sender = match create_ddp_sender(&ddp_ip, ddp_port, config.led_count, false) {
-        Ok(sender) => DdpSender::new(sender),
+    // LED plátno se dělí na segmenty; bez `outputs` jde celé přes DDP na wled_ip.
+    let segments = config.outputs.clone().unwrap_or_else(|| {
+        vec![OutputSegment {
+            target: OutputTarget::Ddp {
+                ip: wled_ip.clone(),
+                port: Some(ddp_port),
+            },
+            offset: 0,
+            length: config.led_count,
+            color_order: ColorOrder::Rgb,
+            color: ColorCorrection {
+                rgbw: config.color_format.as_deref() == Some("RGBW"),
+                ..Default::default()
+            },
+            fps: None,
+        }]
+    });
+    let output_router = match OutputRouter::open(&segments) {
+        Ok(router) => router,
         Err(e) => {
-            error!("Failed to create DDP sender: {}", e);
-            panic!("Failed to create DDP sender: {}", e);
+            error!("Failed to open LED outputs: {}", e);
+            panic!("Failed to open LED outputs: {}", e);
         }
     };
+    let canvas_len = output_router.canvas_len().max(config.led_count);
+    // ESP32 vizualizéry dostávají i živé MIDI, dávkově jednou za tick;
+    // OSC desky každou událost hned jako `/midi`.
+    let mut esp32_links = output_router.event_links();
+    let mut esp32_events = Vec::new();
+    let osc_event_senders = output_router.osc_event_senders();
 
     // --- DDP Receiver Thread ---
     let ddp_shutdown_rx = shutdown_rx.clone();
+    let ddp_clock = clock.clone();
+    let ddp_attachment = ClockAttachment::new(&clock);
     let ddp_task = tokio::spawn(async move {
+        let _attachment = ddp_attachment;
         let mut receiver = DdpReceiver::new();
         if let Err(e) = receiver.init() {
             error!("Failed to initialize DDP receiver: {}", e);
@@ -68,17 +118,17 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
                         break;
                     }
                 }
-                _ = tokio::time::sleep(std::time::Duration::from_millis(5)) => {
+                _ = ddp_clock.sleep_until_async(ddp_clock.now_us() + 5_000) => {
                     match receiver.poll(&mut buf) {
                         Ok(Some((ts, len))) => {
-                            info!("Received DDP frame: timestamp={}ms, len={}", ts, len);
+                            debug!("Received DDP frame: timestamp={}ms, len={}", ts, len);
                         }
                         Ok(None) => {
                             // No data available, continue
                         }
                         Err(e) => {
                             error!("DDP receiver error: {}", e);
-                            tokio::time::sleep(std::time::Duration::from_millis(100)).await;
+                            ddp_clock.sleep_until_async(ddp_clock.now_us() + 100_000).await;
                         }
                     }
                 }
@@ -90,7 +140,6 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
     let event_bus = event_bus::EventBus::new(32);
     let event_tx = event_bus.sender.clone();
     let mut audio_event_rx = event_tx.subscribe();
-    let mut midi_event_rx = event_tx.subscribe();
     let network_send_rx = event_tx.subscribe();
     let network_recv_tx = event_tx.clone();
 
@@ -99,12 +148,14 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
 
     // --- Start Network Interface Task ---
     let mut network_shutdown_rx = shutdown_rx.clone();
+    let network_clock = clock.clone();
     let network_task = tokio::spawn(async move {
         network::network_interface::start_network_interface(
             network_send_rx,
             network_recv_tx,
             midi_port,
             &mut network_shutdown_rx,
+            network_clock,
         )
         .await
         .expect("Failed to start network interface");
@@ -113,133 +164,226 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
     // --- Start Audio Input Thread ---
     let audio_input_config = config.clone();
     let event_tx_clone = event_tx.clone();
-    let audio_stream = match audio_input::start_audio_input(
-        audio_input_config.audio_device.as_deref(),
-        event_tx_clone,
-    ) {
-        Ok(stream) => stream,
-        Err(e) => {
-            error!("Failed to start audio input stream: {}", e);
-            return;
+    // `audio_device = "none"` runs without capture (MIDI-only light, loopback tests).
+    let audio_stream = match audio_input_config.audio_device.as_deref() {
+        Some("none") => {
+            info!("Audio input disabled.");
+            None
         }
+        device => match audio_input::start_audio_input(device, event_tx_clone, clock.clone()) {
+            Ok(stream) => Some(stream),
+            Err(e) => {
+                error!("Failed to start audio input stream: {}", e);
+                return;
+            }
+        },
     };
     // Keep the stream alive by storing it in a variable that will be dropped when the function ends
     let _audio_stream_guard = audio_stream;
 
-    // --- Start RTP-MIDI Session Task ---
-    let event_tx_clone_midi = event_tx.clone();
+    // --- Start RTP-MIDI Session Host ---
+    // Každý peer (DAW, controller) má vlastní stav shardovaný podle SSRC.
+    let mut host_config = SessionHostConfig {
+        clock: clock.clone(),
+        ..Default::default()
+    };
+    if let Some(workers) = config.midi_workers {
+        host_config.workers = workers;
+    }
+    // MIDI reaches the main loop on its own queue, one entry per packet, so
+    // a dense packet cannot push its own commands (or audio) off the bus.
+    let (midi_tx, midi_rx) = std::sync::mpsc::sync_channel::<ReceivedMidi>(MIDI_QUEUE_PACKETS);
+    let midi_dropped = Arc::new(AtomicU64::new(0));
+    let host_midi_dropped = midi_dropped.clone();
+    let event_tx_out = event_tx.clone();
+    let session_host = SessionHost::start(
+        host_config,
+        Arc::new(move |received: ReceivedMidi| {
+            if midi_tx.try_send(received).is_err() {
+                host_midi_dropped.fetch_add(1, Ordering::Relaxed);
+            }
+        }),
+        Arc::new(move |dest_addr, payload| {
+            if let Err(e) = event_tx_out.send(event_bus::Event::SendPacket { payload, dest_addr }) {
+                error!(
+                    "Failed to send outgoing RTP-MIDI packet to event bus: {}",
+                    e
+                );
+            }
+        }),
+    );
+    let mut raw_packet_rx = event_tx.subscribe();
     tokio::spawn(async move {
-        let session = Arc::new(Mutex::new(
-            RtpMidiSession::new(
-                "Rust WLED Hub".to_string(),
-                midi_port,
-                Some(event_tx_clone_midi.clone()),
-            )
-            .await
-            .expect("Failed to create RTP-MIDI session"),
-        ));
-
-        let mut raw_packet_rx = event_tx_clone_midi.subscribe();
-        let _session_clone = Arc::clone(&session);
-        let event_tx_clone_midi_inner = event_tx_clone_midi.clone();
-        tokio::spawn(async move {
-            while let Ok(event) = raw_packet_rx.recv().await {
-                if let event_bus::Event::RawPacketReceived {
+        loop {
+            match raw_packet_rx.recv().await {
+                Ok(event_bus::Event::RawPacketReceived {
                     payload,
                     source_addr,
-                } = event
-                {
-                    info!(
-                        "RTP-MIDI Session received raw packet from {}: {:?}",
-                        source_addr, payload
+                    received_at_us,
+                }) => {
+                    debug!(
+                        "RTP-MIDI host received {} bytes from {}",
+                        payload.len(),
+                        source_addr
                     );
-                    _session_clone
-                        .lock()
-                        .await
-                        .handle_incoming_packet(payload, &event_tx_clone_midi_inner, source_addr)
+                    session_host
+                        .dispatch(payload, source_addr, received_at_us)
                         .await;
                 }
+                Ok(_) => {}
+                Err(tokio::sync::broadcast::error::RecvError::Lagged(n)) => {
+                    warn!("RTP-MIDI host lagged behind the event bus by {} events.", n);
+                }
+                Err(tokio::sync::broadcast::error::RecvError::Closed) => break,
+            }
+        }
+        session_host.shutdown().await;
+    });
+    info!(
+        "RTP-MIDI Server started on port {}. Waiting for connections...",
+        midi_port
+    );
+
+    // --- LED Frame Clock ---
+    // Snímky se renderují v pevném taktu z posledního stavu audia a MIDI,
+    // nezávisle na velikosti audio bufferu.
+    let mapping_preset = MappingPreset::from_name(config.mapping_preset.as_deref());
+    let live_state = Arc::new(LiveState::new(
+        canvas_len,
+        mapping_preset,
+        NoteRendererConfig::default(),
+    ));
+    let mut frame_config = FrameSchedulerConfig::default();
+    if let Some(fps) = config.led_fps {
+        frame_config.fps = fps;
+    }
+    if let Some(ms) = config.led_keepalive_ms {
+        frame_config.keepalive = Duration::from_millis(ms);
+    }
+
+    // --- Show Recording / Playback ---
+    // Záznam MIDI, analýzy a výsledných snímků; přehrávání nahrazuje živý
+    // render uloženými snímky (ve smyčce).
+    let recorder = config.show_record.as_deref().and_then(|path| {
+        match ShowRecorder::create(path, RecorderConfig::default()) {
+            Ok(recorder) => {
+                info!("Recording show to {}", path);
+                Some(recorder)
+            }
+            Err(e) => {
+                error!("Failed to create show file {}: {}", path, e);
+                None
+            }
+        }
+    });
+    let recorder = Arc::new(Mutex::new(recorder));
+    let playback = config
+        .show_play
+        .as_deref()
+        .and_then(|path| match ShowPlayer::open(path) {
+            Ok(player) => player.time_range().map(|range| (player, range)),
+            Err(e) => {
+                error!("Failed to open show file {}: {}", path, e);
+                None
             }
         });
 
-        let _session_clone = Arc::clone(&session);
-        let event_tx_clone_midi2 = event_tx_clone_midi.clone();
-        _session_clone
-            .lock()
-            .await
-            .add_outgoing_packet_handler(move |destination, port, data| {
-                let ip: IpAddr = destination
-                    .parse()
-                    .unwrap_or(IpAddr::V4(Ipv4Addr::LOCALHOST));
-                let dest_addr = SocketAddr::new(ip, port);
-                if let Err(e) = event_tx_clone_midi2.send(event_bus::Event::SendPacket {
-                    payload: data.to_vec(),
-                    dest_addr,
-                }) {
-                    error!(
-                        "Failed to send outgoing RTP-MIDI packet to event bus: {}",
-                        e
-                    );
+    let render_state = live_state.clone();
+    let frame_recorder = recorder.clone();
+    let started_us = clock.now_us();
+    let mut frame_scheduler = FrameScheduler::spawn_with_clock(
+        frame_config,
+        clock.clone(),
+        move |now_us, frame| {
+            let _span = trace::span(Stage::OutputEncode, now_us);
+            match &playback {
+                Some((player, (first_us, last_us))) => {
+                    let length = (last_us - first_us).max(1);
+                    player.frame_at(first_us + now_us.saturating_sub(started_us) % length, frame);
                 }
-            })
-            .await;
+                None => render_state.render(now_us, frame),
+            }
+            if let Some(recorder) = frame_recorder.lock().unwrap().as_mut() {
+                recorder.record_frame(now_us, frame);
+            }
+            viz_stream::tap().publish_leds(now_us, frame);
+        },
+        output_router,
+    );
+    let mut stats_logged_at = clock.now_us();
+    let mut midi_dropped_logged = 0;
 
-        let _session_clone = Arc::clone(&session);
-        let event_tx_clone_midi3 = event_tx_clone_midi.clone();
-        _session_clone
-            .lock()
-            .await
-            .add_midi_command_handler(move |commands: Vec<MidiMessage>| {
-                for command in commands {
-                    let timestamp = SystemTime::now()
-                        .duration_since(UNIX_EPOCH)
-                        .unwrap_or_default()
-                        .as_millis() as u64;
-                    let peer = SocketAddr::new(IpAddr::V4(Ipv4Addr::LOCALHOST), 0);
-                    if let Err(e) =
-                        event_tx_clone_midi3.send(event_bus::Event::MidiCommandsReceived {
-                            commands: command.command.clone(),
-                            timestamp,
-                            peer,
-                        })
-                    {
-                        error!("Failed to send MIDI command to event bus: {}", e);
+    // --- Audio/MIDI Alignment ---
+    // Audio path delay is measured continuously; MIDI light can wait for it.
+    let av_sync = av_sync::global();
+    av_sync.configure(&config.av_sync.unwrap_or_default());
+
+    // --- Audio Analysis Task ---
+    // Runs as soon as a buffer arrives instead of on the main loop's poll,
+    // so the analysis latency is the engine's own (FFT window or IIR hop).
+    let mut analyzer = Analyzer::from_name(config.audio_analysis.as_deref());
+    let analysis_state = live_state.clone();
+    let analysis_recorder = recorder.clone();
+    let analysis_clock = clock.clone();
+    let (bass_tx, bass_rx) = std::sync::mpsc::channel::<f32>();
+    let mut analysis_shutdown_rx = shutdown_rx.clone();
+    let analysis_task = tokio::spawn(async move {
+        let mut magnitudes = Vec::new();
+        loop {
+            let event = tokio::select! {
+                _ = analysis_shutdown_rx.changed() => {
+                    if *analysis_shutdown_rx.borrow() {
+                        break;
                     }
+                    continue;
                 }
-            })
-            .await;
-
-        info!(
-            "RTP-MIDI Server started on port {}. Waiting for connections...",
-            midi_port
-        );
-        // let _ = session.start().await; // No start() method; session is ready after construction
-    });
-
-    // --- Main Processing Loop ---
-    let mut prev_mags = Vec::new();
-    let mut bass_preset_triggered = false;
-    let mapping_preset = match config.mapping_preset.as_deref() {
-        Some("vumeter") => MappingPreset::VuMeter,
-        _ => MappingPreset::Spectrum,
-    };
+                event = audio_event_rx.recv() => event,
+            };
+            let (samples, sample_rate, channels, captured_us) = match event {
+                Ok(event_bus::Event::AudioDataReady {
+                    samples,
+                    sample_rate,
+                    channels,
+                    captured_us,
+                }) => (samples, sample_rate, channels, captured_us),
+                Ok(_) | Err(broadcast::error::RecvError::Lagged(_)) => continue,
+                Err(broadcast::error::RecvError::Closed) => break,
+            };
+            // Every hop goes out as it completes; the frame clock picks the
+            // newest one up at its next tick.
+            let offset_us = analyzer.analyze(
+                &samples,
+                sample_rate,
+                channels,
+                &mut magnitudes,
+                |at, levels| {
+                    analysis_state.set_magnitudes(levels);
+                    viz_stream::tap().publish_bands(captured_us + at, levels);
+                },
+            );
+            if let Some(recorder) = analysis_recorder.lock().unwrap().as_mut() {
+                recorder.record_analysis(captured_us + offset_us, &magnitudes);
+            }
+            av_sync.record_audio(captured_us + offset_us, analysis_clock.now_us());
+            analysis_state.set_midi_delay_us(av_sync.midi_delay_us());
 
-    while !*shutdown_rx.borrow() {
-        // --- Audio Processing ---
-        if let Ok(event_bus::Event::AudioDataReady(audio_buffer)) = audio_event_rx.try_recv() {
-            let magnitudes = compute_fft_magnitudes(&audio_buffer, &mut prev_mags, 0.5);
-            let band_size = magnitudes.len() / 3;
+            let band_size = (magnitudes.len() / 3).max(1);
             let bass_level = magnitudes
                 .iter()
                 .take(band_size)
                 .cloned()
                 .fold(0.0, f32::max);
-            let led_data = map_leds_with_preset(&magnitudes, config.led_count, mapping_preset);
-            // Send led_data to DDP output
-            if let Err(e) = ddp_sender.send(0, &led_data) {
-                error!("Failed to send LED data to DDP output: {}", e);
-            }
+            let _ = bass_tx.send(bass_level);
+        }
+    });
 
+    // --- Main Processing Loop ---
+    let mut bass_preset_triggered = false;
+    let main_attachment = ClockAttachment::new(&clock);
+
+    while !*shutdown_rx.borrow() {
+        // --- Audio Mappings ---
+        while let Ok(bass_level) = bass_rx.try_recv() {
             if let Some(mappings) = &mappings {
                 for mapping in mappings {
                     if let InputEvent::AudioBand { band, threshold } = &mapping.input {
@@ -255,7 +399,9 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
                                     match action {
                                         MappingOutput::Wled(wled_action) => {
                                             if let Ok(payload) = serde_json::to_vec(&wled_action) {
-                                                let _ = wled_sender.send(0, &payload);
+                                                let _ = tokio::task::block_in_place(|| {
+                                                    wled_sender.send(0, &payload)
+                                                });
                                             }
                                         } // utils::MappingOutput::Ddp(ddp_action) => {
                                           //     // Přidejte logiku pro DDP výstup
@@ -273,35 +419,55 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
         }
 
         // --- MIDI Processing ---
-        if let Ok(event_bus::Event::MidiCommandsReceived {
-            commands,
-            timestamp: _timestamp,
-            peer: _peer,
-        }) = midi_event_rx.try_recv()
-        {
-            if let Ok((parsed_command, _)) = parse_midi_message(&commands) {
-                if let Some(mappings) = &mappings {
-                    for mapping in mappings {
-                        if mapping.matches_midi_command(&parsed_command) {
-                            match parsed_command {
-                                MidiCommand::NoteOn { key, .. } => {
-                                    info!("MIDI NoteOn {} matched a mapping.", key)
-                                }
-                                MidiCommand::ControlChange { control, value, .. } => {
-                                    info!("MIDI CC {} ({}) matched a mapping.", control, value)
-                                }
-                                _ => (),
-                            }
-                            for action in &mapping.output {
-                                match action {
-                                    MappingOutput::Wled(wled_action) => {
-                                        if let Ok(payload) = serde_json::to_vec(&wled_action) {
-                                            let _ = wled_sender.send(0, &payload);
-                                        }
-                                    } // utils::MappingOutput::Ddp(ddp_action) => {
-                                      //     // Přidejte logiku pro DDP výstup
-                                      // }
-                                }
+        // Drain every packet queued since the last tick.
+        let packets = std::iter::from_fn(|| midi_rx.try_recv().ok());
+        for (event, arrival_us) in packets.flat_map(|received| {
+            let arrival_us = received.arrival_us;
+            received
+                .events
+                .into_iter()
+                .map(move |event| (event, arrival_us))
+        }) {
+            let _span = trace::span(Stage::Mapping, arrival_us);
+            live_state.handle_midi(&event);
+            if !esp32_links.is_empty() {
+                esp32_events.push(event);
+            }
+            for sender in &osc_event_senders {
+                sender.send_event(&event);
+            }
+            if let Some(recorder) = recorder.lock().unwrap().as_mut() {
+                recorder.record_midi(&event);
+            }
+            if let Some(mappings) = &mappings {
+                for mapping in mappings {
+                    if mapping.matches_event(&event) {
+                        match event.kind() {
+                            0x90 => debug!("MIDI NoteOn {} matched a mapping.", event.data1()),
+                            0xB0 => debug!(
+                                "MIDI CC {} ({}) matched a mapping.",
+                                event.data1(),
+                                event.data2()
+                            ),
+                            _ => (),
+                        }
+                        for action in &mapping.output {
+                            match action {
+                                MappingOutput::Wled(wled_action) => {
+                                    let payload = {
+                                        let _span = trace::span(Stage::OutputEncode, arrival_us);
+                                        serde_json::to_vec(&wled_action)
+                                    };
+                                    if let Ok(payload) = payload {
+                                        let _span = trace::span(Stage::SocketSend, arrival_us);
+                                        // The WLED JSON API call blocks on HTTP.
+                                        let _ = tokio::task::block_in_place(|| {
+                                            wled_sender.send(0, &payload)
+                                        });
+                                    }
+                                } // utils::MappingOutput::Ddp(ddp_action) => {
+                                  //     // Přidejte logiku pro DDP výstup
+                                  // }
                             }
                         }
                     }
@@ -309,7 +475,75 @@ pub async fn run_service_loop(config: Config, shutdown_rx: watch::Receiver<bool>
             }
         }
 
-        tokio::time::sleep(Duration::from_millis(10)).await;
+        if !esp32_events.is_empty() {
+            for link in &mut esp32_links {
+                if let Err(e) = link.send_events(&esp32_events) {
+                    warn!("Failed to send MIDI to ESP32 {}: {}", link.address(), e);
+                }
+            }
+            esp32_events.clear();
+        }
+
+        let now_us = clock.now_us();
+        if now_us - stats_logged_at >= 10_000_000 {
+            stats_logged_at = now_us;
+            let dropped = midi_dropped.load(Ordering::Relaxed);
+            if dropped > midi_dropped_logged {
+                warn!(
+                    "MIDI queue full: {} packets dropped ({} in total)",
+                    dropped - midi_dropped_logged,
+                    dropped
+                );
+                midi_dropped_logged = dropped;
+            }
+            let stats = frame_scheduler.stats();
+            debug!(
+                "LED frames: {} sent, {} unchanged, {} dropped, {} missed ticks; jitter {:.0}/{} us (mean/max), render load {:.1}%",
+                stats.sent,
+                stats.unchanged,
+                stats.dropped,
+                stats.missed_ticks,
+                stats.jitter_mean_us(),
+                stats.jitter_max_us,
+                stats.cpu_load() * 100.0
+            );
+            debug!(
+                "A/V sync: audio delay {} us, MIDI delay {} us, offset {} us",
+                av_sync.audio_delay_us(),
+                av_sync.midi_delay_us(),
+                av_sync.offset_us()
+            );
+            for link in &esp32_links {
+                let stats = link.stats();
+                debug!(
+                    "ESP32 {}: {} datagrams, {} bytes, {} events, {} frames, {} paced, {} unchanged slices",
+                    link.address(),
+                    stats.datagrams,
+                    stats.bytes,
+                    stats.events,
+                    stats.frames,
+                    stats.paced,
+                    stats.unchanged_slices
+                );
+            }
+        }
+
+        tokio::select! {
+            _ = clock.sleep_until_async(now_us + 10_000) => {}
+            Ok(()) = shutdown_rx.changed() => {}
+        }
+    }
+    drop(main_attachment);
+    frame_scheduler.stop();
+    let _ = analysis_task.await;
+    if let Some(recorder) = recorder.lock().unwrap().take() {
+        match recorder.finish() {
+            Ok(stats) => info!(
+                "Show recording finished: {} records, {} dropped",
+                stats.records, stats.dropped
+            ),
+            Err(e) => error!("Failed to finish show recording: {}", e),
+        }
     }
 
     // Wait for all tasks to complete
@@ -0,0 +1,399 @@
+//! Offline rendering of a song (WAV plus Standard MIDI File) into a show file.
+//!
+//! Runs the live pipeline — audio analysis of `audio_buffer_size` buffers,
+//! the mapping preset and the MIDI note renderer on the LED canvas — at
+//! every frame time of the song, as fast as the CPU allows. Frames are
+//! stored like a live recording (the canvas before the per-output colour
+//! stage, which the router applies on playback).
+//!
+//! The song is split into chunks rendered in parallel. Analysis smoothing
+//! and filter state carry over between buffers, so each chunk first
+//! analyses `overlap_ms` of the audio before it and throws the result away;
+//! by the chunk start the state has settled to what a sequential render
+//! would have (within one LSB of the output). Note state is rebuilt exactly
+//! by replaying all earlier MIDI events, which is cheap.
+
+use std::io;
+use std::ops::Range;
+use std::path::Path;
+
+use audio::audio_analysis::Analyzer;
+use audio::wav::WavFile;
+use log::info;
+use output::light_mapper::{map_leds_into, MappingPreset};
+use output::note_renderer::{NoteRenderer, NoteRendererConfig};
+use output::show::{RecorderConfig, ShowRecorder};
+use rayon::prelude::*;
+use rtp_midi_core::{smf, Config, MidiEvent};
+
+/// Parameters of an offline render.
+#[derive(Debug, Clone)]
+pub struct OfflineConfig {
+    /// Canvas size (pixels).
+    pub led_count: usize,
+    pub preset: MappingPreset,
+    /// `audio_analysis` engine name (see `Analyzer::from_name`).
+    pub analysis: Option<String>,
+    pub fps: u32,
+    /// Frames per analysed audio buffer.
+    pub buffer_frames: usize,
+    pub notes: NoteRendererConfig,
+    /// Song time per parallel work unit.
+    pub chunk_ms: u64,
+    /// Audio analysed and discarded before each chunk.
+    pub overlap_ms: u64,
+}
+
+impl Default for OfflineConfig {
+    fn default() -> Self {
+        Self {
+            led_count: 60,
+            preset: MappingPreset::Spectrum,
+            analysis: None,
+            fps: 60,
+            buffer_frames: 1024,
+            notes: NoteRendererConfig::default(),
+            chunk_ms: 10_000,
+            overlap_ms: 1_000,
+        }
+    }
+}
+
+impl OfflineConfig {
+    /// Same canvas, preset, analysis and frame rate as the live service.
+    pub fn from_config(config: &Config) -> Self {
+        let canvas = config
+            .outputs
+            .iter()
+            .flatten()
+            .map(|segment| segment.offset + segment.length)
+            .max()
+            .unwrap_or(0);
+        Self {
+            led_count: canvas.max(config.led_count),
+            preset: MappingPreset::from_name(config.mapping_preset.as_deref()),
+            analysis: config.audio_analysis.clone(),
+            fps: config.led_fps.unwrap_or(60),
+            buffer_frames: config.audio_buffer_size,
+            ..Default::default()
+        }
+    }
+}
+
+/// Result of an offline render.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct OfflineStats {
+    pub frames: u64,
+    pub analyses: u64,
+    pub midi_events: u64,
+    /// Rendered song length (µs).
+    pub duration_us: u64,
+}
+
+/// Renders `wav` and the optional MIDI file into the show file `out`.
+pub fn render_files(
+    wav: impl AsRef<Path>,
+    midi: Option<&Path>,
+    out: impl AsRef<Path>,
+    config: &OfflineConfig,
+) -> io::Result<OfflineStats> {
+    let audio = WavFile::open(wav)?;
+    let events = match midi {
+        Some(path) => smf::read_smf(path)?,
+        None => Vec::new(),
+    };
+    render(&audio, &events, out, config)
+}
+
+/// Renders decoded audio and MIDI events (time order, µs from the song
+/// start) into the show file `out`.
+pub fn render(
+    audio: &WavFile,
+    midi: &[MidiEvent],
+    out: impl AsRef<Path>,
+    config: &OfflineConfig,
+) -> io::Result<OfflineStats> {
+    let song = Song::new(audio, midi, config);
+    let frame_count = song.frame_count();
+    let chunk_frames = (config.chunk_ms * song.fps / 1_000).max(1) as usize;
+    let chunks: Vec<Range<usize>> = (0..frame_count)
+        .step_by(chunk_frames)
+        .map(|start| start..(start + chunk_frames).min(frame_count))
+        .collect();
+
+    let frame_len = config.led_count * 3;
+    let mut recorder = ShowRecorder::create(
+        out,
+        RecorderConfig {
+            chunk_bytes: (256 * 1024).max(frame_len).max(song.analysis_len() * 4),
+            lossless: true,
+            ..Default::default()
+        },
+    )?;
+    let mut stats = OfflineStats {
+        duration_us: song.duration_us,
+        ..Default::default()
+    };
+    for event in midi {
+        recorder.record_midi(event);
+    }
+    stats.midi_events = recorder.stats().records;
+
+    // A few chunks per thread at a time bounds the frames held in memory.
+    let batch = rayon::current_num_threads().max(1) * 2;
+    for group in chunks.chunks(batch) {
+        let rendered: Vec<Rendered> = group
+            .par_iter()
+            .map(|frames| song.render_chunk(frames.clone()))
+            .collect();
+        for (frames, chunk) in group.iter().zip(rendered) {
+            for (time_us, values) in &chunk.analyses {
+                recorder.record_analysis(*time_us, values);
+            }
+            for (index, frame) in frames.clone().zip(chunk.frames.chunks_exact(frame_len)) {
+                recorder.record_frame(song.frame_time(index), frame);
+            }
+            stats.analyses += chunk.analyses.len() as u64;
+            stats.frames += frames.len() as u64;
+        }
+        info!("Offline render: {} of {} frames", stats.frames, frame_count);
+    }
+    let recorded = recorder.finish()?;
+    if recorded.dropped > 0 {
+        return Err(io::Error::other(format!(
+            "{} records did not fit the show file",
+            recorded.dropped
+        )));
+    }
+    Ok(stats)
+}
+
+// Output of one chunk, in time order.
+struct Rendered {
+    frames: Vec<u8>,
+    analyses: Vec<(u64, Vec<f32>)>,
+}
+
+struct Song<'a> {
+    audio: &'a WavFile,
+    midi: &'a [MidiEvent],
+    config: &'a OfflineConfig,
+    fps: u64,
+    buffer: usize,
+    duration_us: u64,
+}
+
+impl<'a> Song<'a> {
+    fn new(audio: &'a WavFile, midi: &'a [MidiEvent], config: &'a OfflineConfig) -> Self {
+        // Released notes fade out after the last event.
+        let midi_end = midi
+            .last()
+            .map_or(0, |event| event.time_us + config.notes.release_us);
+        Self {
+            audio,
+            midi,
+            config,
+            fps: config.fps.clamp(1, output::frame_scheduler::MAX_FPS) as u64,
+            buffer: config.buffer_frames.max(1),
+            duration_us: audio.duration_us().max(midi_end),
+        }
+    }
+
+    fn frame_count(&self) -> usize {
+        (self.duration_us * self.fps).div_ceil(1_000_000) as usize
+    }
+
+    fn frame_time(&self, index: usize) -> u64 {
+        index as u64 * 1_000_000 / self.fps
+    }
+
+    // Audio buffers complete at the time of frame `index`, which are the
+    // ones the live frame clock would have seen.
+    fn buffers_before(&self, index: usize) -> usize {
+        let sample = self.frame_time(index) as u128 * self.audio.sample_rate() as u128 / 1_000_000;
+        (sample / self.buffer as u128) as usize
+    }
+
+    fn buffer_time(&self, buffer: usize) -> u64 {
+        (buffer * self.buffer) as u64 * 1_000_000 / self.audio.sample_rate() as u64
+    }
+
+    // Length of one analysis vector (FFT bins or filter bank bands).
+    fn analysis_len(&self) -> usize {
+        let mut magnitudes = Vec::new();
+        let mut samples = Vec::new();
+        self.audio.read_frames(0..self.buffer, &mut samples);
+        samples.resize(self.buffer * self.audio.channels() as usize, 0.0);
+        Analyzer::from_name(self.config.analysis.as_deref()).analyze(
+            &samples,
+            self.audio.sample_rate(),
+            self.audio.channels(),
+            &mut magnitudes,
+            |_, _| {},
+        );
+        magnitudes.len()
+    }
+
+    fn render_chunk(&self, frames: Range<usize>) -> Rendered {
+        let led_count = self.config.led_count;
+        // Buffers this chunk records: those completing within its frames.
+        let own_start = match frames.start {
+            0 => 0,
+            start => self.buffers_before(start - 1),
+        };
+        let overlap_frames =
+            self.config.overlap_ms as u128 * self.audio.sample_rate() as u128 / 1_000;
+        let overlap = (overlap_frames as usize).div_ceil(self.buffer);
+        let mut next_buffer = own_start.saturating_sub(overlap);
+
+        let mut analyzer = Analyzer::from_name(self.config.analysis.as_deref());
+        let mut notes = NoteRenderer::new(NoteRendererConfig {
+            led_count,
+            ..self.config.notes
+        });
+        let first_time = self.frame_time(frames.start);
+        let mut next_event = self.midi.partition_point(|e| e.time_us < first_time);
+        for event in &self.midi[..next_event] {
+            notes.handle(event);
+        }
+
+        let channels = self.audio.channels();
+        let mut out = Rendered {
+            frames: Vec::with_capacity(frames.len() * led_count * 3),
+            analyses: Vec::new(),
+        };
+        let (mut samples, mut magnitudes, mut frame) = (Vec::new(), Vec::new(), Vec::new());
+        for index in frames {
+            let time_us = self.frame_time(index);
+            while next_buffer < self.buffers_before(index) {
+                let start = next_buffer * self.buffer;
+                self.audio
+                    .read_frames(start..start + self.buffer, &mut samples);
+                // Past the end of the audio (MIDI tail) the analysis hears silence.
+                samples.resize(self.buffer * channels as usize, 0.0);
+                let offset_us = analyzer.analyze(
+                    &samples,
+                    self.audio.sample_rate(),
+                    channels,
+                    &mut magnitudes,
+                    |_, _| {},
+                );
+                if next_buffer >= own_start {
+                    let analysed_us = self.buffer_time(next_buffer) + offset_us;
+                    out.analyses.push((analysed_us, magnitudes.clone()));
+                }
+                next_buffer += 1;
+            }
+            while let Some(event) = self.midi.get(next_event).filter(|e| e.time_us <= time_us) {
+                notes.handle(event);
+                next_event += 1;
+            }
+            map_leds_into(&magnitudes, led_count, self.config.preset, &mut frame);
+            notes.render(time_us, &mut frame);
+            out.frames.extend_from_slice(&frame);
+        }
+        out
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use output::show::{ShowPlayer, Track};
+
+    const RATE: u32 = 48_000;
+
+    // Mono 16-bit WAV: a tone switching between bass and treble every 0.7 s.
+    fn song(seconds: usize) -> WavFile {
+        let frames = RATE as usize * seconds;
+        let mut bytes = b"RIFF\0\0\0\0WAVEfmt ".to_vec();
+        for field in [16u32, 0x0001_0001, RATE, RATE * 2, 0x0010_0002] {
+            bytes.extend_from_slice(&field.to_le_bytes());
+        }
+        bytes.extend_from_slice(b"data");
+        bytes.extend_from_slice(&(frames as u32 * 2).to_le_bytes());
+        for i in 0..frames {
+            let hz = if (i / 33_600) % 2 == 0 { 80.0 } else { 3_000.0 };
+            let phase = 2.0 * std::f32::consts::PI * hz * i as f32 / RATE as f32;
+            let sample = (phase.sin() * 20_000.0) as i16;
+            bytes.extend_from_slice(&sample.to_le_bytes());
+        }
+        WavFile::from_bytes(bytes).unwrap()
+    }
+
+    fn config(chunk_ms: u64) -> OfflineConfig {
+        OfflineConfig {
+            led_count: 30,
+            analysis: Some("filterbank".into()),
+            buffer_frames: 256,
+            chunk_ms,
+            ..Default::default()
+        }
+    }
+
+    fn frames(path: &Path) -> Vec<(u64, Vec<u8>)> {
+        let player = ShowPlayer::open(path).unwrap();
+        let start = player.seek(Track::Frames, 0);
+        player
+            .records(Track::Frames, start)
+            .map(|(time, frame)| (time, frame.to_vec()))
+            .collect()
+    }
+
+    #[test]
+    fn parallel_chunks_match_a_sequential_render() {
+        let audio = song(4);
+        // A note held across several chunk boundaries, another one short.
+        let midi = [
+            MidiEvent::note_on(0, 60, 100, 200_000),
+            MidiEvent::note_on(0, 72, 80, 1_550_000),
+            MidiEvent::note_off(0, 72, 0, 1_600_000),
+            MidiEvent::note_off(0, 60, 0, 3_100_000),
+        ];
+        let dir = std::env::temp_dir();
+        let sequential = dir.join(format!("offline_seq_{}.rmshow", std::process::id()));
+        let parallel = dir.join(format!("offline_par_{}.rmshow", std::process::id()));
+        let whole = render(&audio, &midi, &sequential, &config(60_000)).unwrap();
+        let chunked = render(&audio, &midi, &parallel, &config(250)).unwrap();
+        assert_eq!(whole, chunked);
+        // 4 s of audio plus the release of the last note, at 60 fps.
+        assert_eq!(whole.duration_us, 4_000_000);
+        assert_eq!(whole.frames, 240);
+        assert_eq!(whole.midi_events, 4);
+        // Buffers complete by the last frame (3.983 s).
+        assert_eq!(whole.analyses, 746);
+
+        let (a, b) = (frames(&sequential), frames(&parallel));
+        assert_eq!(a.len(), 240);
+        for ((time_a, frame_a), (time_b, frame_b)) in a.iter().zip(&b) {
+            assert_eq!(time_a, time_b);
+            let worst = frame_a
+                .iter()
+                .zip(frame_b)
+                .map(|(x, y)| x.abs_diff(*y))
+                .max();
+            assert!(worst <= Some(1), "frame at {time_a} differs by {worst:?}");
+        }
+        // The held note is lit in chunks that never saw its Note On.
+        render(&audio, &[], &sequential, &config(250)).unwrap();
+        assert_ne!(frames(&sequential)[150], b[150]);
+        let _ = std::fs::remove_file(&sequential);
+        let _ = std::fs::remove_file(&parallel);
+    }
+
+    #[test]
+    fn midi_past_the_audio_extends_the_song() {
+        let audio = song(1);
+        let midi = [MidiEvent::note_on(1, 40, 127, 1_500_000)];
+        let path = std::env::temp_dir().join(format!("offline_tail_{}.rmshow", std::process::id()));
+        let stats = render(&audio, &midi, &path, &config(300)).unwrap();
+        let release = NoteRendererConfig::default().release_us;
+        assert_eq!(stats.duration_us, 1_500_000 + release);
+        let player = ShowPlayer::open(&path).unwrap();
+        let mut frame = Vec::new();
+        assert!(player.frame_at(1_600_000, &mut frame));
+        assert_eq!(frame.len(), 90);
+        assert!(frame.iter().any(|&v| v > 0));
+        let _ = std::fs::remove_file(&path);
+    }
+}
@@ -1,14 +1,17 @@
 use std::env;
+use std::path::Path;
 use tokio::sync::watch;
 
 #[tokio::main]
 async fn main() {
     let args: Vec<String> = env::args().collect();
-    let role = args
-        .iter()
-        .position(|a| a == "--role")
-        .and_then(|i| args.get(i + 1))
-        .map(|s| s.as_str());
+    let arg = |name: &str| {
+        args.iter()
+            .position(|a| a == name)
+            .and_then(|i| args.get(i + 1))
+            .map(|s| s.as_str())
+    };
+    let role = arg("--role");
 
     match role {
         Some("server") => {
@@ -18,6 +21,35 @@ async fn main() {
             let (_shutdown_tx, shutdown_rx) = watch::channel(false);
             rtp_midi_lib::run_service_loop(config, shutdown_rx).await;
         }
+        Some("render") => {
+            // Offline render písně (WAV + MIDI) do show souboru pro `show_play`.
+            let (Some(wav), Some(out)) = (arg("--wav"), arg("--out")) else {
+                eprintln!("Použití: rtp-midi-node --role render --wav song.wav [--midi song.mid] --out show.rmshow");
+                std::process::exit(1);
+            };
+            let config = rtp_midi_lib::Config::load_from_file("config.toml")
+                .expect("config.toml načtení selhalo");
+            let offline = rtp_midi_lib::offline::OfflineConfig::from_config(&config);
+            let started = std::time::Instant::now();
+            match rtp_midi_lib::offline::render_files(
+                wav,
+                arg("--midi").map(Path::new),
+                out,
+                &offline,
+            ) {
+                Ok(stats) => println!(
+                    "[rtp-midi-node] {} snímků ({:.1} s písně) vyrenderováno do {} za {:.2} s",
+                    stats.frames,
+                    stats.duration_us as f64 / 1e6,
+                    out,
+                    started.elapsed().as_secs_f64()
+                ),
+                Err(e) => {
+                    eprintln!("Offline render selhal: {e}");
+                    std::process::exit(1);
+                }
+            }
+        }
         Some("client") => {
             println!("[rtp-midi-node] Spouštím v režimu CLIENT");
             println!("Spusťte klientskou aplikaci přímo: cargo run -p client_app");
@@ -42,7 +74,7 @@ async fn main() {
             .listen("127.0.0.1", "8088");
         }
         _ => {
-            eprintln!("Použití: rtp-midi-node --role [server|client|ui-host]");
+            eprintln!("Použití: rtp-midi-node --role [server|client|ui-host|render]");
             std::process::exit(1);
         }
     }